@@ -0,0 +1,303 @@
+#include "callgraph.h"
+
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+
+#define OUTPUT_LINE 128
+
+static void on_call(void* context, uint16_t site, uint16_t target, uint16_t sp, uint64_t now);
+static void on_return(void* context, uint16_t sp, uint64_t now);
+
+void callgraph_init(callgraph_t* cg, altair_memory_t* memory)
+{
+    memset(cg, 0, sizeof(*cg));
+    cg->memory = memory;
+    cg->hooks.call = on_call;
+    cg->hooks.ret = on_return;
+    cg->hooks.context = cg;
+}
+
+void callgraph_start(callgraph_t* cg, uint64_t cycles)
+{
+    cg->running = true;
+    cg->last = cycles;
+    cg->total = 0;
+    cg->root_self = 0;
+    cg->resyncs = 0;
+    cg->unmatched_returns = 0;
+    cg->too_deep = 0;
+    cg->dropped_arcs = 0;
+    cg->depth = 0;
+    cg->arc_count = 0;
+    memset(cg->self, 0, sizeof(cg->self));
+    memset(cg->arcs, 0, sizeof(cg->arcs));
+}
+
+void callgraph_set_symbols(callgraph_t* cg, const altair_symbol_t* symbols, size_t count)
+{
+    cg->symbols = symbols;
+    cg->symbol_count = count;
+}
+
+// Charges the T-states since the last event to the function on top
+static void charge(callgraph_t* cg, uint64_t now)
+{
+    uint64_t delta;
+
+    if (now < cg->last)
+    {
+        // The machine went back to a snapshot or checkpoint, so the open
+        // calls never return
+        cg->resyncs += cg->depth;
+        cg->depth = 0;
+        cg->last = now;
+        return;
+    }
+    delta = now - cg->last;
+    if (cg->depth > 0)
+    {
+        cg->self[cg->frames[cg->depth - 1].entry] += delta;
+    }
+    else
+    {
+        cg->root_self += delta;
+    }
+    cg->total += delta;
+    cg->last = now;
+}
+
+static void close_top(callgraph_t* cg, uint64_t now)
+{
+    const callgraph_frame_t* frame = &cg->frames[--cg->depth];
+
+    if (frame->arc < CALLGRAPH_MAX_ARCS)
+    {
+        cg->arcs[frame->arc].inclusive += now - frame->start;
+    }
+}
+
+static uint32_t arc_hash(uint32_t caller, uint16_t site, uint16_t callee)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ caller) * 16777619u;
+    hash = (hash ^ site) * 16777619u;
+    hash = (hash ^ callee) * 16777619u;
+    return hash;
+}
+
+// Counts a call on its arc, in an open-addressed table kept at most three
+// quarters full. Returns the arc's index, or CALLGRAPH_MAX_ARCS if it did
+// not fit.
+static uint32_t count_call(callgraph_t* cg, uint32_t caller, uint16_t site, uint16_t callee)
+{
+    uint32_t slot = arc_hash(caller, site, callee) % CALLGRAPH_MAX_ARCS;
+
+    while (cg->arcs[slot].calls != 0)
+    {
+        callgraph_arc_t* arc = &cg->arcs[slot];
+
+        if (arc->caller == caller && arc->site == site && arc->callee == callee)
+        {
+            arc->calls++;
+            return slot;
+        }
+        slot = (slot + 1) % CALLGRAPH_MAX_ARCS;
+    }
+    if (cg->arc_count >= CALLGRAPH_MAX_ARCS / 4 * 3)
+    {
+        cg->dropped_arcs++;
+        return CALLGRAPH_MAX_ARCS;
+    }
+    cg->arcs[slot].caller = caller;
+    cg->arcs[slot].site = site;
+    cg->arcs[slot].callee = callee;
+    cg->arcs[slot].calls = 1;
+    cg->arc_count++;
+    return slot;
+}
+
+static void on_call(void* context, uint16_t site, uint16_t target, uint16_t sp, uint64_t now)
+{
+    callgraph_t* cg = context;
+    callgraph_frame_t* frame;
+
+    if (!cg->running)
+    {
+        return;
+    }
+    charge(cg, now);
+
+    // A frame further down the stack is the caller. One whose slot this
+    // call pushes to will not be returned from, nor will one above SP whose
+    // return address has been overwritten; above SP with its return address
+    // intact, SP has probably moved to another stack and back it will come.
+    while (cg->depth > 0)
+    {
+        const callgraph_frame_t* top = &cg->frames[cg->depth - 1];
+
+        if (top->sp > sp || (top->sp < sp && read16(cg->memory, top->sp) == top->ret))
+        {
+            break;
+        }
+        close_top(cg, now);
+        cg->resyncs++;
+    }
+    if (cg->depth == CALLGRAPH_DEPTH)
+    {
+        cg->too_deep++;
+        return;
+    }
+
+    frame = &cg->frames[cg->depth];
+    frame->sp = sp;
+    frame->ret = read16(cg->memory, sp);
+    frame->entry = target;
+    frame->arc = count_call(cg, cg->depth > 0 ? cg->frames[cg->depth - 1].entry : CALLGRAPH_ROOT, site, target);
+    frame->start = now;
+    cg->depth++;
+}
+
+static void on_return(void* context, uint16_t sp, uint64_t now)
+{
+    callgraph_t* cg = context;
+
+    if (!cg->running)
+    {
+        return;
+    }
+    charge(cg, now);
+
+    // Usually the top frame; those above it were left without a RET. The
+    // return address itself may have been changed, as by routines that read
+    // their arguments from after the CALL and return past them.
+    for (uint32_t i = cg->depth; i-- > 0;)
+    {
+        if (cg->frames[i].sp == sp)
+        {
+            while (cg->depth > i + 1)
+            {
+                close_top(cg, now);
+                cg->resyncs++;
+            }
+            close_top(cg, now);
+            return;
+        }
+    }
+    cg->unmatched_returns++;
+}
+
+void callgraph_stop(callgraph_t* cg, uint64_t cycles)
+{
+    if (!cg->running)
+    {
+        return;
+    }
+    charge(cg, cycles);
+    while (cg->depth > 0)
+    {
+        close_top(cg, cycles);
+    }
+    cg->running = false;
+}
+
+// The symbol, "NAME+0x12" inside one, or sub_XXXX without
+static void function_name(const callgraph_t* cg, uint32_t entry, char* text, size_t size)
+{
+    const altair_symbol_t* symbol;
+
+    if (entry == CALLGRAPH_ROOT)
+    {
+        snprintf(text, size, "[root]");
+        return;
+    }
+    symbol = symbols_find(cg->symbols, cg->symbol_count, (uint16_t)entry);
+    if (symbol && symbol->address == entry)
+    {
+        snprintf(text, size, "%s", symbol->name);
+    }
+    else if (symbol)
+    {
+        snprintf(text, size, "%s+0x%X", symbol->name, (unsigned)(entry - symbol->address));
+    }
+    else
+    {
+        snprintf(text, size, "sub_%04X", (unsigned)entry);
+    }
+}
+
+static void print_counter(callgraph_print_fn print, void* context, const char* what, uint64_t count)
+{
+    char line[OUTPUT_LINE];
+
+    if (count > 0)
+    {
+        snprintf(line, sizeof(line), "# %s: %llu", what, (unsigned long long)count);
+        print(context, line);
+    }
+}
+
+void callgraph_write_callgrind(const callgraph_t* cg, const char* creator, callgraph_print_fn print,
+                               void* context)
+{
+    char line[OUTPUT_LINE];
+    char name[SYMBOL_NAME + 16];
+
+    print(context, "# callgrind format");
+    print(context, "version: 1");
+    snprintf(line, sizeof(line), "creator: %s", creator);
+    print(context, line);
+    print(context, "positions: instr");
+    print(context, "events: Cycles");
+    print_counter(print, context, "frames dropped without a matching return", cg->resyncs);
+    print_counter(print, context, "returns matching no call", cg->unmatched_returns);
+    print_counter(print, context, "calls too deep to track", cg->too_deep);
+    print_counter(print, context, "calls without room for their call site", cg->dropped_arcs);
+    snprintf(line, sizeof(line), "summary: %llu", (unsigned long long)cg->total);
+    print(context, line);
+
+    // Exclusive costs, one line per function at its entry address
+    print(context, "");
+    print(context, "fn=[root]");
+    snprintf(line, sizeof(line), "0 %llu", (unsigned long long)cg->root_self);
+    print(context, line);
+    for (uint32_t entry = 0; entry < 65536; entry++)
+    {
+        if (cg->self[entry] == 0)
+        {
+            continue;
+        }
+        function_name(cg, entry, name, sizeof(name));
+        print(context, "");
+        snprintf(line, sizeof(line), "fn=%s", name);
+        print(context, line);
+        snprintf(line, sizeof(line), "0x%04X %llu", (unsigned)entry, (unsigned long long)cg->self[entry]);
+        print(context, line);
+    }
+
+    // Inclusive costs of each call site; a function may have several fn= blocks
+    for (uint32_t i = 0; i < CALLGRAPH_MAX_ARCS; i++)
+    {
+        const callgraph_arc_t* arc = &cg->arcs[i];
+
+        if (arc->calls == 0)
+        {
+            continue;
+        }
+        print(context, "");
+        function_name(cg, arc->caller, name, sizeof(name));
+        snprintf(line, sizeof(line), "fn=%s", name);
+        print(context, line);
+        function_name(cg, arc->callee, name, sizeof(name));
+        snprintf(line, sizeof(line), "cfn=%s", name);
+        print(context, line);
+        snprintf(line, sizeof(line), "calls=%llu 0x%04X", (unsigned long long)arc->calls, (unsigned)arc->callee);
+        print(context, line);
+        snprintf(line, sizeof(line), "0x%04X %llu", (unsigned)arc->site, (unsigned long long)arc->inclusive);
+        print(context, line);
+    }
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _CALLGRAPH_H_
+#define _CALLGRAPH_H_
+
+#include "intel8080.h"
+#include "memory.h"
+#include "symbols.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Call graph of the guest, built with I8080_CALL_PROFILE.
+//
+// The interpreter cores report every CALL, taken Ccc, RST, interrupt, RET
+// and taken Rcc through cpu->call_hooks. The call graph keeps a shadow of
+// the 8080 call stack from them and charges the T-states in between to the
+// function on top: exclusive T-states per function, and calls and inclusive
+// T-states per call site, from the CALL to the RET.
+//
+// Guests do not always return the way they were called: they pop return
+// addresses, rewrite them, jump through them or move SP to another stack.
+// The shadow stack is therefore resynchronised lazily rather than trusted. A
+// call first drops the frames above SP whose return address has since been
+// overwritten, or whose slot the new call reuses; a return unwinds to the
+// frame pushed to the slot it pops, and is ignored if there is none. A jump
+// back in time (a snapshot resume or a rewind) drops every frame without
+// charging it.
+//
+// The result is written in the callgrind format that callgrind_annotate and
+// KCachegrind read.
+
+#define CALLGRAPH_DEPTH 256         // frames kept; deeper calls are not tracked
+#define CALLGRAPH_MAX_ARCS 16384    // caller, call site, callee triples
+
+#define CALLGRAPH_ROOT 0x10000      // the caller outside every tracked call
+
+typedef struct
+{
+    uint16_t sp;        // where the return address was pushed
+    uint16_t ret;       // and what it was
+    uint16_t entry;     // the function called
+    uint32_t arc;       // index into arcs[], or CALLGRAPH_MAX_ARCS if it did not fit
+    uint64_t start;     // T-states at the call
+} callgraph_frame_t;
+
+typedef struct
+{
+    uint32_t caller;    // entry of the calling function, or CALLGRAPH_ROOT
+    uint16_t site;      // address of the CALL
+    uint16_t callee;
+    uint64_t calls;     // 0 for a free slot
+    uint64_t inclusive; // T-states of the calls that have returned
+} callgraph_arc_t;
+
+// Takes the output a line at a time, without a line ending
+typedef void (*callgraph_print_fn)(void* context, const char* line);
+
+typedef struct
+{
+    bool running;
+    altair_memory_t* memory;
+    i8080_call_hooks_t hooks;           // for cpu->call_hooks
+    uint64_t last;                      // T-states at the last call or return
+    uint64_t total;                     // T-states charged so far
+    uint64_t root_self;                 // outside every tracked call
+    uint64_t resyncs;                   // frames dropped without a matching return
+    uint64_t unmatched_returns;
+    uint64_t too_deep;                  // calls past CALLGRAPH_DEPTH
+    uint64_t dropped_arcs;              // calls whose arc did not fit in arcs[]
+    const altair_symbol_t* symbols;     // sorted by address
+    size_t symbol_count;
+    uint32_t depth;
+    uint32_t arc_count;
+    callgraph_frame_t frames[CALLGRAPH_DEPTH];
+    uint64_t self[65536];               // exclusive T-states per function entry
+    callgraph_arc_t arcs[CALLGRAPH_MAX_ARCS];
+} callgraph_t;
+
+// memory is the guest's, read for the return addresses on its stack
+void callgraph_init(callgraph_t* cg, altair_memory_t* memory);
+
+// Forgets the graph and starts a new one at cycles T-states. Set
+// cpu->call_hooks to &cg->hooks for it to see the calls.
+void callgraph_start(callgraph_t* cg, uint64_t cycles);
+
+// Returns from every open call at cycles T-states and stops
+void callgraph_stop(callgraph_t* cg, uint64_t cycles);
+
+// Names functions with symbols (see symbols.h), which must outlive cg
+void callgraph_set_symbols(callgraph_t* cg, const altair_symbol_t* symbols, size_t count);
+
+// The graph in callgrind's format, creator naming the program
+void callgraph_write_callgrind(const callgraph_t* cg, const char* creator, callgraph_print_fn print,
+                               void* context);
+
+#endif
@@ -0,0 +1,358 @@
+#include "checkpoint.h"
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+
+#include <string.h>
+
+// A record is its length, its entries and its length again, so the ring can
+// be walked from either end. Each entry starts with a type byte:
+//   ENTRY_PAGE   page number, then the page as it was
+//   ENTRY_SECTOR drive, 32-bit offset, 16-bit length, then the bytes as they were
+//   ENTRY_STATE  64-bit cycles, 16-bit length, then the device state as it was
+// Disk sectors are added as they are written; pages and the state when the
+// record is finished by the next checkpoint.
+#define ENTRY_PAGE 'P'
+#define ENTRY_SECTOR 'D'
+#define ENTRY_STATE 'S'
+
+#define RECORD_LENGTH_SIZE 4
+
+static void ring_write(checkpoint_ring_t* cp, size_t pos, const void* data, size_t length)
+{
+    const uint8_t* p = data;
+    size_t first;
+
+    pos %= cp->capacity;
+    first = cp->capacity - pos < length ? cp->capacity - pos : length;
+    memcpy(cp->ring + pos, p, first);
+    memcpy(cp->ring, p + first, length - first);
+}
+
+static void ring_read(const checkpoint_ring_t* cp, size_t pos, void* data, size_t length)
+{
+    uint8_t* p = data;
+    size_t first;
+
+    pos %= cp->capacity;
+    first = cp->capacity - pos < length ? cp->capacity - pos : length;
+    memcpy(p, cp->ring + pos, first);
+    memcpy(p + first, cp->ring, length - first);
+}
+
+static uint32_t ring_read_u32(const checkpoint_ring_t* cp, size_t pos)
+{
+    uint8_t le[4];
+
+    ring_read(cp, pos, le, sizeof(le));
+    return (uint32_t)le[0] | (uint32_t)le[1] << 8 | (uint32_t)le[2] << 16 | (uint32_t)le[3] << 24;
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void drop_all(checkpoint_ring_t* cp)
+{
+    cp->tail = 0;
+    cp->used = 0;
+    cp->open_length = 0;
+    cp->count = 0;
+    cp->valid = false;
+}
+
+// Appends to the open record, dropping the oldest records to make room. If
+// the open record alone does not fit, every checkpoint is lost.
+static bool append(checkpoint_ring_t* cp, const void* data, size_t length)
+{
+    while (cp->used + cp->open_length + length > cp->capacity)
+    {
+        if (cp->count == 0)
+        {
+            drop_all(cp);
+            return false;
+        }
+        uint32_t oldest = ring_read_u32(cp, cp->tail) + 2 * RECORD_LENGTH_SIZE;
+
+        cp->tail = (cp->tail + oldest) % cp->capacity;
+        cp->used -= oldest;
+        cp->count--;
+    }
+    ring_write(cp, cp->tail + cp->used + cp->open_length, data, length);
+    cp->open_length += length;
+    return true;
+}
+
+static bool open_record(checkpoint_ring_t* cp)
+{
+    uint8_t length[RECORD_LENGTH_SIZE] = {0};
+
+    cp->open_length = 0;
+    return append(cp, length, sizeof(length));
+}
+
+static void save_state(checkpoint_ring_t* cp, uint64_t cycles)
+{
+    snapshot_writer_t w;
+
+    snapshot_write_begin(&w, cp->state, sizeof(cp->state), NULL, NULL);
+    cp->save(cp->context, &w);
+    cp->valid = snapshot_write_end(&w);
+    cp->state_length = w.length;
+    cp->cycles = cycles;
+}
+
+void checkpoint_init(checkpoint_ring_t* cp, altair_memory_t* memory, uint8_t* ring, size_t capacity,
+                     checkpoint_save_fn save, checkpoint_restore_fn restore, checkpoint_disk_fn disk_write,
+                     void* context)
+{
+    cp->memory = memory;
+    cp->ring = ring;
+    cp->capacity = capacity;
+    cp->save = save;
+    cp->restore = restore;
+    cp->disk_write = disk_write;
+    cp->context = context;
+    drop_all(cp);
+}
+
+void checkpoint_clear(checkpoint_ring_t* cp)
+{
+    drop_all(cp);
+}
+
+// Records the previous contents of each page written since the latest
+// checkpoint and brings the copy of memory up to date
+static bool save_written_pages(checkpoint_ring_t* cp)
+{
+    const altair_memory_t* mem = cp->memory;
+
+    for (int page = 0; page < 256; page++)
+    {
+        uint8_t entry[2] = {ENTRY_PAGE, (uint8_t)page};
+
+        if (mem->page_gen[page] == cp->shadow_gen[page])
+        {
+            continue;
+        }
+        if (!append(cp, entry, sizeof(entry)) || !append(cp, cp->shadow + page * 256, 256))
+        {
+            return false;
+        }
+        memcpy(cp->shadow + page * 256, mem->bytes + page * 256, 256);
+        cp->shadow_gen[page] = mem->page_gen[page];
+    }
+    return true;
+}
+
+static bool pages_written(const checkpoint_ring_t* cp)
+{
+    return memcmp(cp->memory->page_gen, cp->shadow_gen, sizeof(cp->shadow_gen)) != 0;
+}
+
+void checkpoint_take(checkpoint_ring_t* cp, uint64_t cycles)
+{
+    if (!cp->valid)
+    {
+        // Start again from a full copy of memory
+        memcpy(cp->shadow, cp->memory->bytes, sizeof(cp->shadow));
+        memcpy(cp->shadow_gen, cp->memory->page_gen, sizeof(cp->shadow_gen));
+        drop_all(cp);
+        save_state(cp, cycles);
+        if (cp->valid && !open_record(cp))
+        {
+            cp->valid = false;
+        }
+        return;
+    }
+
+    if (cycles == cp->cycles && cp->open_length == RECORD_LENGTH_SIZE && !pages_written(cp))
+    {
+        return;
+    }
+
+    uint8_t entry[1 + 8 + 2] = {ENTRY_STATE};
+    uint8_t length[RECORD_LENGTH_SIZE];
+
+    for (int i = 0; i < 8; i++)
+    {
+        entry[1 + i] = (uint8_t)(cp->cycles >> (8 * i));
+    }
+    entry[9] = (uint8_t)cp->state_length;
+    entry[10] = (uint8_t)(cp->state_length >> 8);
+    if (!save_written_pages(cp) || !append(cp, entry, sizeof(entry)) ||
+        !append(cp, cp->state, cp->state_length))
+    {
+        return;
+    }
+
+    put_u32(length, (uint32_t)(cp->open_length - RECORD_LENGTH_SIZE));
+    ring_write(cp, cp->tail + cp->used, length, sizeof(length));
+    if (!append(cp, length, sizeof(length)))
+    {
+        return;
+    }
+    cp->used += cp->open_length;
+    cp->count++;
+
+    save_state(cp, cycles);
+    if (cp->valid && !open_record(cp))
+    {
+        cp->valid = false;
+    }
+}
+
+// Finds a sector entry for drive and offset in the open record
+static bool sector_saved(const checkpoint_ring_t* cp, uint8_t drive, uint32_t offset)
+{
+    size_t start = cp->tail + cp->used;
+    size_t pos = RECORD_LENGTH_SIZE;
+
+    while (pos < cp->open_length)
+    {
+        uint8_t entry[1 + 1 + 4 + 2];
+        uint32_t entry_offset;
+        uint16_t entry_length;
+
+        ring_read(cp, start + pos, entry, sizeof(entry));
+        entry_offset = (uint32_t)entry[2] | (uint32_t)entry[3] << 8 | (uint32_t)entry[4] << 16 |
+                       (uint32_t)entry[5] << 24;
+        entry_length = (uint16_t)(entry[6] | entry[7] << 8);
+        if (entry[1] == drive && entry_offset == offset)
+        {
+            return true;
+        }
+        pos += sizeof(entry) + entry_length;
+    }
+    return false;
+}
+
+void checkpoint_disk_write(checkpoint_ring_t* cp, uint8_t drive, uint32_t offset, const uint8_t* old_data,
+                           uint16_t length)
+{
+    uint8_t entry[1 + 1 + 4 + 2] = {ENTRY_SECTOR, drive};
+
+    if (!cp->valid || sector_saved(cp, drive, offset))
+    {
+        return;
+    }
+    put_u32(entry + 2, offset);
+    entry[6] = (uint8_t)length;
+    entry[7] = (uint8_t)(length >> 8);
+    if (append(cp, entry, sizeof(entry)))
+    {
+        append(cp, old_data, length);
+    }
+}
+
+uint32_t checkpoint_depth(const checkpoint_ring_t* cp)
+{
+    return cp->valid ? cp->count + 1 : 0;
+}
+
+// Applies the entries of a record from start, length bytes long: pages go
+// to memory and the copy of it, sectors back to disk, and the state becomes
+// the latest checkpoint's
+static void undo_entries(checkpoint_ring_t* cp, size_t start, size_t length)
+{
+    size_t pos = 0;
+
+    while (pos < length)
+    {
+        uint8_t type;
+        uint8_t header[1 + 4 + 2];
+        uint8_t sector[512];
+
+        ring_read(cp, start + pos, &type, 1);
+        pos++;
+        switch (type)
+        {
+            case ENTRY_PAGE:
+                ring_read(cp, start + pos, header, 1);
+                ring_read(cp, start + pos + 1, cp->shadow + header[0] * 256, 256);
+                memcpy(cp->memory->bytes + header[0] * 256, cp->shadow + header[0] * 256, 256);
+                memory_pages_written(cp->memory, (uint16_t)(header[0] * 256), 256);
+                pos += 1 + 256;
+                break;
+            case ENTRY_SECTOR:
+            {
+                uint16_t sector_length;
+
+                ring_read(cp, start + pos, header, sizeof(header));
+                sector_length = (uint16_t)(header[5] | header[6] << 8);
+                if (sector_length <= sizeof(sector))
+                {
+                    ring_read(cp, start + pos + sizeof(header), sector, sector_length);
+                    cp->disk_write(cp->context, header[0],
+                                   (uint32_t)header[1] | (uint32_t)header[2] << 8 | (uint32_t)header[3] << 16 |
+                                       (uint32_t)header[4] << 24,
+                                   sector, sector_length);
+                }
+                pos += sizeof(header) + sector_length;
+                break;
+            }
+            default:
+            {
+                uint8_t state_header[8 + 2];
+
+                ring_read(cp, start + pos, state_header, sizeof(state_header));
+                cp->cycles = 0;
+                for (int i = 7; i >= 0; i--)
+                {
+                    cp->cycles = cp->cycles << 8 | state_header[i];
+                }
+                cp->state_length = (size_t)(state_header[8] | state_header[9] << 8);
+                ring_read(cp, start + pos + sizeof(state_header), cp->state, cp->state_length);
+                pos += sizeof(state_header) + cp->state_length;
+                break;
+            }
+        }
+    }
+}
+
+bool checkpoint_rewind(checkpoint_ring_t* cp, uint32_t n)
+{
+    altair_memory_t* mem = cp->memory;
+    snapshot_reader_t r;
+
+    if (n == 0 || n > checkpoint_depth(cp))
+    {
+        return false;
+    }
+
+    // Back to the latest checkpoint: sectors from the open record, pages
+    // from the copy of memory
+    undo_entries(cp, cp->tail + cp->used + RECORD_LENGTH_SIZE, cp->open_length - RECORD_LENGTH_SIZE);
+    for (int page = 0; page < 256; page++)
+    {
+        if (mem->page_gen[page] != cp->shadow_gen[page])
+        {
+            memcpy(mem->bytes + page * 256, cp->shadow + page * 256, 256);
+            memory_pages_written(mem, (uint16_t)(page * 256), 256);
+        }
+    }
+
+    // Then back through the finished records, newest first
+    while (--n > 0)
+    {
+        size_t end = cp->tail + cp->used;
+        uint32_t length = ring_read_u32(cp, end + cp->capacity - RECORD_LENGTH_SIZE);
+        size_t start = end + cp->capacity - length - 2 * RECORD_LENGTH_SIZE;
+
+        undo_entries(cp, start + RECORD_LENGTH_SIZE, length);
+        cp->used -= length + 2 * RECORD_LENGTH_SIZE;
+        cp->count--;
+    }
+
+    memcpy(cp->shadow_gen, mem->page_gen, sizeof(cp->shadow_gen));
+    if (!open_record(cp))
+    {
+        return false;
+    }
+    return snapshot_read_begin(&r, cp->state, cp->state_length, NULL, NULL, NULL, 0) && cp->restore(cp->context, &r);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include "memory.h"
+#include "snapshot.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Rewindable checkpoints of a running machine, built with ALTAIR_CHECKPOINTS.
+//
+// Each checkpoint is an undo record for the time since the one before: the
+// previous contents of every memory page written in between, found through
+// page_gen[], the previous contents of every disk sector written, and the
+// CPU and device state as it was. Only pages and sectors actually written
+// are copied, so a checkpoint of a mostly idle machine costs a scan of 256
+// page counters and nothing more.
+//
+// Records go in a ring of bytes owned by the caller, the oldest dropped to
+// make room. A copy of memory as of the latest checkpoint supplies the
+// previous contents of pages, so the ring itself holds only what changed.
+
+// Room for the device state a save function writes
+#define CHECKPOINT_STATE_MAX 1536
+
+// Writes the CPU and device state as snapshot sections; memory is not needed
+typedef void (*checkpoint_save_fn)(void* context, snapshot_writer_t* w);
+
+// Restores what the save function wrote
+typedef bool (*checkpoint_restore_fn)(void* context, snapshot_reader_t* r);
+
+// Writes length bytes back to a disk image at offset
+typedef void (*checkpoint_disk_fn)(void* context, uint8_t drive, uint32_t offset, const uint8_t* data,
+                                   uint16_t length);
+
+typedef struct checkpoint_ring
+{
+    altair_memory_t* memory;
+    uint8_t* ring;
+    size_t capacity;
+    size_t tail;            // oldest record
+    size_t used;            // bytes of finished records
+    size_t open_length;     // bytes so far of the record after them
+    uint32_t count;         // finished records
+    bool valid;             // false until the first checkpoint, or after the ring overflowed
+    uint64_t cycles;        // CPU cycles at the latest checkpoint
+    size_t state_length;
+    checkpoint_save_fn save;
+    checkpoint_restore_fn restore;
+    checkpoint_disk_fn disk_write;
+    void* context;
+    uint32_t shadow_gen[256];           // page_gen[] at the latest checkpoint
+    uint8_t state[CHECKPOINT_STATE_MAX];    // device state at the latest checkpoint
+    uint8_t shadow[64 * 1024];          // memory at the latest checkpoint
+} checkpoint_ring_t;
+
+void checkpoint_init(checkpoint_ring_t* cp, altair_memory_t* memory, uint8_t* ring, size_t capacity,
+                     checkpoint_save_fn save, checkpoint_restore_fn restore, checkpoint_disk_fn disk_write,
+                     void* context);
+
+// Forgets every checkpoint, e.g. after a reset or a snapshot load
+void checkpoint_clear(checkpoint_ring_t* cp);
+
+// Takes a checkpoint. Call between runs of the CPU. Does nothing if the
+// machine has not run or written anything since the last one.
+void checkpoint_take(checkpoint_ring_t* cp, uint64_t cycles);
+
+// Call before a disk controller overwrites a sector, with what it held
+void checkpoint_disk_write(checkpoint_ring_t* cp, uint8_t drive, uint32_t offset, const uint8_t* old_data,
+                           uint16_t length);
+
+// Checkpoints that can be rewound to
+uint32_t checkpoint_depth(const checkpoint_ring_t* cp);
+
+// Goes back to the nth latest checkpoint, 1 being the latest, and forgets
+// those after it. Returns false, changing nothing, if there are not that
+// many. Also returns false if the restore function fails, in which case the
+// machine should be reset.
+bool checkpoint_rewind(checkpoint_ring_t* cp, uint32_t n);
+
+#endif
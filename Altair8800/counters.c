@@ -0,0 +1,264 @@
+#include "counters.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+
+#define REPORT_MAX_TOP 32
+#define REPORT_LINE 128
+#define PORT_OUT 0x100  // added to the port in the keys of the busiest ports
+
+// Picks the largest of count values, at most limit of them, largest first.
+// Returns how many were nonzero.
+static int top_keys(const uint64_t* values, int count, int limit, int* keys)
+{
+    int size = 0;
+
+    for (int key = 0; key < count; key++)
+    {
+        int i;
+
+        if (values[key] == 0 || (size == limit && values[key] <= values[keys[size - 1]]))
+        {
+            continue;
+        }
+        i = size < limit ? size++ : size - 1;
+        while (i > 0 && values[keys[i - 1]] < values[key])
+        {
+            keys[i] = keys[i - 1];
+            i--;
+        }
+        keys[i] = key;
+    }
+    return size;
+}
+
+// Both directions in one array, OUTs at PORT_OUT and up
+static void port_counts(const intel8080_t* cpu, uint64_t counts[512])
+{
+    for (int port = 0; port < 256; port++)
+    {
+        counts[port] = cpu->counters.port_in[port];
+        counts[PORT_OUT + port] = cpu->counters.port_out[port];
+    }
+}
+
+static const char* port_name(int key)
+{
+    switch (key)
+    {
+        case 0x01:
+        case PORT_OUT + 0x01:
+            return "console";
+        case 0x08:
+            return "disk status";
+        case PORT_OUT + 0x08:
+            return "disk select";
+        case 0x09:
+            return "disk sector";
+        case PORT_OUT + 0x09:
+            return "disk function";
+        case 0x0a:
+            return "disk read";
+        case PORT_OUT + 0x0a:
+            return "disk write";
+        case 0x0c:
+            return "disk DMA status";
+        case PORT_OUT + 0x0c:
+            return "disk DMA command";
+        case PORT_OUT + 0x0d:
+        case PORT_OUT + 0x0e:
+            return "disk DMA block";
+        case 0x10:
+            return "2SIO status";
+        case PORT_OUT + 0x10:
+            return "2SIO control";
+        case 0x11:
+        case PORT_OUT + 0x11:
+            return "2SIO data";
+        case 200:
+            return "request data";
+        case 0xff:
+            return "sense switches";
+        default:
+            return "";
+    }
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole == 0 ? 0.0 : 100.0 * (double)part / (double)whole;
+}
+
+void counters_report(const intel8080_t* cpu, int top, double seconds, counters_print_fn print, void* context)
+{
+    const i8080_counters_t* c = &cpu->counters;
+    char line[REPORT_LINE];
+    uint64_t ports[512];
+    uint64_t interpreted = 0;
+    uint64_t port_total = 0;
+    int keys[REPORT_MAX_TOP];
+    int n;
+
+    top = top < 1 ? 1 : (top > REPORT_MAX_TOP ? REPORT_MAX_TOP : top);
+    for (int op = 0; op < 256; op++)
+    {
+        interpreted += c->opcodes[op];
+    }
+    port_counts(cpu, ports);
+    for (int key = 0; key < 512; key++)
+    {
+        port_total += ports[key];
+    }
+
+    snprintf(line, sizeof(line), "Counters: %llu instructions, %llu of them in native loops, in %llu T-states",
+             (unsigned long long)cpu->instructions, (unsigned long long)c->loop_instructions,
+             (unsigned long long)cpu->cycles);
+    print(context, line);
+
+    print(context, "Top opcodes:");
+    n = top_keys(c->opcodes, 256, top, keys);
+    for (int i = 0; i < n; i++)
+    {
+        snprintf(line, sizeof(line), "  %6.2f%% %12llu  0x%02X", percent(c->opcodes[keys[i]], interpreted),
+                 (unsigned long long)c->opcodes[keys[i]], keys[i]);
+        print(context, line);
+    }
+
+    print(context, "Top ports:");
+    n = top_keys(ports, 512, top, keys);
+    for (int i = 0; i < n; i++)
+    {
+        snprintf(line, sizeof(line), "  %6.2f%% %12llu  %-3s 0x%02X  %s", percent(ports[keys[i]], port_total),
+                 (unsigned long long)ports[keys[i]], keys[i] >= PORT_OUT ? "OUT" : "IN", keys[i] & 0xff,
+                 port_name(keys[i]));
+        print(context, line);
+    }
+
+    snprintf(line, sizeof(line), "Disk: %llu selects, %llu status reads, %llu functions, %llu sector positions",
+             (unsigned long long)c->port_out[0x08], (unsigned long long)c->port_in[0x08],
+             (unsigned long long)c->port_out[0x09], (unsigned long long)c->port_in[0x09]);
+    print(context, line);
+    snprintf(line, sizeof(line), "Disk: %llu bytes read, %llu written; %llu sectors read, %llu written",
+             (unsigned long long)c->port_in[0x0a], (unsigned long long)c->port_out[0x0a],
+             (unsigned long long)c->sectors_read, (unsigned long long)c->sectors_written);
+    print(context, line);
+
+    if (seconds > 0.0)
+    {
+        snprintf(line, sizeof(line), "Console: %llu input polls, %.0f per second; %llu characters out",
+                 (unsigned long long)c->console_polls, (double)c->console_polls / seconds,
+                 (unsigned long long)(c->port_out[0x01] + c->port_out[0x11]));
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "Console: %llu input polls; %llu characters out",
+                 (unsigned long long)c->console_polls,
+                 (unsigned long long)(c->port_out[0x01] + c->port_out[0x11]));
+    }
+    print(context, line);
+}
+
+// Appends " <prefix><key>:<count>" for the top keys while they fit
+static size_t append_top(char* buffer, size_t buffer_length, size_t len, const uint64_t* values, int count,
+                         int limit, bool ports)
+{
+    int keys[REPORT_MAX_TOP];
+    int n = top_keys(values, count, limit, keys);
+
+    if (len >= buffer_length)
+    {
+        return buffer_length - 1;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int written;
+
+        if (ports)
+        {
+            written = snprintf(buffer + len, buffer_length - len, " %c%02X:%llu", keys[i] >= PORT_OUT ? 'O' : 'I',
+                               keys[i] & 0xff, (unsigned long long)values[keys[i]]);
+        }
+        else
+        {
+            written = snprintf(buffer + len, buffer_length - len, " %02X:%llu", keys[i],
+                               (unsigned long long)values[keys[i]]);
+        }
+        if (written < 0 || len + (size_t)written >= buffer_length)
+        {
+            buffer[len] = '\0';
+            break;
+        }
+        len += (size_t)written;
+    }
+    return len < buffer_length ? len : buffer_length - 1;
+}
+
+size_t counters_output(const intel8080_t* cpu, uint8_t data, char* buffer, size_t buffer_length)
+{
+    const i8080_counters_t* c = &cpu->counters;
+    uint64_t ports[512];
+    size_t len;
+
+    if (buffer == NULL || buffer_length == 0)
+    {
+        return 0;
+    }
+
+    switch (data)
+    {
+        case COUNTERS_SUMMARY:
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Instr:%llu Cycles:%llu Loops:%llu",
+                                   (unsigned long long)cpu->instructions, (unsigned long long)cpu->cycles,
+                                   (unsigned long long)c->loop_instructions);
+            break;
+
+        case COUNTERS_DISK:
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Disk in:%llu out:%llu rd:%llu wr:%llu",
+                                   (unsigned long long)c->port_in[0x0a], (unsigned long long)c->port_out[0x0a],
+                                   (unsigned long long)c->sectors_read, (unsigned long long)c->sectors_written);
+            break;
+
+        case COUNTERS_CONSOLE:
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Console polls:%llu in:%llu out:%llu",
+                                   (unsigned long long)c->console_polls,
+                                   (unsigned long long)(c->port_in[0x01] + c->port_in[0x11]),
+                                   (unsigned long long)(c->port_out[0x01] + c->port_out[0x11]));
+            break;
+
+        case COUNTERS_TOP_PORTS:
+            port_counts(cpu, ports);
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Ports");
+            len = append_top(buffer, buffer_length, len, ports, 512, 4, true);
+            break;
+
+        case COUNTERS_TOP_OPCODES:
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Ops");
+            len = append_top(buffer, buffer_length, len, c->opcodes, 256, 6, false);
+            break;
+
+        default:
+            len = (size_t)snprintf(buffer, buffer_length, "[CNT] Unknown stat type: %u", data);
+            break;
+    }
+    return len < buffer_length ? len : buffer_length - 1;
+}
+
+#else
+
+size_t counters_output(const intel8080_t* cpu, uint8_t data, char* buffer, size_t buffer_length)
+{
+    size_t len;
+
+    (void)cpu;
+    (void)data;
+    if (buffer == NULL || buffer_length == 0)
+    {
+        return 0;
+    }
+    len = (size_t)snprintf(buffer, buffer_length, "[CNT] Not available (built without ALTAIR_COUNTERS)");
+    return len < buffer_length ? len : buffer_length - 1;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#include "intel8080.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reports of the hot-path counters of an ALTAIR_COUNTERS build, kept in
+// cpu->counters (see i8080_counters_t). Without the option the CPU keeps no
+// counters and the cores count nothing.
+//
+// Guests read them through stats port 52: OUT the selector, then read the
+// text back from port 200 until it returns 0.
+
+#define COUNTERS_PORT 52
+
+typedef enum
+{
+    COUNTERS_SUMMARY = 0,       // "[CNT] Instr:%llu Cycles:%llu Loops:%llu"
+    COUNTERS_DISK = 1,          // "[CNT] Disk in:%llu out:%llu rd:%llu wr:%llu" (bytes, then sectors)
+    COUNTERS_CONSOLE = 2,       // "[CNT] Console polls:%llu in:%llu out:%llu"
+    COUNTERS_TOP_PORTS = 3,     // "[CNT] Ports I01:%llu O01:%llu ..." the busiest four
+    COUNTERS_TOP_OPCODES = 4,   // "[CNT] Ops 7E:%llu 23:%llu ..." the most frequent six
+    COUNTERS_STAT_COUNT
+} counters_stat_t;
+
+// Takes the report a line at a time, without a line ending
+typedef void (*counters_print_fn)(void* context, const char* line);
+
+// Writes the text for a stats port selector, or a note that the build has
+// no counters, and returns its length
+size_t counters_output(const intel8080_t* cpu, uint8_t data, char* buffer, size_t buffer_length);
+
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+// Instructions, the top opcodes and ports, disk and console counts, top
+// lines of each. seconds is how long the counters ran, for the console
+// polls per second, or 0 to leave the rate out.
+void counters_report(const intel8080_t* cpu, int top, double seconds, counters_print_fn print, void* context);
+#endif
+
+#endif
@@ -1,4 +1,5 @@
 #include "intel8080.h"
+#include "intel8080_ops.h"
 #include "op_codes.h"
 #include <string.h>
 #include <stdio.h>
@@ -14,1156 +15,819 @@
 
 #include "memory.h"
 
-// Performance optimization macros
-#if defined(__GNUC__) || defined(__clang__)
-#define LIKELY(x)   __builtin_expect(!!(x), 1)
-#define UNLIKELY(x) __builtin_expect(!!(x), 0)
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+	#include "pico.h"
+	#define I8080_SRAM_DATA(name)	__not_in_flash("i8080_tables") name
 #else
-#define LIKELY(x)   (x)
-#define UNLIKELY(x) (x)
+	#define I8080_SRAM_DATA(name)	name
 #endif
-#define CHECK_CARRY(a, b) ((a + b) > 0xff)
-#define CHECK_HALF_CARRY(a, b) (((a & 0xf) + (b & 0xf)) > 0xf)
-
-// define CPU stats LEDs
-#define STATUS_MEMORY_READ		0x80
-#define STATUS_PORT_INPUT		0x40
-#define STATUS_OP_CODE_FETCH	0x20
-#define STATUS_PORT_OUTPUT		0x10
-#define STATUS_HALT				0x08
-#define STATUS_STACK			0x04
-#define STATUS_WRITE_OUTPUT		0x02	// inverted!
-#define STATUS_INTERRUPT		0x01
-
-// Fast parity lookup table
-static const uint8_t parity_table[256] = {
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1
+
+// Sign, zero and parity flags for each result byte. ALU ops read it on every
+// instruction, so Pico builds keep it in SRAM rather than XIP flash.
+const uint8_t I8080_SRAM_DATA(i8080_szp_table)[256] = {
+	0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84
 };
 
-static inline uint8_t get_parity_fast(uint8_t val)
-{
-	return parity_table[val];
-}
+// Jump-table core: one function per opcode, each generated from the shared
+// instruction body with its register operands fixed at compile time. The
+// registers are reached through the flat r8 view so no handler has to decode
+// a register field at run time.
+#define CPU_R8(R)	cpu->registers.r8[I8080_R8_##R]
+
+#define CPU_A	CPU_R8(A)
+#define CPU_F	CPU_R8(F)
+#define CPU_SP	cpu->registers.sp
+#define CPU_PC	cpu->registers.pc
+#define CPU_LAZY	cpu->lazy_flags
+
+#define CPU_GET_A()		CPU_R8(A)
+#define CPU_GET_B()		CPU_R8(B)
+#define CPU_GET_C()		CPU_R8(C)
+#define CPU_GET_D()		CPU_R8(D)
+#define CPU_GET_E()		CPU_R8(E)
+#define CPU_GET_H()		CPU_R8(H)
+#define CPU_GET_L()		CPU_R8(L)
+#define CPU_SET_A(v)	(CPU_R8(A) = (v))
+#define CPU_SET_B(v)	(CPU_R8(B) = (v))
+#define CPU_SET_C(v)	(CPU_R8(C) = (v))
+#define CPU_SET_D(v)	(CPU_R8(D) = (v))
+#define CPU_SET_E(v)	(CPU_R8(E) = (v))
+#define CPU_SET_H(v)	(CPU_R8(H) = (v))
+#define CPU_SET_L(v)	(CPU_R8(L) = (v))
+
+#define CPU_GET_BC()	cpu->registers.bc
+#define CPU_GET_DE()	cpu->registers.de
+#define CPU_GET_HL()	cpu->registers.hl
+#define CPU_GET_SP()	cpu->registers.sp
+#define CPU_SET_BC(v)	(cpu->registers.bc = (v))
+#define CPU_SET_DE(v)	(cpu->registers.de = (v))
+#define CPU_SET_HL(v)	(cpu->registers.hl = (v))
+#define CPU_SET_SP(v)	(cpu->registers.sp = (v))
+
+// mem is the handler's copy of cpu->memory, which a byte store could
+// otherwise force the compiler to reload
+#define CPU_RD8(addr)		read8(mem, addr)
+#define CPU_WR8(addr, val)	write8(mem, addr, val)
+#define CPU_RD16(addr)		read16(mem, addr)
+#define CPU_WR16(addr, val)	write16(mem, addr, val)
+#define CPU_IMM8()			read8(mem, cpu->registers.pc + 1)
+#define CPU_IMM16()			read16(mem, cpu->registers.pc + 1)
+
+// Registers already live in *cpu
+#define CPU_SAVE()	((void)0)
+#define CPU_LOAD()	((void)0)
+
+#define OP_END(n)		return (n)
+#define OP_END_EVENT(n)	return (n)
+
+// run_core keeps cpu->cycles current in call profiling builds
+#define CPU_NOW()		cpu->cycles
+
+#define JT_HANDLER(code, body) \
+	static uint8_t i8080_op_##code(intel8080_t *cpu) \
+	{ \
+		altair_memory_t *const mem = cpu->memory; \
+		(void)mem; \
+		I8080_COUNT(cpu, opcodes[code]); \
+		body \
+	}
+#define JT_ENTRY(code, body)	[code] = i8080_op_##code,
+
+I8080_OPCODE_TABLE(JT_HANDLER)
+
+uint8_t (*const i8080_opcode_handlers[256])(intel8080_t *cpu) = { I8080_OPCODE_TABLE(JT_ENTRY) };
+
+#if I8080_USE_FUSION
+#include "intel8080_fusion.h"
+
+// A fused handler runs the first instruction and then the second, both
+// inlined, so the pair costs one dispatch. The first may have overwritten the
+// next opcode, so it is fetched again and anything else goes through the
+// jump table. The second instruction is counted here, the first by the caller.
+#define FUSED_HANDLER(first, second) \
+	static uint8_t i8080_fused_##first(intel8080_t *cpu) \
+	{ \
+		const altair_memory_t *mem = cpu->memory; \
+		uint8_t cycles = i8080_op_##first(cpu); \
+		uint8_t next = cpu->current_op_code = read8(mem, cpu->registers.pc); \
+		cpu->instructions++; \
+		if(next == (second)) \
+			return cycles + i8080_op_##second(cpu); \
+		return cycles + i8080_opcode_handlers[next](cpu); \
+	}
+#define FUSED_ENTRY(first, second)	fused_handlers[first] = i8080_fused_##first;
 
-uint8_t get_parity(uint8_t val)
-{
-	return get_parity_fast(val);
-}
+// No instruction that can start a pair takes longer than XTHL
+#define FUSION_MAX_FIRST_CYCLES	CYCLES_XTHL
 
-// Forward declarations for jump table
-static uint8_t i8080_nop(intel8080_t *cpu);
-static uint8_t i8080_lxi(intel8080_t *cpu);
-static uint8_t i8080_stax(intel8080_t *cpu);
-static uint8_t i8080_inx(intel8080_t *cpu);
-static uint8_t i8080_inr(intel8080_t *cpu);
-static uint8_t i8080_dcr(intel8080_t *cpu);
-static uint8_t i8080_mvi(intel8080_t *cpu);
-static uint8_t i8080_rlc(intel8080_t *cpu);
-static uint8_t i8080_dad(intel8080_t *cpu);
-static uint8_t i8080_ldax(intel8080_t *cpu);
-static uint8_t i8080_dcx(intel8080_t *cpu);
-static uint8_t i8080_rrc(intel8080_t *cpu);
-static uint8_t i8080_ral(intel8080_t *cpu);
-static uint8_t i8080_rar(intel8080_t *cpu);
-static uint8_t i8080_shld(intel8080_t *cpu);
-static uint8_t i8080_daa(intel8080_t *cpu);
-static uint8_t i8080_lhld(intel8080_t *cpu);
-static uint8_t i8080_cma(intel8080_t *cpu);
-static uint8_t i8080_lda(intel8080_t *cpu);
-static uint8_t i8080_sta(intel8080_t *cpu);
-static uint8_t i8080_stc(intel8080_t *cpu);
-static uint8_t i8080_cmc(intel8080_t *cpu);
-static uint8_t i8080_mov(intel8080_t *cpu);
-static uint8_t i8080_add(intel8080_t *cpu);
-static uint8_t i8080_adc(intel8080_t *cpu);
-static uint8_t i8080_sub(intel8080_t *cpu);
-static uint8_t i8080_sbb(intel8080_t *cpu);
-static uint8_t i8080_ana(intel8080_t *cpu);
-static uint8_t i8080_xra(intel8080_t *cpu);
-static uint8_t i8080_ora(intel8080_t *cpu);
-static uint8_t i8080_cmp(intel8080_t *cpu);
-static uint8_t i8080_rccc(intel8080_t *cpu);
-static uint8_t i8080_pop(intel8080_t *cpu);
-static uint8_t i8080_jccc(intel8080_t *cpu);
-static uint8_t i8080_jmp(intel8080_t *cpu);
-static uint8_t i8080_cccc(intel8080_t *cpu);
-static uint8_t i8080_push(intel8080_t *cpu);
-static uint8_t i8080_adi(intel8080_t *cpu);
-static uint8_t i8080_rst(intel8080_t *cpu);
-static uint8_t i8080_ret(intel8080_t *cpu);
-static uint8_t i8080_call(intel8080_t *cpu);
-static uint8_t i8080_aci(intel8080_t *cpu);
-static uint8_t i8080_out(intel8080_t *cpu);
-static uint8_t i8080_sui(intel8080_t *cpu);
-static uint8_t i8080_in(intel8080_t *cpu);
-static uint8_t i8080_sbi(intel8080_t *cpu);
-static uint8_t i8080_xthl(intel8080_t *cpu);
-static uint8_t i8080_ani(intel8080_t *cpu);
-static uint8_t i8080_pchl(intel8080_t *cpu);
-static uint8_t i8080_xchg(intel8080_t *cpu);
-static uint8_t i8080_xri(intel8080_t *cpu);
-static uint8_t i8080_di(intel8080_t *cpu);
-static uint8_t i8080_ori(intel8080_t *cpu);
-static uint8_t i8080_sphl(intel8080_t *cpu);
-static uint8_t i8080_ei(intel8080_t *cpu);
-static uint8_t i8080_cpi(intel8080_t *cpu);
-
-// Jump table for fast opcode dispatch
-static uint8_t (*const opcode_handlers[256])(intel8080_t *cpu) = {
-	[0x00] = i8080_nop,    [0x01] = i8080_lxi,    [0x02] = i8080_stax,   [0x03] = i8080_inx,
-	[0x04] = i8080_inr,    [0x05] = i8080_dcr,    [0x06] = i8080_mvi,    [0x07] = i8080_rlc,
-	[0x08] = NULL,         [0x09] = i8080_dad,    [0x0a] = i8080_ldax,   [0x0b] = i8080_dcx,
-	[0x0c] = i8080_inr,    [0x0d] = i8080_dcr,    [0x0e] = i8080_mvi,    [0x0f] = i8080_rrc,
-	[0x10] = NULL,         [0x11] = i8080_lxi,    [0x12] = i8080_stax,   [0x13] = i8080_inx,
-	[0x14] = i8080_inr,    [0x15] = i8080_dcr,    [0x16] = i8080_mvi,    [0x17] = i8080_ral,
-	[0x18] = NULL,         [0x19] = i8080_dad,    [0x1a] = i8080_ldax,   [0x1b] = i8080_dcx,
-	[0x1c] = i8080_inr,    [0x1d] = i8080_dcr,    [0x1e] = i8080_mvi,    [0x1f] = i8080_rar,
-	[0x20] = NULL,         [0x21] = i8080_lxi,    [0x22] = i8080_shld,   [0x23] = i8080_inx,
-	[0x24] = i8080_inr,    [0x25] = i8080_dcr,    [0x26] = i8080_mvi,    [0x27] = i8080_daa,
-	[0x28] = NULL,         [0x29] = i8080_dad,    [0x2a] = i8080_lhld,   [0x2b] = i8080_dcx,
-	[0x2c] = i8080_inr,    [0x2d] = i8080_dcr,    [0x2e] = i8080_mvi,    [0x2f] = i8080_cma,
-	[0x30] = NULL,         [0x31] = i8080_lxi,    [0x32] = i8080_sta,    [0x33] = i8080_inx,
-	[0x34] = i8080_inr,    [0x35] = i8080_dcr,    [0x36] = i8080_mvi,    [0x37] = i8080_stc,
-	[0x38] = NULL,         [0x39] = i8080_dad,    [0x3a] = i8080_lda,    [0x3b] = i8080_dcx,
-	[0x3c] = i8080_inr,    [0x3d] = i8080_dcr,    [0x3e] = i8080_mvi,    [0x3f] = i8080_cmc,
-	[0x40] = i8080_mov,    [0x41] = i8080_mov,    [0x42] = i8080_mov,    [0x43] = i8080_mov,
-	[0x44] = i8080_mov,    [0x45] = i8080_mov,    [0x46] = i8080_mov,    [0x47] = i8080_mov,
-	[0x48] = i8080_mov,    [0x49] = i8080_mov,    [0x4a] = i8080_mov,    [0x4b] = i8080_mov,
-	[0x4c] = i8080_mov,    [0x4d] = i8080_mov,    [0x4e] = i8080_mov,    [0x4f] = i8080_mov,
-	[0x50] = i8080_mov,    [0x51] = i8080_mov,    [0x52] = i8080_mov,    [0x53] = i8080_mov,
-	[0x54] = i8080_mov,    [0x55] = i8080_mov,    [0x56] = i8080_mov,    [0x57] = i8080_mov,
-	[0x58] = i8080_mov,    [0x59] = i8080_mov,    [0x5a] = i8080_mov,    [0x5b] = i8080_mov,
-	[0x5c] = i8080_mov,    [0x5d] = i8080_mov,    [0x5e] = i8080_mov,    [0x5f] = i8080_mov,
-	[0x60] = i8080_mov,    [0x61] = i8080_mov,    [0x62] = i8080_mov,    [0x63] = i8080_mov,
-	[0x64] = i8080_mov,    [0x65] = i8080_mov,    [0x66] = i8080_mov,    [0x67] = i8080_mov,
-	[0x68] = i8080_mov,    [0x69] = i8080_mov,    [0x6a] = i8080_mov,    [0x6b] = i8080_mov,
-	[0x6c] = i8080_mov,    [0x6d] = i8080_mov,    [0x6e] = i8080_mov,    [0x6f] = i8080_mov,
-	[0x70] = i8080_mov,    [0x71] = i8080_mov,    [0x72] = i8080_mov,    [0x73] = i8080_mov,
-	[0x74] = i8080_mov,    [0x75] = i8080_mov,    [0x76] = NULL,         [0x77] = i8080_mov,
-	[0x78] = i8080_mov,    [0x79] = i8080_mov,    [0x7a] = i8080_mov,    [0x7b] = i8080_mov,
-	[0x7c] = i8080_mov,    [0x7d] = i8080_mov,    [0x7e] = i8080_mov,    [0x7f] = i8080_mov,
-	[0x80] = i8080_add,    [0x81] = i8080_add,    [0x82] = i8080_add,    [0x83] = i8080_add,
-	[0x84] = i8080_add,    [0x85] = i8080_add,    [0x86] = i8080_add,    [0x87] = i8080_add,
-	[0x88] = i8080_adc,    [0x89] = i8080_adc,    [0x8a] = i8080_adc,    [0x8b] = i8080_adc,
-	[0x8c] = i8080_adc,    [0x8d] = i8080_adc,    [0x8e] = i8080_adc,    [0x8f] = i8080_adc,
-	[0x90] = i8080_sub,    [0x91] = i8080_sub,    [0x92] = i8080_sub,    [0x93] = i8080_sub,
-	[0x94] = i8080_sub,    [0x95] = i8080_sub,    [0x96] = i8080_sub,    [0x97] = i8080_sub,
-	[0x98] = i8080_sbb,    [0x99] = i8080_sbb,    [0x9a] = i8080_sbb,    [0x9b] = i8080_sbb,
-	[0x9c] = i8080_sbb,    [0x9d] = i8080_sbb,    [0x9e] = i8080_sbb,    [0x9f] = i8080_sbb,
-	[0xa0] = i8080_ana,    [0xa1] = i8080_ana,    [0xa2] = i8080_ana,    [0xa3] = i8080_ana,
-	[0xa4] = i8080_ana,    [0xa5] = i8080_ana,    [0xa6] = i8080_ana,    [0xa7] = i8080_ana,
-	[0xa8] = i8080_xra,    [0xa9] = i8080_xra,    [0xaa] = i8080_xra,    [0xab] = i8080_xra,
-	[0xac] = i8080_xra,    [0xad] = i8080_xra,    [0xae] = i8080_xra,    [0xaf] = i8080_xra,
-	[0xb0] = i8080_ora,    [0xb1] = i8080_ora,    [0xb2] = i8080_ora,    [0xb3] = i8080_ora,
-	[0xb4] = i8080_ora,    [0xb5] = i8080_ora,    [0xb6] = i8080_ora,    [0xb7] = i8080_ora,
-	[0xb8] = i8080_cmp,    [0xb9] = i8080_cmp,    [0xba] = i8080_cmp,    [0xbb] = i8080_cmp,
-	[0xbc] = i8080_cmp,    [0xbd] = i8080_cmp,    [0xbe] = i8080_cmp,    [0xbf] = i8080_cmp,
-	[0xc0] = i8080_rccc,   [0xc1] = i8080_pop,    [0xc2] = i8080_jccc,   [0xc3] = i8080_jmp,
-	[0xc4] = i8080_cccc,   [0xc5] = i8080_push,   [0xc6] = i8080_adi,    [0xc7] = i8080_rst,
-	[0xc8] = i8080_rccc,   [0xc9] = i8080_ret,    [0xca] = i8080_jccc,   [0xcb] = NULL,
-	[0xcc] = i8080_cccc,   [0xcd] = i8080_call,   [0xce] = i8080_aci,    [0xcf] = i8080_rst,
-	[0xd0] = i8080_rccc,   [0xd1] = i8080_pop,    [0xd2] = i8080_jccc,   [0xd3] = i8080_out,
-	[0xd4] = i8080_cccc,   [0xd5] = i8080_push,   [0xd6] = i8080_sui,    [0xd7] = i8080_rst,
-	[0xd8] = i8080_rccc,   [0xd9] = NULL,         [0xda] = i8080_jccc,   [0xdb] = i8080_in,
-	[0xdc] = i8080_cccc,   [0xdd] = NULL,         [0xde] = i8080_sbi,    [0xdf] = i8080_rst,
-	[0xe0] = i8080_rccc,   [0xe1] = i8080_pop,    [0xe2] = i8080_jccc,   [0xe3] = i8080_xthl,
-	[0xe4] = i8080_cccc,   [0xe5] = i8080_push,   [0xe6] = i8080_ani,    [0xe7] = i8080_rst,
-	[0xe8] = i8080_rccc,   [0xe9] = i8080_pchl,   [0xea] = i8080_jccc,   [0xeb] = i8080_xchg,
-	[0xec] = i8080_cccc,   [0xed] = NULL,         [0xee] = i8080_xri,    [0xef] = i8080_rst,
-	[0xf0] = i8080_rccc,   [0xf1] = i8080_pop,    [0xf2] = i8080_jccc,   [0xf3] = i8080_di,
-	[0xf4] = i8080_cccc,   [0xf5] = i8080_push,   [0xf6] = i8080_ori,    [0xf7] = i8080_rst,
-	[0xf8] = i8080_rccc,   [0xf9] = i8080_sphl,   [0xfa] = i8080_jccc,   [0xfb] = i8080_ei,
-	[0xfc] = i8080_cccc,   [0xfd] = NULL,         [0xfe] = i8080_cpi,    [0xff] = i8080_rst
-};
+I8080_FUSED_PAIRS(FUSED_HANDLER)
 
-void i8080_reset(intel8080_t *cpu, port_in in, port_out out, read_sense_switches sense,
-			 disk_controller_t *disk_controller, io_port_in_fn io_in, io_port_out_fn io_out)
-{
-	memset(cpu, 0, sizeof(intel8080_t));
-	cpu->term_in = in;
-	cpu->term_out = out;
-	cpu->io_port_in_handler = io_in;
-	cpu->io_port_out_handler = io_out;
-	cpu->disk_controller = *disk_controller;
-	cpu->registers.flags = 0x2;
-	cpu->sense = sense;
-	cpu->cpuStatus = 0x00;
-}
-
-static inline void i8080_update_flag_bit(intel8080_t *cpu, uint8_t flag, int condition)
-{
-	if (LIKELY(condition)) {
-		cpu->registers.flags |= flag;
-	} else {
-		cpu->registers.flags &= ~flag;
-	}
-}
+// The jump table with the first opcode of each pair replaced, set up by i8080_reset()
+static uint8_t (*fused_handlers[256])(intel8080_t *cpu);
+#endif
 
-static inline void i8080_set_flag(intel8080_t *cpu, uint8_t flag)
-{
-	cpu->registers.flags |= flag;
-}
+#if I8080_USE_PAIR_PROFILE
+#define PAIR_PROFILE_MIN_PERMILLE	5	// leave out pairs rarer than this
+#define PAIR_PROFILE_MAX_PAIRS		32
 
-static inline void i8080_clear_flag(intel8080_t *cpu, uint8_t flag)
-{
-	cpu->registers.flags &= ~flag;
-}
+static uint64_t pair_counts[256][256];
+static uint8_t pair_prev;
 
-static inline void i8080_mwrite(intel8080_t *cpu)
+// Opcodes that fall through to the next instruction without raising an event
+static int pair_can_fuse(uint8_t op)
 {
-	cpu->cpuStatus &= ~(STATUS_MEMORY_READ);
-	write8(cpu->address_bus, cpu->data_bus);
+	return !((op & 0xc7) == 0xc0 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7 ||
+			 op == 0xc3 || op == 0xc9 || op == 0xcd || op == 0xe9 || op == 0xd3 || op == 0xdb || op == 0x76);
 }
 
-static inline void i8080_mread(intel8080_t *cpu)
+int i8080_pair_profile_write(const char *path)
 {
-	cpu->cpuStatus |= STATUS_MEMORY_READ;
-	cpu->data_bus = read8(cpu->address_bus);
-}
+	uint64_t total = 0, best_count[256] = { 0 };
+	uint8_t best[256] = { 0 }, firsts[256];
+	int n = 0, i, j;
+	FILE *out;
 
-static inline void i8080_pairwrite(intel8080_t *cpu, uint8_t pair, uint16_t val)
-{
-	cpu->cpuStatus &= ~(STATUS_MEMORY_READ);
-	switch(pair)
+	for(i = 0; i < 256; i++)
 	{
-	case PAIR_BC:
-		cpu->registers.bc = val;
-		break;
-	case PAIR_DE:
-		cpu->registers.de = val;
-		break;
-	case PAIR_HL:
-		cpu->registers.hl = val;
-		break;
-	case PAIR_SP:
-		cpu->registers.sp = val;
-		break;
+		for(j = 0; j < 256; j++)
+		{
+			total += pair_counts[i][j];
+			if(pair_counts[i][j] > best_count[i])
+			{
+				best_count[i] = pair_counts[i][j];
+				best[i] = (uint8_t)j;
+			}
+		}
 	}
-}
 
-static inline uint16_t i8080_pairread(intel8080_t *cpu, uint8_t pair)
-{
-	cpu->cpuStatus |= STATUS_MEMORY_READ;
-	switch(pair)
+	// Most frequent first
+	for(i = 0; i < 256; i++)
 	{
-	case PAIR_BC:
-		return cpu->registers.bc;
-	case PAIR_DE:
-		return cpu->registers.de;
-	case PAIR_HL:
-		return cpu->registers.hl;
-	case PAIR_SP:
-		return cpu->registers.sp;
-	default:
-		return 0;
+		if(!pair_can_fuse((uint8_t)i) || best_count[i] * 1000 < total * PAIR_PROFILE_MIN_PERMILLE || !best_count[i])
+			continue;
+		for(j = n; j > 0 && best_count[firsts[j - 1]] < best_count[i]; j--)
+			firsts[j] = firsts[j - 1];
+		firsts[j] = (uint8_t)i;
+		n++;
 	}
-}
-
-static inline void i8080_regwrite(intel8080_t *cpu, uint8_t reg, uint8_t val)
-{
-	switch(reg)
+	if(n > PAIR_PROFILE_MAX_PAIRS)
+		n = PAIR_PROFILE_MAX_PAIRS;
+
+	out = fopen(path, "w");
+	if(!out)
+		return -1;
+
+	fprintf(out,
+			"#ifndef _INTEL8080_FUSION_H_\n"
+			"#define _INTEL8080_FUSION_H_\n"
+			"\n"
+			"// Superinstruction pairs for the jump-table core (I8080_FUSION), written by\n"
+			"// i8080_pair_profile_write() from a profile of %llu instruction pairs.\n"
+			"// X(first, second) fuses an opcode with its most frequent successor; the\n"
+			"// comment is the pair's share of the profile.\n"
+			"\n"
+			"#define I8080_FUSED_PAIRS(X) \\\n", (unsigned long long)total);
+	for(i = 0; i < n; i++)
 	{
-	case REGISTER_A:
-		cpu->registers.a = val;
-		break;
-	case REGISTER_B:
-		cpu->registers.b = val;
-		break;
-	case REGISTER_C:
-		cpu->registers.c = val;
-		break;
-	case REGISTER_D:
-		cpu->registers.d = val;
-		break;
-	case REGISTER_E:
-		cpu->registers.e = val;
-		break;
-	case REGISTER_H:
-		cpu->registers.h = val;
-		break;
-	case REGISTER_L:
-		cpu->registers.l = val;
-		break;
-	case MEMORY_ACCESS:
-		cpu->address_bus = cpu->registers.hl;
-		cpu->data_bus = val;
-		i8080_mwrite(cpu);
-		break;
-	}
-}
+		uint8_t first = firsts[i];
 
-static inline uint8_t i8080_regread(intel8080_t *cpu, uint8_t reg)
-{
-	switch(reg)
-	{
-	case REGISTER_A:
-		return cpu->registers.a;
-	case REGISTER_B:
-		return cpu->registers.b;
-	case REGISTER_C:
-		return cpu->registers.c;
-	case REGISTER_D:
-		return cpu->registers.d;
-	case REGISTER_E:
-		return cpu->registers.e;
-	case REGISTER_H:
-		return cpu->registers.h;
-	case REGISTER_L:
-		return cpu->registers.l;
-	case MEMORY_ACCESS:
-		cpu->address_bus = cpu->registers.hl;
-		i8080_mread(cpu);
-		return cpu->data_bus;
-	default:
-		return 0;
+		fprintf(out, "\tX(0x%02x, 0x%02x)\t/* %5.2f%% */%s\n", first, best[first],
+				100.0 * (double)best_count[first] / (double)total, i + 1 < n ? " \\" : "");
 	}
-}
+	fprintf(out, "\n#endif\n");
 
-uint8_t i8080_check_condition(intel8080_t *cpu, uint8_t condition)
-{
-	switch(condition)
-	{
-	case CONDITION_NZ:
-		return !(cpu->registers.flags & FLAGS_ZERO);
-	case CONDITION_Z:
-		return (cpu->registers.flags & FLAGS_ZERO);
-	case CONDITION_NC:
-		return !(cpu->registers.flags & FLAGS_CARRY);
-	case CONDITION_C:
-		return (cpu->registers.flags & FLAGS_CARRY);
-	case CONDITION_PO:
-		return !(cpu->registers.flags & FLAGS_PARITY);
-	case CONDITION_PE:
-		return (cpu->registers.flags & FLAGS_PARITY);
-	case CONDITION_P:
-		return !(cpu->registers.flags & FLAGS_SIGN);
-	case CONDITION_M:
-		return (cpu->registers.flags & FLAGS_SIGN);
-	}
-	return 0;
+	return fclose(out) == 0 ? 0 : -1;
 }
 
-void i8080_examine(intel8080_t *cpu, uint16_t address)
+// Every instruction is the second of a pair, the first one with pair_prev 0
+int i8080_opcode_counts(uint64_t counts[256])
 {
-	// Jump to the supplied address
-	cpu->registers.pc = cpu->address_bus = address;
-	cpu->data_bus = read8(cpu->address_bus);
-}
+	int i, j;
 
-void i8080_examine_next(intel8080_t *cpu)
-{
-	cpu->address_bus++;
-	cpu->data_bus = read8(cpu->address_bus);
+	memset(counts, 0, 256 * sizeof(counts[0]));
+	for(i = 0; i < 256; i++)
+		for(j = 0; j < 256; j++)
+			counts[j] += pair_counts[i][j];
+	return 0;
 }
-
-void i8080_deposit(intel8080_t *cpu, uint8_t data)
+#else
+int i8080_pair_profile_write(const char *path)
 {
-	cpu->data_bus = data;
-	i8080_mwrite(cpu);
+	(void)path;
+	return -1;
 }
 
-void i8080_deposit_next(intel8080_t *cpu, uint8_t data)
+int i8080_opcode_counts(uint64_t counts[256])
 {
-	i8080_examine_next(cpu);
-	cpu->data_bus = data;
-	i8080_mwrite(cpu);
+	memset(counts, 0, 256 * sizeof(counts[0]));
+	return -1;
 }
+#endif
 
-void i8080_update_flags(intel8080_t *cpu, uint8_t reg, uint8_t mask)
-{
-	uint8_t val = i8080_regread(cpu, reg);
-	
-	if (mask & FLAGS_PARITY) {
-		i8080_update_flag_bit(cpu, FLAGS_PARITY, get_parity_fast(val));
-	}
-	if (mask & FLAGS_ZERO) {
-		i8080_update_flag_bit(cpu, FLAGS_ZERO, val == 0);
-	}
-	if (mask & FLAGS_SIGN) {
-		i8080_update_flag_bit(cpu, FLAGS_SIGN, val & 0x80);
-	}
-}
+// The CPU's own devices, which i8080_reset() registers with the context
+// being the CPU
 
-void i8080_gensub(intel8080_t *cpu, uint16_t val)
+static uint8_t console_in(void *context, uint8_t port)
 {
-	uint16_t a, b;
-	// Subtract by adding with two-complement of val. Carry-flag meaning becomes inverted since we add.
-	a = cpu->registers.a;
-	b = 0x100 - val;
-
-	i8080_update_flag_bit(cpu, FLAGS_H, CHECK_HALF_CARRY(a, b));
-	i8080_update_flag_bit(cpu, FLAGS_CARRY, !CHECK_CARRY(a, b));
+	intel8080_t *cpu = context;
 
-	a += b;
-	cpu->registers.a = a & 0xff;
-
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
+	(void)port;
+	cpu->cpuStatus |= STATUS_PORT_INPUT;
+	I8080_COUNT(cpu, console_polls);
+	return cpu->term_in(cpu->context);
 }
 
-void i8080_compare(intel8080_t *cpu, uint8_t val)
+static void console_out(void *context, uint8_t port, uint8_t data)
 {
-	uint8_t tmp_a = cpu->registers.a;
-	i8080_gensub(cpu, val);
-	cpu->registers.a = tmp_a;
-}
-
-static uint8_t i8080_mov(intel8080_t *cpu)
-{
-	uint8_t dest = DESTINATION(cpu->current_op_code);
-	uint8_t source = SOURCE(cpu->current_op_code);
-	uint8_t val;
-	uint8_t cycles;
-
-	if(dest == MEMORY_ACCESS || source == MEMORY_ACCESS)
-		cycles = CYCLES_MOV_MEM;
-	else
-		cycles = CYCLES_MOV_REG;
-
-	val = i8080_regread(cpu, source);
-	i8080_regwrite(cpu, dest, val);
-	cpu->registers.pc++;
+	intel8080_t *cpu = context;
 
-	return cycles;
+	(void)port;
+	cpu->cpuStatus |= STATUS_PORT_OUTPUT;
+	cpu->term_out(cpu->context, data);
 }
 
-static uint8_t i8080_mvi(intel8080_t *cpu)
+static uint8_t disk_in(void *context, uint8_t port)
 {
-	uint8_t dest = DESTINATION(cpu->current_op_code);
-	uint8_t cycles;
-
-	if(dest == MEMORY_ACCESS)
-		cycles = CYCLES_MVI_MEM;
-	else
-		cycles = CYCLES_MVI_REG;
-
-	i8080_regwrite(cpu, dest, read8(cpu->registers.pc+1));
-
-	cpu->registers.pc+=2;
+	intel8080_t *cpu = context;
+	const disk_controller_t *disk = &cpu->disk_controller;
 
-	return cycles;
+	switch(port)
+	{
+	case 0x8:
+		return disk->disk_status(disk->context);
+	case 0x9:
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+		// Reading the sector position starts the sector over
+		cpu->counters.sector_unread = 1;
+#endif
+		return disk->sector(disk->context);
+	default:
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+		cpu->counters.sectors_read += cpu->counters.sector_unread;
+		cpu->counters.sector_unread = 0;
+#endif
+		return disk->read(disk->context);
+	}
 }
 
-static uint8_t i8080_lxi(intel8080_t *cpu)
+static void disk_out(void *context, uint8_t port, uint8_t data)
 {
-	uint8_t pair = RP(cpu->current_op_code);
-
-	i8080_pairwrite(cpu, pair, read16(cpu->registers.pc+1));
-	cpu->registers.pc+=3;
+	intel8080_t *cpu = context;
+	const disk_controller_t *disk = &cpu->disk_controller;
 
-	return CYCLES_LXI;
+	switch(port)
+	{
+	case 0x8:
+		disk->disk_select(disk->context, data);
+		break;
+	case 0x9:
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+		if(data & 0x80)	// write enable
+		{
+			cpu->counters.sectors_written++;
+		}
+#endif
+		disk->disk_function(disk->context, data);
+		break;
+	default:
+		disk->write(disk->context, data);
+		break;
+	}
 }
 
-uint8_t i8080_lda(intel8080_t *cpu)
+static uint8_t sio_in(void *context, uint8_t port)
 {
-	cpu->address_bus = read16(cpu->registers.pc+1);
-	i8080_mread(cpu);
-	cpu->registers.a = cpu->data_bus;
+	intel8080_t *cpu = context;
+	uint8_t data;
 
-	cpu->registers.pc+=3;
-	return CYCLES_LDA;
+	if(port == 0x10)	// 2SIO port 1, status
+	{
+		data = 0x2; // bit 1 == transmit buffer empty
+		if(i8080_sio_rx_ready(cpu))
+		{
+			data |= 0x1;
+		}
+		return data;
+	}
+	if(cpu->sio_rx)		// 2SIO port 1, read
+	{
+		data = cpu->sio_rx;
+		cpu->sio_rx = 0;
+		return data;
+	}
+	I8080_COUNT(cpu, console_polls);
+	return cpu->term_in(cpu->context);
 }
 
-uint8_t i8080_sta(intel8080_t *cpu)
+static void sio_out(void *context, uint8_t port, uint8_t data)
 {
-	cpu->address_bus = read16(cpu->registers.pc+1);
-	cpu->data_bus = cpu->registers.a;
-	i8080_mwrite(cpu);
+	intel8080_t *cpu = context;
 
-	cpu->registers.pc+=3;
-	return CYCLES_STA;
+	if(port == 0x11)	// 2SIO port 1 write; port 0x10 is its control
+	{
+		cpu->term_out(cpu->context, data);
+	}
 }
 
-uint8_t i8080_lhld(intel8080_t *cpu)
+static uint8_t sense_in(void *context, uint8_t port)
 {
-	cpu->registers.hl = read16(read16(cpu->registers.pc+1));
-	cpu->registers.pc+=3;
-	return CYCLES_LHLD;
-}
+	intel8080_t *cpu = context;
 
-uint8_t i8080_shld(intel8080_t *cpu)
-{
-	write16(read16(cpu->registers.pc+1), cpu->registers.hl);
-	cpu->registers.pc+=3;
-	return CYCLES_SHLD;
+	(void)port;
+	return cpu->sense(cpu->context);
 }
 
-// TODO: only BC and DE allowed for indirect
-uint8_t i8080_ldax(intel8080_t *cpu)
+static uint8_t no_input(void *context, uint8_t port)
 {
-	uint8_t pair = RP(cpu->current_op_code);
-
-	cpu->registers.a = read8(i8080_pairread(cpu, pair));
-	cpu->registers.pc++;
-	return CYCLES_LDAX;
+	(void)context;
+	(void)port;
+	return 0x00;
 }
 
-// TODO: only BC and DE allowed for indirect
-uint8_t i8080_stax(intel8080_t *cpu)
+static void no_output(void *context, uint8_t port, uint8_t data)
 {
-	uint8_t pair = RP(cpu->current_op_code);
-	write8(i8080_pairread(cpu, pair), cpu->registers.a);
-	cpu->registers.pc++;
-	return CYCLES_STAX;
+	(void)context;
+	(void)port;
+	(void)data;
 }
 
-uint8_t i8080_xchg(intel8080_t *cpu)
+void i8080_ports_init(i8080_ports_t *ports)
 {
-	uint16_t tmp = cpu->registers.hl;
-	cpu->registers.hl = cpu->registers.de;
-	cpu->registers.de = tmp;
-	cpu->registers.pc++;
-
-	return CYCLES_XCHG;
+	i8080_ports_register(ports, 0x00, 0xff, NULL, NULL, NULL);
 }
 
-void i8080_genadd(intel8080_t *cpu, uint16_t val)
+void i8080_ports_register(i8080_ports_t *ports, uint8_t first, uint8_t last, io_port_in_fn in, io_port_out_fn out,
+			  void *context)
 {
-	uint8_t a = cpu->registers.a;
-
-	i8080_update_flag_bit(cpu, FLAGS_H, CHECK_HALF_CARRY(a, val));
-	i8080_update_flag_bit(cpu, FLAGS_CARRY, CHECK_CARRY(a, val));
-
-	cpu->registers.a += val;
-
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
+	for(unsigned port = first; port <= last; port++)
+	{
+		ports->port[port].in = in ? in : no_input;
+		ports->port[port].out = out ? out : no_output;
+		ports->port[port].context = context;
+	}
 }
 
-
-uint8_t i8080_add(intel8080_t *cpu)
+void i8080_reset(intel8080_t *cpu, struct altair_memory *memory, void *context, port_in in, port_out out,
+			 read_sense_switches sense, disk_controller_t *disk_controller, i8080_ports_t *ports)
 {
-	uint8_t source = SOURCE(cpu->current_op_code);
-	uint8_t val = i8080_regread(cpu, source);
-	i8080_genadd(cpu, val);
-	cpu->registers.pc++;
-	return CYCLES_ADD;
+	memset(cpu, 0, sizeof(intel8080_t));
+	cpu->memory = memory;
+	cpu->context = context;
+	cpu->term_in = in;
+	cpu->term_out = out;
+	cpu->ports = ports;
+	i8080_ports_register(ports, 0x00, 0x00, NULL, NULL, NULL);
+	i8080_ports_register(ports, 0x01, 0x01, console_in, console_out, cpu);
+	i8080_ports_register(ports, 0x08, 0x0a, disk_in, disk_out, cpu);
+	i8080_ports_register(ports, 0x10, 0x11, sio_in, sio_out, cpu);
+	i8080_ports_register(ports, 0xff, 0xff, sense_in, NULL, cpu);
+	cpu->disk_controller = *disk_controller;
+	cpu->registers.flags = 0x2;
+	cpu->sense = sense;
+	cpu->cpuStatus = 0x00;
+#if I8080_USE_BLOCK_CACHE || I8080_USE_JIT
+	// Code cached before may not match what memory holds now
+	memory_pages_written(memory, 0x0000, 64 * 1024);
+#endif
+#if I8080_USE_FUSION
+	memcpy(fused_handlers, i8080_opcode_handlers, sizeof(fused_handlers));
+	I8080_FUSED_PAIRS(FUSED_ENTRY)
+#endif
 }
 
-uint8_t i8080_adi(intel8080_t *cpu)
-{
-	i8080_genadd(cpu, read8(cpu->registers.pc+1));
-	cpu->registers.pc+=2;
-	return CYCLES_ADI;
-}
+// A slice counts as idle when a repeated status read came at least this
+// often on average. Console input loops in the BIOS take under 30 T-states
+// per read, calls through the BDOS a few hundred.
+#define IDLE_POLL_CYCLES	256
 
-uint8_t i8080_adc(intel8080_t *cpu)
+// Sample of memory taken at every IN, which changes when a polling loop
+// writes memory. With page tracking it sums the write generations of all
+// pages; otherwise only the bytes addressed by HL, DE and BC are compared.
+static inline uint32_t i8080_poll_memory(const intel8080_t *cpu)
 {
-	uint8_t source = SOURCE(cpu->current_op_code);
-	uint16_t val = i8080_regread(cpu, source);
-
-	if(cpu->registers.flags & FLAGS_CARRY)
-		val++;
-	i8080_genadd(cpu, val);
-	cpu->registers.pc++;
-	return CYCLES_ADC;
-}
+#if MEMORY_PAGE_TRACKING
+	const altair_memory_t *mem = cpu->memory;
+	uint32_t sum = 0;
+	int page;
 
-uint8_t i8080_aci(intel8080_t *cpu)
-{
-	uint16_t val;
-	val = read8(cpu->registers.pc+1);
-	if(cpu->registers.flags & FLAGS_CARRY)
-		val++;
-	i8080_genadd(cpu, val);
-	cpu->registers.pc+=2;
-	return CYCLES_ACI;
-}
+	for(page = 0; page < 256; page++)
+		sum += mem->page_gen[page];
+	return sum;
+#else
+	const uint8_t *bytes = cpu->memory->bytes;
 
-uint8_t i8080_sub(intel8080_t *cpu)
-{
-	uint8_t source = SOURCE(cpu->current_op_code);
-	uint8_t val = i8080_regread(cpu, source);
-	i8080_gensub(cpu, val);
-	cpu->registers.pc++;
-	return CYCLES_SUB;
+	return bytes[cpu->registers.hl] | (uint32_t)bytes[cpu->registers.de] << 8 | (uint32_t)bytes[cpu->registers.bc] << 16;
+#endif
 }
 
-uint8_t i8080_sui(intel8080_t *cpu)
+static inline void i8080_mwrite(intel8080_t *cpu)
 {
-	i8080_gensub(cpu, read8(cpu->registers.pc+1));
-	cpu->registers.pc+=2;
-	return CYCLES_SUI;
+	cpu->cpuStatus &= ~(STATUS_MEMORY_READ);
+	write8(cpu->memory, cpu->address_bus, cpu->data_bus);
 }
 
-uint8_t i8080_sbb(intel8080_t *cpu)
+void i8080_examine(intel8080_t *cpu, uint16_t address)
 {
-	uint8_t source = SOURCE(cpu->current_op_code);
-	uint16_t val = i8080_regread(cpu, source);
-
-	if(cpu->registers.flags & FLAGS_CARRY)
-		val++;
-
-	i8080_gensub(cpu, val);
-	cpu->registers.pc++;
-	return CYCLES_SBB;
+	// Jump to the supplied address, which also takes the CPU out of a halt
+	cpu->halted = 0;
+	cpu->registers.pc = cpu->address_bus = address;
+	cpu->data_bus = read8(cpu->memory, cpu->address_bus);
 }
 
-uint8_t i8080_sbi(intel8080_t *cpu)
+void i8080_examine_next(intel8080_t *cpu)
 {
-	uint16_t val;
-	val = read8(cpu->registers.pc+1);
-	if(cpu->registers.flags & FLAGS_CARRY)
-		val++;
-	i8080_gensub(cpu, val);
-	cpu->registers.pc+=2;
-	return CYCLES_SBI;
+	cpu->address_bus++;
+	cpu->data_bus = read8(cpu->memory, cpu->address_bus);
 }
 
-uint8_t i8080_inr(intel8080_t *cpu)
+void i8080_deposit(intel8080_t *cpu, uint8_t data)
 {
-	uint8_t dest = DESTINATION(cpu->current_op_code);
-	uint8_t val = i8080_regread(cpu, dest);
-
-	i8080_update_flag_bit(cpu, FLAGS_H, CHECK_HALF_CARRY(val, 1));
-
-	i8080_regwrite(cpu, dest, val + 1);
-
-	i8080_update_flags(cpu, dest, FLAGS_ZERO | FLAGS_PARITY | FLAGS_SIGN | FLAGS_H);
-	cpu->registers.pc++;
-	return CYCLES_INR;
+	cpu->data_bus = data;
+	i8080_mwrite(cpu);
 }
 
-uint8_t i8080_dcr(intel8080_t *cpu)
+void i8080_deposit_next(intel8080_t *cpu, uint8_t data)
 {
-	uint8_t dest = DESTINATION(cpu->current_op_code);
-	uint8_t val = i8080_regread(cpu, dest);
-
-	i8080_update_flag_bit(cpu, FLAGS_H, CHECK_HALF_CARRY(val, 0xff));
-
-	i8080_regwrite(cpu, dest, val + 0xff);
-	i8080_update_flags(cpu, dest, FLAGS_ZERO | FLAGS_PARITY | FLAGS_SIGN | FLAGS_H);
-	cpu->registers.pc++;
-	return CYCLES_DCR;
+	i8080_examine_next(cpu);
+	cpu->data_bus = data;
+	i8080_mwrite(cpu);
 }
 
-uint8_t i8080_inx(intel8080_t *cpu)
+uint8_t i8080_sio_rx_ready(intel8080_t *cpu)
 {
-	uint8_t rp = RP(cpu->current_op_code);
-	i8080_pairwrite(cpu, rp, i8080_pairread(cpu, rp) + 1);
-	cpu->registers.pc++;
-	return CYCLES_INX;
+	if(!cpu->sio_rx)
+	{
+		I8080_COUNT(cpu, console_polls);
+		cpu->sio_rx = cpu->term_in(cpu->context);
+	}
+	return cpu->sio_rx != 0;
 }
 
-uint8_t i8080_dcx(intel8080_t *cpu)
+uint8_t i8080_port_in(intel8080_t *cpu, uint8_t port)
 {
-	uint8_t rp = RP(cpu->current_op_code);
-	cpu->registers.pc++;
-	i8080_pairwrite(cpu, rp, i8080_pairread(cpu, rp) - 1);
-	return CYCLES_DCX;
-}
+	const i8080_port_t *handler = &cpu->ports->port[port];
+	uint8_t data;
+	uint32_t memory_sample;
 
-uint8_t i8080_dad(intel8080_t *cpu)
-{
-	uint8_t rp = RP(cpu->current_op_code);
-	uint32_t val = i8080_pairread(cpu, rp);
-	val += i8080_pairread(cpu, PAIR_HL);
+	I8080_COUNT(cpu, port_in[port]);
+	data = handler->in(handler->context, port);
 
-	if(val > 0xffff)
-		i8080_set_flag(cpu, FLAGS_CARRY);
+	// A guest waiting for input or a timer reads the same status from the
+	// same IN over and over; i8080_run() counts the repeats to spot it. A
+	// loop that also counts down a timeout changes a register or memory
+	// between the reads and is not idle.
+	memory_sample = i8080_poll_memory(cpu);
+	if(cpu->registers.pc == cpu->poll_pc && port == cpu->poll_port && data == cpu->poll_value &&
+	   cpu->registers.bc == cpu->poll_bc && cpu->registers.de == cpu->poll_de &&
+	   cpu->registers.hl == cpu->poll_hl && cpu->registers.sp == cpu->poll_sp && memory_sample == cpu->poll_memory)
+	{
+		cpu->idle_polls++;
+	}
 	else
-		i8080_clear_flag(cpu, FLAGS_CARRY);
-
-	i8080_pairwrite(cpu, PAIR_HL, val & 0xffff);
-
-	cpu->registers.pc++;
-
-	return CYCLES_DAD;
-}
-
-uint8_t i8080_ana(intel8080_t *cpu)
-{
-	uint8_t source = SOURCE(cpu->current_op_code);
-
-	cpu->registers.a &= i8080_regread(cpu, source);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
-
-	cpu->registers.pc++;
-	return CYCLES_ANA;
-}
-
-uint8_t i8080_ani(intel8080_t *cpu)
-{
-	cpu->registers.a &= read8(cpu->registers.pc+1);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_clear_flag(cpu, FLAGS_H);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
-
-	cpu->registers.pc+=2;
-	return CYCLES_ANI;
-}
-
-uint8_t i8080_ora(intel8080_t *cpu)
-{
-	uint8_t source = SOURCE(cpu->current_op_code);
-
-	cpu->registers.a |= i8080_regread(cpu, source);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_clear_flag(cpu, FLAGS_H);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
-
-	cpu->registers.pc++;
-	return CYCLES_ORA;
-}
-
-uint8_t i8080_ori(intel8080_t *cpu)
-{
-	cpu->registers.a |= read8(cpu->registers.pc+1);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_clear_flag(cpu, FLAGS_H);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
+	{
+		cpu->poll_pc = cpu->registers.pc;
+		cpu->poll_port = port;
+		cpu->poll_value = data;
+		cpu->poll_bc = cpu->registers.bc;
+		cpu->poll_de = cpu->registers.de;
+		cpu->poll_hl = cpu->registers.hl;
+		cpu->poll_sp = cpu->registers.sp;
+		cpu->poll_memory = memory_sample;
+		cpu->idle_polls = 0;
+	}
 
-	cpu->registers.pc+=2;
-	return CYCLES_ORI;
+	return data;
 }
 
-uint8_t i8080_xra(intel8080_t *cpu)
+void i8080_port_out(intel8080_t *cpu, uint8_t port, uint8_t data)
 {
-	uint8_t source = SOURCE(cpu->current_op_code);
+	const i8080_port_t *handler = &cpu->ports->port[port];
 
-	cpu->registers.a ^= i8080_regread(cpu, source);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_clear_flag(cpu, FLAGS_H);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
+	cpu->idle_polls = 0;
 
-	cpu->registers.pc++;
-	return CYCLES_XRA;
+	I8080_COUNT(cpu, port_out[port]);
+	handler->out(handler->context, port, data);
 }
 
-uint8_t i8080_xri(intel8080_t *cpu)
+void i8080_cycle(intel8080_t *cpu)
 {
-	cpu->registers.a ^= read8(cpu->registers.pc+1);
-	i8080_clear_flag(cpu, FLAGS_CARRY);
-	i8080_clear_flag(cpu, FLAGS_H);
-	i8080_update_flags(cpu, REGISTER_A, FLAGS_ZERO | FLAGS_SIGN | FLAGS_PARITY | FLAGS_CARRY | FLAGS_H);
-
-	cpu->registers.pc+=2;
-	return CYCLES_XRI;
-}
+	uint8_t op_code;
 
-uint8_t i8080_ei(intel8080_t *cpu)
-{
-	cpu->registers.pc++;
-	i8080_set_flag(cpu, FLAGS_IF);
-	return CYCLES_EI;
-}
+	if(cpu->halted)
+	{
+		cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_HALT;
+		return;
+	}
 
-uint8_t i8080_di(intel8080_t *cpu)
-{
-	cpu->registers.pc++;
-	i8080_clear_flag(cpu, FLAGS_IF);
-	return CYCLES_DI;
-}
+	op_code = cpu->current_op_code = read8(cpu->memory, cpu->registers.pc);
 
-uint8_t i8080_xthl(intel8080_t *cpu)
-{
-	uint16_t temp = read16(cpu->registers.sp);
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH;
+	cpu->address_bus = cpu->registers.pc;
+	cpu->data_bus = op_code;
 
-	write16(cpu->registers.sp, cpu->registers.hl);
-	cpu->registers.hl = temp;
-	cpu->registers.pc++;
-	return CYCLES_XTHL;
+	cpu->events = 0;
+	cpu->cycles += i8080_opcode_handlers[op_code](cpu);
+	cpu->instructions++;
+	I8080_FLAGS_SYNC();
 }
 
-uint8_t i8080_sphl(intel8080_t *cpu)
+#if !I8080_USE_THREADED_CORE
+uint32_t i8080_run_jump_table(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
 {
-	cpu->registers.sp = cpu->registers.hl;
-	cpu->registers.pc++;
-	return CYCLES_SPHL;
-}
+	const altair_memory_t *mem = cpu->memory;
+	uint32_t elapsed = 0;
+	uint32_t count = 0;
 
-uint8_t i8080_in(intel8080_t *cpu)
-{
-	static uint8_t character = 0;
-	uint8_t port = read8(cpu->registers.pc + 1);
+	cpu->events = 0;
 
-	switch(port)
+	// The front panel only samples the bus, so it is updated once per slice
+	// rather than on every fetch.
+	do
 	{
-	case 0x00:
-		cpu->registers.a = 0x00;
-		break;
-	case 0x1:
-		cpu->cpuStatus |= STATUS_PORT_INPUT;
-		cpu->registers.a = cpu->term_in();
-		// cpu->term_out(cpu->registers.a);
-		break;
-	case 0x8:
-		cpu->registers.a = cpu->disk_controller.disk_status();
-		break;
-	case 0x9:
-		cpu->registers.a = cpu->disk_controller.sector();
-		break;
-	case 0xa:
-		cpu->registers.a = cpu->disk_controller.read();
-		break;
-	case 0x10: // 2SIO port 1, status
-		cpu->registers.a = 0x2; // bit 1 == transmit buffer empty
-		if(!character)
-		{
-			character = cpu->term_in();
-		}
-		if(character)
-		{
-			cpu->registers.a |= 0x1;
-		}
-		break;
-	case 0x11: // 2SIO port 1, read
-		if(character)
-		{
-			cpu->registers.a = character;
-			character = 0;
-		}
+		uint8_t op_code = cpu->current_op_code = read8(mem, cpu->registers.pc);
+#if I8080_USE_PAIR_PROFILE
+		pair_counts[pair_prev][op_code]++;
+		pair_prev = op_code;
+#endif
+#if I8080_USE_FUSION
+		// Close to the end of the slice the loop may have to stop between
+		// the two instructions of a pair, so only single ones run there
+		if(cycle_budget - elapsed > FUSION_MAX_FIRST_CYCLES)
+			elapsed += fused_handlers[op_code](cpu);
 		else
+#endif
+#if I8080_USE_CALL_PROFILE
 		{
-			cpu->registers.a = cpu->term_in();
+			uint8_t t_cycles = i8080_opcode_handlers[op_code](cpu);
+			elapsed += t_cycles;
+			cpu->cycles += t_cycles;
 		}
-		break;
-	case 0xff: // Front panel switches
-		cpu->registers.a = cpu->sense();
-		break;
-	default:
-		cpu->registers.a = 0xff;
-		cpu->registers.a = cpu->io_port_in_handler(port);
-		//printf("IN PORT %x\n", cpu->data_bus);
-		break;
-	}
-
-	cpu->registers.pc+=2;
-	return CYCLES_IN;
-}
-
-uint8_t i8080_out(intel8080_t *cpu)
-{
-	uint8_t port = read8(cpu->registers.pc + 1);
-	switch(port)
-	{
-	case 0x1:
-		cpu->cpuStatus |= STATUS_PORT_OUTPUT;
-		cpu->term_out(cpu->registers.a);
-		break;
-	case 0x8:
-		cpu->disk_controller.disk_select(cpu->registers.a);
-		break;
-	case 0x9:
-		cpu->disk_controller.disk_function(cpu->registers.a);
-		break;
-	case 0xa:
-		cpu->disk_controller.write(cpu->registers.a);
-		break;
-	case 0x10:  // 2SIO port 1 control
-		break;
-	case 0x11: // 2sio port 1 write
-		cpu->term_out(cpu->registers.a);
-		break;
-	default:
-		cpu->io_port_out_handler(port, cpu->registers.a);
-		// printf("OUT PORT %x, DATA: %x\n", read8(cpu->registers.pc + 1), cpu->registers.a);
-		break;
-	}
-	cpu->registers.pc+=2;
-	return CYCLES_OUT;
-}
-
-uint8_t i8080_push(intel8080_t *cpu)
-{
-	cpu->cpuStatus |= STATUS_STACK;
-	uint8_t pair = RP(cpu->current_op_code);
-	uint16_t val;
-
-	if(pair == PAIR_SP)
-		val = cpu->registers.af;
-	else
-		val = i8080_pairread(cpu, pair);
-
-	cpu->registers.sp-=2;
-	write16(cpu->registers.sp, val);
-
-	cpu->registers.pc++;
-	return CYCLES_PUSH;
-}
-
-uint8_t i8080_pop(intel8080_t *cpu)
-{
-	cpu->cpuStatus |= STATUS_STACK;
-	uint8_t pair = RP(cpu->current_op_code);
-	uint16_t val = read16(cpu->registers.sp);
-	cpu->registers.sp+=2;
-	if(pair == PAIR_SP)
-		cpu->registers.af = val;
-	else
-		i8080_pairwrite(cpu, pair, val);
+#else
+		elapsed += i8080_opcode_handlers[op_code](cpu);
+#endif
+		count++;
+	} while (elapsed < cycle_budget && !(cpu->events & stop_flags));
 
-	cpu->registers.pc++;
-	return CYCLES_POP;
-}
+	I8080_FLAGS_SYNC();
+#if !I8080_USE_CALL_PROFILE
+	cpu->cycles += elapsed;
+#endif
+	cpu->instructions += count;
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH;
+	cpu->address_bus = cpu->registers.pc;
+	cpu->data_bus = read8(mem, cpu->registers.pc);
 
-uint8_t i8080_stc(intel8080_t *cpu)
-{
-	i8080_set_flag(cpu, FLAGS_CARRY);
-	cpu->registers.pc++;
-	return CYCLES_STC;
+	return elapsed;
 }
+#endif
 
-uint8_t i8080_cmc(intel8080_t *cpu)
+#if !I8080_USE_THREADED_CORE && !I8080_USE_BLOCK_CACHE && !I8080_USE_JIT
+uint32_t i8080_run_core(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
 {
-	cpu->registers.flags ^= FLAGS_CARRY;
-	cpu->registers.pc++;
-	return CYCLES_CMC;
+	return i8080_run_jump_table(cpu, cycle_budget, stop_flags);
 }
+#endif
 
-uint8_t i8080_rlc(intel8080_t *cpu)
+void i8080_interrupt(intel8080_t *cpu, uint8_t vector)
 {
-	uint8_t high_bit = cpu->registers.a & 0x80;
+	cpu->interrupt_requests |= (uint8_t)(1 << (vector & 7));
 
-	cpu->registers.a <<= 1;
-	if(high_bit)
+	// Raised from a port handler, the request is taken once the running
+	// instruction has finished rather than at the end of the slice
+	if(cpu->registers.flags & FLAGS_IF)
 	{
-		i8080_set_flag(cpu, FLAGS_CARRY);
-		cpu->registers.a |= 1;
+		cpu->events |= I8080_EVENT_INTERRUPT;
 	}
-	else
-	{
-		i8080_clear_flag(cpu, FLAGS_CARRY);
-		cpu->registers.a &= ~1;
-	}
-
-	cpu->registers.pc++;
-	return CYCLES_RAL;
 }
 
-uint8_t i8080_rrc(intel8080_t *cpu)
+// Takes the lowest pending request if interrupts are enabled: the CPU leaves
+// any halt, disables interrupts and runs the RST the device puts on the bus.
+static uint32_t i8080_interrupt_accept(intel8080_t *cpu)
 {
-	uint8_t low_bit = cpu->registers.a & 1;
-
-	cpu->registers.a >>= 1;
+	uint8_t vector = 0;
 
-	if(low_bit)
+	if(!cpu->interrupt_requests || !(cpu->registers.flags & FLAGS_IF))
 	{
-		i8080_set_flag(cpu, FLAGS_CARRY);
-		cpu->registers.a |= 0x80;
+		return 0;
 	}
-	else
+	while(!(cpu->interrupt_requests & (1 << vector)))
 	{
-		cpu->registers.a &= ~0x80;
-		i8080_clear_flag(cpu, FLAGS_CARRY);
+		vector++;
 	}
+	cpu->interrupt_requests &= (uint8_t)~(1 << vector);
+	cpu->registers.flags &= ~FLAGS_IF;
+	cpu->halted = 0;
+	cpu->registers.sp -= 2;
+	write16(cpu->memory, cpu->registers.sp, cpu->registers.pc);
+#if I8080_USE_CALL_PROFILE
+	if(cpu->call_hooks)
+		cpu->call_hooks->call(cpu->call_hooks->context, cpu->registers.pc, vector * 8, cpu->registers.sp, cpu->cycles);
+#endif
+	cpu->registers.pc = vector * 8;
+	cpu->cycles += CYCLES_RST;
+	cpu->instructions++;
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH | STATUS_INTERRUPT;
+	cpu->address_bus = cpu->registers.pc;
+	cpu->data_bus = read8(cpu->memory, cpu->registers.pc);
 
-	cpu->registers.pc++;
-	return CYCLES_RAR;
-}
-
-uint8_t i8080_ral(intel8080_t *cpu)
-{
-	uint8_t high_bit = cpu->registers.a & 0x80;
-	cpu->registers.a <<= 1;
-
-	if(cpu->registers.flags & FLAGS_CARRY)
-		cpu->registers.a |= 1;
-	else
-		cpu->registers.a &= ~1;
-
-	if(high_bit)
-		i8080_set_flag(cpu, FLAGS_CARRY);
-	else
-		i8080_clear_flag(cpu, FLAGS_CARRY);
-
-	cpu->registers.pc++;
-	return CYCLES_RLC;
-}
-
-uint8_t i8080_rar(intel8080_t *cpu)
-{
-	uint8_t low_bit = cpu->registers.a & 1;
-
-	cpu->registers.a >>= 1;
-
-	if(cpu->registers.flags & FLAGS_CARRY)
-		cpu->registers.a |= 0x80;
-	else
-		cpu->registers.a &= ~0x80;
-
-	if(low_bit)
-		i8080_set_flag(cpu, FLAGS_CARRY);
-	else
-		i8080_clear_flag(cpu, FLAGS_CARRY);
-
-	cpu->registers.pc++;
-	return CYCLES_RRC;
-}
-
-uint8_t i8080_jmp(intel8080_t *cpu)
-{
-	cpu->registers.pc = read16(cpu->registers.pc+1);
-	return CYCLES_JMP;
+	return CYCLES_RST;
 }
 
-uint8_t i8080_jccc(intel8080_t *cpu)
+#if I8080_USE_PC_TRAPS
+int i8080_trap_set(intel8080_t *cpu, uint16_t address, i8080_trap_fn fn, void *context)
 {
-	uint8_t condition = CONDITION(cpu->current_op_code);
+	uint8_t i = 0;
 
-	if(i8080_check_condition(cpu, condition))
+	while(i < cpu->trap_count && cpu->traps[i].address != address)
 	{
-		i8080_jmp(cpu);
+		i++;
 	}
-	else
+	if(i == I8080_MAX_TRAPS)
 	{
-		cpu->registers.pc+=3;
+		return -1;
 	}
-
-	return CYCLES_JMP;
-}
-
-uint8_t i8080_ret(intel8080_t *cpu)
-{
-	cpu->cpuStatus |= STATUS_STACK;
-	cpu->registers.pc = read16(cpu->registers.sp);
-	cpu->registers.sp+=2;
-	return CYCLES_RET;
+	if(i == cpu->trap_count)
+	{
+		cpu->trap_count++;
+	}
+	cpu->traps[i].address = address;
+	cpu->traps[i].fn = fn;
+	cpu->traps[i].context = context;
+	cpu->trap_map[address >> 3] |= (uint8_t)(1 << (address & 7));
+#if I8080_USE_JIT
+	// Translated code may already be linked straight to the address
+	i8080_jit_flush(cpu->code_cache);
+#endif
+	return 0;
 }
 
-uint8_t i8080_rccc(intel8080_t *cpu)
+void i8080_trap_clear(intel8080_t *cpu, uint16_t address)
 {
-	uint8_t condition = CONDITION(cpu->current_op_code);
-
-	if(i8080_check_condition(cpu, condition))
+	for(uint8_t i = 0; i < cpu->trap_count; i++)
 	{
-		i8080_ret(cpu);
-	}
-	else
-	{
-		cpu->registers.pc++;
+		if(cpu->traps[i].address == address)
+		{
+			cpu->traps[i] = cpu->traps[--cpu->trap_count];
+			cpu->trap_map[address >> 3] &= (uint8_t)~(1 << (address & 7));
+			return;
+		}
 	}
-	return CYCLES_RET;
 }
 
-uint8_t i8080_rst(intel8080_t *cpu)
+void i8080_trap_return(intel8080_t *cpu)
 {
-	cpu->cpuStatus |= STATUS_STACK;
-	uint8_t vec = DESTINATION(cpu->current_op_code);
-
-	cpu->registers.sp-=2;
-	write16(cpu->registers.sp, cpu->registers.pc + 1);
-
-	cpu->registers.pc = vec*8;
-
-	return CYCLES_RET;
+#if I8080_USE_CALL_PROFILE
+	if(cpu->call_hooks)
+		cpu->call_hooks->ret(cpu->call_hooks->context, cpu->registers.sp, cpu->cycles);
+#endif
+	cpu->registers.pc = read16(cpu->memory, cpu->registers.sp);
+	cpu->registers.sp += 2;
 }
 
-uint8_t i8080_call(intel8080_t *cpu)
+// Runs the handler of the trap at PC, or the instruction there if the handler
+// leaves it to the guest. The return from a handler may land on another trap,
+// as may the instruction.
+static uint32_t i8080_trap_run(intel8080_t *cpu)
 {
-	cpu->cpuStatus |= STATUS_STACK;
-	cpu->registers.sp-=2;
-	write16(cpu->registers.sp, cpu->registers.pc + 3);
+	uint32_t elapsed = 0;
+
+	while(cpu->events & I8080_EVENT_TRAP)
+	{
+		uint16_t pc = cpu->registers.pc;
+		uint8_t enabled = cpu->registers.flags & FLAGS_IF;
+		uint32_t cycles = 0;
 
-	cpu->registers.pc = read16(cpu->registers.pc + 1);
-	return CYCLES_JMP;
+		cpu->events &= ~I8080_EVENT_TRAP;
+		for(uint8_t i = 0; i < cpu->trap_count; i++)
+		{
+			if(cpu->traps[i].address == pc)
+			{
+				cycles = cpu->traps[i].fn(cpu->traps[i].context, cpu);
+				break;
+			}
+		}
+		if(cycles)
+		{
+			if(I8080_TRAPPED(cpu, cpu->registers.pc))
+				cpu->events |= I8080_EVENT_TRAP;
+			if((cpu->registers.flags & FLAGS_IF) && !enabled)
+				cpu->events |= I8080_EVENT_INTERRUPT;
+		}
+		else
+		{
+			cpu->current_op_code = read8(cpu->memory, pc);
+			cycles = i8080_opcode_handlers[cpu->current_op_code](cpu);
+			I8080_FLAGS_SYNC();
+		}
+		cpu->cycles += cycles;
+		cpu->instructions++;
+		elapsed += cycles;
+	}
+	return elapsed;
 }
+#endif
 
-uint8_t i8080_cccc(intel8080_t *cpu)
+uint32_t i8080_run(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
 {
-	uint8_t condition = CONDITION(cpu->current_op_code);
+	uint32_t elapsed = i8080_interrupt_accept(cpu);
 
-	if(i8080_check_condition(cpu, condition))
+	cpu->events = 0;
+	cpu->idle_polls = 0;
+	while(!cpu->halted && elapsed < cycle_budget)
 	{
-		i8080_call(cpu);
+		elapsed += i8080_run_core(cpu, cycle_budget - elapsed, stop_flags | I8080_CORE_STOPS);
+#if I8080_USE_PC_TRAPS
+		if(cpu->events & I8080_EVENT_TRAP)
+			elapsed += i8080_trap_run(cpu);
+#endif
+		if(cpu->events & I8080_EVENT_INTERRUPT)
+		{
+			// EI takes effect after the instruction that follows it, which
+			// therefore runs even when the budget has been used up
+			while((cpu->events & I8080_EVENT_INTERRUPT) && !(cpu->events & stop_flags) && !cpu->halted)
+			{
+				elapsed += i8080_run_core(cpu, 1, stop_flags | I8080_CORE_STOPS);
+#if I8080_USE_PC_TRAPS
+				if(cpu->events & I8080_EVENT_TRAP)
+					elapsed += i8080_trap_run(cpu);
+#endif
+			}
+			elapsed += i8080_interrupt_accept(cpu);
+			cpu->events &= stop_flags;
+		}
+		if(cpu->events & stop_flags)
+			break;
+#if I8080_USE_LOOP_IDIOMS
+		if((cpu->events & I8080_EVENT_LOOP) && elapsed < cycle_budget)
+			elapsed += i8080_loop_run(cpu, cycle_budget - elapsed);
+#endif
 	}
-	else
+	cpu->events &= ~I8080_EVENT_LOOP;
+
+	// A halted 8080 does nothing until it is woken, so the rest of the slice
+	// passes at once; hosts check halted to sleep instead of calling again
+	if(cpu->halted)
 	{
-		cpu->registers.pc+=3;
+		if(elapsed < cycle_budget && !(cpu->events & stop_flags))
+		{
+			cpu->cycles += cycle_budget - elapsed;
+			elapsed = cycle_budget;
+		}
+		cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_HALT;
 	}
 
-	return CYCLES_CALL;
-}
+	// Idle if the slice did little but read an unchanging status
+	cpu->idle = !cpu->halted && elapsed <= cpu->idle_polls * IDLE_POLL_CYCLES;
 
-uint8_t i8080_pchl(intel8080_t *cpu)
-{
-	cpu->registers.pc = cpu->registers.hl;
-	return CYCLES_PCHL;
-}
-
-uint8_t i8080_nop(intel8080_t *cpu)
-{
-	cpu->registers.pc++;
-
-	return CYCLES_NOP;
+	return elapsed;
 }
 
-uint8_t i8080_cma(intel8080_t *cpu)
+#if !I8080_USE_BLOCK_CACHE && !I8080_USE_JIT
+i8080_code_cache_t *i8080_code_cache_create(void)
 {
-	cpu->registers.a = ~cpu->registers.a;
-	cpu->registers.pc++;
-
-	return CYCLES_CMA;
-}
-
-uint8_t i8080_cmp(intel8080_t *cpu)
-{
-	uint8_t reg = SOURCE(cpu->current_op_code);
-
-	i8080_compare(cpu, i8080_regread(cpu, reg));
-
-	cpu->registers.pc++;
-	return CYCLES_CMP;
+	return NULL;
 }
 
-uint8_t i8080_cpi(intel8080_t *cpu)
+void i8080_code_cache_destroy(i8080_code_cache_t *cache)
 {
-	i8080_compare(cpu, read8(cpu->registers.pc+1));
-	cpu->registers.pc+=2;
-	return CYCLES_CPI;
+	(void)cache;
 }
+#endif
 
-void i8080_fetch_next_op(intel8080_t *cpu)
+#if !I8080_USE_BLOCK_CACHE
+void i8080_block_cache_stats(const i8080_code_cache_t *cache, i8080_block_stats_t *stats)
 {
-	cpu->address_bus = cpu->registers.pc;
-	i8080_mread(cpu);
+	(void)cache;
+	memset(stats, 0, sizeof(*stats));
 }
+#endif
 
-uint8_t i8080_daa(intel8080_t *cpu)
+#if !I8080_USE_JIT
+void i8080_jit_stats(const i8080_code_cache_t *cache, i8080_jit_stats_t *stats)
 {
-	uint8_t val, add = 0;
-	val = i8080_regread(cpu, REGISTER_A);
-
-	if((val & 0xf) > 9 || cpu->registers.flags & FLAGS_H)
-		add += 0x06;
-
-	val += add;
-
-	if(((val & 0xf0) >> 4) > 9 || cpu->registers.flags & FLAGS_CARRY)
-		add += 0x60;
-
-	i8080_genadd(cpu, add);
-
-	cpu->registers.pc++;
-	return CYCLES_DAA;
+	(void)cache;
+	memset(stats, 0, sizeof(*stats));
 }
 
-void i8080_cycle(intel8080_t *cpu)
+int i8080_jit_set_lockstep(i8080_code_cache_t *cache, int enable)
 {
-	cpu->cpuStatus = 0;
-	i8080_fetch_next_op(cpu);
-
-	uint8_t op_code = cpu->current_op_code = cpu->data_bus;
-	uint8_t (*handler)(intel8080_t *) = opcode_handlers[op_code];
-	
-	if (LIKELY(handler != NULL)) {
-		handler(cpu);
-	} else {
-		// Handle undefined opcodes (NOP behavior)
-		cpu->registers.pc++;
-	}
+	(void)cache;
+	(void)enable;
+	return -1;
 }
+#endif
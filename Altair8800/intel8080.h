@@ -10,46 +10,69 @@
 #define FLAGS_ZERO		64
 #define FLAGS_SIGN		128
 
+// Events raised by instruction handlers. Pass a mask of these to i8080_run()
+// to return at the end of the instruction that raised them.
+#define I8080_STOP_IO		0x01	// IN or OUT executed
+#define I8080_STOP_HALT		0x02	// HLT executed
+
+// Byte offsets of the 8-bit registers in registers_t.r8
+#define I8080_R8_F	0
+#define I8080_R8_A	1
+#define I8080_R8_C	2
+#define I8080_R8_B	3
+#define I8080_R8_E	4
+#define I8080_R8_D	5
+#define I8080_R8_L	6
+#define I8080_R8_H	7
+
 typedef struct
 {
 	union
 	{
-		uint16_t af;
-
-		struct {
-			uint8_t flags;
-			uint8_t a;
-		};
-	};
+		uint8_t r8[8];	// flat view indexed by I8080_R8_*
 
-	union
-	{
-		uint16_t bc;
 		struct
 		{
-			uint8_t c;
-			uint8_t b;
-		};
-	};
+			union
+			{
+				uint16_t af;
 
-	union
-	{
-		uint16_t de;
-		struct
-		{
-			uint8_t e;
-			uint8_t d;
+				struct {
+					uint8_t flags;
+					uint8_t a;
+				};
+			};
 
-		};
-	};
+			union
+			{
+				uint16_t bc;
+				struct
+				{
+					uint8_t c;
+					uint8_t b;
+				};
+			};
 
-	union
-	{
-		uint16_t hl;
-		struct
-		{
-			uint8_t l;
-			uint8_t h;
+			union
+			{
+				uint16_t de;
+				struct
+				{
+					uint8_t e;
+					uint8_t d;
+
+				};
+			};
+
+			union
+			{
+				uint16_t hl;
+				struct
+				{
+					uint8_t l;
+					uint8_t h;
+				};
+			};
 		};
 	};
 
@@ -57,15 +80,48 @@ typedef struct
 	uint16_t pc;
 } registers_t;
 
-typedef void (*io_port_out_fn)(uint8_t port, uint8_t data);
-typedef uint8_t (*io_port_in_fn)(uint8_t port);
+// Flag state left pending by the lazy-flags core (I8080_LAZY_FLAGS). Outside
+// i8080_run() and i8080_cycle() nothing is pending and registers.flags is exact.
+typedef struct
+{
+	uint8_t pending;	// flag bits still to be derived from result/aux
+	uint8_t result;		// result of the last ALU op
+	uint8_t aux;		// XOR of its addends, for half carry
+} i8080_lazy_flags_t;
+
+struct altair_memory;
+
+// Device callbacks get the context passed to i8080_reset(), or for the disk
+// controller and the I/O ports their own, so one process can run several
+// machines.
+typedef void (*io_port_out_fn)(void *context, uint8_t port, uint8_t data);
+typedef uint8_t (*io_port_in_fn)(void *context, uint8_t port);
+
+typedef void (*port_out)(void *context, uint8_t b);
+typedef uint8_t (*port_in)(void *context);
+typedef uint8_t (*read_sense_switches)(void *context);
+
+// An I/O port's handlers and the context they are given
+typedef struct
+{
+	io_port_in_fn in;
+	io_port_out_fn out;
+	void *context;
+} i8080_port_t;
 
-typedef void (*port_out)(uint8_t b);
-typedef uint8_t (*port_in)(void);
-typedef uint8_t (*read_sense_switches)(void);
+// A machine's I/O ports, one entry per port number, so that IN and OUT are a
+// single indexed call. Devices register their ports once, when the machine
+// is set up; i8080_reset() then takes the CPU's own: 00 (reads 0), the
+// console at 01, the disk controller at 08-0A, the 2SIO port 1 at 10-11 and
+// the sense switches at FF.
+typedef struct
+{
+	i8080_port_t port[256];
+} i8080_ports_t;
 
 typedef struct
 {
+	void *context;
 	port_out disk_select;
 	port_in	disk_status;
 	port_out disk_function;
@@ -74,7 +130,67 @@ typedef struct
 	port_in read;
 } disk_controller_t;
 
+// Decoded or translated code of the block cache (I8080_BLOCK_CACHE) or the
+// recompiler (I8080_JIT), see i8080_code_cache_create()
+typedef struct i8080_code_cache i8080_code_cache_t;
+
+// Told of every CALL, RST, interrupt and RET in an I8080_CALL_PROFILE build,
+// with the T-states run since reset when the instruction started. sp is the
+// stack pointer after the push, or before the pop, so the return address is
+// the word at sp either way.
+typedef void (*i8080_call_fn)(void *context, uint16_t site, uint16_t target, uint16_t sp, uint64_t now);
+typedef void (*i8080_return_fn)(void *context, uint16_t sp, uint64_t now);
+
 typedef struct
+{
+	i8080_call_fn call;
+	i8080_return_fn ret;
+	void *context;
+} i8080_call_hooks_t;
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+#define I8080_MAX_TRAPS	16
+
+struct intel8080;
+
+// Runs host code in place of the guest's at a trapped address, see
+// i8080_trap_set(). Returns the T-states to charge for it, having left the
+// registers and memory as the guest code would have, the return to its caller
+// included; or 0, changing nothing, to run the guest code after all.
+typedef uint32_t (*i8080_trap_fn)(void *context, struct intel8080 *cpu);
+
+typedef struct
+{
+	uint16_t address;
+	i8080_trap_fn fn;
+	void *context;
+} i8080_trap_t;
+#endif
+
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+// Hot-path counters of an ALTAIR_COUNTERS build, kept in each CPU so that
+// machines on different threads never share their cache lines. See
+// counters.h for the reports.
+typedef struct
+{
+	uint64_t opcodes[256];		// instructions interpreted, per opcode
+	uint64_t port_in[256];		// INs per port, the disk controller's 08-0A included
+	uint64_t port_out[256];
+	uint64_t loop_instructions;	// run as native loops (I8080_LOOP_IDIOMS), so in no opcode count
+	uint64_t console_polls;		// calls to the terminal input callback
+	uint64_t sectors_read;		// 88-DCDD sectors the guest read data from
+	uint64_t sectors_written;	// write enables, each starting a sector write
+	uint8_t sector_unread;		// the sector position was read, but no data byte since
+} i8080_counters_t;
+
+#define I8080_COUNT(cpu, counter)		((cpu)->counters.counter++)
+#define I8080_COUNT_N(cpu, counter, n)	((cpu)->counters.counter += (n))
+#else
+#define I8080_COUNT(cpu, counter)		((void)0)
+#define I8080_COUNT_N(cpu, counter, n)	((void)0)
+#endif
+
+typedef struct intel8080
 {
 	uint8_t data_bus;
 	uint16_t address_bus;
@@ -82,20 +198,61 @@ typedef struct
 	uint8_t current_op_code;
 
 	registers_t registers;
+	i8080_lazy_flags_t lazy_flags;
+
+	struct altair_memory *memory;	// fixed while i8080_run() runs
+	i8080_code_cache_t *code_cache;	// set after i8080_reset(), or NULL
+	void *context;		// passed to the terminal and sense switch callbacks
 
-	io_port_in_fn io_port_in_handler;
-	io_port_out_fn io_port_out_handler;
+	i8080_ports_t *ports;	// given to i8080_reset(), fixed while i8080_run() runs
 
 	port_in term_in;
 	port_out term_out;
 	read_sense_switches sense;
 	uint8_t cpuStatus;
+	uint8_t events;
+	uint8_t halted;		// set by HLT, cleared by an interrupt, i8080_reset() or i8080_examine()
+	uint8_t interrupt_requests;	// RST vectors requested by devices, bit n for RST n
+	uint8_t sio_rx;		// character received by the 2SIO port 1 and not yet read, or 0
+	uint8_t idle;		// set by i8080_run() when the slice only polled an unchanging status
+
+	uint16_t poll_pc;		// last IN, to recognise status polling loops
+	uint8_t poll_port;
+	uint8_t poll_value;
+	uint16_t poll_bc;		// register pairs at that IN
+	uint16_t poll_de;
+	uint16_t poll_hl;
+	uint16_t poll_sp;
+	uint32_t poll_memory;	// memory sample at that IN, see i8080_port_in()
+	uint32_t idle_polls;	// repeats of that IN in the current slice
 
 	disk_controller_t disk_controller;
+	i8080_call_hooks_t *call_hooks;	// I8080_CALL_PROFILE only; NULL after i8080_reset()
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+	uint8_t trap_map[64 * 1024 / 8];	// a bit per address, set for those in traps[]
+	i8080_trap_t traps[I8080_MAX_TRAPS];
+	uint8_t trap_count;
+#endif
+
+	uint64_t cycles;		// T-states executed since reset
+	uint64_t instructions;	// Instructions executed since reset
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+	i8080_counters_t counters;	// since reset
+#endif
 } intel8080_t;
 
-void i8080_reset(intel8080_t *cpu, port_in in, port_out out, read_sense_switches sense,
-		 disk_controller_t *disk_controller, io_port_in_fn io_in, io_port_out_fn io_out);
+// The CPU keeps no state outside *cpu, *memory and its code cache, so several
+// can run at once on different threads. i8080_reset() clears code_cache.
+void i8080_reset(intel8080_t *cpu, struct altair_memory *memory, void *context, port_in in, port_out out,
+		 read_sense_switches sense, disk_controller_t *disk_controller, i8080_ports_t *ports);
+
+// Leaves every port without a device: IN reads 0 and OUT does nothing
+void i8080_ports_init(i8080_ports_t *ports);
+
+// Gives ports first to last to a device. A NULL handler leaves that
+// direction without one.
+void i8080_ports_register(i8080_ports_t *ports, uint8_t first, uint8_t last, io_port_in_fn in, io_port_out_fn out,
+			  void *context);
 void i8080_deposit(intel8080_t *cpu, uint8_t data);
 void i8080_deposit_next(intel8080_t *cpu, uint8_t data);
 
@@ -104,4 +261,98 @@ void i8080_examine_next(intel8080_t *cpu);
 
 void i8080_cycle(intel8080_t *cpu);
 
+// Request an interrupt with RST vector (0-7), as a device wired to the 88-VI
+// vectored interrupt board does. The request is held until the CPU accepts
+// it with interrupts enabled, lowest vector first, which also ends a halt.
+// Call it from the thread that runs the CPU, between runs or from a port
+// handler.
+void i8080_interrupt(intel8080_t *cpu, uint8_t vector);
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+// Calls fn whenever a jump, call, return or RST lands on address, before the
+// instruction there runs (I8080_PC_TRAPS only). Code that runs on into the
+// address from the instruction before it need not fire the trap, so traps
+// belong on entry points. Setting an address again replaces its handler.
+// Returns 0, or -1 if I8080_MAX_TRAPS are set already. i8080_reset() clears
+// every trap.
+int i8080_trap_set(intel8080_t *cpu, uint16_t address, i8080_trap_fn fn, void *context);
+void i8080_trap_clear(intel8080_t *cpu, uint16_t address);
+
+// Pops PC as RET does, for a trap handler that stands in for a routine. A
+// handler that sets FLAGS_IF has interrupts taken as after EI and RET.
+void i8080_trap_return(intel8080_t *cpu);
+#endif
+
+// IN and OUT as the instructions do them, through the machine's ports, for
+// trap handlers that stand in for guest I/O
+uint8_t i8080_port_in(intel8080_t *cpu, uint8_t port);
+void i8080_port_out(intel8080_t *cpu, uint8_t port, uint8_t data);
+
+// Nonzero if the 2SIO port 1 has a received character waiting, reading the
+// terminal for one if none is buffered
+uint8_t i8080_sio_rx_ready(intel8080_t *cpu);
+
+// The block cache and recompiler keep what they decode in a code cache, one
+// per CPU, which the caller creates and sets in cpu->code_cache after every
+// i8080_reset(). A CPU without one runs in the jump-table core. Returns NULL
+// if neither core is built in or memory runs out. A cache belongs to the
+// memory of the last CPU that ran with it and is emptied when that changes.
+i8080_code_cache_t *i8080_code_cache_create(void);
+void i8080_code_cache_destroy(i8080_code_cache_t *cache);
+
+// Counters of the basic-block cache (I8080_BLOCK_CACHE); all zero without it
+// or for a NULL cache.
+typedef struct
+{
+	uint64_t hits;			// block lookups served from the cache
+	uint64_t misses;		// lookups that had to decode a block
+	uint64_t invalidations;	// cached blocks dropped because their page was written
+} i8080_block_stats_t;
+
+void i8080_block_cache_stats(const i8080_code_cache_t *cache, i8080_block_stats_t *stats);
+
+// Counters of the dynamic recompiler (I8080_JIT); all zero without it or for
+// a NULL cache.
+typedef struct
+{
+	uint64_t translations;		// blocks translated to native code
+	uint64_t native_entries;	// calls from i8080_run() into native code
+	uint64_t links;			// block exits patched to jump straight to their target
+	uint64_t interpreted;		// instructions run by the interpreter instead
+	uint64_t invalidations;		// translations dropped because their page was written
+	uint64_t flushes;			// times the code buffer filled up and was emptied
+	uint64_t lockstep_checks;	// native runs compared against the interpreter
+	uint64_t lockstep_mismatches;
+} i8080_jit_stats_t;
+
+void i8080_jit_stats(const i8080_code_cache_t *cache, i8080_jit_stats_t *stats);
+
+// Rerun every block the cache translates in the interpreter and compare the
+// results (I8080_JIT only). Mismatches are reported on stderr and the
+// interpreter's result is kept. Returns 0, or -1 if the recompiler is not
+// built in or cache is NULL.
+int i8080_jit_set_lockstep(i8080_code_cache_t *cache, int enable);
+
+// Write intel8080_fusion.h for the superinstruction pairs measured so far
+// (I8080_PAIR_PROFILE only). Returns 0 on success, -1 if path could not be
+// written or profiling is not built in.
+int i8080_pair_profile_write(const char *path);
+
+// Instructions executed so far per opcode, from the pair counters
+// (I8080_PAIR_PROFILE only). Returns 0, or -1 with counts zeroed if they are
+// not built in.
+int i8080_opcode_counts(uint64_t counts[256]);
+
+// Run instructions until at least cycle_budget T-states have elapsed or an
+// event in stop_flags is raised. Returns the number of T-states executed.
+// HLT leaves the CPU halted with PC past it; the rest of the budget and every
+// later run then pass as idle T-states until the CPU is woken. Pending
+// interrupts are taken on entry and after any instruction that enables or
+// requests them. Hosts may sleep when it leaves idle set, as the guest then
+// waits in a loop for input or a timer. A loop counts as idle only while its
+// status reads see the same value and registers; memory is compared by page
+// write counts where the block cache or JIT keep them, and otherwise only at
+// the bytes BC, DE and HL address.
+uint32_t i8080_run(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags);
+
 #endif
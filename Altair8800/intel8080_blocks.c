@@ -0,0 +1,303 @@
+// Basic-block cache core, selected with I8080_BLOCK_CACHE.
+//
+// Straight-line runs of instructions are decoded once into a block holding,
+// for each instruction, the label of its body and its operand bytes. A block
+// ends at a branch, RST, HLT or I/O instruction, at MAX_BLOCK_OPS or at the
+// end of its 256-byte page. Blocks are found by start address and checked
+// against the page generation of their page, so any write to the page drops
+// them. Each CPU has its own cache, which belongs to the memory it was
+// decoded from and is emptied when a CPU with other memory runs. A block that writes into its own page
+// stops right after that instruction and the rest is decoded again.
+#include "intel8080_ops.h"
+
+#if I8080_USE_BLOCK_CACHE
+
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_CACHE_SIZE	4096	// direct-mapped on the start address
+#define MAX_BLOCK_OPS		32
+
+#define BLOCK_END			0x80	// op_info flag: instruction ends a block
+#define BLOCK_LEN_MASK		0x03	// op_info: instruction length in bytes
+
+typedef struct
+{
+	const void *body;		// label of the instruction body in i8080_run_core
+	uint16_t imm;			// operand bytes, low byte first
+} block_op_t;
+
+typedef struct
+{
+	uint32_t gen;			// page_gen[] of the page when decoded
+	uint16_t start;
+	uint8_t valid;
+	uint8_t count;			// instructions in ops[]
+	block_op_t ops[MAX_BLOCK_OPS];
+} block_t;
+
+static const uint8_t op_info[256] = {
+	0x01, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,
+	0x01, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,
+	0x01, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,
+	0x01, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x81, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x81, 0x01, 0x83, 0x83, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x01, 0x83, 0x83, 0x02, 0x81,
+	0x81, 0x01, 0x83, 0x82, 0x83, 0x01, 0x02, 0x81, 0x81, 0x01, 0x83, 0x82, 0x83, 0x01, 0x02, 0x81,
+	0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81,
+	0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81, 0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81
+};
+
+struct i8080_code_cache
+{
+	block_t blocks[BLOCK_CACHE_SIZE];
+	block_t scratch;	// for an instruction that straddles two pages
+	i8080_block_stats_t stats;
+	altair_memory_t *memory;	// what blocks[] were decoded from
+};
+
+i8080_code_cache_t *i8080_code_cache_create(void)
+{
+	return calloc(1, sizeof(i8080_code_cache_t));
+}
+
+void i8080_code_cache_destroy(i8080_code_cache_t *cache)
+{
+	free(cache);
+}
+
+void i8080_block_cache_stats(const i8080_code_cache_t *cache, i8080_block_stats_t *stats)
+{
+	if(cache)
+		*stats = cache->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+}
+
+static block_t *block_decode(i8080_code_cache_t *cache, altair_memory_t *mem, uint16_t start,
+							 const void *const *dispatch)
+{
+	block_t *blk = &cache->blocks[start & (BLOCK_CACHE_SIZE - 1)];
+
+	if(blk->valid && blk->start == start)
+		cache->stats.invalidations++;
+	cache->stats.misses++;
+
+	uint16_t pc = start;
+	uint8_t page = start >> 8;
+	uint32_t n = 0;
+
+	// An instruction running into the next page would need both pages checked;
+	// it gets a block of its own that is used once and not cached.
+	if((uint16_t)(start + (op_info[read8(mem, start)] & BLOCK_LEN_MASK) - 1) >> 8 != page)
+	{
+		blk = &cache->scratch;
+	}
+
+	while(n < MAX_BLOCK_OPS)
+	{
+		uint8_t op_code = read8(mem, pc);
+		uint8_t len = op_info[op_code] & BLOCK_LEN_MASK;
+
+		if(n && (uint16_t)(pc + len - 1) >> 8 != page)
+			break;
+
+		blk->ops[n].body = dispatch[op_code];
+		blk->ops[n].imm = len > 1 ? read8(mem, pc + 1) : 0;
+		if(len > 2)
+			blk->ops[n].imm |= read8(mem, pc + 2) << 8;
+		n++;
+		pc += len;
+
+		if((op_info[op_code] & BLOCK_END) || pc >> 8 != page)
+			break;
+	}
+
+	blk->count = n;
+	blk->start = start;
+	blk->gen = mem->page_gen[page];
+	blk->valid = blk != &cache->scratch;
+	return blk;
+}
+
+// True if a write at address..address+len-1 lands in the page at base
+static inline int block_page_hit(uint16_t address, uint16_t base, uint16_t len)
+{
+	return (uint16_t)(address - base + len - 1) < 0x100 + len - 1;
+}
+
+#define CPU_A	a
+#define CPU_F	f
+#define CPU_SP	sp
+#define CPU_PC	pc
+#define CPU_LAZY	lazy
+
+#define CPU_GET_A()		a
+#define CPU_GET_B()		((uint8_t)(bc >> 8))
+#define CPU_GET_C()		((uint8_t)bc)
+#define CPU_GET_D()		((uint8_t)(de >> 8))
+#define CPU_GET_E()		((uint8_t)de)
+#define CPU_GET_H()		((uint8_t)(hl >> 8))
+#define CPU_GET_L()		((uint8_t)hl)
+#define CPU_SET_A(v)	(a = (v))
+#define CPU_SET_B(v)	(bc = (uint16_t)((bc & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_C(v)	(bc = (uint16_t)((bc & 0xff00) | (uint8_t)(v)))
+#define CPU_SET_D(v)	(de = (uint16_t)((de & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_E(v)	(de = (uint16_t)((de & 0xff00) | (uint8_t)(v)))
+#define CPU_SET_H(v)	(hl = (uint16_t)((hl & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_L(v)	(hl = (uint16_t)((hl & 0xff00) | (uint8_t)(v)))
+
+#define CPU_GET_BC()	bc
+#define CPU_GET_DE()	de
+#define CPU_GET_HL()	hl
+#define CPU_GET_SP()	sp
+#define CPU_SET_BC(v)	(bc = (v))
+#define CPU_SET_DE(v)	(de = (v))
+#define CPU_SET_HL(v)	(hl = (v))
+#define CPU_SET_SP(v)	(sp = (v))
+
+// A write into the running block's own page drops the budget to zero so the
+// block is left at the end of the instruction (see done: below).
+#define CPU_RD8(addr)		read8(mem, addr)
+#define CPU_RD16(addr)		read16(mem, addr)
+#define CPU_WR8(addr, val) \
+	do { \
+		uint16_t t_wr = (addr); \
+		write8(mem, t_wr, val); \
+		if(block_page_hit(t_wr, blk_base, 1)) \
+			limit = 0; \
+	} while(0)
+#define CPU_WR16(addr, val) \
+	do { \
+		uint16_t t_wr = (addr); \
+		write16(mem, t_wr, val); \
+		if(block_page_hit(t_wr, blk_base, 2)) \
+			limit = 0; \
+	} while(0)
+#define CPU_IMM8()			((uint8_t)op->imm)
+#define CPU_IMM16()			(op->imm)
+
+#define CPU_SAVE() \
+	do { \
+		cpu->registers.a = a; cpu->registers.flags = f; \
+		cpu->registers.bc = bc; cpu->registers.de = de; cpu->registers.hl = hl; \
+		cpu->registers.sp = sp; cpu->registers.pc = pc; \
+		cpu->lazy_flags = lazy; \
+	} while(0)
+
+#define CPU_LOAD() \
+	do { \
+		a = cpu->registers.a; f = cpu->registers.flags; \
+		bc = cpu->registers.bc; de = cpu->registers.de; hl = cpu->registers.hl; \
+		sp = cpu->registers.sp; pc = cpu->registers.pc; \
+		lazy = cpu->lazy_flags; \
+	} while(0)
+
+// Looking the next block up at the end of every instruction body, rather than
+// in one shared place, gives each body its own indirect jump to predict.
+#define BLOCK_ENTER() \
+	do { \
+		const block_t *t_blk = &cache->blocks[pc & (BLOCK_CACHE_SIZE - 1)]; \
+		if(__builtin_expect(t_blk->start == pc && t_blk->gen == mem->page_gen[pc >> 8] && t_blk->valid, 1)) \
+			cache->stats.hits++; \
+		else \
+			t_blk = block_decode(cache, mem, pc, dispatch); \
+		blk_base = pc & 0xff00; \
+		op = t_blk->ops; \
+		op_end = op + t_blk->count; \
+	} while(0)
+
+#define NEXT_OP() \
+	do { \
+		if(++op == op_end) \
+			BLOCK_ENTER(); \
+		goto *op->body; \
+	} while(0)
+
+#define OP_END(n) \
+	do { \
+		elapsed += (n); \
+		count++; \
+		if(__builtin_expect(elapsed >= limit, 0)) \
+			goto done; \
+		NEXT_OP(); \
+	} while(0)
+
+#define OP_END_EVENT(n) \
+	do { \
+		elapsed += (n); \
+		count++; \
+		if(elapsed >= limit || (cpu->events & stop_flags)) \
+			goto done; \
+		NEXT_OP(); \
+	} while(0)
+
+#define CPU_NOW()	(cpu->cycles + elapsed)
+
+#define BLOCK_LABEL(code, body)	[code] = &&op_##code,
+#define BLOCK_BODY(code, body)	op_##code: I8080_COUNT(cpu, opcodes[code]); body
+
+I8080_LABEL_CORE_ATTR uint32_t i8080_run_core(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
+{
+	static const void *const dispatch[256] = { I8080_OPCODE_TABLE(BLOCK_LABEL) };
+
+	altair_memory_t *const mem = cpu->memory;
+	i8080_code_cache_t *const cache = cpu->code_cache;
+	uint8_t a, f;
+	uint16_t bc, de, hl, sp, pc;
+	i8080_lazy_flags_t lazy;
+	uint32_t elapsed = 0;
+	uint32_t count = 0;
+	uint32_t limit = cycle_budget;
+	const block_op_t *op, *op_end;
+	uint16_t blk_base;
+
+	if(!cache)
+		return i8080_run_jump_table(cpu, cycle_budget, stop_flags);
+
+	// Page generations of other memory mean nothing to the cached blocks
+	if(mem != cache->memory)
+	{
+		memset(cache->blocks, 0, sizeof(cache->blocks));
+		cache->memory = mem;
+	}
+
+	CPU_LOAD();
+	cpu->events = 0;
+
+next_block:
+	BLOCK_ENTER();
+	goto *op->body;
+
+	I8080_OPCODE_TABLE(BLOCK_BODY)
+
+done:
+	if(limit != cycle_budget)
+	{
+		// Left early after a write into the block's own page
+		limit = cycle_budget;
+		if(elapsed < limit && !(cpu->events & stop_flags))
+			goto next_block;
+	}
+
+	I8080_FLAGS_SYNC();
+	CPU_SAVE();
+	cpu->cycles += elapsed;
+	cpu->instructions += count;
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH;
+	cpu->address_bus = pc;
+	cpu->data_bus = read8(mem, pc);
+
+	return elapsed;
+}
+
+#endif
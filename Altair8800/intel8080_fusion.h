@@ -0,0 +1,43 @@
+#ifndef _INTEL8080_FUSION_H_
+#define _INTEL8080_FUSION_H_
+
+// Superinstruction pairs for the jump-table core (I8080_FUSION), written by
+// i8080_pair_profile_write() from a profile of 440090522 instruction pairs.
+// X(first, second) fuses an opcode with its most frequent successor; the
+// comment is the pair's share of the profile.
+
+#define I8080_FUSED_PAIRS(X) \
+	X(0xfe, 0xc2)	/*  2.28% */ \
+	X(0x0b, 0xc3)	/*  1.86% */ \
+	X(0xb7, 0xca)	/*  1.85% */ \
+	X(0x3a, 0xb7)	/*  1.83% */ \
+	X(0xbb, 0xc2)	/*  1.65% */ \
+	X(0x79, 0xbb)	/*  1.61% */ \
+	X(0x0a, 0x77)	/*  1.53% */ \
+	X(0x2b, 0x0b)	/*  1.51% */ \
+	X(0x77, 0x79)	/*  1.51% */ \
+	X(0x7e, 0x23)	/*  1.18% */ \
+	X(0x5e, 0x23)	/*  0.94% */ \
+	X(0x1d, 0xc2)	/*  0.81% */ \
+	X(0x02, 0x82)	/*  0.79% */ \
+	X(0x82, 0x57)	/*  0.79% */ \
+	X(0x23, 0x1d)	/*  0.79% */ \
+	X(0x03, 0x23)	/*  0.79% */ \
+	X(0x57, 0x03)	/*  0.79% */ \
+	X(0x78, 0xb1)	/*  0.70% */ \
+	X(0xb1, 0xc2)	/*  0.68% */ \
+	X(0x66, 0x6f)	/*  0.65% */ \
+	X(0xaf, 0x3c)	/*  0.63% */ \
+	X(0xeb, 0x26)	/*  0.61% */ \
+	X(0x6f, 0xc9)	/*  0.61% */ \
+	X(0x47, 0x1a)	/*  0.61% */ \
+	X(0x09, 0x7e)	/*  0.59% */ \
+	X(0xe5, 0xeb)	/*  0.58% */ \
+	X(0xb8, 0xca)	/*  0.58% */ \
+	X(0xe1, 0x5e)	/*  0.56% */ \
+	X(0x26, 0x09)	/*  0.56% */ \
+	X(0x11, 0x19)	/*  0.56% */ \
+	X(0xe6, 0x47)	/*  0.55% */ \
+	X(0x1a, 0xb8)	/*  0.55% */
+
+#endif
@@ -0,0 +1,1364 @@
+// Dynamic recompiler, selected with I8080_JIT on x86-64 hosts.
+//
+// Addresses that are entered often enough are translated into straight-line
+// x86-64 code covering one basic block. The 8080 registers stay in *cpu and
+// the generated code reads and writes them in place, so an instruction the
+// translator does not cover can be handed to the interpreter's handler
+// mid-block. Flags are always computed eagerly.
+//
+// A block ends at a branch, call, return, RST, PCHL, IN or OUT, at
+// MAX_BLOCK_OPS or at the end of its 256-byte page. IN and OUT call the
+// interpreter's handler and leave native code if it raised an event in
+// stop_flags; HLT and EI are never translated.
+//
+// Each block starts by checking that it is still the translation in its
+// slot of the cache's blocks[], that the generation of its page matches the slot and
+// that the remaining budget covers its longest path. When the page was
+// written the run loop compares the block's saved source bytes and either
+// drops the translation or takes the new generation. A block that writes into
+// its own page ends right after that instruction. Since every instruction in
+// a block that starts would have run in the interpreter too, the cycle and
+// instruction counts match the interpreter exactly. That lets an exit to a
+// known address be patched into a direct jump to the target's code the first
+// time it is taken; exits to computed addresses look the target up in
+// blocks[]. Lockstep mode reruns each block in the interpreter and compares
+// the results. Each CPU has its own code cache; its translations belong to
+// the memory they were made from and are all dropped when a CPU with other
+// memory runs.
+//
+// The code buffer is never writable and executable at once. It is mapped
+// writable, switched to executable before native code runs, and only the
+// pages a block is translated into or a link patches are made writable again
+// meanwhile, which keeps each switch to a few pages. If a switch fails the
+// translations are dropped and the interpreter runs everything from then on.
+#include "intel8080_ops.h"
+
+#if I8080_USE_JIT
+
+#include "memory.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef I8080_JIT_HOT_THRESHOLD
+#define I8080_JIT_HOT_THRESHOLD	16	// entries into an address before it is translated
+#endif
+
+#define JIT_BLOCKS			16384	// direct-mapped on the start address
+#define JIT_CODE_SIZE		(16 * 1024 * 1024)
+#define JIT_BLOCK_RESERVE	(16 * 1024)	// more than the largest possible block
+#define JIT_PAGE_SIZE		4096
+#define MAX_BLOCK_OPS		32
+
+// Returns T-states in the low and instructions in the high half
+typedef uint64_t (*jit_enter_fn)(intel8080_t *cpu, const uint8_t *code);
+
+enum
+{
+	JIT_EMPTY,
+	JIT_COLD,		// counting entries
+	JIT_NATIVE,		// translated
+	JIT_REFUSED		// nothing translatable at this address, or failed lockstep
+};
+
+typedef struct
+{
+	uint8_t *code;
+	const uint8_t *source;	// copy of the 8080 code it was translated from
+	uint32_t gen;		// page_gen[] of the page when last checked
+	uint16_t start;
+	uint16_t max_cycles;	// T-states along the block's longest path
+	uint8_t length;		// bytes of 8080 code
+	uint8_t state;
+	uint8_t heat;
+	uint8_t body;		// offset of the code past the entry checks
+} jit_block_t;
+
+// State shared with the generated code, which reaches it through r14
+typedef struct
+{
+	uint32_t budget;		// T-states native code may run before returning
+	uint32_t count;			// instructions run since jit_enter
+	uint8_t *link_site;		// unlinked exit native code last left through
+	uint8_t stop_flags;		// of the current i8080_run_core()
+	uint8_t szp[256];		// copy of i8080_szp_table
+} jit_context_t;
+
+// One CPU's translations, with its own code buffer and stubs
+struct i8080_code_cache
+{
+	jit_block_t blocks[JIT_BLOCKS];
+	jit_context_t context;
+	uint8_t *code_base;
+	uint8_t *code_start;	// after the stubs
+	uint8_t *code_ptr;
+	jit_enter_fn enter;
+	uint8_t *leave;
+	int unavailable;
+	uint8_t *writable_start;	// the pages of the code buffer now writable,
+	uint8_t *writable_end;		// the rest being executable
+	int lockstep;
+	i8080_jit_stats_t stats;
+	altair_memory_t *memory;	// what blocks[] were translated from
+	uint8_t memory_before[64 * 1024];	// lockstep copies
+	uint8_t memory_native[64 * 1024];
+	uint32_t gen_before[256];
+};
+
+// The cache the emitter and run loop work on, set on entry to each of them
+static _Thread_local i8080_code_cache_t *jit;
+
+// x86-64 register numbers. The generated code keeps the cpu pointer in rbx,
+// the T-states run so far in ebp and the cpu->memory, its page_gen[],
+// jit->context and jit->blocks[] bases in r12..r15; rax, rcx, rdx and rsi are
+// scratch.
+#define RAX	0
+#define RCX	1
+#define RDX	2
+#define RBX	3
+#define RSP	4
+#define RBP	5
+#define RSI	6
+#define RDI	7
+#define R12	12
+#define R13	13
+#define R14	14
+#define R15	15
+#define NO_INDEX	(-1)
+
+#define X86_JZ	0x4
+#define X86_JNZ	0x5
+#define X86_JA	0x7
+
+#define OFF_R8(idx)	((int32_t)(offsetof(intel8080_t, registers) + offsetof(registers_t, r8) + (idx)))
+#define OFF_A		OFF_R8(I8080_R8_A)
+#define OFF_F		OFF_R8(I8080_R8_F)
+#define OFF_BC		OFF_R8(I8080_R8_C)
+#define OFF_DE		OFF_R8(I8080_R8_E)
+#define OFF_HL		OFF_R8(I8080_R8_L)
+#define OFF_SP		((int32_t)(offsetof(intel8080_t, registers) + offsetof(registers_t, sp)))
+#define OFF_PC		((int32_t)(offsetof(intel8080_t, registers) + offsetof(registers_t, pc)))
+#define OFF_MEMORY	((int32_t)offsetof(intel8080_t, memory))
+
+// Relative to the memory base in r12
+#define MEM_WRITE_MAP	((int32_t)offsetof(altair_memory_t, write_map))
+#define MEM_PAGE_GEN	((int32_t)offsetof(altair_memory_t, page_gen))
+#define OFF_EVENTS	((int32_t)offsetof(intel8080_t, events))
+
+// r8[] index of each register field value (B C D E H L M A); M has none
+static const int8_t reg_index[8] = {
+	I8080_R8_B, I8080_R8_C, I8080_R8_D, I8080_R8_E, I8080_R8_H, I8080_R8_L, -1, I8080_R8_A
+};
+
+// Register pair field (BC DE HL SP); PUSH and POP use AF in place of SP
+static const int32_t pair_offset[4] = { OFF_BC, OFF_DE, OFF_HL, OFF_SP };
+
+// Flag tested by each condition field (NZ Z NC C PO PE P M); odd ones are taken when set
+static const uint8_t cond_mask[8] = {
+	FLAGS_ZERO, FLAGS_ZERO, FLAGS_CARRY, FLAGS_CARRY, FLAGS_PARITY, FLAGS_PARITY, FLAGS_SIGN, FLAGS_SIGN
+};
+
+static void emit8(uint8_t val)
+{
+	*jit->code_ptr++ = val;
+}
+
+static void emit16(uint16_t val)
+{
+	memcpy(jit->code_ptr, &val, 2);
+	jit->code_ptr += 2;
+}
+
+static void emit32(uint32_t val)
+{
+	memcpy(jit->code_ptr, &val, 4);
+	jit->code_ptr += 4;
+}
+
+static void emit64(uint64_t val)
+{
+	memcpy(jit->code_ptr, &val, 8);
+	jit->code_ptr += 8;
+}
+
+static void emit_rex(int w, int reg, int index, int base)
+{
+	uint8_t rex = (uint8_t)(0x40 | w << 3 | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1));
+
+	if(rex != 0x40)
+		emit8(rex);
+}
+
+static void emit_opcode(uint16_t opcode)
+{
+	if(opcode > 0xff)
+		emit8((uint8_t)(opcode >> 8));
+	emit8((uint8_t)opcode);
+}
+
+// opcode with a [base + index * (1 << scale) + disp] operand
+static void emit_op_mem(uint8_t prefix, int w, uint16_t opcode, int reg, int base, int index, int scale, int32_t disp)
+{
+	int mod;
+
+	if(prefix)
+		emit8(prefix);
+	emit_rex(w, reg, index < 0 ? 0 : index, base);
+	emit_opcode(opcode);
+
+	if(disp == 0 && (base & 7) != 5)
+		mod = 0;
+	else if(disp >= -128 && disp <= 127)
+		mod = 1;
+	else
+		mod = 2;
+
+	if(index < 0 && (base & 7) != 4)
+	{
+		emit8((uint8_t)(mod << 6 | (reg & 7) << 3 | (base & 7)));
+	}
+	else
+	{
+		emit8((uint8_t)(mod << 6 | (reg & 7) << 3 | 4));
+		emit8((uint8_t)(scale << 6 | ((index < 0 ? 4 : index) & 7) << 3 | (base & 7)));
+	}
+
+	if(mod == 1)
+		emit8((uint8_t)disp);
+	else if(mod == 2)
+		emit32((uint32_t)disp);
+}
+
+static void emit_op_rr(uint8_t prefix, int w, uint16_t opcode, int reg, int rm)
+{
+	if(prefix)
+		emit8(prefix);
+	emit_rex(w, reg, 0, rm);
+	emit_opcode(opcode);
+	emit8((uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// Register field operands of the cpu register accesses below are always rbx-relative
+static void x_ld8(int dst, int32_t off)				{ emit_op_mem(0, 0, 0x0fb6, dst, RBX, NO_INDEX, 0, off); }
+static void x_ld16(int dst, int32_t off)			{ emit_op_mem(0, 0, 0x0fb7, dst, RBX, NO_INDEX, 0, off); }
+static void x_st8(int32_t off, int src)				{ emit_op_mem(0, 0, 0x88, src, RBX, NO_INDEX, 0, off); }
+static void x_st16(int32_t off, int src)			{ emit_op_mem(0x66, 0, 0x89, src, RBX, NO_INDEX, 0, off); }
+static void x_st8_imm(int32_t off, uint8_t imm)		{ emit_op_mem(0, 0, 0xc6, 0, RBX, NO_INDEX, 0, off); emit8(imm); }
+static void x_st16_imm(int32_t off, uint16_t imm)	{ emit_op_mem(0x66, 0, 0xc7, 0, RBX, NO_INDEX, 0, off); emit16(imm); }
+static void x_grp1_m8(int ext, int32_t off, uint8_t imm)	{ emit_op_mem(0, 0, 0x80, ext, RBX, NO_INDEX, 0, off); emit8(imm); }
+static void x_test_m8(int32_t off, uint8_t imm)		{ emit_op_mem(0, 0, 0xf6, 0, RBX, NO_INDEX, 0, off); emit8(imm); }
+static void x_not_m8(int32_t off)					{ emit_op_mem(0, 0, 0xf6, 2, RBX, NO_INDEX, 0, off); }
+static void x_incdec_m16(int ext, int32_t off)		{ emit_op_mem(0x66, 0, 0xff, ext, RBX, NO_INDEX, 0, off); }
+static void x_add_m16(int32_t off, int8_t imm)		{ emit_op_mem(0x66, 0, 0x83, 0, RBX, NO_INDEX, 0, off); emit8((uint8_t)imm); }
+
+// 8080 memory and table accesses
+static void x_mem_ld8(int dst, int index, int32_t disp)	{ emit_op_mem(0, 0, 0x0fb6, dst, R12, index, 0, disp); }
+static void x_szp(int dst, int index)					{ emit_op_mem(0, 0, 0x0fb6, dst, R14, index, 0, offsetof(jit_context_t, szp)); }
+static void x_gen_inc(int index, int32_t disp)			{ emit_op_mem(0, 0, 0xff, 0, R13, index, 2, disp); }
+
+// Register to register, 32-bit. op is the "rm, reg" form: add 01, or 09, and 21, sub 29, xor 31
+static void x_alu_rr(uint8_t op, int dst, int src)	{ emit_op_rr(0, 0, op, src, dst); }
+static void x_mov_rr(int dst, int src)				{ emit_op_rr(0, 0, 0x89, src, dst); }
+static void x_movzx8_rr(int dst, int src)			{ emit_op_rr(0, 0, 0x0fb6, dst, src); }
+static void x_neg(int dst)							{ emit_op_rr(0, 0, 0xf7, 3, dst); }
+static void x_shift(int ext, int dst, uint8_t n)	{ emit_op_rr(0, 0, 0xc1, ext, dst); emit8(n); }
+#define x_shl(dst, n)	x_shift(4, dst, n)
+#define x_shr(dst, n)	x_shift(5, dst, n)
+
+// ext: add 0, or 1, and 4, sub 5, xor 6, cmp 7
+static void x_alu_ri(int ext, int dst, int32_t imm)
+{
+	if(imm >= -128 && imm <= 127)
+	{
+		emit_op_rr(0, 0, 0x83, ext, dst);
+		emit8((uint8_t)imm);
+	}
+	else
+	{
+		emit_op_rr(0, 0, 0x81, ext, dst);
+		emit32((uint32_t)imm);
+	}
+}
+#define x_add_ri(dst, imm)	x_alu_ri(0, dst, imm)
+#define x_or_ri(dst, imm)	x_alu_ri(1, dst, imm)
+#define x_and_ri(dst, imm)	x_alu_ri(4, dst, imm)
+#define x_xor_ri(dst, imm)	x_alu_ri(6, dst, imm)
+
+#define x_add_rr(dst, src)	x_alu_rr(0x01, dst, src)
+#define x_or_rr(dst, src)	x_alu_rr(0x09, dst, src)
+#define x_and_rr(dst, src)	x_alu_rr(0x21, dst, src)
+#define x_xor_rr(dst, src)	x_alu_rr(0x31, dst, src)
+
+static void x_mov_ri(int dst, uint32_t imm)
+{
+	emit_rex(0, 0, 0, dst);
+	emit8((uint8_t)(0xb8 | (dst & 7)));
+	emit32(imm);
+}
+
+static void x_mov_ri64(int dst, uint64_t imm)
+{
+	emit_rex(1, 0, 0, dst);
+	emit8((uint8_t)(0xb8 | (dst & 7)));
+	emit64(imm);
+}
+
+static void x_push(int reg)
+{
+	emit_rex(0, 0, 0, reg);
+	emit8((uint8_t)(0x50 | (reg & 7)));
+}
+
+static void x_pop(int reg)
+{
+	emit_rex(0, 0, 0, reg);
+	emit8((uint8_t)(0x58 | (reg & 7)));
+}
+
+// Forward conditional jump; returns the end of the instruction for x_patch()
+static uint8_t *x_jcc(int cc)
+{
+	emit8(0x0f);
+	emit8((uint8_t)(0x80 | cc));
+	emit32(0);
+	return jit->code_ptr;
+}
+
+static void x_patch(uint8_t *after)
+{
+	int32_t rel = (int32_t)(jit->code_ptr - after);
+
+	memcpy(after - 4, &rel, 4);
+}
+
+
+static void x_call_rax(void)
+{
+	emit8(0xff);
+	emit8(0xd0);
+}
+
+static void x_jcc_to(int cc, const uint8_t *target)
+{
+	emit8(0x0f);
+	emit8((uint8_t)(0x80 | cc));
+	emit32((uint32_t)(int32_t)(target - (jit->code_ptr + 4)));
+}
+
+static void x_jmp_to(const uint8_t *target)
+{
+	emit8(0xe9);
+	emit32((uint32_t)(int32_t)(target - (jit->code_ptr + 4)));
+}
+
+// Shared entry and exit of native code, emitted once at the start of the
+// code buffer. jit->enter(cpu, code) saves the host registers, loads the bases
+// and jumps to code; native code returns through jit->leave with the
+// instructions it ran in the high and the T-states in the low half.
+static void emit_stubs(void)
+{
+	jit->enter = (jit_enter_fn)(void *)jit->code_ptr;
+	x_push(RBX);
+	x_push(RBP);
+	x_push(R12);
+	x_push(R13);
+	x_push(R14);
+	x_push(R15);
+	emit_op_rr(0, 1, 0x83, 5, RSP);	// sub rsp, 8 to align the stack for handler calls
+	emit8(8);
+	emit_op_rr(0, 1, 0x89, RDI, RBX);
+	x_xor_rr(RBP, RBP);
+	emit_op_mem(0, 1, 0x8b, R12, RBX, NO_INDEX, 0, OFF_MEMORY);		// mov r12, cpu->memory
+	emit_op_mem(0, 1, 0x8d, R13, R12, NO_INDEX, 0, MEM_PAGE_GEN);	// lea r13, [r12 + page_gen]
+	x_mov_ri64(R14, (uint64_t)(uintptr_t)&jit->context);
+	x_mov_ri64(R15, (uint64_t)(uintptr_t)jit->blocks);
+	emit_op_mem(0, 0, 0xc7, 0, R14, NO_INDEX, 0, offsetof(jit_context_t, count));
+	emit32(0);
+	emit_op_rr(0, 0, 0xff, 4, RSI);	// jmp rsi
+
+	jit->leave = jit->code_ptr;
+	emit_op_mem(0, 0, 0x8b, RAX, R14, NO_INDEX, 0, offsetof(jit_context_t, count));
+	emit_op_rr(0, 1, 0xc1, 4, RAX);	// shl rax, 32
+	emit8(32);
+	emit_op_rr(0, 1, 0x09, RBP, RAX);
+	emit_op_rr(0, 1, 0x83, 0, RSP);
+	emit8(8);
+	x_pop(R15);
+	x_pop(R14);
+	x_pop(R13);
+	x_pop(R12);
+	x_pop(RBP);
+	x_pop(RBX);
+	emit8(0xc3);
+
+	jit->code_start = jit->code_ptr;
+}
+
+static void x_lea_rip(int dst, const uint8_t *target)
+{
+	emit_rex(1, dst, 0, 0);
+	emit8(0x8d);
+	emit8((uint8_t)(0x05 | (dst & 7) << 3));
+	emit32((uint32_t)(int32_t)(target - (jit->code_ptr + 4)));
+}
+
+// Block entry checks against the block's slot, at byte offset slot of
+// jit->blocks[]: that the block is still the slot's translation, that its page
+// is unchanged since the run loop last checked it and that the budget covers
+// the block. Stores the three jumps to be patched to the fail path in fail[].
+static void emit_entry(int32_t slot, uint8_t page, uint8_t **fail)
+{
+	x_lea_rip(RAX, jit->code_ptr);
+	emit_op_mem(0, 1, 0x3b, RAX, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, code));
+	fail[0] = x_jcc(X86_JNZ);
+	emit_op_mem(0, 0, 0x8b, RAX, R13, NO_INDEX, 0, page * 4);
+	emit_op_mem(0, 0, 0x3b, RAX, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, gen));
+	fail[1] = x_jcc(X86_JNZ);
+	emit_op_mem(0, 0, 0x0fb7, RAX, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, max_cycles));
+	x_add_rr(RAX, RBP);
+	emit_op_mem(0, 0, 0x3b, RAX, R14, NO_INDEX, 0, offsetof(jit_context_t, budget));
+	fail[2] = x_jcc(X86_JA);
+}
+
+static void emit_account(uint32_t cycles, uint32_t count)
+{
+	x_add_ri(RBP, (int32_t)cycles);
+	emit_op_mem(0, 0, 0x83, 0, R14, NO_INDEX, 0, offsetof(jit_context_t, count));
+	emit8((uint8_t)count);
+}
+
+// Jump to the block at registers.pc if it is translated; its entry checks do
+// the rest. Otherwise leave native code.
+static void emit_dispatch(void)
+{
+	x_ld16(RAX, OFF_PC);
+	x_mov_rr(RCX, RAX);
+	x_and_ri(RCX, JIT_BLOCKS - 1);
+	emit_op_rr(0, 0, 0x69, RCX, RCX);
+	emit32(sizeof(jit_block_t));
+	emit_op_mem(0x66, 0, 0x39, RAX, R15, RCX, 0, offsetof(jit_block_t, start));
+	x_jcc_to(X86_JNZ, jit->leave);
+	emit_op_mem(0, 0, 0x80, 7, R15, RCX, 0, offsetof(jit_block_t, state));
+	emit8(JIT_NATIVE);
+	x_jcc_to(X86_JNZ, jit->leave);
+	emit_op_mem(0, 0, 0xff, 4, R15, RCX, 0, offsetof(jit_block_t, code));
+}
+
+// Leave the block with registers.pc already stored
+static void emit_exit(uint32_t cycles, uint32_t count)
+{
+	emit_account(cycles, count);
+	emit_dispatch();
+}
+
+// Exit to a known address. Until jit_link() patches the jump to go straight
+// to the target block, it falls through to code that stores the address,
+// records itself in jit->context.link_site and leaves.
+static void emit_link(uint16_t pc)
+{
+	uint8_t *site = jit->code_ptr;
+
+	x_jmp_to(site + 5);
+	x_st16_imm(OFF_PC, pc);
+	x_mov_ri64(RAX, (uint64_t)(uintptr_t)site);
+	emit_op_mem(0, 1, 0x89, RAX, R14, NO_INDEX, 0, offsetof(jit_context_t, link_site));
+	x_jmp_to(jit->leave);
+}
+
+static void emit_exit_to(uint16_t pc, uint32_t cycles, uint32_t count)
+{
+	emit_account(cycles, count);
+	emit_link(pc);
+}
+
+static void jit_link(uint8_t *site, const jit_block_t *target)
+{
+	int32_t rel = (int32_t)(target->code - (site + 5));
+
+	memcpy(site + 1, &rel, 4);
+	jit->stats.links++;
+}
+
+// Memory writes go through write_map[] and bump the page generation
+// like write8() does. The value is in cl; emit_store8() takes the address in
+// eax and also clobbers edx and rsi.
+static void emit_store8(void)
+{
+	x_mov_rr(RDX, RAX);
+	x_shr(RDX, 8);
+	x_gen_inc(RDX, 0);
+	emit_op_mem(0, 1, 0x8b, RSI, R12, RDX, 3, MEM_WRITE_MAP);	// mov rsi, [r12 + rdx * 8 + write_map]
+	x_movzx8_rr(RDX, RAX);
+	emit_op_mem(0, 0, 0x88, RCX, RSI, RDX, 0, 0);	// mov [rsi + rdx], cl
+}
+
+static void emit_store8_at(uint16_t addr)
+{
+	emit_op_mem(0, 1, 0x8b, RSI, R12, NO_INDEX, 0, MEM_WRITE_MAP + (addr >> 8) * 8);
+	emit_op_mem(0, 0, 0x88, RCX, RSI, NO_INDEX, 0, addr & 0xff);
+	x_gen_inc(NO_INDEX, (addr >> 8) * 4);
+}
+
+// Address in eax, value in cx; clobbers eax, ecx and edx
+static void emit_store16(void)
+{
+	emit_store8();
+	x_add_ri(RAX, 1);
+	x_and_ri(RAX, 0xffff);
+	x_shr(RCX, 8);
+	emit_store8();
+}
+
+// Address in eax, result in ecx; clobbers eax and edx
+static void emit_load16(void)
+{
+	x_mem_ld8(RCX, RAX, 0);
+	x_add_ri(RAX, 1);
+	x_and_ri(RAX, 0xffff);
+	x_mem_ld8(RDX, RAX, 0);
+	x_shl(RDX, 8);
+	x_or_rr(RCX, RDX);
+}
+
+// SP -= 2 and push the value in cx
+static void emit_push(void)
+{
+	x_ld16(RAX, OFF_SP);
+	x_add_ri(RAX, -2);
+	x_and_ri(RAX, 0xffff);
+	x_st16(OFF_SP, RAX);
+	emit_store16();
+}
+
+// Pop into cx, SP += 2
+static void emit_pop(void)
+{
+	x_ld16(RAX, OFF_SP);
+	emit_load16();
+	x_add_m16(OFF_SP, 2);
+}
+
+// flags = (flags & ~clear) | ecx; clobbers eax
+static void emit_set_flags(uint8_t clear)
+{
+	x_ld8(RAX, OFF_F);
+	x_and_ri(RAX, (uint8_t)~clear);
+	x_or_rr(RAX, RCX);
+	x_st8(OFF_F, RAX);
+}
+
+// Load 8080 register field r (M reads through HL) into dst; clobbers eax
+static void emit_load_reg(int dst, int r)
+{
+	if(r == 6)
+	{
+		x_ld16(RAX, OFF_HL);
+		x_mem_ld8(dst, RAX, 0);
+	}
+	else
+	{
+		x_ld8(dst, OFF_R8(reg_index[r]));
+	}
+}
+
+// Accumulator op opn (ADD ADC SUB SBB ANA XRA ORA CMP) on the operand in ecx,
+// as the eager helpers in intel8080_ops.h compute it. immediate selects ANI,
+// which clears half carry where ANA keeps it.
+static void emit_alu(int opn, int immediate)
+{
+	uint8_t clear;
+
+	switch(opn)
+	{
+	case 4:
+	case 5:
+	case 6:
+		x_ld8(RDX, OFF_A);
+		if(opn == 4)
+			x_and_rr(RDX, RCX);
+		else if(opn == 5)
+			x_xor_rr(RDX, RCX);
+		else
+			x_or_rr(RDX, RCX);
+		x_st8(OFF_A, RDX);
+		x_szp(RCX, RDX);
+		clear = (opn == 4 && !immediate) ? FLAGS_CARRY : FLAGS_CARRY | FLAGS_H;
+		emit_set_flags(I8080_SZP_MASK | clear);
+		return;
+	}
+
+	if(opn == 1 || opn == 3)
+	{
+		// ADC and SBB fold the carry into the operand
+		x_ld8(RDX, OFF_F);
+		x_and_ri(RDX, FLAGS_CARRY);
+		x_add_rr(RCX, RDX);
+	}
+	if(opn >= 2)
+	{
+		// Subtract by adding 0x100 - operand
+		x_neg(RCX);
+		x_add_ri(RCX, 0x100);
+	}
+	x_ld8(RAX, OFF_A);
+	x_mov_rr(RDX, RAX);
+	x_add_rr(RDX, RCX);
+	x_xor_rr(RCX, RAX);
+	x_xor_rr(RCX, RDX);
+	x_and_ri(RCX, FLAGS_H);
+	x_mov_rr(RAX, RDX);
+	x_shr(RAX, 8);
+	if(opn >= 2)
+		x_xor_ri(RAX, FLAGS_CARRY);
+	x_or_rr(RCX, RAX);
+	x_movzx8_rr(RDX, RDX);
+	if(opn != 7)
+		x_st8(OFF_A, RDX);
+	x_szp(RAX, RDX);
+	x_or_rr(RCX, RAX);
+	emit_set_flags(I8080_SZP_MASK | FLAGS_H | FLAGS_CARRY);
+}
+
+// INR or DCR of the value in eax, result in edx; clobbers eax and ecx
+static void emit_inr_dcr(int dcr)
+{
+	x_mov_rr(RDX, RAX);
+	x_add_ri(RDX, dcr ? -1 : 1);
+	x_and_ri(RDX, 0xff);
+	x_mov_rr(RCX, RAX);
+	x_xor_rr(RCX, RDX);
+	x_xor_ri(RCX, dcr ? 0xff : 0x01);
+	x_and_ri(RCX, FLAGS_H);
+	x_szp(RAX, RDX);
+	x_or_rr(RCX, RAX);
+	emit_set_flags(I8080_SZP_MASK | FLAGS_H);
+}
+
+// Run one instruction through the interpreter's handler
+static void emit_call_handler(uint8_t op, uint16_t pc)
+{
+	x_st16_imm(OFF_PC, pc);
+	emit_op_rr(0, 1, 0x89, RBX, RDI);
+	x_mov_ri64(RAX, (uint64_t)(uintptr_t)i8080_opcode_handlers[op]);
+	x_call_rax();
+}
+
+static uint8_t jit_op_length(uint8_t op)
+{
+	if((op & 0xcf) == 0x01 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 ||
+	   op == 0x22 || op == 0x2a || op == 0x32 || op == 0x3a || op == 0xc3 || op == 0xcd)
+		return 3;
+	if((op & 0xc7) == 0x06 || (op & 0xc7) == 0xc6 || op == 0xd3 || op == 0xdb)
+		return 2;
+	return 1;
+}
+
+// EI is left to the interpreter so that i8080_run() sees it and can take a
+// pending interrupt. Lockstep leaves IN and OUT to the interpreter too, since
+// rerunning them would repeat their side effects.
+static int jit_op_translatable(uint8_t op)
+{
+	return op != 0x76 && op != 0xfb && (!jit->lockstep || (op != 0xd3 && op != 0xdb));	// HLT, EI, OUT, IN
+}
+
+static int jit_op_ends_block(uint8_t op)
+{
+	return (op & 0xc7) == 0xc0 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7 ||
+		   op == 0xc3 || op == 0xc9 || op == 0xcd || op == 0xe9 || op == 0xd3 || op == 0xdb;
+}
+
+// Emit a straight-line instruction. Returns its T-states and sets *writes if
+// it may store to memory.
+static uint32_t emit_body(uint8_t op, uint16_t pc, uint8_t imm8, uint16_t imm16, int *writes)
+{
+	static const uint8_t alu_cycles[8] = {
+		CYCLES_ADD, CYCLES_ADC, CYCLES_SUB, CYCLES_SBB, CYCLES_ANA, CYCLES_XRA, CYCLES_ORA, CYCLES_CMP
+	};
+	static const uint8_t alu_imm_cycles[8] = {
+		CYCLES_ADI, CYCLES_ACI, CYCLES_SUI, CYCLES_SBI, CYCLES_ANI, CYCLES_XRI, CYCLES_ORI, CYCLES_CPI
+	};
+	int d = op >> 3 & 7, s = op & 7, rp = op >> 4 & 3;
+
+	*writes = 0;
+
+	if(op >= 0x40 && op < 0x80)
+	{
+		if(s == 6)
+		{
+			emit_load_reg(RCX, 6);
+			x_st8(OFF_R8(reg_index[d]), RCX);
+			return CYCLES_MOV_MEM;
+		}
+		if(d == 6)
+		{
+			x_ld8(RCX, OFF_R8(reg_index[s]));
+			x_ld16(RAX, OFF_HL);
+			emit_store8();
+			*writes = 1;
+			return CYCLES_MOV_MEM;
+		}
+		if(d != s)
+		{
+			x_ld8(RAX, OFF_R8(reg_index[s]));
+			x_st8(OFF_R8(reg_index[d]), RAX);
+		}
+		return CYCLES_MOV_REG;
+	}
+
+	if(op >= 0x80 && op < 0xc0)
+	{
+		emit_load_reg(RCX, s);
+		emit_alu(d, 0);
+		return s == 6 ? CYCLES_ALU_MEM : alu_cycles[d];
+	}
+
+	if((op & 0xc7) == 0xc6)
+	{
+		x_mov_ri(RCX, imm8);
+		emit_alu(d, 1);
+		return alu_imm_cycles[d];
+	}
+
+	switch(op & 0xcf)
+	{
+	case 0x01:	// LXI
+		x_st16_imm(pair_offset[rp], imm16);
+		return CYCLES_LXI;
+	case 0x03:	// INX
+		x_incdec_m16(0, pair_offset[rp]);
+		return CYCLES_INX;
+	case 0x0b:	// DCX
+		x_incdec_m16(1, pair_offset[rp]);
+		return CYCLES_DCX;
+	case 0x09:	// DAD
+		x_ld16(RAX, pair_offset[rp]);
+		x_ld16(RCX, OFF_HL);
+		x_add_rr(RAX, RCX);
+		x_st16(OFF_HL, RAX);
+		x_shr(RAX, 16);
+		x_mov_rr(RCX, RAX);
+		emit_set_flags(FLAGS_CARRY);
+		return CYCLES_DAD;
+	case 0xc1:	// POP
+		emit_pop();
+		x_st16(rp == 3 ? OFF_F : pair_offset[rp], RCX);
+		return CYCLES_POP;
+	case 0xc5:	// PUSH
+		x_ld16(RCX, rp == 3 ? OFF_F : pair_offset[rp]);
+		emit_push();
+		*writes = 1;
+		return CYCLES_PUSH;
+	}
+
+	switch(op & 0xc7)
+	{
+	case 0x04:	// INR
+	case 0x05:	// DCR
+		if(d == 6)
+		{
+			x_ld16(RSI, OFF_HL);
+			x_mem_ld8(RAX, RSI, 0);
+			emit_inr_dcr(s == 5);
+			x_mov_rr(RCX, RDX);
+			x_mov_rr(RAX, RSI);
+			emit_store8();
+			*writes = 1;
+			return s == 5 ? CYCLES_DCR_MEM : CYCLES_INR_MEM;
+		}
+		x_ld8(RAX, OFF_R8(reg_index[d]));
+		emit_inr_dcr(s == 5);
+		x_st8(OFF_R8(reg_index[d]), RDX);
+		return s == 5 ? CYCLES_DCR : CYCLES_INR;
+	case 0x06:	// MVI
+		if(d == 6)
+		{
+			x_ld16(RAX, OFF_HL);
+			x_mov_ri(RCX, imm8);
+			emit_store8();
+			*writes = 1;
+			return CYCLES_MVI_MEM;
+		}
+		x_st8_imm(OFF_R8(reg_index[d]), imm8);
+		return CYCLES_MVI_REG;
+	}
+
+	switch(op)
+	{
+	case 0x02:	// STAX B
+	case 0x12:	// STAX D
+		x_ld8(RCX, OFF_A);
+		x_ld16(RAX, pair_offset[rp]);
+		emit_store8();
+		*writes = 1;
+		return CYCLES_STAX;
+	case 0x0a:	// LDAX B
+	case 0x1a:	// LDAX D
+		x_ld16(RAX, pair_offset[rp]);
+		x_mem_ld8(RCX, RAX, 0);
+		x_st8(OFF_A, RCX);
+		return CYCLES_LDAX;
+	case 0x07:	// RLC
+		x_ld8(RAX, OFF_A);
+		x_mov_rr(RCX, RAX);
+		x_shr(RCX, 7);
+		x_shl(RAX, 1);
+		x_or_rr(RAX, RCX);
+		x_st8(OFF_A, RAX);
+		emit_set_flags(FLAGS_CARRY);
+		return CYCLES_RLC;
+	case 0x0f:	// RRC
+		x_ld8(RAX, OFF_A);
+		x_mov_rr(RCX, RAX);
+		x_and_ri(RCX, 1);
+		x_shr(RAX, 1);
+		x_mov_rr(RDX, RCX);
+		x_shl(RDX, 7);
+		x_or_rr(RAX, RDX);
+		x_st8(OFF_A, RAX);
+		emit_set_flags(FLAGS_CARRY);
+		return CYCLES_RRC;
+	case 0x17:	// RAL
+		x_ld8(RAX, OFF_A);
+		x_mov_rr(RCX, RAX);
+		x_shr(RCX, 7);
+		x_shl(RAX, 1);
+		x_ld8(RDX, OFF_F);
+		x_and_ri(RDX, FLAGS_CARRY);
+		x_or_rr(RAX, RDX);
+		x_st8(OFF_A, RAX);
+		emit_set_flags(FLAGS_CARRY);
+		return CYCLES_RAL;
+	case 0x1f:	// RAR
+		x_ld8(RAX, OFF_A);
+		x_mov_rr(RCX, RAX);
+		x_and_ri(RCX, 1);
+		x_shr(RAX, 1);
+		x_ld8(RDX, OFF_F);
+		x_and_ri(RDX, FLAGS_CARRY);
+		x_shl(RDX, 7);
+		x_or_rr(RAX, RDX);
+		x_st8(OFF_A, RAX);
+		emit_set_flags(FLAGS_CARRY);
+		return CYCLES_RAR;
+	case 0x22:	// SHLD; byte stores, since the two bytes may be in pages of different kinds
+		x_ld8(RCX, OFF_R8(I8080_R8_L));
+		emit_store8_at(imm16);
+		x_ld8(RCX, OFF_R8(I8080_R8_H));
+		emit_store8_at((uint16_t)(imm16 + 1));
+		*writes = 1;
+		return CYCLES_SHLD;
+	case 0x2a:	// LHLD
+		if(imm16 != 0xffff)
+		{
+			emit_op_mem(0, 0, 0x0fb7, RCX, R12, NO_INDEX, 0, imm16);
+		}
+		else
+		{
+			x_mem_ld8(RCX, NO_INDEX, imm16);
+			x_mem_ld8(RDX, NO_INDEX, 0);
+			x_shl(RDX, 8);
+			x_or_rr(RCX, RDX);
+		}
+		x_st16(OFF_HL, RCX);
+		return CYCLES_LHLD;
+	case 0x27:	// DAA
+		emit_call_handler(op, pc);
+		return CYCLES_DAA;
+	case 0x2f:	// CMA
+		x_not_m8(OFF_A);
+		return CYCLES_CMA;
+	case 0x32:	// STA
+		x_ld8(RCX, OFF_A);
+		emit_store8_at(imm16);
+		*writes = 1;
+		return CYCLES_STA;
+	case 0x3a:	// LDA
+		x_mem_ld8(RCX, NO_INDEX, imm16);
+		x_st8(OFF_A, RCX);
+		return CYCLES_LDA;
+	case 0x37:	// STC
+		x_grp1_m8(1, OFF_F, FLAGS_CARRY);
+		return CYCLES_STC;
+	case 0x3f:	// CMC
+		x_grp1_m8(6, OFF_F, FLAGS_CARRY);
+		return CYCLES_CMC;
+	case 0xe3:	// XTHL
+		emit_call_handler(op, pc);
+		*writes = 1;
+		return CYCLES_XTHL;
+	case 0xeb:	// XCHG
+		x_ld16(RAX, OFF_HL);
+		x_ld16(RCX, OFF_DE);
+		x_st16(OFF_HL, RCX);
+		x_st16(OFF_DE, RAX);
+		return CYCLES_XCHG;
+	case 0xf9:	// SPHL
+		x_ld16(RAX, OFF_HL);
+		x_st16(OFF_SP, RAX);
+		return CYCLES_SPHL;
+	case 0xf3:	// DI
+		x_grp1_m8(4, OFF_F, (uint8_t)~FLAGS_IF);
+		return CYCLES_DI;
+	}
+
+	// NOP and the undefined opcodes
+	return CYCLES_NOP;
+}
+
+// CALL from pc: push the return address, then read the target back from
+// memory as the interpreter does, in case the push overwrote it.
+static void emit_call(uint16_t pc, uint16_t target, uint32_t cycles, uint32_t count)
+{
+	uint8_t *changed;
+
+	x_mov_ri(RCX, (uint16_t)(pc + 3));
+	emit_push();
+	emit_account(cycles, count);
+	emit_op_mem(0x66, 0, 0x81, 7, R12, NO_INDEX, 0, pc + 1);
+	emit16(target);
+	changed = x_jcc(X86_JNZ);
+	emit_link(target);
+	x_patch(changed);
+	x_mem_ld8(RCX, NO_INDEX, pc + 1);
+	x_mem_ld8(RDX, NO_INDEX, pc + 2);
+	x_shl(RDX, 8);
+	x_or_rr(RCX, RDX);
+	x_st16(OFF_PC, RCX);
+	emit_dispatch();
+}
+
+static void emit_ret(uint32_t cycles, uint32_t count)
+{
+	emit_pop();
+	x_st16(OFF_PC, RCX);
+	emit_exit(cycles, count);
+}
+
+// Emit the instruction that ends a block along with every exit from it.
+// cycles and count cover the instructions before it. Returns the T-states of
+// its longest path.
+static uint32_t emit_branch(uint8_t op, uint16_t pc, uint16_t imm16, uint32_t cycles, uint32_t count)
+{
+	int cc = op >> 3 & 7;
+	uint8_t *not_taken;
+
+	count++;
+
+	switch(op & 0xc7)
+	{
+	case 0xc0:	// Rcc
+		x_test_m8(OFF_F, cond_mask[cc]);
+		not_taken = x_jcc((cc & 1) ? X86_JZ : X86_JNZ);
+		emit_ret(cycles + CYCLES_RET_TAKEN, count);
+		x_patch(not_taken);
+		emit_exit_to((uint16_t)(pc + 1), cycles + CYCLES_RET_COND, count);
+		return CYCLES_RET_TAKEN;
+	case 0xc2:	// Jcc
+		x_test_m8(OFF_F, cond_mask[cc]);
+		not_taken = x_jcc((cc & 1) ? X86_JZ : X86_JNZ);
+		emit_exit_to(imm16, cycles + CYCLES_JMP, count);
+		x_patch(not_taken);
+		emit_exit_to((uint16_t)(pc + 3), cycles + CYCLES_JMP, count);
+		return CYCLES_JMP;
+	case 0xc4:	// Ccc
+		x_test_m8(OFF_F, cond_mask[cc]);
+		not_taken = x_jcc((cc & 1) ? X86_JZ : X86_JNZ);
+		emit_call(pc, imm16, cycles + CYCLES_CALL, count);
+		x_patch(not_taken);
+		emit_exit_to((uint16_t)(pc + 3), cycles + CYCLES_CALL_COND, count);
+		return CYCLES_CALL;
+	case 0xc7:	// RST
+		x_mov_ri(RCX, (uint16_t)(pc + 1));
+		emit_push();
+		emit_exit_to((uint16_t)(cc * 8), cycles + CYCLES_RST, count);
+		return CYCLES_RST;
+	}
+
+	switch(op)
+	{
+	case 0xd3:	// OUT
+	case 0xdb:	// IN
+		emit_call_handler(op, pc);
+		cycles += op == 0xdb ? CYCLES_IN : CYCLES_OUT;
+		emit_account(cycles, count);
+		x_ld8(RAX, OFF_EVENTS);
+		emit_op_mem(0, 0, 0x84, RAX, R14, NO_INDEX, 0, offsetof(jit_context_t, stop_flags));
+		x_jcc_to(X86_JNZ, jit->leave);
+		emit_link((uint16_t)(pc + 2));
+		return op == 0xdb ? CYCLES_IN : CYCLES_OUT;
+	case 0xc3:	// JMP
+		emit_exit_to(imm16, cycles + CYCLES_JMP, count);
+		return CYCLES_JMP;
+	case 0xcd:	// CALL
+		emit_call(pc, imm16, cycles + CYCLES_CALL, count);
+		return CYCLES_CALL;
+	case 0xc9:	// RET
+		emit_ret(cycles + CYCLES_RET, count);
+		return CYCLES_RET;
+	default:	// PCHL
+		x_ld16(RCX, OFF_HL);
+		x_st16(OFF_PC, RCX);
+		emit_exit(cycles + CYCLES_PCHL, count);
+		return CYCLES_PCHL;
+	}
+}
+
+void i8080_jit_flush(i8080_code_cache_t *cache)
+{
+	if(!cache)
+		return;
+	memset(cache->blocks, 0, sizeof(cache->blocks));
+	cache->code_ptr = cache->code_start;
+	cache->context.link_site = NULL;
+}
+
+// Makes the pages holding length bytes from start writable and the rest of
+// the code buffer executable, or for a length of 0 all of it executable.
+// Returns 0, or -1 if that failed and the interpreter has taken over.
+static int jit_protect(uint8_t *start, size_t length)
+{
+	uintptr_t mask = JIT_PAGE_SIZE - 1;
+	uint8_t *first = length ? (uint8_t *)((uintptr_t)start & ~mask) : NULL;
+	uint8_t *end = length ? (uint8_t *)(((uintptr_t)start + length + mask) & ~mask) : NULL;
+
+	if(first >= jit->writable_start && end <= jit->writable_end)
+		return 0;
+
+	if((jit->writable_end != jit->writable_start &&
+		mprotect(jit->writable_start, (size_t)(jit->writable_end - jit->writable_start), PROT_READ | PROT_EXEC) != 0) ||
+	   (length && mprotect(first, (size_t)(end - first), PROT_READ | PROT_WRITE) != 0))
+	{
+		fprintf(stderr, "i8080 JIT: cannot change the code buffer's protection, using the interpreter\n");
+		jit->unavailable = 1;
+		i8080_jit_flush(jit);
+		return -1;
+	}
+	jit->writable_start = first;
+	jit->writable_end = end;
+	return 0;
+}
+
+// Translate the block starting at blk->start, leaving blk NATIVE or REFUSED
+static void jit_translate(jit_block_t *blk)
+{
+	uint16_t pc = blk->start;
+	uint8_t page = (uint8_t)(pc >> 8);
+	int32_t slot = (int32_t)((size_t)(blk - jit->blocks) * sizeof(jit_block_t));
+	uint32_t cycles = 0, count = 0, max_cycles;
+	uint8_t op = read8(jit->memory, pc);
+	uint8_t *fail[3];
+
+	if(!jit_op_translatable(op) || (pc & 0xff) + jit_op_length(op) > 0x100)
+	{
+		blk->state = JIT_REFUSED;
+		return;
+	}
+
+	if(jit->code_ptr + JIT_BLOCK_RESERVE > jit->code_base + JIT_CODE_SIZE)
+	{
+		jit_block_t keep = *blk;
+
+		i8080_jit_flush(jit);
+		jit->stats.flushes++;
+		*blk = keep;
+	}
+	if(jit_protect(jit->code_ptr, JIT_BLOCK_RESERVE) != 0)
+		return;
+
+	blk->code = jit->code_ptr;
+	emit_entry(slot, page, fail);
+	blk->body = (uint8_t)(jit->code_ptr - blk->code);
+
+	for(;;)
+	{
+		uint8_t len;
+		uint16_t imm16;
+		int writes;
+
+		op = read8(jit->memory, pc);
+		len = jit_op_length(op);
+		if(count == MAX_BLOCK_OPS || !jit_op_translatable(op) || (pc & 0xff) + len > 0x100)
+		{
+			emit_exit_to(pc, cycles, count);
+			max_cycles = cycles;
+			break;
+		}
+
+		imm16 = len > 1 ? (uint16_t)(read8(jit->memory, pc + 1) | (len > 2 ? read8(jit->memory, pc + 2) << 8 : 0)) : 0;
+		if(jit_op_ends_block(op))
+		{
+			max_cycles = cycles + emit_branch(op, pc, imm16, cycles, count);
+			pc += len;
+			break;
+		}
+
+		cycles += emit_body(op, pc, (uint8_t)imm16, imm16, &writes);
+		count++;
+		pc += len;
+
+		if(writes)
+		{
+			// Leave if the store hit this block's page
+			uint8_t *same;
+
+			emit_op_mem(0, 0, 0x8b, RAX, R13, NO_INDEX, 0, page * 4);
+			emit_op_mem(0, 0, 0x3b, RAX, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, gen));
+			same = x_jcc(X86_JZ);
+			emit_exit_to(pc, cycles, count);
+			x_patch(same);
+		}
+
+		if(pc >> 8 != page)
+		{
+			emit_exit_to(pc, cycles, count);
+			max_cycles = cycles;
+			break;
+		}
+	}
+
+	// Failed entry checks leave with registers.pc at the block's start, unless
+	// a stale link led here and the block's slot has a newer translation
+	x_patch(fail[0]);
+	x_patch(fail[1]);
+	x_patch(fail[2]);
+	x_st16_imm(OFF_PC, blk->start);
+	x_lea_rip(RAX, blk->code);
+	emit_op_mem(0, 1, 0x3b, RAX, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, code));
+	x_jcc_to(X86_JZ, jit->leave);
+	emit_op_mem(0x66, 0, 0x81, 7, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, start));
+	emit16(blk->start);
+	x_jcc_to(X86_JNZ, jit->leave);
+	emit_op_mem(0, 0, 0x80, 7, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, state));
+	emit8(JIT_NATIVE);
+	x_jcc_to(X86_JNZ, jit->leave);
+	emit_op_mem(0, 0, 0xff, 4, R15, NO_INDEX, 0, slot + offsetof(jit_block_t, code));
+
+	// Keep the source so a write elsewhere on the page need not drop the block
+	blk->length = (uint8_t)(uint16_t)(pc - blk->start);
+	blk->source = jit->code_ptr;
+	memcpy(jit->code_ptr, &jit->memory->bytes[blk->start], blk->length);
+	jit->code_ptr += blk->length;
+
+	blk->max_cycles = (uint16_t)max_cycles;
+	blk->state = JIT_NATIVE;
+	jit->stats.translations++;
+}
+
+// Run a native block, then rerun the same instructions in the interpreter
+// from the same starting state and keep the interpreter's result.
+static uint64_t jit_run_lockstep(intel8080_t *cpu, jit_block_t *blk)
+{
+	altair_memory_t *mem = cpu->memory;
+	registers_t before = cpu->registers, native;
+	uint64_t result;
+	uint32_t cycles = 0, count, i;
+
+	memcpy(jit->memory_before, mem->bytes, sizeof(jit->memory_before));
+	memcpy(jit->gen_before, mem->page_gen, sizeof(jit->gen_before));
+
+	result = jit->enter(cpu, blk->code + blk->body);
+	native = cpu->registers;
+	memcpy(jit->memory_native, mem->bytes, sizeof(jit->memory_native));
+
+	memcpy(mem->bytes, jit->memory_before, sizeof(jit->memory_before));
+	memcpy(mem->page_gen, jit->gen_before, sizeof(jit->gen_before));
+	cpu->registers = before;
+
+	count = (uint32_t)(result >> 32);
+	for(i = 0; i < count; i++)
+	{
+		cpu->current_op_code = read8(mem, cpu->registers.pc);
+		cycles += i8080_opcode_handlers[cpu->current_op_code](cpu);
+	}
+
+	jit->stats.lockstep_checks++;
+	if(cycles != (uint32_t)result || memcmp(&native, &cpu->registers, sizeof(native)) != 0 ||
+	   memcmp(jit->memory_native, mem->bytes, sizeof(jit->memory_native)) != 0)
+	{
+		jit->stats.lockstep_mismatches++;
+		fprintf(stderr, "i8080 JIT: lockstep mismatch in block %04x after %u instructions\n"
+				"  native:      pc=%04x af=%04x bc=%04x de=%04x hl=%04x sp=%04x cycles=%u\n"
+				"  interpreter: pc=%04x af=%04x bc=%04x de=%04x hl=%04x sp=%04x cycles=%u\n",
+				blk->start, (unsigned)count,
+				native.pc, native.af, native.bc, native.de, native.hl, native.sp, (unsigned)(uint32_t)result,
+				cpu->registers.pc, cpu->registers.af, cpu->registers.bc, cpu->registers.de,
+				cpu->registers.hl, cpu->registers.sp, (unsigned)cycles);
+		for(i = 0; i < sizeof(jit->memory_native); i++)
+		{
+			if(jit->memory_native[i] != mem->bytes[i])
+			{
+				fprintf(stderr, "  memory %04x: native %02x, interpreter %02x\n", (unsigned)i, jit->memory_native[i], mem->bytes[i]);
+				break;
+			}
+		}
+		blk->state = JIT_REFUSED;
+		blk->code = NULL;
+	}
+
+	return (uint64_t)count << 32 | cycles;
+}
+
+i8080_code_cache_t *i8080_code_cache_create(void)
+{
+	i8080_code_cache_t *cache = calloc(1, sizeof(i8080_code_cache_t));
+	void *code;
+
+	if(!cache)
+		return NULL;
+
+	jit = cache;
+	code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(code == MAP_FAILED)
+	{
+		fprintf(stderr, "i8080 JIT: no memory for the code buffer, using the interpreter\n");
+		jit->unavailable = 1;
+		return cache;
+	}
+	jit->code_base = jit->code_ptr = code;
+	jit->writable_start = jit->code_base;
+	jit->writable_end = jit->code_base + JIT_CODE_SIZE;
+	memcpy(jit->context.szp, i8080_szp_table, sizeof(jit->context.szp));
+	emit_stubs();
+	return cache;
+}
+
+void i8080_code_cache_destroy(i8080_code_cache_t *cache)
+{
+	if(!cache)
+		return;
+	if(cache->code_base)
+		munmap(cache->code_base, JIT_CODE_SIZE);
+	if(jit == cache)
+		jit = NULL;
+	free(cache);
+}
+
+void i8080_jit_stats(const i8080_code_cache_t *cache, i8080_jit_stats_t *stats)
+{
+	if(cache)
+		*stats = cache->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+}
+
+int i8080_jit_set_lockstep(i8080_code_cache_t *cache, int enable)
+{
+	if(!cache)
+		return -1;
+	cache->lockstep = enable;
+	return 0;
+}
+
+uint32_t i8080_run_core(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
+{
+	altair_memory_t *mem = cpu->memory;
+	uint32_t elapsed = 0;
+	uint32_t count = 0;
+
+	if(!cpu->code_cache)
+		return i8080_run_jump_table(cpu, cycle_budget, stop_flags);
+
+	jit = cpu->code_cache;
+	if(mem != jit->memory)
+	{
+		// Translations of other memory mean nothing here
+		i8080_jit_flush(jit);
+		jit->memory = mem;
+	}
+
+	cpu->events = 0;
+	jit->context.stop_flags = stop_flags;
+
+	do
+	{
+		uint16_t pc = cpu->registers.pc;
+		jit_block_t *blk = &jit->blocks[pc & (JIT_BLOCKS - 1)];
+		uint32_t gen = mem->page_gen[pc >> 8];
+
+#if I8080_USE_PC_TRAPS
+		// Blocks are never linked to a trapped address, so every jump there
+		// comes back through here
+		if(I8080_TRAPPED(cpu, pc))
+		{
+			cpu->events |= I8080_EVENT_TRAP;
+			break;
+		}
+#endif
+
+		if(blk->start != pc || blk->state == JIT_EMPTY)
+		{
+			// Old code still reachable through links fails its entry check
+			// once it is no longer its slot's translation
+			blk->code = NULL;
+			blk->start = pc;
+			blk->gen = gen;
+			blk->state = jit->unavailable ? JIT_REFUSED : JIT_COLD;
+			blk->heat = 0;
+		}
+		else if(blk->gen != gen)
+		{
+			// The page was written; keep the translation if its own bytes are unchanged
+			if(blk->state == JIT_NATIVE && memcmp(&mem->bytes[pc], blk->source, blk->length) != 0)
+			{
+				jit->stats.invalidations++;
+				blk->code = NULL;
+				blk->state = JIT_COLD;
+				blk->heat = 0;
+			}
+			else if(blk->state == JIT_REFUSED && !jit->unavailable)
+			{
+				blk->state = JIT_COLD;
+			}
+			blk->gen = gen;
+		}
+
+		if(blk->state == JIT_COLD && ++blk->heat >= I8080_JIT_HOT_THRESHOLD)
+			jit_translate(blk);
+
+		if(jit->context.link_site)
+		{
+			if(blk->state == JIT_NATIVE && jit_protect(jit->context.link_site, 5) == 0)
+				jit_link(jit->context.link_site, blk);
+			jit->context.link_site = NULL;
+		}
+
+		// Native code stores through write_map[] without checking for
+		// trapped pages, so those run in the interpreter while any are set
+		if(blk->state == JIT_NATIVE && cycle_budget - elapsed >= blk->max_cycles && !mem->trapped_pages &&
+		   jit_protect(NULL, 0) == 0)
+		{
+			uint64_t result;
+
+			// Enter past the checks just done. Lockstep checks one block at a
+			// time, so its zero budget fails the entry check of the next one.
+			jit->context.budget = jit->lockstep ? 0 : cycle_budget - elapsed;
+			result = jit->lockstep ? jit_run_lockstep(cpu, blk) : jit->enter(cpu, blk->code + blk->body);
+
+			elapsed += (uint32_t)result;
+			count += (uint32_t)(result >> 32);
+			jit->stats.native_entries++;
+			continue;
+		}
+
+		cpu->current_op_code = read8(mem, pc);
+		elapsed += i8080_opcode_handlers[cpu->current_op_code](cpu);
+		count++;
+		jit->stats.interpreted++;
+	} while (elapsed < cycle_budget && !(cpu->events & stop_flags));
+
+	// The caller may change registers.pc before the next run
+	jit->context.link_site = NULL;
+
+	cpu->cycles += elapsed;
+	cpu->instructions += count;
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH;
+	cpu->address_bus = cpu->registers.pc;
+	cpu->data_bus = read8(mem, cpu->registers.pc);
+
+	return elapsed;
+}
+
+#endif
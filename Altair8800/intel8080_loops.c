@@ -0,0 +1,457 @@
+// Loop idioms for the interpreter cores, selected with I8080_LOOP_IDIOMS.
+//
+// The 8080 has no block instructions, so software copies, fills, sums, scans
+// and compares memory with short loops of MOV/LDAX/STAX/INX/DCR that end in a
+// conditional jump back to their first instruction. When such a jump is taken
+// the core stops and i8080_run() calls i8080_loop_run() with PC at the loop
+// start. The body is matched against the forms below (P and Q are BC, DE or
+// HL, each stepped once per pass by INX or DCX; "count" is DCR r, or DCX rp
+// followed by MOV A,x / ORA y on the two halves of rp):
+//
+//   copy		LD A,(P); ST (Q),A; [ADD r; MOV r,A]; steps; count; JNZ
+//   fill		ST (Q),r or MVI M,n; step; count; JNZ
+//   sum		ADD M; step H; DCR r; JNZ
+//   scan		LD A,(P); step; ORA A, ANA A or CPI n; Jcc (NZ/Z, or P/M after ORA/ANA)
+//   compare	LDAX P; CMP M; JNZ out; steps; count; JNZ
+//
+// Only passes that are certain to jump back again, and that end before the
+// cycle budget runs out, are taken over: all but the last with memmove(),
+// memset() or a plain loop, and the last through the jump-table handlers so
+// the accumulator and flags come out exactly as if every pass had been
+// interpreted. Whatever is left, including the pass that leaves the loop,
+// goes back to the core. Passes that would store into the loop's own code or
+// into a page that is not RAM, or run a pointer around the end of memory, are
+// left to the interpreter too.
+#include "intel8080_ops.h"
+
+#if I8080_USE_LOOP_IDIOMS
+
+#include "memory.h"
+#include <string.h>
+
+// For I8080_FLAGS_SYNC(); the last pass runs on the jump-table handlers
+#define CPU_F		cpu->registers.flags
+#define CPU_LAZY	cpu->lazy_flags
+
+#define LOOP_MIN_PASSES	4	// shorter runs are left to the interpreter
+
+enum
+{
+	LOOP_COPY,
+	LOOP_FILL,
+	LOOP_SUM,
+	LOOP_SCAN,
+	LOOP_COMPARE
+};
+
+#define LOOP_NONE	0xff
+
+typedef struct
+{
+	uint8_t form;
+	uint8_t ops;			// instructions per pass
+	uint16_t cycles;		// T-states per pass
+	uint8_t src, dst;		// pointer pairs (0 BC, 1 DE, 2 HL) or LOOP_NONE
+	int8_t src_step, dst_step;
+	uint8_t counter;		// r8 index of a DCR counter, or LOOP_NONE
+	uint8_t counter_pair;	// pair of a DCX counter, or LOOP_NONE
+	uint8_t acc;			// r8 index of a copy's checksum register, or LOOP_NONE
+	uint8_t value;			// r8 index of a fill's value, LOOP_NONE for MVI M
+	uint8_t imm;			// MVI M or CPI operand
+	uint8_t test;			// scan: ORA A, ANA A or CPI
+	uint8_t jump;			// scan: opcode of the jump back
+	uint16_t end;			// address after the jump back
+} loop_t;
+
+// LDAX, MOV A,M, STAX, MOV M,r, MVI M and ADD M
+const uint8_t i8080_loop_heads[256] = {
+	[0x02] = 1, [0x0a] = 1, [0x12] = 1, [0x1a] = 1, [0x36] = 1, [0x7e] = 1, [0x86] = 1,
+	[0x70] = 1, [0x71] = 1, [0x72] = 1, [0x73] = 1, [0x74] = 1, [0x75] = 1, [0x77] = 1
+};
+
+// r8 index of each register in opcode order; M (6) has none
+static const uint8_t loop_r8[8] = {
+	I8080_R8_B, I8080_R8_C, I8080_R8_D, I8080_R8_E, I8080_R8_H, I8080_R8_L, LOOP_NONE, I8080_R8_A
+};
+
+static uint16_t *loop_pair(intel8080_t *cpu, uint8_t pair)
+{
+	return pair == 0 ? &cpu->registers.bc : pair == 1 ? &cpu->registers.de : &cpu->registers.hl;
+}
+
+// True if the r8 register is one half of the pair
+static int loop_in_pair(uint8_t r8, uint8_t pair)
+{
+	return pair != LOOP_NONE && r8 != LOOP_NONE && (r8 >> 1) == pair + 1;
+}
+
+// Pointer pair read or written by LDAX/STAX/MOV A,M/MOV M,A, else LOOP_NONE
+static uint8_t loop_load_pair(uint8_t op)
+{
+	return op == 0x0a ? 0 : op == 0x1a ? 1 : op == 0x7e ? 2 : LOOP_NONE;
+}
+
+static uint8_t loop_store_pair(uint8_t op)
+{
+	return op == 0x02 ? 0 : op == 0x12 ? 1 : op == 0x77 ? 2 : LOOP_NONE;
+}
+
+// Decodes the loop starting at start. Returns 0 if it is not one of the forms.
+static int loop_match(const altair_memory_t *mem, uint16_t start, loop_t *loop)
+{
+	uint16_t pc = start;
+	uint16_t limit = start + I8080_LOOP_MAX_BYTES;
+	uint8_t op = read8(mem, pc);
+	uint8_t src_steps = 0, dst_steps = 0, tests = 0;
+
+	memset(loop, 0, sizeof(*loop));
+	loop->src = loop->dst = loop->counter = loop->counter_pair = loop->acc = loop->value = LOOP_NONE;
+
+	// The head reads or writes memory before any pointer moves
+	if(loop_load_pair(op) != LOOP_NONE)
+	{
+		uint8_t next = read8(mem, pc + 1);
+
+		loop->src = loop_load_pair(op);
+		loop->cycles = op == 0x7e ? CYCLES_MOV_MEM : CYCLES_LDAX;
+		if(loop_store_pair(next) != LOOP_NONE && loop_store_pair(next) != loop->src)
+		{
+			loop->form = LOOP_COPY;
+			loop->dst = loop_store_pair(next);
+			loop->cycles += next == 0x77 ? CYCLES_MOV_MEM : CYCLES_STAX;
+			pc += 2;
+			loop->ops = 2;
+
+			// ADD r; MOV r,A keeps a running sum of the bytes copied in r
+			op = read8(mem, pc);
+			if((op & 0xf8) == 0x80 && (op & 7) != 6 && (op & 7) != 7 && read8(mem, pc + 1) == (0x47 | (op & 7) << 3))
+			{
+				loop->acc = loop_r8[op & 7];
+				if(loop_in_pair(loop->acc, loop->src) || loop_in_pair(loop->acc, loop->dst))
+					return 0;
+				loop->cycles += CYCLES_ADD + CYCLES_MOV_REG;
+				pc += 2;
+				loop->ops += 2;
+			}
+		}
+		else if(next == 0xbe && loop->src != 2 && op != 0x7e)
+		{
+			// LDAX P; CMP M; JNZ out
+			if(read8(mem, pc + 2) != 0xc2)
+				return 0;
+			loop->form = LOOP_COMPARE;
+			loop->dst = 2;
+			loop->cycles += CYCLES_ALU_MEM + CYCLES_JMP;
+			pc += 5;
+			loop->ops = 3;
+		}
+		else
+		{
+			loop->form = LOOP_SCAN;
+			pc++;
+			loop->ops = 1;
+		}
+	}
+	else if(op == 0x36 || loop_store_pair(op) != LOOP_NONE || ((op & 0xf8) == 0x70 && op != 0x76))
+	{
+		loop->form = LOOP_FILL;
+		if(op == 0x36)
+		{
+			loop->dst = 2;
+			loop->imm = read8(mem, pc + 1);
+			loop->cycles = CYCLES_MVI_MEM;
+			pc += 2;
+		}
+		else if(loop_store_pair(op) != LOOP_NONE)
+		{
+			loop->dst = loop_store_pair(op);
+			loop->value = I8080_R8_A;
+			loop->cycles = op == 0x77 ? CYCLES_MOV_MEM : CYCLES_STAX;
+			pc++;
+		}
+		else
+		{
+			loop->dst = 2;
+			loop->value = loop_r8[op & 7];
+			if(loop_in_pair(loop->value, 2))
+				return 0;
+			loop->cycles = CYCLES_MOV_MEM;
+			pc++;
+		}
+		loop->ops = 1;
+	}
+	else if(op == 0x86)
+	{
+		loop->form = LOOP_SUM;
+		loop->src = 2;
+		loop->cycles = CYCLES_ALU_MEM;
+		pc++;
+		loop->ops = 1;
+	}
+	else
+	{
+		return 0;
+	}
+
+	// The tail moves the pointers, counts and tests, in any order, and jumps
+	// back. Nothing in it writes flags except the counter or the scan's test.
+	while(pc < limit)
+	{
+		uint8_t pair = (op = read8(mem, pc)) >> 4 & 3;
+
+		if((op & 0xc7) == 0xc2)
+		{
+			if(read16(mem, pc + 1) != start)
+				return 0;
+			loop->jump = op;
+			loop->end = pc + 3;
+			loop->cycles += CYCLES_JMP;
+			loop->ops++;
+			break;
+		}
+
+		if((op & 0xc7) == 0x03 && pair != 3 && pair == loop->src && !src_steps)
+		{
+			loop->src_step = op & 0x08 ? -1 : 1;
+			loop->cycles += CYCLES_INX;
+			src_steps++;
+		}
+		else if((op & 0xc7) == 0x03 && pair != 3 && pair == loop->dst && pair != loop->src && !dst_steps)
+		{
+			loop->dst_step = op & 0x08 ? -1 : 1;
+			loop->cycles += CYCLES_INX;
+			dst_steps++;
+		}
+		else if((op & 0xcf) == 0x0b && pair != 3 && loop->counter == LOOP_NONE && loop->counter_pair == LOOP_NONE)
+		{
+			// DCX rp; MOV A,hi; ORA lo (or lo, then hi) tests rp for zero
+			uint8_t mov = read8(mem, pc + 1), ora = read8(mem, pc + 2);
+			uint8_t hi = pair * 2, lo = pair * 2 + 1;
+
+			if(!((mov == (0x78 | hi) && ora == (0xb0 | lo)) || (mov == (0x78 | lo) && ora == (0xb0 | hi))))
+				return 0;
+			loop->counter_pair = pair;
+			loop->cycles += CYCLES_DCX + CYCLES_MOV_REG + CYCLES_ORA;
+			loop->ops += 2;
+			pc += 2;
+		}
+		else if((op & 0xc7) == 0x05 && op != 0x35 && op != 0x3d && loop->counter == LOOP_NONE &&
+				loop->counter_pair == LOOP_NONE)
+		{
+			loop->counter = loop_r8[op >> 3 & 7];
+			loop->cycles += CYCLES_DCR;
+		}
+		else if(loop->form == LOOP_SCAN && !tests && (op == 0xb7 || op == 0xa7 || op == 0xfe))
+		{
+			loop->test = op;
+			if(op == 0xfe)
+			{
+				loop->imm = read8(mem, pc + 1);
+				loop->cycles += CYCLES_CPI;
+				pc++;
+			}
+			else
+			{
+				loop->cycles += CYCLES_ORA;
+			}
+			tests++;
+		}
+		else
+		{
+			return 0;
+		}
+		pc++;
+		loop->ops++;
+	}
+	if(!loop->end)
+		return 0;
+
+	// Every pointer moves exactly once per pass and nothing else touches it
+	if((loop->src != LOOP_NONE && src_steps != 1) || (loop->dst != LOOP_NONE && dst_steps != 1))
+		return 0;
+	if(loop->form == LOOP_SCAN)
+	{
+		return tests == 1 && loop->counter == LOOP_NONE && loop->counter_pair == LOOP_NONE &&
+			   (loop->jump == 0xc2 || loop->jump == 0xca || (loop->test != 0xfe && (loop->jump == 0xf2 || loop->jump == 0xfa)));
+	}
+
+	// The rest count down to zero with JNZ
+	if(loop->jump != 0xc2 || (loop->counter == LOOP_NONE && loop->counter_pair == LOOP_NONE))
+		return 0;
+	if(loop->counter != LOOP_NONE)
+	{
+		if(loop->counter == I8080_R8_A || loop_in_pair(loop->counter, loop->src) || loop_in_pair(loop->counter, loop->dst) ||
+		   loop->counter == loop->acc || loop->counter == loop->value)
+			return 0;
+	}
+	else
+	{
+		// The zero test goes through A
+		if(loop->counter_pair == loop->src || loop->counter_pair == loop->dst || loop->value == I8080_R8_A ||
+		   loop_in_pair(loop->acc, loop->counter_pair) || loop_in_pair(loop->value, loop->counter_pair))
+			return 0;
+	}
+	if(loop->form == LOOP_SUM && loop->counter == LOOP_NONE)
+		return 0;
+	return 1;
+}
+
+// Passes a pointer can make from p before it wraps around 64K
+static uint32_t loop_room(uint16_t p, int8_t step)
+{
+	return step > 0 ? 0x10000u - p : p + 1u;
+}
+
+// Passes a pointer can store through before it reaches the loop's own code
+static uint32_t loop_clear_of_code(const loop_t *loop, uint16_t start, uint16_t p, int8_t step)
+{
+	uint16_t len = loop->end - start;
+
+	if((uint16_t)(p - start) < len)
+		return 0;
+	return step > 0 ? (uint16_t)(start - p) : (uint16_t)(p - (loop->end - 1));
+}
+
+// True if a scan continues past the byte
+static int loop_scan_continues(const loop_t *loop, uint8_t val)
+{
+	if(loop->jump == 0xf2 || loop->jump == 0xfa)
+		return !(val & 0x80) == (loop->jump == 0xf2);
+	return (val == (loop->test == 0xfe ? loop->imm : 0)) == (loop->jump == 0xca);
+}
+
+// Runs whole passes of the loop at PC natively, within cycle_budget. Returns
+// the T-states taken, or 0 if the loop is not an idiom or too few passes are left.
+uint32_t i8080_loop_run(intel8080_t *cpu, uint32_t cycle_budget)
+{
+	altair_memory_t *mem = cpu->memory;
+	uint16_t start = cpu->registers.pc;
+	uint16_t *src = NULL, *dst = NULL;
+	uint32_t passes, native, cycles, i;
+	loop_t loop;
+
+	if(!loop_match(mem, start, &loop))
+		return 0;
+
+	// Passes that certainly jump back again and fit in the budget
+	passes = cycle_budget / loop.cycles;
+	if(loop.counter != LOOP_NONE && passes > (uint8_t)(cpu->registers.r8[loop.counter] - 1))
+		passes = (uint8_t)(cpu->registers.r8[loop.counter] - 1);
+	if(loop.counter_pair != LOOP_NONE && passes > (uint16_t)(*loop_pair(cpu, loop.counter_pair) - 1))
+		passes = (uint16_t)(*loop_pair(cpu, loop.counter_pair) - 1);
+	if(loop.src != LOOP_NONE)
+	{
+		src = loop_pair(cpu, loop.src);
+		if(passes > loop_room(*src, loop.src_step))
+			passes = loop_room(*src, loop.src_step);
+	}
+	if(loop.dst != LOOP_NONE)
+	{
+		dst = loop_pair(cpu, loop.dst);
+		if(passes > loop_room(*dst, loop.dst_step))
+			passes = loop_room(*dst, loop.dst_step);
+		if(loop.form != LOOP_COMPARE && passes > loop_clear_of_code(&loop, start, *dst, loop.dst_step))
+			passes = loop_clear_of_code(&loop, start, *dst, loop.dst_step);
+		if(loop.form != LOOP_COMPARE)
+			passes = memory_ram_room(mem, *dst, loop.dst_step, passes);
+	}
+	if(loop.form == LOOP_SCAN)
+	{
+		for(i = 0; i < passes && loop_scan_continues(&loop, read8(mem, *src + loop.src_step * (int32_t)i)); i++)
+			;
+		passes = i;
+	}
+	else if(loop.form == LOOP_COMPARE)
+	{
+		for(i = 0; i < passes && read8(mem, *src + loop.src_step * (int32_t)i) == read8(mem, *dst + loop.dst_step * (int32_t)i); i++)
+			;
+		passes = i;
+	}
+	if(passes < LOOP_MIN_PASSES)
+		return 0;
+
+	// All but the last pass, without flags
+	native = passes - 1;
+	switch(loop.form)
+	{
+	case LOOP_COPY:
+	{
+		uint16_t s = *src, d = *dst;
+		uint16_t s_lo = loop.src_step > 0 ? s : s - native + 1;
+		uint16_t d_lo = loop.dst_step > 0 ? d : d - native + 1;
+		uint8_t sum = 0;
+
+		// A forward copy onto a destination just above its source, or a
+		// backward one just below, reads bytes it has already written
+		if(loop.src_step == loop.dst_step && (uint16_t)((loop.src_step > 0 ? d - s : s - d) - 1) >= native - 1)
+		{
+			memmove(&mem->bytes[d_lo], &mem->bytes[s_lo], native);
+			if(loop.acc != LOOP_NONE)
+			{
+				for(i = 0; i < native; i++)
+					sum += mem->bytes[d_lo + i];
+			}
+		}
+		else
+		{
+			for(i = 0; i < native; i++)
+			{
+				uint8_t val = read8(mem, s);
+
+				mem->bytes[d] = val;
+				sum += val;
+				s += loop.src_step;
+				d += loop.dst_step;
+			}
+		}
+		memory_pages_written(mem, d_lo, native);
+		if(loop.acc != LOOP_NONE)
+			cpu->registers.r8[loop.acc] += sum;
+		break;
+	}
+	case LOOP_FILL:
+	{
+		uint16_t d_lo = loop.dst_step > 0 ? *dst : *dst - native + 1;
+
+		memset(&mem->bytes[d_lo], loop.value == LOOP_NONE ? loop.imm : cpu->registers.r8[loop.value], native);
+		memory_pages_written(mem, d_lo, native);
+		break;
+	}
+	case LOOP_SUM:
+	{
+		uint16_t s_lo = loop.src_step > 0 ? *src : *src - native + 1;
+		uint8_t sum = 0;
+
+		for(i = 0; i < native; i++)
+			sum += mem->bytes[s_lo + i];
+		cpu->registers.a += sum;
+		break;
+	}
+	default:
+		break;
+	}
+	if(src)
+		*src += loop.src_step * (int32_t)native;
+	if(dst && dst != src)
+		*dst += loop.dst_step * (int32_t)native;
+	if(loop.counter != LOOP_NONE)
+		cpu->registers.r8[loop.counter] -= native;
+	if(loop.counter_pair != LOOP_NONE)
+		*loop_pair(cpu, loop.counter_pair) -= native;
+
+	// The last pass sets A and the flags as the interpreter would
+	cycles = native * loop.cycles;
+	for(i = 0; i < loop.ops; i++)
+	{
+		uint8_t op_code = cpu->current_op_code = read8(mem, cpu->registers.pc);
+
+		cycles += i8080_opcode_handlers[op_code](cpu);
+	}
+	I8080_FLAGS_SYNC();
+	cpu->cycles += cycles;
+	cpu->instructions += passes * loop.ops;
+	I8080_COUNT_N(cpu, loop_instructions, passes * loop.ops);
+	return cycles;
+}
+
+#endif
@@ -0,0 +1,560 @@
+#ifndef _INTEL8080_OPS_H_
+#define _INTEL8080_OPS_H_
+
+// Instruction bodies shared by the interpreter cores.
+//
+// A core includes this header and defines, before expanding any body:
+//   CPU_A, CPU_F						accumulator and flags lvalues
+//   CPU_SP, CPU_PC						stack pointer and program counter lvalues
+//   CPU_GET_B() .. CPU_GET_L(), CPU_SET_B(v) .. CPU_SET_L(v), plus CPU_GET_A()/CPU_SET_A(v)
+//   CPU_GET_BC() .. CPU_GET_SP(), CPU_SET_BC(v) .. CPU_SET_SP(v)
+//   CPU_LAZY							i8080_lazy_flags_t lvalue holding the pending flag state
+//   CPU_RD8(a), CPU_WR8(a, v), CPU_RD16(a), CPU_WR16(a, v)
+//   CPU_IMM8(), CPU_IMM16()			the current instruction's operand bytes
+//   CPU_SAVE(), CPU_LOAD()		copy registers to/from *cpu around calls out of the core
+//   OP_END(n)					finish an instruction that took n T-states
+//   OP_END_EVENT(n)			as OP_END, after an instruction that may have raised an event
+//   CPU_NOW()					T-states since reset at the start of the current instruction
+//								(I8080_CALL_PROFILE builds only)
+//
+// I8080_OPCODE_TABLE(X) expands X(opcode, body) for all 256 opcodes.
+
+#include "intel8080.h"
+#include "op_codes.h"
+
+// The dynamic recompiler only has an x86-64 backend and needs mmap; elsewhere
+// I8080_JIT falls back to the interpreter cores below. It takes precedence
+// over them and runs the jump-table handlers for what it does not translate.
+#if defined(I8080_JIT) && I8080_JIT && defined(__x86_64__) && !defined(_WIN32) && \
+	!(defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE) && !(defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS)
+#define I8080_USE_JIT 1
+#else
+#define I8080_USE_JIT 0
+#endif
+
+// Calls and returns are reported to cpu->call_hooks, see callgraph.h. The
+// recompiler neither reports them nor counts instructions for ALTAIR_COUNTERS,
+// so it is left out of such builds.
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+#define I8080_USE_CALL_PROFILE 1
+#else
+#define I8080_USE_CALL_PROFILE 0
+#endif
+
+// Labels-as-values dispatch needs GCC or Clang; other compilers keep the jump table.
+// The block cache core is built on the same dispatch and takes precedence.
+#if defined(__GNUC__) || defined(__clang__)
+#define I8080_HAVE_LABELS_AS_VALUES 1
+#else
+#define I8080_HAVE_LABELS_AS_VALUES 0
+#endif
+
+#if defined(I8080_BLOCK_CACHE) && I8080_BLOCK_CACHE && I8080_HAVE_LABELS_AS_VALUES && !I8080_USE_JIT
+#define I8080_USE_BLOCK_CACHE 1
+#else
+#define I8080_USE_BLOCK_CACHE 0
+#endif
+
+#if defined(I8080_THREADED_DISPATCH) && I8080_THREADED_DISPATCH && I8080_HAVE_LABELS_AS_VALUES && !I8080_USE_BLOCK_CACHE && \
+	!I8080_USE_JIT
+#define I8080_USE_THREADED_CORE 1
+#else
+#define I8080_USE_THREADED_CORE 0
+#endif
+
+// Pair profiling counts what the jump-table loop dispatches, so it runs unfused
+#if defined(I8080_PAIR_PROFILE) && I8080_PAIR_PROFILE && !I8080_USE_THREADED_CORE && !I8080_USE_BLOCK_CACHE && \
+	!I8080_USE_JIT
+#define I8080_USE_PAIR_PROFILE 1
+#else
+#define I8080_USE_PAIR_PROFILE 0
+#endif
+
+// Superinstructions for the jump-table core, see intel8080_fusion.h
+#if defined(I8080_FUSION) && I8080_FUSION && !I8080_USE_THREADED_CORE && !I8080_USE_BLOCK_CACHE && !I8080_USE_JIT && \
+	!I8080_USE_PAIR_PROFILE && !I8080_USE_CALL_PROFILE
+#define I8080_USE_FUSION 1
+#else
+#define I8080_USE_FUSION 0
+#endif
+
+// Host handlers at trapped addresses, see i8080_trap_set()
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+#define I8080_USE_PC_TRAPS 1
+#else
+#define I8080_USE_PC_TRAPS 0
+#endif
+
+// Copy, fill, sum, scan and compare loops in the interpreter cores, see intel8080_loops.c
+#if defined(I8080_LOOP_IDIOMS) && I8080_LOOP_IDIOMS && !I8080_USE_BLOCK_CACHE && !I8080_USE_JIT && !I8080_USE_PAIR_PROFILE
+#define I8080_USE_LOOP_IDIOMS 1
+#else
+#define I8080_USE_LOOP_IDIOMS 0
+#endif
+
+// GCC's SLP vectorizer packs the register locals of the label-dispatched cores
+// into a vector around the shared save/load code, which forces every dispatch
+// back through one block.
+#if defined(__GNUC__) && !defined(__clang__)
+#define I8080_LABEL_CORE_ATTR	__attribute__((optimize("no-tree-slp-vectorize")))
+#else
+#define I8080_LABEL_CORE_ATTR
+#endif
+
+// Code generated by the recompiler reads and writes the flags byte directly
+#if defined(I8080_LAZY_FLAGS) && I8080_LAZY_FLAGS && !I8080_USE_JIT
+#define I8080_USE_LAZY_FLAGS 1
+#else
+#define I8080_USE_LAZY_FLAGS 0
+#endif
+
+// define CPU stats LEDs
+#define STATUS_MEMORY_READ		0x80
+#define STATUS_PORT_INPUT		0x40
+#define STATUS_OP_CODE_FETCH	0x20
+#define STATUS_PORT_OUTPUT		0x10
+#define STATUS_HALT				0x08
+#define STATUS_STACK			0x04
+#define STATUS_WRITE_OUTPUT		0x02	// inverted!
+#define STATUS_INTERRUPT		0x01
+
+#define I8080_SZP_MASK		(FLAGS_SIGN | FLAGS_ZERO | FLAGS_PARITY)
+
+// Sign, zero and parity flags for each result byte
+extern const uint8_t i8080_szp_table[256];
+
+// Each core provides i8080_run_core(). i8080_run() in intel8080.c wraps it
+// with the halt state and the loop idioms, and adds I8080_CORE_STOPS to the
+// events the caller asked to stop at.
+uint32_t i8080_run_core(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags);
+
+#if I8080_USE_LOOP_IDIOMS
+// Raised by a conditional jump taken back over fewer than I8080_LOOP_MAX_BYTES
+// to an instruction that can start an idiom. The core stops as for a stop
+// event, and i8080_run() calls i8080_loop_run() before running the core again.
+#define I8080_EVENT_LOOP		0x80
+#define I8080_LOOP_MAX_BYTES	16
+
+// Nonzero for the opcodes a loop idiom can start with
+extern const uint8_t i8080_loop_heads[256];
+
+#define I8080_LOOP_CHECK(from, n) \
+	if((uint16_t)((from) - CPU_PC) < I8080_LOOP_MAX_BYTES && i8080_loop_heads[CPU_RD8(CPU_PC)]) \
+	{ \
+		cpu->events |= I8080_EVENT_LOOP; \
+		OP_END_EVENT(n); \
+	}
+
+// Runs whole passes of the idiom loop at PC, see intel8080_loops.c
+uint32_t i8080_loop_run(intel8080_t *cpu, uint32_t cycle_budget);
+#else
+#define I8080_EVENT_LOOP		0x00
+#define I8080_LOOP_CHECK(from, n)	(void)(from);
+#endif
+
+// Raised by EI and by interrupt requests made while interrupts are enabled,
+// so that i8080_run() can take the interrupt at the right instruction
+#define I8080_EVENT_INTERRUPT	0x40
+
+#if I8080_USE_PC_TRAPS
+// Raised by a jump, call, return or RST that lands on a trapped address. The
+// core stops before the instruction there, and i8080_run() calls the trap's
+// handler before running the core again.
+#define I8080_EVENT_TRAP		0x20
+
+#define I8080_TRAPPED(cpu, address)	((cpu)->trap_map[(uint16_t)(address) >> 3] & (1 << ((address) & 7)))
+
+#define I8080_TRAP_CHECK(n) \
+	if(I8080_TRAPPED(cpu, CPU_PC)) \
+	{ \
+		cpu->events |= I8080_EVENT_TRAP; \
+		OP_END_EVENT(n); \
+	}
+#else
+#define I8080_EVENT_TRAP		0x00
+#define I8080_TRAP_CHECK(n)
+#endif
+
+#define I8080_CORE_STOPS		(I8080_STOP_HALT | I8080_EVENT_INTERRUPT | I8080_EVENT_LOOP | I8080_EVENT_TRAP)
+
+// The jump-table core's run loop, also used by the block cache and recompiler
+// for a CPU without a code cache
+uint32_t i8080_run_jump_table(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags);
+
+// Drops every translation of the recompiler's cache, which may be NULL
+void i8080_jit_flush(i8080_code_cache_t *cache);
+
+// Jump-table handlers, one per opcode; each returns the T-states it took
+extern uint8_t (*const i8080_opcode_handlers[256])(intel8080_t *cpu);
+
+// Flag helpers. Each takes the flags byte by pointer and returns the result.
+// Half carry is the carry into bit 4 of the addition, which is bit 4 of
+// a ^ b ^ result; carry is bit 8 of the 16-bit sum.
+
+static inline uint8_t i8080_flags_szp(uint8_t flags, uint8_t val)
+{
+	return (flags & ~I8080_SZP_MASK) | i8080_szp_table[val];
+}
+
+static inline uint8_t i8080_alu_add(uint8_t *flags, uint8_t a, uint16_t val)
+{
+	uint16_t sum = a + val;
+	uint8_t res = (uint8_t)sum;
+
+	*flags = (*flags & ~(I8080_SZP_MASK | FLAGS_H | FLAGS_CARRY)) | i8080_szp_table[res] |
+			 ((a ^ val ^ res) & FLAGS_H) | (sum >> 8);
+	return res;
+}
+
+// Subtract by adding the two's complement; the carry flag is inverted since we add.
+static inline uint8_t i8080_alu_sub(uint8_t *flags, uint8_t a, uint16_t val)
+{
+	uint16_t b = 0x100 - val;
+	uint16_t sum = a + b;
+	uint8_t res = (uint8_t)sum;
+
+	*flags = (*flags & ~(I8080_SZP_MASK | FLAGS_H | FLAGS_CARRY)) | i8080_szp_table[res] |
+			 ((a ^ b ^ res) & FLAGS_H) | ((sum >> 8) ^ FLAGS_CARRY);
+	return res;
+}
+
+// INR and DCR add 0x01 and 0xff, leaving carry alone
+static inline uint8_t i8080_alu_inr(uint8_t *flags, uint8_t val)
+{
+	uint8_t res = val + 1;
+
+	*flags = (*flags & ~(I8080_SZP_MASK | FLAGS_H)) | i8080_szp_table[res] | ((val ^ 0x01 ^ res) & FLAGS_H);
+	return res;
+}
+
+static inline uint8_t i8080_alu_dcr(uint8_t *flags, uint8_t val)
+{
+	uint8_t res = val - 1;
+
+	*flags = (*flags & ~(I8080_SZP_MASK | FLAGS_H)) | i8080_szp_table[res] | ((val ^ 0xff ^ res) & FLAGS_H);
+	return res;
+}
+
+// clear holds the flags the logical op resets alongside sign, zero and parity
+static inline uint8_t i8080_alu_logic(uint8_t *flags, uint8_t result, uint8_t clear)
+{
+	*flags = i8080_flags_szp(*flags & ~clear, result);
+	return result;
+}
+
+static inline uint8_t i8080_alu_daa(uint8_t *flags, uint8_t a)
+{
+	uint8_t val = a, add = 0;
+
+	if((val & 0xf) > 9 || *flags & FLAGS_H)
+		add += 0x06;
+
+	val += add;
+
+	if(((val & 0xf0) >> 4) > 9 || *flags & FLAGS_CARRY)
+		add += 0x60;
+
+	return i8080_alu_add(flags, a, add);
+}
+
+// Lazy flags. An ALU op only settles carry; sign, zero, parity and half carry
+// are left pending in i8080_lazy_flags_t as the result byte and the XOR of the
+// two addends, and are rebuilt when a condition, PUSH PSW or DAA reads them.
+// Subtraction and DCR are recorded as the two's complement addition the eager
+// helpers perform, so half carry is always bit 4 of aux ^ result.
+
+#define I8080_LAZY_MASK		(I8080_SZP_MASK | FLAGS_H)
+
+static inline uint8_t i8080_flags_resolve(uint8_t flags, const i8080_lazy_flags_t *lazy)
+{
+	uint8_t val = i8080_szp_table[lazy->result] | ((lazy->aux ^ lazy->result) & FLAGS_H);
+
+	return (flags & ~lazy->pending) | (val & lazy->pending);
+}
+
+static inline uint8_t i8080_lazy_add(uint8_t *flags, i8080_lazy_flags_t *lazy, uint8_t a, uint16_t val)
+{
+	uint16_t sum = a + val;
+
+	*flags = (*flags & ~FLAGS_CARRY) | (sum >> 8);
+	lazy->aux = a ^ (uint8_t)val;
+	lazy->result = (uint8_t)sum;
+	lazy->pending = I8080_LAZY_MASK;
+	return (uint8_t)sum;
+}
+
+static inline uint8_t i8080_lazy_sub(uint8_t *flags, i8080_lazy_flags_t *lazy, uint8_t a, uint16_t val)
+{
+	uint16_t b = 0x100 - val;
+	uint16_t sum = a + b;
+
+	*flags = (*flags & ~FLAGS_CARRY) | ((sum >> 8) ^ FLAGS_CARRY);
+	lazy->aux = a ^ (uint8_t)b;
+	lazy->result = (uint8_t)sum;
+	lazy->pending = I8080_LAZY_MASK;
+	return (uint8_t)sum;
+}
+
+static inline uint8_t i8080_lazy_inr(i8080_lazy_flags_t *lazy, uint8_t val)
+{
+	lazy->aux = val ^ 0x01;
+	lazy->result = val + 1;
+	lazy->pending = I8080_LAZY_MASK;
+	return lazy->result;
+}
+
+static inline uint8_t i8080_lazy_dcr(i8080_lazy_flags_t *lazy, uint8_t val)
+{
+	lazy->aux = val ^ 0xff;
+	lazy->result = val - 1;
+	lazy->pending = I8080_LAZY_MASK;
+	return lazy->result;
+}
+
+// ANA keeps the previous half carry, so a pending one is settled before the
+// result is replaced.
+static inline uint8_t i8080_lazy_logic(uint8_t *flags, i8080_lazy_flags_t *lazy, uint8_t result, uint8_t clear)
+{
+	uint8_t h_pending = lazy->pending & FLAGS_H;
+
+	*flags = ((*flags & ~h_pending) | (h_pending & (lazy->aux ^ lazy->result))) & ~clear;
+	lazy->result = result;
+	lazy->pending = I8080_SZP_MASK;
+	return result;
+}
+
+static inline uint8_t i8080_lazy_daa(uint8_t *flags, i8080_lazy_flags_t *lazy, uint8_t a)
+{
+	uint8_t f = i8080_flags_resolve(*flags, lazy);
+	uint8_t val = a, add = 0;
+
+	if((val & 0xf) > 9 || f & FLAGS_H)
+		add += 0x06;
+
+	val += add;
+
+	if(((val & 0xf0) >> 4) > 9 || f & FLAGS_CARRY)
+		add += 0x60;
+
+	*flags = f;
+	return i8080_lazy_add(flags, lazy, a, add);
+}
+
+// Flag updates as used by the instruction bodies, in the configured mode.
+// I8080_FLAGS() yields the complete flags byte, I8080_FLAGS_LOADED() marks
+// CPU_F as complete after it is written whole, and I8080_FLAGS_SYNC() folds
+// pending flags into CPU_F before the registers are handed back to the caller.
+#if I8080_USE_LAZY_FLAGS
+#define I8080_OP_ADD(a, v)			i8080_lazy_add(&CPU_F, &CPU_LAZY, (a), (v))
+#define I8080_OP_SUB(a, v)			i8080_lazy_sub(&CPU_F, &CPU_LAZY, (a), (v))
+#define I8080_OP_INR(v)				i8080_lazy_inr(&CPU_LAZY, (v))
+#define I8080_OP_DCR(v)				i8080_lazy_dcr(&CPU_LAZY, (v))
+#define I8080_OP_DAA(a)				i8080_lazy_daa(&CPU_F, &CPU_LAZY, (a))
+#define I8080_OP_LOGIC(r, clear)	i8080_lazy_logic(&CPU_F, &CPU_LAZY, (r), (clear))
+#define I8080_FLAGS()				i8080_flags_resolve(CPU_F, &CPU_LAZY)
+#define I8080_FLAGS_LOADED()		(CPU_LAZY.pending = 0)
+#define I8080_FLAGS_SYNC()			(CPU_F = I8080_FLAGS(), CPU_LAZY.pending = 0)
+#else
+#define I8080_OP_ADD(a, v)			i8080_alu_add(&CPU_F, (a), (v))
+#define I8080_OP_SUB(a, v)			i8080_alu_sub(&CPU_F, (a), (v))
+#define I8080_OP_INR(v)				i8080_alu_inr(&CPU_F, (v))
+#define I8080_OP_DCR(v)				i8080_alu_dcr(&CPU_F, (v))
+#define I8080_OP_DAA(a)				i8080_alu_daa(&CPU_F, (a))
+#define I8080_OP_LOGIC(r, clear)	i8080_alu_logic(&CPU_F, (r), (clear))
+#define I8080_FLAGS()				CPU_F
+#define I8080_FLAGS_LOADED()		((void)0)
+#define I8080_FLAGS_SYNC()			((void)0)
+#endif
+
+#define I8080_COND_NZ(f)	(!((f) & FLAGS_ZERO))
+#define I8080_COND_Z(f)		((f) & FLAGS_ZERO)
+#define I8080_COND_NC(f)	(!((f) & FLAGS_CARRY))
+#define I8080_COND_C(f)		((f) & FLAGS_CARRY)
+#define I8080_COND_PO(f)	(!((f) & FLAGS_PARITY))
+#define I8080_COND_PE(f)	((f) & FLAGS_PARITY)
+#define I8080_COND_P(f)		(!((f) & FLAGS_SIGN))
+#define I8080_COND_M(f)		((f) & FLAGS_SIGN)
+
+// Accumulator operations, named after the mnemonic that uses them
+#define I8080_DO_ADD(v)	CPU_A = I8080_OP_ADD(CPU_A, (v))
+#define I8080_DO_ADC(v)	CPU_A = I8080_OP_ADD(CPU_A, (uint16_t)((v) + (CPU_F & FLAGS_CARRY)))
+#define I8080_DO_SUB(v)	CPU_A = I8080_OP_SUB(CPU_A, (v))
+#define I8080_DO_SBB(v)	CPU_A = I8080_OP_SUB(CPU_A, (uint16_t)((v) + (CPU_F & FLAGS_CARRY)))
+#define I8080_DO_ANA(v)	CPU_A = I8080_OP_LOGIC(CPU_A & (v), FLAGS_CARRY)
+#define I8080_DO_XRA(v)	CPU_A = I8080_OP_LOGIC(CPU_A ^ (v), FLAGS_CARRY | FLAGS_H)
+#define I8080_DO_ORA(v)	CPU_A = I8080_OP_LOGIC(CPU_A | (v), FLAGS_CARRY | FLAGS_H)
+#define I8080_DO_CMP(v)	(void)I8080_OP_SUB(CPU_A, (v))
+#define I8080_DO_ADI	I8080_DO_ADD
+#define I8080_DO_ACI	I8080_DO_ADC
+#define I8080_DO_SUI	I8080_DO_SUB
+#define I8080_DO_SBI	I8080_DO_SBB
+#define I8080_DO_ANI(v)	CPU_A = I8080_OP_LOGIC(CPU_A & (v), FLAGS_CARRY | FLAGS_H)
+#define I8080_DO_XRI	I8080_DO_XRA
+#define I8080_DO_ORI	I8080_DO_ORA
+#define I8080_DO_CPI	I8080_DO_CMP
+
+// Instruction bodies. R, D and S are register tokens (B C D E H L A), RP is a
+// pair token (BC DE HL SP) and CC a condition token (NZ Z NC C PO PE P M).
+
+#define I8080_NOP()		{ CPU_PC++; OP_END(CYCLES_NOP); }
+#define I8080_HLT()		{ cpu->halted = 1; cpu->events |= I8080_STOP_HALT; CPU_PC++; OP_END_EVENT(CYCLES_HLT); }
+
+#define I8080_MOV_RR(D, S)	{ CPU_SET_##D(CPU_GET_##S()); CPU_PC++; OP_END(CYCLES_MOV_REG); }
+#define I8080_MOV_RM(D)		{ CPU_SET_##D(CPU_RD8(CPU_GET_HL())); CPU_PC++; OP_END(CYCLES_MOV_MEM); }
+#define I8080_MOV_MR(S)		{ CPU_WR8(CPU_GET_HL(), CPU_GET_##S()); CPU_PC++; OP_END(CYCLES_MOV_MEM); }
+#define I8080_MVI_R(D)		{ CPU_SET_##D(CPU_IMM8()); CPU_PC += 2; OP_END(CYCLES_MVI_REG); }
+#define I8080_MVI_M()		{ CPU_WR8(CPU_GET_HL(), CPU_IMM8()); CPU_PC += 2; OP_END(CYCLES_MVI_MEM); }
+
+#define I8080_LXI(RP)		{ CPU_SET_##RP(CPU_IMM16()); CPU_PC += 3; OP_END(CYCLES_LXI); }
+#define I8080_LDA()			{ CPU_A = CPU_RD8(CPU_IMM16()); CPU_PC += 3; OP_END(CYCLES_LDA); }
+#define I8080_STA()			{ CPU_WR8(CPU_IMM16(), CPU_A); CPU_PC += 3; OP_END(CYCLES_STA); }
+#define I8080_LHLD()		{ CPU_SET_HL(CPU_RD16(CPU_IMM16())); CPU_PC += 3; OP_END(CYCLES_LHLD); }
+#define I8080_SHLD()		{ CPU_WR16(CPU_IMM16(), CPU_GET_HL()); CPU_PC += 3; OP_END(CYCLES_SHLD); }
+#define I8080_LDAX(RP)		{ CPU_A = CPU_RD8(CPU_GET_##RP()); CPU_PC++; OP_END(CYCLES_LDAX); }
+#define I8080_STAX(RP)		{ CPU_WR8(CPU_GET_##RP(), CPU_A); CPU_PC++; OP_END(CYCLES_STAX); }
+#define I8080_XCHG()		{ uint16_t t_hl = CPU_GET_HL(); CPU_SET_HL(CPU_GET_DE()); CPU_SET_DE(t_hl); CPU_PC++; OP_END(CYCLES_XCHG); }
+
+#define I8080_ALU_R(OPN, S)	{ I8080_DO_##OPN(CPU_GET_##S()); CPU_PC++; OP_END(CYCLES_##OPN); }
+#define I8080_ALU_M(OPN)	{ I8080_DO_##OPN(CPU_RD8(CPU_GET_HL())); CPU_PC++; OP_END(CYCLES_ALU_MEM); }
+#define I8080_ALU_I(OPN)	{ I8080_DO_##OPN(CPU_IMM8()); CPU_PC += 2; OP_END(CYCLES_##OPN); }
+
+#define I8080_INR_R(R)		{ CPU_SET_##R(I8080_OP_INR(CPU_GET_##R())); CPU_PC++; OP_END(CYCLES_INR); }
+#define I8080_DCR_R(R)		{ CPU_SET_##R(I8080_OP_DCR(CPU_GET_##R())); CPU_PC++; OP_END(CYCLES_DCR); }
+#define I8080_INR_M()		{ uint16_t t_addr = CPU_GET_HL(); CPU_WR8(t_addr, I8080_OP_INR(CPU_RD8(t_addr))); CPU_PC++; OP_END(CYCLES_INR_MEM); }
+#define I8080_DCR_M()		{ uint16_t t_addr = CPU_GET_HL(); CPU_WR8(t_addr, I8080_OP_DCR(CPU_RD8(t_addr))); CPU_PC++; OP_END(CYCLES_DCR_MEM); }
+#define I8080_INX(RP)		{ CPU_SET_##RP(CPU_GET_##RP() + 1); CPU_PC++; OP_END(CYCLES_INX); }
+#define I8080_DCX(RP)		{ CPU_SET_##RP(CPU_GET_##RP() - 1); CPU_PC++; OP_END(CYCLES_DCX); }
+#define I8080_DAD(RP)		{ uint32_t t_sum = (uint32_t)CPU_GET_##RP() + CPU_GET_HL(); \
+							  CPU_F = t_sum > 0xffff ? (CPU_F | FLAGS_CARRY) : (CPU_F & ~FLAGS_CARRY); \
+							  CPU_SET_HL(t_sum); CPU_PC++; OP_END(CYCLES_DAD); }
+#define I8080_DAA()			{ CPU_A = I8080_OP_DAA(CPU_A); CPU_PC++; OP_END(CYCLES_DAA); }
+#define I8080_CMA()			{ CPU_A = ~CPU_A; CPU_PC++; OP_END(CYCLES_CMA); }
+#define I8080_STC()			{ CPU_F |= FLAGS_CARRY; CPU_PC++; OP_END(CYCLES_STC); }
+#define I8080_CMC()			{ CPU_F ^= FLAGS_CARRY; CPU_PC++; OP_END(CYCLES_CMC); }
+
+#define I8080_RLC()	{ uint8_t t_bit = CPU_A >> 7; \
+					  CPU_A = (uint8_t)(CPU_A << 1) | t_bit; CPU_F = (CPU_F & ~FLAGS_CARRY) | t_bit; \
+					  CPU_PC++; OP_END(CYCLES_RLC); }
+#define I8080_RRC()	{ uint8_t t_bit = CPU_A & 1; \
+					  CPU_A = (CPU_A >> 1) | (t_bit << 7); CPU_F = (CPU_F & ~FLAGS_CARRY) | t_bit; \
+					  CPU_PC++; OP_END(CYCLES_RRC); }
+#define I8080_RAL()	{ uint8_t t_bit = CPU_A >> 7; \
+					  CPU_A = (uint8_t)(CPU_A << 1) | (CPU_F & FLAGS_CARRY); CPU_F = (CPU_F & ~FLAGS_CARRY) | t_bit; \
+					  CPU_PC++; OP_END(CYCLES_RAL); }
+#define I8080_RAR()	{ uint8_t t_bit = CPU_A & 1; \
+					  CPU_A = (CPU_A >> 1) | ((CPU_F & FLAGS_CARRY) << 7); CPU_F = (CPU_F & ~FLAGS_CARRY) | t_bit; \
+					  CPU_PC++; OP_END(CYCLES_RAR); }
+
+#define I8080_JMP()		{ CPU_PC = CPU_IMM16(); I8080_TRAP_CHECK(CYCLES_JMP) OP_END(CYCLES_JMP); }
+#define I8080_JCC(CC)	{ uint16_t t_from = CPU_PC; \
+						  CPU_PC = I8080_COND_##CC(I8080_FLAGS()) ? CPU_IMM16() : CPU_PC + 3; \
+						  I8080_TRAP_CHECK(CYCLES_JMP) I8080_LOOP_CHECK(t_from, CYCLES_JMP) OP_END(CYCLES_JMP); }
+#if I8080_USE_CALL_PROFILE
+#define I8080_PROFILE_CALL(TARGET)	if(cpu->call_hooks) \
+									cpu->call_hooks->call(cpu->call_hooks->context, CPU_PC, TARGET, CPU_SP, CPU_NOW());
+#define I8080_PROFILE_RET()			if(cpu->call_hooks) \
+									cpu->call_hooks->ret(cpu->call_hooks->context, CPU_SP, CPU_NOW());
+#else
+#define I8080_PROFILE_CALL(TARGET)
+#define I8080_PROFILE_RET()
+#endif
+
+// CALL pushes before fetching its target, so the target is read back from
+// memory in case the push overwrote it.
+#define I8080_CALL()	{ CPU_SP -= 2; CPU_WR16(CPU_SP, CPU_PC + 3); I8080_PROFILE_CALL(CPU_RD16(CPU_PC + 1)) \
+						  CPU_PC = CPU_RD16(CPU_PC + 1); I8080_TRAP_CHECK(CYCLES_CALL) OP_END(CYCLES_CALL); }
+#define I8080_CCC(CC)	{ if(I8080_COND_##CC(I8080_FLAGS())) I8080_CALL() \
+						  CPU_PC += 3; OP_END(CYCLES_CALL_COND); }
+#define I8080_RET()		{ I8080_PROFILE_RET() CPU_PC = CPU_RD16(CPU_SP); CPU_SP += 2; I8080_TRAP_CHECK(CYCLES_RET) \
+						  OP_END(CYCLES_RET); }
+#define I8080_RCC(CC)	{ if(I8080_COND_##CC(I8080_FLAGS())) { I8080_PROFILE_RET() CPU_PC = CPU_RD16(CPU_SP); CPU_SP += 2; \
+																 I8080_TRAP_CHECK(CYCLES_RET_TAKEN) OP_END(CYCLES_RET_TAKEN); } \
+						  CPU_PC++; OP_END(CYCLES_RET_COND); }
+#define I8080_RST(N)	{ CPU_SP -= 2; CPU_WR16(CPU_SP, CPU_PC + 1); I8080_PROFILE_CALL((N) * 8) \
+						  CPU_PC = (N) * 8; I8080_TRAP_CHECK(CYCLES_RST) OP_END(CYCLES_RST); }
+#define I8080_PCHL()	{ CPU_PC = CPU_GET_HL(); I8080_TRAP_CHECK(CYCLES_PCHL) OP_END(CYCLES_PCHL); }
+#define I8080_SPHL()	{ CPU_SP = CPU_GET_HL(); CPU_PC++; OP_END(CYCLES_SPHL); }
+#define I8080_XTHL()	{ uint16_t t_top = CPU_RD16(CPU_SP); CPU_WR16(CPU_SP, CPU_GET_HL()); CPU_SET_HL(t_top); \
+						  CPU_PC++; OP_END(CYCLES_XTHL); }
+
+#define I8080_PUSH(RP)	{ CPU_SP -= 2; CPU_WR16(CPU_SP, CPU_GET_##RP()); CPU_PC++; OP_END(CYCLES_PUSH); }
+#define I8080_POP(RP)	{ CPU_SET_##RP(CPU_RD16(CPU_SP)); CPU_SP += 2; CPU_PC++; OP_END(CYCLES_POP); }
+#define I8080_PUSH_PSW()	{ CPU_SP -= 2; CPU_WR16(CPU_SP, (uint16_t)(CPU_A << 8 | I8080_FLAGS())); CPU_PC++; OP_END(CYCLES_PUSH); }
+#define I8080_POP_PSW()		{ uint16_t t_psw = CPU_RD16(CPU_SP); CPU_F = (uint8_t)t_psw; I8080_FLAGS_LOADED(); CPU_A = t_psw >> 8; \
+							  CPU_SP += 2; CPU_PC++; OP_END(CYCLES_POP); }
+
+#define I8080_EI()		{ CPU_F |= FLAGS_IF; cpu->events |= I8080_EVENT_INTERRUPT; CPU_PC++; OP_END_EVENT(CYCLES_EI); }
+#define I8080_DI()		{ CPU_F &= ~FLAGS_IF; CPU_PC++; OP_END(CYCLES_DI); }
+#define I8080_IN()		{ uint8_t t_data; CPU_SAVE(); t_data = i8080_port_in(cpu, CPU_IMM8()); CPU_LOAD(); \
+						  CPU_A = t_data; cpu->events |= I8080_STOP_IO; CPU_PC += 2; OP_END_EVENT(CYCLES_IN); }
+#define I8080_OUT()		{ CPU_SAVE(); i8080_port_out(cpu, CPU_IMM8(), CPU_A); CPU_LOAD(); \
+						  cpu->events |= I8080_STOP_IO; CPU_PC += 2; OP_END_EVENT(CYCLES_OUT); }
+
+// Undefined opcodes execute as NOP
+#define I8080_OPCODE_TABLE(X) \
+	X(0x00, I8080_NOP())		X(0x01, I8080_LXI(BC))		X(0x02, I8080_STAX(BC))		X(0x03, I8080_INX(BC)) \
+	X(0x04, I8080_INR_R(B))		X(0x05, I8080_DCR_R(B))		X(0x06, I8080_MVI_R(B))		X(0x07, I8080_RLC()) \
+	X(0x08, I8080_NOP())		X(0x09, I8080_DAD(BC))		X(0x0a, I8080_LDAX(BC))		X(0x0b, I8080_DCX(BC)) \
+	X(0x0c, I8080_INR_R(C))		X(0x0d, I8080_DCR_R(C))		X(0x0e, I8080_MVI_R(C))		X(0x0f, I8080_RRC()) \
+	X(0x10, I8080_NOP())		X(0x11, I8080_LXI(DE))		X(0x12, I8080_STAX(DE))		X(0x13, I8080_INX(DE)) \
+	X(0x14, I8080_INR_R(D))		X(0x15, I8080_DCR_R(D))		X(0x16, I8080_MVI_R(D))		X(0x17, I8080_RAL()) \
+	X(0x18, I8080_NOP())		X(0x19, I8080_DAD(DE))		X(0x1a, I8080_LDAX(DE))		X(0x1b, I8080_DCX(DE)) \
+	X(0x1c, I8080_INR_R(E))		X(0x1d, I8080_DCR_R(E))		X(0x1e, I8080_MVI_R(E))		X(0x1f, I8080_RAR()) \
+	X(0x20, I8080_NOP())		X(0x21, I8080_LXI(HL))		X(0x22, I8080_SHLD())		X(0x23, I8080_INX(HL)) \
+	X(0x24, I8080_INR_R(H))		X(0x25, I8080_DCR_R(H))		X(0x26, I8080_MVI_R(H))		X(0x27, I8080_DAA()) \
+	X(0x28, I8080_NOP())		X(0x29, I8080_DAD(HL))		X(0x2a, I8080_LHLD())		X(0x2b, I8080_DCX(HL)) \
+	X(0x2c, I8080_INR_R(L))		X(0x2d, I8080_DCR_R(L))		X(0x2e, I8080_MVI_R(L))		X(0x2f, I8080_CMA()) \
+	X(0x30, I8080_NOP())		X(0x31, I8080_LXI(SP))		X(0x32, I8080_STA())		X(0x33, I8080_INX(SP)) \
+	X(0x34, I8080_INR_M())		X(0x35, I8080_DCR_M())		X(0x36, I8080_MVI_M())		X(0x37, I8080_STC()) \
+	X(0x38, I8080_NOP())		X(0x39, I8080_DAD(SP))		X(0x3a, I8080_LDA())		X(0x3b, I8080_DCX(SP)) \
+	X(0x3c, I8080_INR_R(A))		X(0x3d, I8080_DCR_R(A))		X(0x3e, I8080_MVI_R(A))		X(0x3f, I8080_CMC()) \
+	X(0x40, I8080_MOV_RR(B, B))	X(0x41, I8080_MOV_RR(B, C))	X(0x42, I8080_MOV_RR(B, D))	X(0x43, I8080_MOV_RR(B, E)) \
+	X(0x44, I8080_MOV_RR(B, H))	X(0x45, I8080_MOV_RR(B, L))	X(0x46, I8080_MOV_RM(B))	X(0x47, I8080_MOV_RR(B, A)) \
+	X(0x48, I8080_MOV_RR(C, B))	X(0x49, I8080_MOV_RR(C, C))	X(0x4a, I8080_MOV_RR(C, D))	X(0x4b, I8080_MOV_RR(C, E)) \
+	X(0x4c, I8080_MOV_RR(C, H))	X(0x4d, I8080_MOV_RR(C, L))	X(0x4e, I8080_MOV_RM(C))	X(0x4f, I8080_MOV_RR(C, A)) \
+	X(0x50, I8080_MOV_RR(D, B))	X(0x51, I8080_MOV_RR(D, C))	X(0x52, I8080_MOV_RR(D, D))	X(0x53, I8080_MOV_RR(D, E)) \
+	X(0x54, I8080_MOV_RR(D, H))	X(0x55, I8080_MOV_RR(D, L))	X(0x56, I8080_MOV_RM(D))	X(0x57, I8080_MOV_RR(D, A)) \
+	X(0x58, I8080_MOV_RR(E, B))	X(0x59, I8080_MOV_RR(E, C))	X(0x5a, I8080_MOV_RR(E, D))	X(0x5b, I8080_MOV_RR(E, E)) \
+	X(0x5c, I8080_MOV_RR(E, H))	X(0x5d, I8080_MOV_RR(E, L))	X(0x5e, I8080_MOV_RM(E))	X(0x5f, I8080_MOV_RR(E, A)) \
+	X(0x60, I8080_MOV_RR(H, B))	X(0x61, I8080_MOV_RR(H, C))	X(0x62, I8080_MOV_RR(H, D))	X(0x63, I8080_MOV_RR(H, E)) \
+	X(0x64, I8080_MOV_RR(H, H))	X(0x65, I8080_MOV_RR(H, L))	X(0x66, I8080_MOV_RM(H))	X(0x67, I8080_MOV_RR(H, A)) \
+	X(0x68, I8080_MOV_RR(L, B))	X(0x69, I8080_MOV_RR(L, C))	X(0x6a, I8080_MOV_RR(L, D))	X(0x6b, I8080_MOV_RR(L, E)) \
+	X(0x6c, I8080_MOV_RR(L, H))	X(0x6d, I8080_MOV_RR(L, L))	X(0x6e, I8080_MOV_RM(L))	X(0x6f, I8080_MOV_RR(L, A)) \
+	X(0x70, I8080_MOV_MR(B))	X(0x71, I8080_MOV_MR(C))	X(0x72, I8080_MOV_MR(D))	X(0x73, I8080_MOV_MR(E)) \
+	X(0x74, I8080_MOV_MR(H))	X(0x75, I8080_MOV_MR(L))	X(0x76, I8080_HLT())		X(0x77, I8080_MOV_MR(A)) \
+	X(0x78, I8080_MOV_RR(A, B))	X(0x79, I8080_MOV_RR(A, C))	X(0x7a, I8080_MOV_RR(A, D))	X(0x7b, I8080_MOV_RR(A, E)) \
+	X(0x7c, I8080_MOV_RR(A, H))	X(0x7d, I8080_MOV_RR(A, L))	X(0x7e, I8080_MOV_RM(A))	X(0x7f, I8080_MOV_RR(A, A)) \
+	X(0x80, I8080_ALU_R(ADD, B))	X(0x81, I8080_ALU_R(ADD, C))	X(0x82, I8080_ALU_R(ADD, D))	X(0x83, I8080_ALU_R(ADD, E)) \
+	X(0x84, I8080_ALU_R(ADD, H))	X(0x85, I8080_ALU_R(ADD, L))	X(0x86, I8080_ALU_M(ADD))		X(0x87, I8080_ALU_R(ADD, A)) \
+	X(0x88, I8080_ALU_R(ADC, B))	X(0x89, I8080_ALU_R(ADC, C))	X(0x8a, I8080_ALU_R(ADC, D))	X(0x8b, I8080_ALU_R(ADC, E)) \
+	X(0x8c, I8080_ALU_R(ADC, H))	X(0x8d, I8080_ALU_R(ADC, L))	X(0x8e, I8080_ALU_M(ADC))		X(0x8f, I8080_ALU_R(ADC, A)) \
+	X(0x90, I8080_ALU_R(SUB, B))	X(0x91, I8080_ALU_R(SUB, C))	X(0x92, I8080_ALU_R(SUB, D))	X(0x93, I8080_ALU_R(SUB, E)) \
+	X(0x94, I8080_ALU_R(SUB, H))	X(0x95, I8080_ALU_R(SUB, L))	X(0x96, I8080_ALU_M(SUB))		X(0x97, I8080_ALU_R(SUB, A)) \
+	X(0x98, I8080_ALU_R(SBB, B))	X(0x99, I8080_ALU_R(SBB, C))	X(0x9a, I8080_ALU_R(SBB, D))	X(0x9b, I8080_ALU_R(SBB, E)) \
+	X(0x9c, I8080_ALU_R(SBB, H))	X(0x9d, I8080_ALU_R(SBB, L))	X(0x9e, I8080_ALU_M(SBB))		X(0x9f, I8080_ALU_R(SBB, A)) \
+	X(0xa0, I8080_ALU_R(ANA, B))	X(0xa1, I8080_ALU_R(ANA, C))	X(0xa2, I8080_ALU_R(ANA, D))	X(0xa3, I8080_ALU_R(ANA, E)) \
+	X(0xa4, I8080_ALU_R(ANA, H))	X(0xa5, I8080_ALU_R(ANA, L))	X(0xa6, I8080_ALU_M(ANA))		X(0xa7, I8080_ALU_R(ANA, A)) \
+	X(0xa8, I8080_ALU_R(XRA, B))	X(0xa9, I8080_ALU_R(XRA, C))	X(0xaa, I8080_ALU_R(XRA, D))	X(0xab, I8080_ALU_R(XRA, E)) \
+	X(0xac, I8080_ALU_R(XRA, H))	X(0xad, I8080_ALU_R(XRA, L))	X(0xae, I8080_ALU_M(XRA))		X(0xaf, I8080_ALU_R(XRA, A)) \
+	X(0xb0, I8080_ALU_R(ORA, B))	X(0xb1, I8080_ALU_R(ORA, C))	X(0xb2, I8080_ALU_R(ORA, D))	X(0xb3, I8080_ALU_R(ORA, E)) \
+	X(0xb4, I8080_ALU_R(ORA, H))	X(0xb5, I8080_ALU_R(ORA, L))	X(0xb6, I8080_ALU_M(ORA))		X(0xb7, I8080_ALU_R(ORA, A)) \
+	X(0xb8, I8080_ALU_R(CMP, B))	X(0xb9, I8080_ALU_R(CMP, C))	X(0xba, I8080_ALU_R(CMP, D))	X(0xbb, I8080_ALU_R(CMP, E)) \
+	X(0xbc, I8080_ALU_R(CMP, H))	X(0xbd, I8080_ALU_R(CMP, L))	X(0xbe, I8080_ALU_M(CMP))		X(0xbf, I8080_ALU_R(CMP, A)) \
+	X(0xc0, I8080_RCC(NZ))		X(0xc1, I8080_POP(BC))		X(0xc2, I8080_JCC(NZ))		X(0xc3, I8080_JMP()) \
+	X(0xc4, I8080_CCC(NZ))		X(0xc5, I8080_PUSH(BC))		X(0xc6, I8080_ALU_I(ADI))	X(0xc7, I8080_RST(0)) \
+	X(0xc8, I8080_RCC(Z))		X(0xc9, I8080_RET())		X(0xca, I8080_JCC(Z))		X(0xcb, I8080_NOP()) \
+	X(0xcc, I8080_CCC(Z))		X(0xcd, I8080_CALL())		X(0xce, I8080_ALU_I(ACI))	X(0xcf, I8080_RST(1)) \
+	X(0xd0, I8080_RCC(NC))		X(0xd1, I8080_POP(DE))		X(0xd2, I8080_JCC(NC))		X(0xd3, I8080_OUT()) \
+	X(0xd4, I8080_CCC(NC))		X(0xd5, I8080_PUSH(DE))		X(0xd6, I8080_ALU_I(SUI))	X(0xd7, I8080_RST(2)) \
+	X(0xd8, I8080_RCC(C))		X(0xd9, I8080_NOP())		X(0xda, I8080_JCC(C))		X(0xdb, I8080_IN()) \
+	X(0xdc, I8080_CCC(C))		X(0xdd, I8080_NOP())		X(0xde, I8080_ALU_I(SBI))	X(0xdf, I8080_RST(3)) \
+	X(0xe0, I8080_RCC(PO))		X(0xe1, I8080_POP(HL))		X(0xe2, I8080_JCC(PO))		X(0xe3, I8080_XTHL()) \
+	X(0xe4, I8080_CCC(PO))		X(0xe5, I8080_PUSH(HL))		X(0xe6, I8080_ALU_I(ANI))	X(0xe7, I8080_RST(4)) \
+	X(0xe8, I8080_RCC(PE))		X(0xe9, I8080_PCHL())		X(0xea, I8080_JCC(PE))		X(0xeb, I8080_XCHG()) \
+	X(0xec, I8080_CCC(PE))		X(0xed, I8080_NOP())		X(0xee, I8080_ALU_I(XRI))	X(0xef, I8080_RST(5)) \
+	X(0xf0, I8080_RCC(P))		X(0xf1, I8080_POP_PSW())	X(0xf2, I8080_JCC(P))		X(0xf3, I8080_DI()) \
+	X(0xf4, I8080_CCC(P))		X(0xf5, I8080_PUSH_PSW())	X(0xf6, I8080_ALU_I(ORI))	X(0xf7, I8080_RST(6)) \
+	X(0xf8, I8080_RCC(M))		X(0xf9, I8080_SPHL())		X(0xfa, I8080_JCC(M))		X(0xfb, I8080_EI()) \
+	X(0xfc, I8080_CCC(M))		X(0xfd, I8080_NOP())		X(0xfe, I8080_ALU_I(CPI))	X(0xff, I8080_RST(7))
+
+#endif
@@ -0,0 +1,120 @@
+// Threaded-dispatch interpreter core, selected with I8080_THREADED_DISPATCH.
+//
+// Each instruction body ends by fetching the next opcode and jumping straight
+// to its label, so there is no call/return or shared dispatch branch per
+// instruction, and the registers stay in locals for the whole run slice.
+#include "intel8080_ops.h"
+
+#if I8080_USE_THREADED_CORE
+
+#include "memory.h"
+
+#define CPU_A	a
+#define CPU_F	f
+#define CPU_SP	sp
+#define CPU_PC	pc
+#define CPU_LAZY	lazy
+
+#define CPU_GET_A()		a
+#define CPU_GET_B()		((uint8_t)(bc >> 8))
+#define CPU_GET_C()		((uint8_t)bc)
+#define CPU_GET_D()		((uint8_t)(de >> 8))
+#define CPU_GET_E()		((uint8_t)de)
+#define CPU_GET_H()		((uint8_t)(hl >> 8))
+#define CPU_GET_L()		((uint8_t)hl)
+#define CPU_SET_A(v)	(a = (v))
+#define CPU_SET_B(v)	(bc = (uint16_t)((bc & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_C(v)	(bc = (uint16_t)((bc & 0xff00) | (uint8_t)(v)))
+#define CPU_SET_D(v)	(de = (uint16_t)((de & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_E(v)	(de = (uint16_t)((de & 0xff00) | (uint8_t)(v)))
+#define CPU_SET_H(v)	(hl = (uint16_t)((hl & 0x00ff) | (uint8_t)(v) << 8))
+#define CPU_SET_L(v)	(hl = (uint16_t)((hl & 0xff00) | (uint8_t)(v)))
+
+#define CPU_GET_BC()	bc
+#define CPU_GET_DE()	de
+#define CPU_GET_HL()	hl
+#define CPU_GET_SP()	sp
+#define CPU_SET_BC(v)	(bc = (v))
+#define CPU_SET_DE(v)	(de = (v))
+#define CPU_SET_HL(v)	(hl = (v))
+#define CPU_SET_SP(v)	(sp = (v))
+
+// mem is cpu->memory, kept in a local so it is not reloaded after every store
+#define CPU_RD8(addr)		read8(mem, addr)
+#define CPU_WR8(addr, val)	write8(mem, addr, val)
+#define CPU_RD16(addr)		read16(mem, addr)
+#define CPU_WR16(addr, val)	write16(mem, addr, val)
+#define CPU_IMM8()			read8(mem, pc + 1)
+#define CPU_IMM16()			read16(mem, pc + 1)
+
+#define CPU_SAVE() \
+	do { \
+		cpu->registers.a = a; cpu->registers.flags = f; \
+		cpu->registers.bc = bc; cpu->registers.de = de; cpu->registers.hl = hl; \
+		cpu->registers.sp = sp; cpu->registers.pc = pc; \
+		cpu->lazy_flags = lazy; \
+	} while(0)
+
+#define CPU_LOAD() \
+	do { \
+		a = cpu->registers.a; f = cpu->registers.flags; \
+		bc = cpu->registers.bc; de = cpu->registers.de; hl = cpu->registers.hl; \
+		sp = cpu->registers.sp; pc = cpu->registers.pc; \
+		lazy = cpu->lazy_flags; \
+	} while(0)
+
+#define DISPATCH()	goto *dispatch[read8(mem, pc)]
+
+#define OP_END(n) \
+	do { \
+		elapsed += (n); \
+		count++; \
+		if(__builtin_expect(elapsed >= cycle_budget, 0)) \
+			goto done; \
+		DISPATCH(); \
+	} while(0)
+
+#define OP_END_EVENT(n) \
+	do { \
+		elapsed += (n); \
+		count++; \
+		if(elapsed >= cycle_budget || (cpu->events & stop_flags)) \
+			goto done; \
+		DISPATCH(); \
+	} while(0)
+
+#define CPU_NOW()	(cpu->cycles + elapsed)
+
+#define THREADED_LABEL(code, body)	[code] = &&op_##code,
+#define THREADED_BODY(code, body)	op_##code: I8080_COUNT(cpu, opcodes[code]); body
+
+I8080_LABEL_CORE_ATTR uint32_t i8080_run_core(intel8080_t *cpu, uint32_t cycle_budget, uint8_t stop_flags)
+{
+	static const void *const dispatch[256] = { I8080_OPCODE_TABLE(THREADED_LABEL) };
+
+	altair_memory_t *const mem = cpu->memory;
+	uint8_t a, f;
+	uint16_t bc, de, hl, sp, pc;
+	i8080_lazy_flags_t lazy;
+	uint32_t elapsed = 0;
+	uint32_t count = 0;
+
+	CPU_LOAD();
+	cpu->events = 0;
+	DISPATCH();
+
+	I8080_OPCODE_TABLE(THREADED_BODY)
+
+done:
+	I8080_FLAGS_SYNC();
+	CPU_SAVE();
+	cpu->cycles += elapsed;
+	cpu->instructions += count;
+	cpu->cpuStatus = STATUS_MEMORY_READ | STATUS_OP_CODE_FETCH;
+	cpu->address_bus = pc;
+	cpu->data_bus = read8(mem, pc);
+
+	return elapsed;
+}
+
+#endif
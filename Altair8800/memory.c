@@ -1,23 +1,142 @@
 #include "memory.h"
 #include <string.h>
 
-// Altair system memory - 64KB
-uint8_t memory[64 * 1024] = {0};
+// Mark a range written behind write8/write16, e.g. by memcpy or memset
+void memory_pages_written(altair_memory_t *mem, uint16_t address, uint32_t length)
+{
+#if MEMORY_PAGE_TRACKING
+    uint32_t page;
+
+    if (length == 0)
+    {
+        return;
+    }
+    for (page = address >> 8; page <= (address + length - 1) >> 8; page++)
+    {
+        mem->page_gen[page & 0xff]++;
+    }
+#else
+    (void)mem;
+    (void)address;
+    (void)length;
+#endif
+}
+
+void memory_init(altair_memory_t *mem)
+{
+    // The page generations only ever go up, so code decoded from what was
+    // here before is never mistaken for current
+    memset(mem->bytes, 0x00, sizeof(mem->bytes));
+    memory_pages_written(mem, 0x0000, 64 * 1024);
+    mem->trapped_pages = 0;
+    memset(mem->page_attr, MEMORY_RAM, sizeof(mem->page_attr));
+    memory_reset_pages(mem);
+}
+
+bool memory_set_pages(altair_memory_t *mem, uint16_t address, uint32_t length, uint8_t attr,
+                      memory_write_handler_t handler, void *context)
+{
+    uint32_t page;
+
+    if (length == 0)
+    {
+        return true;
+    }
+#if MEMORY_TRAPS
+    if ((attr == MEMORY_WATCH || attr == MEMORY_MMIO) && handler == NULL)
+    {
+        return false;
+    }
+#else
+    if (attr == MEMORY_WATCH || attr == MEMORY_MMIO)
+    {
+        return false;
+    }
+    (void)handler;
+    (void)context;
+#endif
+
+    for (page = address >> 8; page <= (address + length - 1) >> 8; page++)
+    {
+        uint8_t p = (uint8_t)page;
+        bool was_trapped = mem->page_attr[p] == MEMORY_WATCH || mem->page_attr[p] == MEMORY_MMIO;
+
+        mem->page_attr[p] = attr;
+        switch (attr)
+        {
+            case MEMORY_RAM:
+                mem->write_map[p] = mem->bytes + p * 256;
+                break;
+            case MEMORY_ROM:
+                mem->write_map[p] = mem->rom_sink;
+                break;
+            default:
+                mem->write_map[p] = NULL;
+                break;
+        }
+#if MEMORY_TRAPS
+        mem->write_handlers[p] = handler;
+        mem->handler_contexts[p] = context;
+#endif
+        mem->trapped_pages += (attr == MEMORY_WATCH || attr == MEMORY_MMIO) - was_trapped;
+    }
+    return true;
+}
+
+void memory_reset_pages(altair_memory_t *mem)
+{
+    memory_set_pages(mem, 0x0000, 64 * 1024, MEMORY_RAM, NULL, NULL);
+}
+
+uint32_t memory_ram_room(const altair_memory_t *mem, uint16_t address, int step, uint32_t limit)
+{
+    uint32_t room = step > 0 ? 0x100u - (address & 0xff) : (address & 0xffu) + 1;
+    uint8_t page = (uint8_t)(address >> 8);
+
+    if (mem->page_attr[page] != MEMORY_RAM)
+    {
+        return 0;
+    }
+    while (room < limit && mem->page_attr[(uint8_t)(page + step)] == MEMORY_RAM)
+    {
+        page = (uint8_t)(page + step);
+        room += 0x100;
+    }
+    return room < limit ? room : limit;
+}
+
+#if MEMORY_TRAPS
+// write8() for WATCH and MMIO pages
+void memory_write_trap(altair_memory_t *mem, uint16_t address, uint8_t val)
+{
+    uint8_t page = (uint8_t)(address >> 8);
+
+    if (mem->page_attr[page] == MEMORY_WATCH)
+    {
+        mem->bytes[address] = val;
+        MEMORY_PAGE_WRITTEN(mem, address);
+    }
+    mem->write_handlers[page](mem->handler_contexts[page], address, val);
+}
+#endif
 
 // ROM data stored in flash (XIP)
 #include "88dskrom.h"
 #include "8krom.h"
 
 // Load disk boot loader ROM into memory at specified address
-void loadDiskLoader(uint16_t address)
+void loadDiskLoader(altair_memory_t *mem, uint16_t address)
 {
     // Copy ROM data from flash to RAM
-    memcpy(&memory[address], disk_loader_rom, sizeof(disk_loader_rom));
+    memcpy(&mem->bytes[address], disk_loader_rom, sizeof(disk_loader_rom));
+    memory_pages_written(mem, address, sizeof(disk_loader_rom));
+    memory_set_pages(mem, address, sizeof(disk_loader_rom), MEMORY_ROM, NULL, NULL);
 }
 
 // Load 8K BASIC ROM into memory at specified address
-void load8kRom(uint16_t address)
+void load8kRom(altair_memory_t *mem, uint16_t address)
 {
     // Copy ROM data from flash to RAM
-    memcpy(&memory[address], basic_8k_rom, sizeof(basic_8k_rom));
+    memcpy(&mem->bytes[address], basic_8k_rom, sizeof(basic_8k_rom));
+    memory_pages_written(mem, address, sizeof(basic_8k_rom));
 }
@@ -4,31 +4,120 @@
 #include "altair_panel.h"
 #include "types.h"
 
-extern uint8_t memory[64 * 1024];
+#include <stdbool.h>
+#include <stddef.h>
 
-void loadDiskLoader(uint16_t address);
-void load8kRom(uint16_t address);
+// Page attribute table, one entry per 256-byte page. Reads always come
+// straight from bytes[]; only writes look at the attribute, through
+// write_map[], which points each page at where its writes land.
+#define MEMORY_RAM		0	// writes land in bytes[]
+#define MEMORY_ROM		1	// writes land in a scratch page and are lost
+#define MEMORY_WATCH	2	// writes land in bytes[], then go to the page's handler
+#define MEMORY_MMIO		3	// writes go only to the page's handler, which keeps bytes[] showing what reads should see
+
+// WATCH and MMIO pages need I8080_MEMORY_TRAPS, which adds a test for a
+// trapped page to every write. Without it writes to RAM and ROM are a single
+// store through write_map[].
+#if defined(I8080_MEMORY_TRAPS) && I8080_MEMORY_TRAPS
+#define MEMORY_TRAPS 1
+#else
+#define MEMORY_TRAPS 0
+#endif
+
+// Per-page write tracking, for the block cache and the JIT to see code
+// change and for checkpoints to find the pages written since the last one
+#if (defined(I8080_BLOCK_CACHE) && I8080_BLOCK_CACHE) || (defined(I8080_JIT) && I8080_JIT) || \
+    (defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS)
+#define MEMORY_PAGE_TRACKING 1
+#else
+#define MEMORY_PAGE_TRACKING 0
+#endif
+
+typedef void (*memory_write_handler_t)(void *context, uint16_t address, uint8_t val);
+
+// The 64 KB address space of one machine. bytes[] comes first so the struct
+// address is also the address of 8080 memory location 0.
+typedef struct altair_memory
+{
+    uint8_t bytes[64 * 1024];
+    uint8_t *write_map[256];	// NULL for trapped pages
+#if MEMORY_PAGE_TRACKING
+    // Bumped on every write to a 256-byte page so the CPU's block cache or
+    // recompiler can tell when code it has decoded may have changed, and
+    // checkpoints which pages to save.
+    uint32_t page_gen[256];
+#endif
+    uint8_t page_attr[256];
+    uint32_t trapped_pages;	// WATCH and MMIO pages currently set
+#if MEMORY_TRAPS
+    memory_write_handler_t write_handlers[256];
+    void *handler_contexts[256];
+#endif
+    uint8_t rom_sink[256];	// where writes to ROM pages go
+} altair_memory_t;
+
+// Clears memory and makes every page RAM. Call before first use.
+void memory_init(altair_memory_t *mem);
+
+// Sets the attribute of every page overlapping the range. Returns false,
+// changing nothing, for WATCH or MMIO without a handler or without
+// I8080_MEMORY_TRAPS. The handler is called with context.
+bool memory_set_pages(altair_memory_t *mem, uint16_t address, uint32_t length, uint8_t attr,
+                      memory_write_handler_t handler, void *context);
+
+// Makes every page RAM again
+void memory_reset_pages(altair_memory_t *mem);
+
+// Bytes from address, going up (step 1) or down (step -1), before the first
+// page that is not RAM, up to limit
+uint32_t memory_ram_room(const altair_memory_t *mem, uint16_t address, int step, uint32_t limit);
+
+#if MEMORY_TRAPS
+void memory_write_trap(altair_memory_t *mem, uint16_t address, uint8_t val);
+#endif
+
+#if MEMORY_PAGE_TRACKING
+#define MEMORY_PAGE_WRITTEN(mem, address)	((mem)->page_gen[(uint16_t)(address) >> 8]++)
+#else
+#define MEMORY_PAGE_WRITTEN(mem, address)	((void)0)
+#endif
+
+void memory_pages_written(altair_memory_t *mem, uint16_t address, uint32_t length);
+
+void loadDiskLoader(altair_memory_t *mem, uint16_t address);
+void load8kRom(altair_memory_t *mem, uint16_t address);
 
 // Inline memory operations for better performance
-static inline uint8_t read8(uint16_t address)
+static inline uint8_t read8(const altair_memory_t *mem, uint16_t address)
 {
-    return memory[address];
+    return mem->bytes[address];
 }
 
-static inline void write8(uint16_t address, uint8_t val)
+static inline void write8(altair_memory_t *mem, uint16_t address, uint8_t val)
 {
-    memory[address] = val;
+    uint8_t *page = mem->write_map[address >> 8];
+
+#if MEMORY_TRAPS
+    if (page == NULL)
+    {
+        memory_write_trap(mem, address, val);
+        return;
+    }
+#endif
+    page[address & 0xff] = val;
+    MEMORY_PAGE_WRITTEN(mem, address);
 }
 
-static inline uint16_t read16(uint16_t address)
+// The high byte of a word at 0xffff comes from 0x0000, as on the 8080
+static inline uint16_t read16(const altair_memory_t *mem, uint16_t address)
 {
-    return memory[address] | (memory[address + 1] << 8);
+    return mem->bytes[address] | (mem->bytes[(uint16_t)(address + 1)] << 8);
 }
 
-static inline void write16(uint16_t address, uint16_t val)
+static inline void write16(altair_memory_t *mem, uint16_t address, uint16_t val)
 {
-    memory[address] = val & 0xff;
-    memory[address + 1] = (val >> 8) & 0xff;
+    write8(mem, address, val & 0xff);
+    write8(mem, (uint16_t)(address + 1), (val >> 8) & 0xff);
 }
 
 #endif
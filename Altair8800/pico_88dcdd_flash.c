@@ -147,6 +147,26 @@ static void flush_sector(pico_disk_t* disk)
     disk->sector_pointer = 0;
 }
 
+// Reads the sector at offset from flash, or from its patch if it has been written
+static bool read_image_sector(pico_disk_t* disk, uint32_t offset, uint8_t* data)
+{
+    if (offset + SECTOR_SIZE > disk->disk_size)
+    {
+        return false;
+    }
+
+    uint16_t patch_idx = find_patch_index(disk, (uint16_t)(offset / SECTOR_SIZE));
+    if (patch_idx != PATCH_INDEX_INVALID)
+    {
+        memcpy(data, g_patch_pool[patch_idx].data, SECTOR_SIZE);
+    }
+    else
+    {
+        memcpy(data, &disk->disk_image_flash[offset], SECTOR_SIZE);
+    }
+    return true;
+}
+
 // Helper: Seek to current track
 static void seek_to_track(void)
 {
@@ -242,8 +262,9 @@ bool pico_disk_load(uint8_t drive, const uint8_t* disk_image, uint32_t size)
 }
 
 // Select disk drive
-void pico_disk_select(uint8_t drive)
+void pico_disk_select(void* context, uint8_t drive)
 {
+    (void)context;
     uint8_t select = drive & DRIVE_SELECT_MASK;
 
     if (select < MAX_DRIVES)
@@ -259,15 +280,17 @@ void pico_disk_select(uint8_t drive)
 }
 
 // Get disk status
-uint8_t pico_disk_status(void)
+uint8_t pico_disk_status(void* context)
 {
+    (void)context;
     uint8_t status = pico_disk_controller.current->status;
     return status;
 }
 
 // Disk control function
-void pico_disk_function(uint8_t control)
+void pico_disk_function(void* context, uint8_t control)
 {
+    (void)context;
     pico_disk_t* disk = pico_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -325,8 +348,9 @@ void pico_disk_function(uint8_t control)
 }
 
 // Get current sector
-uint8_t pico_disk_sector(void)
+uint8_t pico_disk_sector(void* context)
 {
+    (void)context;
     pico_disk_t* disk = pico_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -360,8 +384,9 @@ uint8_t pico_disk_sector(void)
 }
 
 // Write byte to disk (Copy-on-Write)
-void pico_disk_write(uint8_t data)
+void pico_disk_write(void* context, uint8_t data)
 {
+    (void)context;
     pico_disk_t* disk = pico_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -391,8 +416,9 @@ void pico_disk_write(uint8_t data)
 }
 
 // Read byte from disk
-uint8_t pico_disk_read(void)
+uint8_t pico_disk_read(void* context)
 {
+    (void)context;
     pico_disk_t* disk = pico_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -405,21 +431,7 @@ uint8_t pico_disk_read(void)
     {
         disk->sector_pointer = 0;
         memset(disk->sector_data, 0x00, SECTOR_SIZE);
-
-        uint32_t offset = disk->disk_pointer;
-        if (offset + SECTOR_SIZE <= disk->disk_size)
-        {
-            memcpy(disk->sector_data, &disk->disk_image_flash[offset], SECTOR_SIZE);
-            disk->have_sector_data = true;
-
-            // Apply patch if exists
-            uint16_t sector_index = (uint16_t)(offset / SECTOR_SIZE);
-            uint16_t patch_idx = find_patch_index(disk, sector_index);
-            if (patch_idx != PATCH_INDEX_INVALID)
-            {
-                memcpy(disk->sector_data, g_patch_pool[patch_idx].data, SECTOR_SIZE);
-            }
-        }
+        disk->have_sector_data = read_image_sector(disk, disk->disk_pointer, disk->sector_data);
     }
 
     // Return current byte and advance pointer within sector
@@ -427,6 +439,56 @@ uint8_t pico_disk_read(void)
     return disk->sector_data[disk->sector_pointer++];
 }
 
+// The drive for a whole-sector access, with its byte-at-a-time sector written back
+static pico_disk_t* sector_disk(uint8_t drive, uint8_t track, uint8_t sector)
+{
+    if (drive >= MAX_DRIVES || track >= MAX_TRACKS || sector >= SECTORS_PER_TRACK)
+    {
+        return NULL;
+    }
+
+    pico_disk_t* disk = &pico_disk_controller.disk[drive];
+    if (!disk->disk_loaded)
+    {
+        return NULL;
+    }
+    flush_sector(disk);
+    return disk;
+}
+
+bool pico_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+    pico_disk_t* disk = sector_disk(drive, track, sector);
+
+    return disk && read_image_sector(disk, track * TRACK_SIZE + sector * SECTOR_SIZE, data);
+}
+
+bool pico_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+    pico_disk_t* disk = sector_disk(drive, track, sector);
+    uint32_t offset = track * TRACK_SIZE + sector * SECTOR_SIZE;
+
+    if (!disk || offset + SECTOR_SIZE > disk->disk_size)
+    {
+        return false;
+    }
+
+    uint16_t patch_idx = get_patch(disk, (uint16_t)(offset / SECTOR_SIZE));
+    if (patch_idx == PATCH_INDEX_INVALID)
+    {
+        return false;
+    }
+    memcpy(g_patch_pool[patch_idx].data, data, SECTOR_SIZE);
+    if (disk->disk_pointer == offset)
+    {
+        // The 88-DCDD reads it afresh
+        disk->have_sector_data = false;
+    }
+    return true;
+}
+
 // Get patch pool statistics
 void pico_disk_get_patch_stats(uint16_t* used, uint16_t* total)
 {
@@ -80,13 +80,21 @@ typedef struct
 // Global disk controller
 extern pico_disk_controller_t pico_disk_controller;
 
-// Disk controller functions (88-DCDD compatible interface)
-void pico_disk_select(uint8_t drive);
-uint8_t pico_disk_status(void);
-void pico_disk_function(uint8_t control);
-uint8_t pico_disk_sector(void);
-void pico_disk_write(uint8_t data);
-uint8_t pico_disk_read(void);
+// Disk controller functions (88-DCDD compatible interface); the context is unused
+void pico_disk_select(void* context, uint8_t drive);
+uint8_t pico_disk_status(void* context);
+void pico_disk_function(void* context, uint8_t control);
+uint8_t pico_disk_sector(void* context);
+void pico_disk_write(void* context, uint8_t data);
+uint8_t pico_disk_read(void* context);
+
+// Whole sectors of SECTOR_SIZE bytes, sector 0-31 in the order they are on
+// the track, for the sector DMA controller (PortDrivers/disk_dma_io.h).
+// Writes go to the patch pool like the 88-DCDD's. A sector the 88-DCDD is in
+// the middle of writing is written back first. Return false for a drive
+// without an image, a track or sector off the disk, or a full patch pool.
+bool pico_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
+bool pico_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
 
 // Initialization
 void pico_disk_init(void);
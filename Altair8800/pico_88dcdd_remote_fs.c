@@ -203,8 +203,9 @@ void rfs_disk_poll(void)
 }
 
 // Select disk drive
-void rfs_disk_select(uint8_t drive)
+void rfs_disk_select(void* context, uint8_t drive)
 {
+    (void)context;
     uint8_t select = drive & RFS_DISK_DRIVE_SELECT_MASK;
 
     if (select < RFS_DISK_MAX_DRIVES)
@@ -220,15 +221,17 @@ void rfs_disk_select(uint8_t drive)
 }
 
 // Get disk status
-uint8_t rfs_disk_status(void)
+uint8_t rfs_disk_status(void* context)
 {
+    (void)context;
     return rfs_disk_controller.current->status;
 }
 
 // Disk control function
 // Disk control function
-void rfs_disk_function(uint8_t control)
+void rfs_disk_function(void* context, uint8_t control)
 {
+    (void)context;
     rfs_disk_t* disk = rfs_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -288,8 +291,9 @@ void rfs_disk_function(uint8_t control)
 }
 
 // Format sector position for reading
-uint8_t rfs_disk_sector(void)
+uint8_t rfs_disk_sector(void* context)
 {
+    (void)context;
     rfs_disk_t* disk = rfs_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -319,8 +323,9 @@ uint8_t rfs_disk_sector(void)
 }
 
 // Write byte to disk
-void rfs_disk_write(uint8_t data)
+void rfs_disk_write(void* context, uint8_t data)
 {
+    (void)context;
     rfs_disk_t* disk = rfs_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -349,8 +354,9 @@ void rfs_disk_write(uint8_t data)
 }
 
 // Read byte from disk
-uint8_t rfs_disk_read(void)
+uint8_t rfs_disk_read(void* context)
 {
+    (void)context;
     rfs_disk_t* disk = rfs_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -461,3 +467,76 @@ static void rfs_readSectorFromServer(rfs_disk_t* pDisk)
 
     pDisk->op_state = RFS_DISK_OP_READ_PENDING;
 }
+
+// The drive for a whole-sector access, with its byte-at-a-time sector written back
+static rfs_disk_t* rfs_sector_disk(uint8_t drive, uint8_t track, uint8_t sector)
+{
+    if (drive >= RFS_DISK_MAX_DRIVES || track >= RFS_DISK_MAX_TRACKS || sector >= RFS_DISK_SECTORS_PER_TRACK)
+    {
+        return NULL;
+    }
+
+    rfs_disk_t* disk = &rfs_disk_controller.disk[drive];
+    if (!disk->disk_loaded)
+    {
+        return NULL;
+    }
+    if (disk->sectorDirty && disk == rfs_disk_controller.current)
+    {
+        rfs_writeSector(disk);
+    }
+    return disk;
+}
+
+// Blocks until the request just queued is answered, as the 88-DCDD's reads and writes do
+static bool rfs_wait_response(void)
+{
+    rfs_response_t response;
+    uint32_t timeout = 25000; // Increased to accommodate Core 1 retries
+    uint32_t start = to_ms_since_boot(get_absolute_time());
+
+    while (!rfs_get_response(&response))
+    {
+        if (to_ms_since_boot(get_absolute_time()) - start > timeout)
+        {
+            printf("[RFS_DISK] Sector DMA timeout\n");
+            return false;
+        }
+        sleep_ms(1);
+    }
+    return response.status == RFS_RESP_OK;
+}
+
+bool rfs_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+
+    if (!rfs_sector_disk(drive, track, sector))
+    {
+        return false;
+    }
+    if (rfs_try_read_cached(drive, track, sector, data))
+    {
+        return true;
+    }
+    return rfs_request_read(drive, track, sector) && rfs_wait_response() &&
+           rfs_try_read_cached(drive, track, sector, data);
+}
+
+bool rfs_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+    rfs_disk_t* disk = rfs_sector_disk(drive, track, sector);
+
+    if (!disk)
+    {
+        return false;
+    }
+    if (disk->track == track && disk->sector == sector + 1)
+    {
+        // The 88-DCDD reads it afresh
+        disk->haveSectorData = false;
+    }
+    // Not queued means the server already has this data
+    return !rfs_request_write(drive, track, sector, data) || rfs_wait_response();
+}
@@ -84,13 +84,21 @@ typedef struct
 // Global disk controller
 extern rfs_disk_controller_t rfs_disk_controller;
 
-// Disk controller functions (88-DCDD compatible interface)
-void rfs_disk_select(uint8_t drive);
-uint8_t rfs_disk_status(void);
-void rfs_disk_function(uint8_t control);
-uint8_t rfs_disk_sector(void);
-void rfs_disk_write(uint8_t data);
-uint8_t rfs_disk_read(void);
+// Disk controller functions (88-DCDD compatible interface); the context is unused
+void rfs_disk_select(void* context, uint8_t drive);
+uint8_t rfs_disk_status(void* context);
+void rfs_disk_function(void* context, uint8_t control);
+uint8_t rfs_disk_sector(void* context);
+void rfs_disk_write(void* context, uint8_t data);
+uint8_t rfs_disk_read(void* context);
+
+// Whole sectors of RFS_DISK_SECTOR_SIZE bytes, sector 0-31 in the order they
+// are on the track, through the sector cache and the server, for the sector
+// DMA controller (PortDrivers/disk_dma_io.h). Both block until the server
+// answers. Return false for a drive that is not available, a track or sector
+// off the disk, or a request that fails or times out.
+bool rfs_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
+bool rfs_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
 
 // Initialization
 void rfs_disk_init(void);
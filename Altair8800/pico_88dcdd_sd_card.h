@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "ff.h"
+#include "checkpoint.h"
+#include "snapshot.h"
 
 // MITS 88-DCDD compatible disk controller for Pico with SD Card support
 // Uses FatFs for file I/O on SD card
@@ -75,21 +77,43 @@ typedef struct
     sd_disk_t disk[MAX_DRIVES];
     sd_disk_t* current;
     uint8_t currentDisk;
+    checkpoint_ring_t* checkpoints;          // when set, gets what each sector held before it is written
 } sd_disk_controller_t;
 
 // Global disk controller
 extern sd_disk_controller_t sd_disk_controller;
 
-// Disk controller functions (88-DCDD compatible interface)
-void sd_disk_select(uint8_t drive);
-uint8_t sd_disk_status(void);
-void sd_disk_function(uint8_t control);
-uint8_t sd_disk_sector(void);
-void sd_disk_write(uint8_t data);
-uint8_t sd_disk_read(void);
+// Disk controller functions (88-DCDD compatible interface); the context is unused
+void sd_disk_select(void* context, uint8_t drive);
+uint8_t sd_disk_status(void* context);
+void sd_disk_function(void* context, uint8_t control);
+uint8_t sd_disk_sector(void* context);
+void sd_disk_write(void* context, uint8_t data);
+uint8_t sd_disk_read(void* context);
+
+// Whole sectors of SECTOR_SIZE bytes, sector 0-31 in the order they are on
+// the track, straight from and to the image, for the sector DMA controller
+// (PortDrivers/disk_dma_io.h). A sector the 88-DCDD is in the middle of
+// writing is written back first. Return false for a drive without an image,
+// a track or sector off the disk, or a failed read or write.
+bool sd_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
+bool sd_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
 
 // Initialization
 void sd_disk_init(void);
 bool sd_disk_load(uint8_t drive, const char* disk_path);
 
+// Snapshot section "DSK ": each drive's head, sector and buffer state and a
+// fingerprint of its image file. Loading fails if an image has changed
+// since the save.
+void sd_disk_save(snapshot_writer_t* w);
+bool sd_disk_restore(snapshot_reader_t* section);
+
+// Section "DSKS": the same state without the fingerprints, for checkpoints
+void sd_disk_save_state(snapshot_writer_t* w);
+bool sd_disk_restore_state(snapshot_reader_t* section);
+
+// Writes bytes straight to a drive's image, for rewinding a checkpoint
+void sd_disk_write_image(uint8_t drive, uint32_t offset, const uint8_t* data, uint16_t length);
+
 #endif // _PICO_88DCDD_SD_CARD_H_
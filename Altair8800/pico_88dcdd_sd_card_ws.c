@@ -110,8 +110,9 @@ bool sd_disk_load(uint8_t drive, const char* disk_path)
     return true;
 }
 
-void sd_disk_select(uint8_t drive)
+void sd_disk_select(void* context, uint8_t drive)
 {
+    (void)context;
     uint8_t select = drive & DRIVE_SELECT_MASK;
 
     if (select < MAX_DRIVES)
@@ -126,13 +127,15 @@ void sd_disk_select(uint8_t drive)
     }
 }
 
-uint8_t sd_disk_status(void)
+uint8_t sd_disk_status(void* context)
 {
+    (void)context;
     return sd_disk_controller.current->status;
 }
 
-void sd_disk_function(uint8_t control)
+void sd_disk_function(void* context, uint8_t control)
 {
+    (void)context;
     sd_disk_t* disk = sd_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -184,8 +187,9 @@ void sd_disk_function(uint8_t control)
     }
 }
 
-uint8_t sd_disk_sector(void)
+uint8_t sd_disk_sector(void* context)
 {
+    (void)context;
     sd_disk_t* disk = sd_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -219,8 +223,9 @@ uint8_t sd_disk_sector(void)
     return ret_val;
 }
 
-void sd_disk_write(uint8_t data)
+void sd_disk_write(void* context, uint8_t data)
 {
+    (void)context;
     sd_disk_t* disk = sd_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -249,8 +254,9 @@ void sd_disk_write(uint8_t data)
     }
 }
 
-uint8_t sd_disk_read(void)
+uint8_t sd_disk_read(void* context)
 {
+    (void)context;
     sd_disk_t* disk = sd_disk_controller.current;
 
     if (!disk->disk_loaded)
@@ -287,6 +293,23 @@ uint8_t sd_disk_read(void)
     return disk->sectorData[disk->sectorPointer++];
 }
 
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+// Hands what the sector at offset, about to be written, holds to the checkpoints
+static void save_old_sector(sd_disk_t* pDisk, uint32_t offset)
+{
+    uint8_t old_data[SECTOR_SIZE];
+    UINT bytes_read;
+
+    if (sd_disk_controller.checkpoints &&
+        ws_f_lseek_read(&pDisk->fil, offset, old_data, SECTOR_SIZE, &bytes_read) == FR_OK &&
+        bytes_read == SECTOR_SIZE)
+    {
+        checkpoint_disk_write(sd_disk_controller.checkpoints, (uint8_t)(pDisk - sd_disk_controller.disk),
+                              offset, old_data, SECTOR_SIZE);
+    }
+}
+#endif
+
 static void flushDirtySector(sd_disk_t* pDisk)
 {
     if (!pDisk->sectorDirty)
@@ -294,6 +317,9 @@ static void flushDirtySector(sd_disk_t* pDisk)
         return;
     }
 
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    save_old_sector(pDisk, pDisk->diskPointer);
+#endif
     UINT bytes_written;
     FRESULT fr = ws_f_lseek_write_sync(&pDisk->fil, pDisk->diskPointer,
                                        pDisk->sectorData, SECTOR_SIZE, &bytes_written);
@@ -314,6 +340,9 @@ static void flushDirtySector(sd_disk_t* pDisk)
 
 static FRESULT flushDirtySectorAndReposition(sd_disk_t* pDisk, uint32_t seek_offset)
 {
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    save_old_sector(pDisk, pDisk->diskPointer);
+#endif
     UINT bytes_written;
     FRESULT seek_fr;
     FRESULT write_fr = ws_f_lseek_write_sync_lseek(&pDisk->fil, pDisk->diskPointer,
@@ -334,4 +363,204 @@ static FRESULT flushDirtySectorAndReposition(sd_disk_t* pDisk, uint32_t seek_off
     pDisk->sectorDirty = false;
 
     return seek_fr;
-}
\ No newline at end of file
+}
+
+// The drive for a whole-sector access, with its byte-at-a-time sector written back
+static sd_disk_t* sector_disk(uint8_t drive, uint8_t track, uint8_t sector)
+{
+    if (drive >= MAX_DRIVES || track >= MAX_TRACKS || sector >= SECTORS_PER_TRACK)
+    {
+        return NULL;
+    }
+
+    sd_disk_t* disk = &sd_disk_controller.disk[drive];
+    if (!disk->disk_loaded)
+    {
+        return NULL;
+    }
+    flushDirtySector(disk);
+    return disk;
+}
+
+bool sd_disk_read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+    sd_disk_t* disk = sector_disk(drive, track, sector);
+    UINT bytes_read;
+
+    return disk &&
+           ws_f_lseek_read(&disk->fil, track * TRACK_SIZE + sector * SECTOR_SIZE, data, SECTOR_SIZE, &bytes_read) ==
+               FR_OK &&
+           bytes_read == SECTOR_SIZE;
+}
+
+bool sd_disk_write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    (void)context;
+    sd_disk_t* disk = sector_disk(drive, track, sector);
+    uint32_t offset = track * TRACK_SIZE + sector * SECTOR_SIZE;
+    UINT bytes_written;
+
+    if (!disk)
+    {
+        return false;
+    }
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    save_old_sector(disk, offset);
+#endif
+    if (disk->diskPointer == offset)
+    {
+        // The 88-DCDD reads it afresh
+        disk->haveSectorData = false;
+    }
+    return ws_f_lseek_write_sync(&disk->fil, offset, data, SECTOR_SIZE, &bytes_written) == FR_OK &&
+           bytes_written == SECTOR_SIZE;
+}
+
+// Hashes the whole image, leaving the file position where it was
+static uint64_t image_fingerprint(sd_disk_t* disk)
+{
+    uint8_t chunk[512];
+    uint64_t hash = SNAPSHOT_HASH_INIT;
+    FSIZE_t position = f_tell(&disk->fil);
+    UINT n;
+
+    if (!disk->disk_loaded || ws_f_lseek(&disk->fil, 0) != FR_OK)
+    {
+        return 0;
+    }
+    while (ws_f_read(&disk->fil, chunk, sizeof(chunk), &n) == FR_OK && n > 0)
+    {
+        hash = snapshot_hash(hash, chunk, n);
+    }
+    ws_f_lseek(&disk->fil, position);
+    return hash;
+}
+
+static void put_drive(snapshot_writer_t* w, sd_disk_t* disk)
+{
+    snapshot_put_u32(w, disk->disk_loaded ? (uint32_t)f_tell(&disk->fil) : 0);
+    snapshot_put_u8(w, disk->track);
+    snapshot_put_u8(w, disk->sector);
+    snapshot_put_u8(w, disk->status);
+    snapshot_put_u8(w, disk->write_status);
+    snapshot_put_u32(w, disk->diskPointer);
+    snapshot_put_u8(w, disk->sectorPointer);
+    snapshot_put_u8(w, disk->sectorDirty);
+    snapshot_put_u8(w, disk->haveSectorData);
+    snapshot_put_bytes(w, disk->sectorData, sizeof(disk->sectorData));
+}
+
+static bool get_drive(snapshot_reader_t* section, sd_disk_t* disk)
+{
+    uint32_t position = snapshot_get_u32(section);
+
+    disk->track = snapshot_get_u8(section);
+    disk->sector = snapshot_get_u8(section);
+    disk->status = snapshot_get_u8(section);
+    disk->write_status = snapshot_get_u8(section);
+    disk->diskPointer = snapshot_get_u32(section);
+    disk->sectorPointer = snapshot_get_u8(section);
+    disk->sectorDirty = snapshot_get_u8(section) != 0;
+    disk->haveSectorData = snapshot_get_u8(section) != 0;
+    snapshot_get_bytes(section, disk->sectorData, sizeof(disk->sectorData));
+
+    if (disk->track >= MAX_TRACKS || disk->sector > SECTORS_PER_TRACK || disk->diskPointer > DISK_SIZE ||
+        disk->sectorPointer > sizeof(disk->sectorData))
+    {
+        return false;
+    }
+    if (disk->disk_loaded)
+    {
+        ws_f_lseek(&disk->fil, position);
+    }
+    return true;
+}
+
+void sd_disk_save(snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "DSK ");
+    snapshot_put_u8(w, MAX_DRIVES);
+    snapshot_put_u8(w, sd_disk_controller.currentDisk);
+    for (int i = 0; i < MAX_DRIVES; i++)
+    {
+        sd_disk_t* disk = &sd_disk_controller.disk[i];
+
+        snapshot_put_u8(w, disk->disk_loaded);
+        snapshot_put_u64(w, image_fingerprint(disk));
+        put_drive(w, disk);
+    }
+    snapshot_section_end(w);
+}
+
+bool sd_disk_restore(snapshot_reader_t* section)
+{
+    uint8_t drives = snapshot_get_u8(section);
+    uint8_t current = snapshot_get_u8(section);
+
+    if (drives != MAX_DRIVES || current >= MAX_DRIVES)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < MAX_DRIVES; i++)
+    {
+        sd_disk_t* disk = &sd_disk_controller.disk[i];
+        uint8_t loaded = snapshot_get_u8(section);
+        uint64_t fingerprint = snapshot_get_u64(section);
+
+        if (loaded != disk->disk_loaded || fingerprint != image_fingerprint(disk) || !get_drive(section, disk))
+        {
+            return false;
+        }
+    }
+
+    sd_disk_controller.currentDisk = current;
+    sd_disk_controller.current = &sd_disk_controller.disk[current];
+    return !section->failed;
+}
+
+void sd_disk_save_state(snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "DSKS");
+    snapshot_put_u8(w, sd_disk_controller.currentDisk);
+    for (int i = 0; i < MAX_DRIVES; i++)
+    {
+        put_drive(w, &sd_disk_controller.disk[i]);
+    }
+    snapshot_section_end(w);
+}
+
+bool sd_disk_restore_state(snapshot_reader_t* section)
+{
+    uint8_t current = snapshot_get_u8(section);
+
+    if (current >= MAX_DRIVES)
+    {
+        return false;
+    }
+    for (int i = 0; i < MAX_DRIVES; i++)
+    {
+        if (!get_drive(section, &sd_disk_controller.disk[i]))
+        {
+            return false;
+        }
+    }
+
+    sd_disk_controller.currentDisk = current;
+    sd_disk_controller.current = &sd_disk_controller.disk[current];
+    return !section->failed;
+}
+
+void sd_disk_write_image(uint8_t drive, uint32_t offset, const uint8_t* data, uint16_t length)
+{
+    sd_disk_t* disk;
+    UINT bytes_written;
+
+    if (drive >= MAX_DRIVES || !sd_disk_controller.disk[drive].disk_loaded)
+    {
+        return;
+    }
+    disk = &sd_disk_controller.disk[drive];
+    ws_f_lseek_write_sync(&disk->fil, offset, data, length, &bytes_written);
+}
@@ -0,0 +1,413 @@
+#include "profiler.h"
+
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+
+#include <stdio.h>
+#include <string.h>
+
+#define REPORT_MAX_TOP 64
+#define REPORT_LINE 256
+
+void profiler_init(profiler_t* p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+void profiler_start(profiler_t* p)
+{
+    p->running = true;
+    p->samples = 0;
+    p->cycles = 0;
+    p->instructions = 0;
+    p->dropped_stacks = 0;
+    p->stack_count = 0;
+    p->until_sample = PROFILER_SAMPLE_CYCLES;
+    p->opcodes_counted = i8080_opcode_counts(p->opcode_base) == 0;
+    memset(p->opcode_total, 0, sizeof(p->opcode_total));
+    memset(p->pc_samples, 0, sizeof(p->pc_samples));
+    memset(p->opcode_samples, 0, sizeof(p->opcode_samples));
+    memset(p->stacks, 0, sizeof(p->stacks));
+}
+
+// Executed since profiling started, if the core counts them
+static void opcodes_since_start(const profiler_t* p, uint64_t counts[256])
+{
+    if (!p->opcodes_counted || i8080_opcode_counts(counts) != 0)
+    {
+        memset(counts, 0, 256 * sizeof(counts[0]));
+        return;
+    }
+    for (int op = 0; op < 256; op++)
+    {
+        counts[op] -= p->opcode_base[op];
+    }
+}
+
+void profiler_stop(profiler_t* p)
+{
+    if (p->running)
+    {
+        opcodes_since_start(p, p->opcode_total);
+        p->running = false;
+    }
+}
+
+// The entry address of the function that a return address goes back into,
+// if the three bytes before it are a CALL
+static bool return_entry(const altair_memory_t* mem, uint16_t address, uint16_t* entry)
+{
+    uint8_t op = read8(mem, (uint16_t)(address - 3));
+
+    if (op != 0xcd && (op & 0xc7) != 0xc4)
+    {
+        return false;
+    }
+    *entry = read16(mem, (uint16_t)(address - 2));
+    return true;
+}
+
+static uint32_t stack_hash(const profiler_stack_t* stack)
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < stack->depth; i++)
+    {
+        hash = (hash ^ stack->pc[i]) * 16777619u;
+        hash = (hash ^ stack->entry[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Counts a sample of the stack, in an open-addressed table kept at most
+// three quarters full
+static void add_stack(profiler_t* p, const profiler_stack_t* stack)
+{
+    uint32_t slot = stack_hash(stack) % PROFILER_MAX_STACKS;
+
+    while (p->stacks[slot].count != 0)
+    {
+        profiler_stack_t* s = &p->stacks[slot];
+
+        if (s->depth == stack->depth && memcmp(s->pc, stack->pc, sizeof(s->pc)) == 0 &&
+            memcmp(s->entry, stack->entry, sizeof(s->entry)) == 0)
+        {
+            s->count++;
+            return;
+        }
+        slot = (slot + 1) % PROFILER_MAX_STACKS;
+    }
+    if (p->stack_count >= PROFILER_MAX_STACKS / 4 * 3)
+    {
+        p->dropped_stacks++;
+        return;
+    }
+    p->stacks[slot] = *stack;
+    p->stacks[slot].count = 1;
+    p->stack_count++;
+}
+
+static void take_sample(profiler_t* p, const intel8080_t* cpu)
+{
+    const altair_memory_t* mem = cpu->memory;
+    uint16_t pc = cpu->registers.pc;
+    profiler_stack_t stack;
+
+    p->samples++;
+    p->pc_samples[pc >> PROFILER_PC_SHIFT]++;
+    p->opcode_samples[read8(mem, pc)]++;
+
+    // The function each frame is in is the target of the CALL in the frame
+    // outside it; the outermost one's stays unknown
+    memset(&stack, 0, sizeof(stack));
+    stack.pc[0] = pc;
+    stack.depth = 1;
+    for (int i = 0; i < PROFILER_STACK_SCAN && stack.depth < PROFILER_STACK_DEPTH; i++)
+    {
+        uint16_t address = read16(mem, (uint16_t)(cpu->registers.sp + 2 * i));
+        uint16_t entry;
+
+        if (return_entry(mem, address, &entry))
+        {
+            stack.entry[stack.depth - 1] = entry;
+            stack.pc[stack.depth++] = address;
+        }
+    }
+    add_stack(p, &stack);
+}
+
+uint32_t profiler_run(profiler_t* p, intel8080_t* cpu, uint32_t cycle_budget, uint8_t stop_flags)
+{
+    uint32_t elapsed = 0;
+    uint64_t instructions = cpu->instructions;
+    uint8_t idle = 1;
+
+    if (!p->running || cycle_budget == 0)
+    {
+        return i8080_run(cpu, cycle_budget, stop_flags);
+    }
+
+    // Samples fall every PROFILER_SAMPLE_CYCLES whatever the budgets, so
+    // short slices of a paced clock are counted as fairly as long ones
+    while (elapsed < cycle_budget && !(cpu->events & stop_flags))
+    {
+        uint32_t remaining = cycle_budget - elapsed;
+        uint32_t ran = i8080_run(cpu, remaining < p->until_sample ? remaining : p->until_sample, stop_flags);
+
+        elapsed += ran;
+        idle &= cpu->idle;
+        if (ran >= p->until_sample)
+        {
+            take_sample(p, cpu);
+            p->until_sample = PROFILER_SAMPLE_CYCLES;
+        }
+        else
+        {
+            p->until_sample -= ran;
+        }
+    }
+    cpu->idle = idle;
+
+    p->cycles += elapsed;
+    p->instructions += cpu->instructions - instructions;
+    return elapsed;
+}
+
+void profiler_set_symbols(profiler_t* p, const altair_symbol_t* symbols, size_t count)
+{
+    p->symbols = symbols;
+    p->symbol_count = count;
+}
+
+static const altair_symbol_t* find_symbol(const profiler_t* p, uint16_t address)
+{
+    return symbols_find(p->symbols, p->symbol_count, address);
+}
+
+// Keeps the top entries, largest first
+typedef struct
+{
+    int size;
+    int limit;
+    uint32_t key[REPORT_MAX_TOP];
+    uint64_t value[REPORT_MAX_TOP];
+} top_list_t;
+
+static void top_init(top_list_t* top, int limit)
+{
+    top->size = 0;
+    top->limit = limit < 1 ? 1 : (limit > REPORT_MAX_TOP ? REPORT_MAX_TOP : limit);
+}
+
+static void top_add(top_list_t* top, uint32_t key, uint64_t value)
+{
+    int i;
+
+    if (value == 0 || (top->size == top->limit && value <= top->value[top->size - 1]))
+    {
+        return;
+    }
+    i = top->size < top->limit ? top->size++ : top->size - 1;
+    while (i > 0 && top->value[i - 1] < value)
+    {
+        top->key[i] = top->key[i - 1];
+        top->value[i] = top->value[i - 1];
+        i--;
+    }
+    top->key[i] = key;
+    top->value[i] = value;
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole == 0 ? 0.0 : 100.0 * (double)part / (double)whole;
+}
+
+static uint64_t range_samples(const profiler_t* p, uint32_t start, uint32_t end)
+{
+    uint64_t samples = 0;
+
+    for (uint32_t bucket = start >> PROFILER_PC_SHIFT; bucket <= (end - 1) >> PROFILER_PC_SHIFT; bucket++)
+    {
+        samples += p->pc_samples[bucket];
+    }
+    return samples;
+}
+
+void profiler_report(const profiler_t* p, int top, profiler_print_fn print, void* context)
+{
+    char line[REPORT_LINE];
+    char name[48];
+    top_list_t list;
+
+    snprintf(line, sizeof(line), "Profile%s: %llu samples, one every %d T-states, of %llu T-states and %llu instructions",
+             p->running ? " (running)" : "", (unsigned long long)p->samples, PROFILER_SAMPLE_CYCLES,
+             (unsigned long long)p->cycles, (unsigned long long)p->instructions);
+    print(context, line);
+    if (p->samples == 0)
+    {
+        return;
+    }
+
+    top_init(&list, top);
+    for (uint32_t bucket = 0; bucket < sizeof(p->pc_samples) / sizeof(p->pc_samples[0]); bucket++)
+    {
+        top_add(&list, bucket << PROFILER_PC_SHIFT, p->pc_samples[bucket]);
+    }
+    print(context, PROFILER_PC_SHIFT ? "Top addresses (16-byte blocks):" : "Top addresses:");
+    for (int i = 0; i < list.size; i++)
+    {
+        name[0] = '\0';
+        if (find_symbol(p, (uint16_t)list.key[i]) != NULL)
+        {
+            name[0] = ' ';
+            name[1] = ' ';
+            symbols_format(p->symbols, p->symbol_count, (uint16_t)list.key[i], name + 2, sizeof(name) - 2);
+        }
+        snprintf(line, sizeof(line), "  %6.2f%% %10llu  0x%04X%s", percent(list.value[i], p->samples),
+                 (unsigned long long)list.value[i], list.key[i], name);
+        print(context, line);
+    }
+
+    // Functions run from their symbol to the next one, pages without symbols
+    top_init(&list, top);
+    if (p->symbol_count > 0)
+    {
+        for (size_t i = 0; i < p->symbol_count; i++)
+        {
+            uint32_t start = p->symbols[i].address;
+            uint32_t end = start + SYMBOL_SPAN;
+
+            if (i + 1 < p->symbol_count && p->symbols[i + 1].address < end)
+            {
+                end = p->symbols[i + 1].address;
+            }
+            if (end > start)
+            {
+                top_add(&list, (uint32_t)i, range_samples(p, start, end > 0x10000 ? 0x10000 : end));
+            }
+        }
+        print(context, "Top functions:");
+    }
+    else
+    {
+        for (uint32_t page = 0; page < 256; page++)
+        {
+            top_add(&list, page, range_samples(p, page << 8, (page + 1) << 8));
+        }
+        print(context, "Top pages:");
+    }
+    for (int i = 0; i < list.size; i++)
+    {
+        if (p->symbol_count > 0)
+        {
+            snprintf(name, sizeof(name), "0x%04X  %s", p->symbols[list.key[i]].address,
+                     p->symbols[list.key[i]].name);
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "0x%04X-0x%04X", list.key[i] << 8, (list.key[i] << 8) | 0xff);
+        }
+        snprintf(line, sizeof(line), "  %6.2f%% %10llu  %s", percent(list.value[i], p->samples),
+                 (unsigned long long)list.value[i], name);
+        print(context, line);
+    }
+
+    top_init(&list, top);
+    for (uint32_t op = 0; op < 256; op++)
+    {
+        top_add(&list, op, p->opcode_samples[op]);
+    }
+    print(context, "Top opcodes by samples:");
+    for (int i = 0; i < list.size; i++)
+    {
+        snprintf(line, sizeof(line), "  %6.2f%% %10llu  0x%02X", percent(list.value[i], p->samples),
+                 (unsigned long long)list.value[i], list.key[i]);
+        print(context, line);
+    }
+
+    if (p->opcodes_counted)
+    {
+        uint64_t counts[256];
+        uint64_t total = 0;
+
+        if (p->running)
+        {
+            opcodes_since_start(p, counts);
+        }
+        else
+        {
+            memcpy(counts, p->opcode_total, sizeof(counts));
+        }
+        top_init(&list, top);
+        for (uint32_t op = 0; op < 256; op++)
+        {
+            total += counts[op];
+            top_add(&list, op, counts[op]);
+        }
+        print(context, "Top opcodes by executions:");
+        for (int i = 0; i < list.size; i++)
+        {
+            snprintf(line, sizeof(line), "  %6.2f%% %10llu  0x%02X", percent(list.value[i], total),
+                     (unsigned long long)list.value[i], list.key[i]);
+            print(context, line);
+        }
+    }
+
+    if (p->dropped_stacks > 0)
+    {
+        snprintf(line, sizeof(line), "%llu samples left out of the call stacks, too many different ones",
+                 (unsigned long long)p->dropped_stacks);
+        print(context, line);
+    }
+}
+
+// A frame's function: its symbol, or the target of the CALL into it
+static void frame_name(const profiler_t* p, const profiler_stack_t* stack, int frame, char* text, size_t size)
+{
+    const altair_symbol_t* symbol = find_symbol(p, stack->pc[frame]);
+
+    if (symbol != NULL)
+    {
+        snprintf(text, size, "%s", symbol->name);
+    }
+    else if (frame + 1 < stack->depth)
+    {
+        snprintf(text, size, "sub_%04X", stack->entry[frame]);
+    }
+    else
+    {
+        snprintf(text, size, "0x%04X", stack->pc[frame]);
+    }
+}
+
+void profiler_write_collapsed(const profiler_t* p, profiler_print_fn print, void* context)
+{
+    char line[REPORT_LINE];
+
+    for (uint32_t slot = 0; slot < PROFILER_MAX_STACKS; slot++)
+    {
+        const profiler_stack_t* stack = &p->stacks[slot];
+        size_t length = 0;
+
+        if (stack->count == 0)
+        {
+            continue;
+        }
+        for (int frame = stack->depth - 1; frame >= 0; frame--)
+        {
+            char name[SYMBOL_NAME + 8];
+
+            frame_name(p, stack, frame, name, sizeof(name));
+            length += (size_t)snprintf(line + length, sizeof(line) - length, "%s%s", name, frame > 0 ? ";" : "");
+        }
+        snprintf(line + length, sizeof(line) - length, " %lu", (unsigned long)stack->count);
+        print(context, line);
+    }
+    if (p->dropped_stacks > 0)
+    {
+        snprintf(line, sizeof(line), "[dropped] %llu", (unsigned long long)p->dropped_stacks);
+        print(context, line);
+    }
+}
+
+#endif
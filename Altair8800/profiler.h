@@ -0,0 +1,95 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include "intel8080.h"
+#include "memory.h"
+#include "symbols.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sampling profiler for the guest, built with ALTAIR_PROFILER.
+//
+// While it runs, profiler_run() stands in for i8080_run(): it runs the CPU
+// PROFILER_SAMPLE_CYCLES T-states at a time and after each run records the
+// PC, the opcode there and the call stack. Stopped, it is i8080_run() and
+// costs nothing. Any CPU core can be profiled, as none of them is changed.
+//
+// The call stack is guessed by walking the 8080 stack for words that point
+// just past a CALL, so data pushed on the stack can now and then show up as
+// a caller and interrupt handlers have none. Each caller also gives the entry address of the function
+// it called, which names the frames when no symbols are loaded.
+//
+// Exact per-opcode counts come from the instruction pair counters of an
+// I8080_PAIR_PROFILE build (see i8080_opcode_counts()); otherwise the report
+// has the opcodes' share of the samples only.
+
+// Prime, so that samples do not lock onto the period of a guest loop
+#define PROFILER_SAMPLE_CYCLES 997
+
+#define PROFILER_STACK_DEPTH 8  // frames kept per sample, the PC's included
+#define PROFILER_STACK_SCAN 32  // stack words searched for return addresses
+
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+#define PROFILER_PC_SHIFT 4     // samples are counted per 16 bytes
+#define PROFILER_MAX_STACKS 256
+#else
+#define PROFILER_PC_SHIFT 0
+#define PROFILER_MAX_STACKS 4096
+#endif
+
+typedef struct
+{
+    uint32_t count;
+    uint8_t depth;
+    uint16_t pc[PROFILER_STACK_DEPTH];       // innermost first
+    uint16_t entry[PROFILER_STACK_DEPTH];    // function each frame is in, from its caller's CALL
+} profiler_stack_t;
+
+// Takes the report a line at a time, without a line ending
+typedef void (*profiler_print_fn)(void* context, const char* line);
+
+typedef struct
+{
+    bool running;
+    uint64_t samples;
+    uint64_t cycles;                    // T-states run while profiling
+    uint64_t instructions;
+    uint64_t dropped_stacks;            // samples whose stack did not fit in stacks[]
+    bool opcodes_counted;               // an I8080_PAIR_PROFILE build counts every opcode
+    uint64_t opcode_base[256];          // i8080_opcode_counts() when profiling started
+    uint64_t opcode_total[256];         // executed while profiling, once stopped
+    uint32_t until_sample;              // T-states left before the next sample
+    const altair_symbol_t* symbols;     // sorted by address
+    size_t symbol_count;
+    uint32_t stack_count;
+    uint32_t pc_samples[65536 >> PROFILER_PC_SHIFT];
+    uint32_t opcode_samples[256];
+    profiler_stack_t stacks[PROFILER_MAX_STACKS];
+} profiler_t;
+
+void profiler_init(profiler_t* p);
+
+// Forgets the samples and starts taking new ones
+void profiler_start(profiler_t* p);
+
+// Stops taking samples, keeping them for the report
+void profiler_stop(profiler_t* p);
+
+// i8080_run(), sampling while the profiler runs
+uint32_t profiler_run(profiler_t* p, intel8080_t* cpu, uint32_t cycle_budget, uint8_t stop_flags);
+
+// Names addresses in the report with symbols (see symbols.h), which must
+// outlive p
+void profiler_set_symbols(profiler_t* p, const altair_symbol_t* symbols, size_t count);
+
+// The top addresses, ranges (functions, or 256-byte pages without symbols)
+// and opcodes, top lines of each
+void profiler_report(const profiler_t* p, int top, profiler_print_fn print, void* context);
+
+// One "outer;...;inner count" line per sampled stack, for flamegraph.pl
+// and the tools that read its collapsed format
+void profiler_write_collapsed(const profiler_t* p, profiler_print_fn print, void* context);
+
+#endif
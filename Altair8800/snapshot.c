@@ -0,0 +1,422 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+#define SECTION_HEADER_SIZE 8
+#define MEMORY_CHUNK_PAGES (SNAPSHOT_MEMORY_CHUNK / 256)
+
+static void put_raw(snapshot_writer_t* w, const void* data, size_t length)
+{
+    if (w->failed || length > w->capacity - w->length)
+    {
+        w->failed = true;
+        return;
+    }
+    memcpy(w->buffer + w->length, data, length);
+    w->length += length;
+}
+
+static void put_le(snapshot_writer_t* w, uint64_t value, int bytes)
+{
+    uint8_t le[8];
+
+    for (int i = 0; i < bytes; i++)
+    {
+        le[i] = (uint8_t)(value >> (8 * i));
+    }
+    put_raw(w, le, (size_t)bytes);
+}
+
+// Hands everything written so far to the sink
+static void drain(snapshot_writer_t* w)
+{
+    if (w->sink == NULL || w->failed || w->length == 0)
+    {
+        return;
+    }
+    if (!w->sink(w->sink_context, w->buffer, w->length))
+    {
+        w->failed = true;
+    }
+    w->length = 0;
+}
+
+void snapshot_write_begin(snapshot_writer_t* w, uint8_t* buffer, size_t capacity, snapshot_sink_fn sink,
+                          void* sink_context)
+{
+    memset(w, 0, sizeof(*w));
+    w->buffer = buffer;
+    w->capacity = capacity;
+    w->sink = sink;
+    w->sink_context = sink_context;
+    put_raw(w, SNAPSHOT_MAGIC, 8);
+    put_le(w, SNAPSHOT_VERSION, 2);
+    drain(w);
+}
+
+void snapshot_section_begin(snapshot_writer_t* w, const char tag[4])
+{
+    w->section = w->length;
+    put_raw(w, tag, 4);
+    put_le(w, 0, 4);
+}
+
+void snapshot_section_end(snapshot_writer_t* w)
+{
+    if (!w->failed)
+    {
+        uint32_t length = (uint32_t)(w->length - w->section - SECTION_HEADER_SIZE);
+
+        for (int i = 0; i < 4; i++)
+        {
+            w->buffer[w->section + 4 + i] = (uint8_t)(length >> (8 * i));
+        }
+    }
+    drain(w);
+}
+
+bool snapshot_write_end(snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "END ");
+    snapshot_section_end(w);
+    return !w->failed;
+}
+
+void snapshot_put_u8(snapshot_writer_t* w, uint8_t value)
+{
+    put_raw(w, &value, 1);
+}
+
+void snapshot_put_u16(snapshot_writer_t* w, uint16_t value)
+{
+    put_le(w, value, 2);
+}
+
+void snapshot_put_u32(snapshot_writer_t* w, uint32_t value)
+{
+    put_le(w, value, 4);
+}
+
+void snapshot_put_u64(snapshot_writer_t* w, uint64_t value)
+{
+    put_le(w, value, 8);
+}
+
+void snapshot_put_bytes(snapshot_writer_t* w, const void* data, size_t length)
+{
+    put_raw(w, data, length);
+}
+
+static bool get_raw(snapshot_reader_t* r, void* data, size_t length)
+{
+    if (r->failed || length > r->length - r->pos)
+    {
+        r->failed = true;
+        memset(data, 0, length);
+        return false;
+    }
+    memcpy(data, r->data + r->pos, length);
+    r->pos += length;
+    return true;
+}
+
+static uint64_t get_le(snapshot_reader_t* r, int bytes)
+{
+    uint8_t le[8];
+    uint64_t value = 0;
+
+    get_raw(r, le, (size_t)bytes);
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        value = (value << 8) | le[i];
+    }
+    return value;
+}
+
+// Reads exactly length bytes through the source
+static bool source_read(snapshot_reader_t* r, uint8_t* data, size_t length)
+{
+    while (length > 0)
+    {
+        size_t got = r->source(r->source_context, data, length);
+
+        if (got == 0)
+        {
+            return false;
+        }
+        data += got;
+        length -= got;
+    }
+    return true;
+}
+
+bool snapshot_read_begin(snapshot_reader_t* r, const uint8_t* data, size_t length, snapshot_source_fn source,
+                         void* source_context, uint8_t* buffer, size_t capacity)
+{
+    uint8_t header[10];
+
+    memset(r, 0, sizeof(*r));
+    r->data = data;
+    r->length = length;
+    r->source = source;
+    r->source_context = source_context;
+    r->buffer = buffer;
+    r->capacity = capacity;
+
+    if (source != NULL)
+    {
+        r->failed = !source_read(r, header, sizeof(header));
+    }
+    else
+    {
+        get_raw(r, header, sizeof(header));
+    }
+    if (r->failed || memcmp(header, SNAPSHOT_MAGIC, 8) != 0 ||
+        (uint16_t)(header[8] | header[9] << 8) != SNAPSHOT_VERSION)
+    {
+        r->failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool snapshot_next_section(snapshot_reader_t* r, char tag[4], snapshot_reader_t* section)
+{
+    uint8_t header[SECTION_HEADER_SIZE];
+    uint32_t length;
+
+    if (r->source != NULL)
+    {
+        r->failed = r->failed || !source_read(r, header, sizeof(header));
+    }
+    else
+    {
+        get_raw(r, header, sizeof(header));
+    }
+    if (r->failed)
+    {
+        return false;
+    }
+
+    memcpy(tag, header, 4);
+    length = (uint32_t)header[4] | (uint32_t)header[5] << 8 | (uint32_t)header[6] << 16 | (uint32_t)header[7] << 24;
+
+    memset(section, 0, sizeof(*section));
+    section->length = length;
+    if (r->source != NULL)
+    {
+        if (length > r->capacity || !source_read(r, r->buffer, length))
+        {
+            r->failed = true;
+            return false;
+        }
+        section->data = r->buffer;
+    }
+    else
+    {
+        if (length > r->length - r->pos)
+        {
+            r->failed = true;
+            return false;
+        }
+        section->data = r->data + r->pos;
+        r->pos += length;
+    }
+    return !snapshot_tag_is(tag, "END ");
+}
+
+uint8_t snapshot_get_u8(snapshot_reader_t* r)
+{
+    return (uint8_t)get_le(r, 1);
+}
+
+uint16_t snapshot_get_u16(snapshot_reader_t* r)
+{
+    return (uint16_t)get_le(r, 2);
+}
+
+uint32_t snapshot_get_u32(snapshot_reader_t* r)
+{
+    return (uint32_t)get_le(r, 4);
+}
+
+uint64_t snapshot_get_u64(snapshot_reader_t* r)
+{
+    return get_le(r, 8);
+}
+
+void snapshot_get_bytes(snapshot_reader_t* r, void* data, size_t length)
+{
+    get_raw(r, data, length);
+}
+
+uint64_t snapshot_hash(uint64_t hash, const void* data, size_t length)
+{
+    const uint8_t* p = data;
+
+    while (length-- > 0)
+    {
+        hash = (hash ^ *p++) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void snapshot_save_cpu(snapshot_writer_t* w, const intel8080_t* cpu)
+{
+    // Outside i8080_run() no flags are pending, so registers.flags is exact
+    snapshot_section_begin(w, "CPU ");
+    snapshot_put_u16(w, cpu->registers.af);
+    snapshot_put_u16(w, cpu->registers.bc);
+    snapshot_put_u16(w, cpu->registers.de);
+    snapshot_put_u16(w, cpu->registers.hl);
+    snapshot_put_u16(w, cpu->registers.sp);
+    snapshot_put_u16(w, cpu->registers.pc);
+    snapshot_put_u16(w, cpu->address_bus);
+    snapshot_put_u8(w, cpu->data_bus);
+    snapshot_put_u8(w, cpu->current_op_code);
+    snapshot_put_u8(w, cpu->cpuStatus);
+    snapshot_put_u8(w, cpu->halted);
+    snapshot_put_u8(w, cpu->interrupt_requests);
+    snapshot_put_u8(w, cpu->sio_rx);
+    snapshot_put_u64(w, cpu->cycles);
+    snapshot_put_u64(w, cpu->instructions);
+    snapshot_section_end(w);
+}
+
+bool snapshot_load_cpu(snapshot_reader_t* section, intel8080_t* cpu)
+{
+    cpu->registers.af = snapshot_get_u16(section);
+    cpu->registers.bc = snapshot_get_u16(section);
+    cpu->registers.de = snapshot_get_u16(section);
+    cpu->registers.hl = snapshot_get_u16(section);
+    cpu->registers.sp = snapshot_get_u16(section);
+    cpu->registers.pc = snapshot_get_u16(section);
+    cpu->address_bus = snapshot_get_u16(section);
+    cpu->data_bus = snapshot_get_u8(section);
+    cpu->current_op_code = snapshot_get_u8(section);
+    cpu->cpuStatus = snapshot_get_u8(section);
+    cpu->halted = snapshot_get_u8(section);
+    cpu->interrupt_requests = snapshot_get_u8(section);
+    cpu->sio_rx = snapshot_get_u8(section);
+    cpu->cycles = snapshot_get_u64(section);
+    cpu->instructions = snapshot_get_u64(section);
+
+    memset(&cpu->lazy_flags, 0, sizeof(cpu->lazy_flags));
+    cpu->events = 0;
+    cpu->idle = 0;
+    cpu->idle_polls = 0;
+    cpu->poll_pc = 0;
+    return !section->failed;
+}
+
+// PackBits: a count byte n of 0-127 is followed by n + 1 literal bytes, one of
+// 129-255 by a byte to repeat 257 - n times
+static void pack_bits(snapshot_writer_t* w, const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+
+    while (i < length)
+    {
+        size_t run = 1;
+
+        while (i + run < length && run < 128 && data[i + run] == data[i])
+        {
+            run++;
+        }
+        if (run >= 3)
+        {
+            snapshot_put_u8(w, (uint8_t)(257 - run));
+            snapshot_put_u8(w, data[i]);
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run of three
+        size_t literal = 0;
+
+        while (i + literal < length && literal < 128)
+        {
+            if (i + literal + 2 < length && data[i + literal] == data[i + literal + 1] &&
+                data[i + literal] == data[i + literal + 2])
+            {
+                break;
+            }
+            literal++;
+        }
+        snapshot_put_u8(w, (uint8_t)(literal - 1));
+        snapshot_put_bytes(w, data + i, literal);
+        i += literal;
+    }
+}
+
+static bool unpack_bits(snapshot_reader_t* r, uint8_t* data, size_t length)
+{
+    size_t i = 0;
+
+    while (i < length && !r->failed)
+    {
+        uint8_t n = snapshot_get_u8(r);
+
+        if (n < 128)
+        {
+            if ((size_t)n + 1 > length - i)
+            {
+                return false;
+            }
+            snapshot_get_bytes(r, data + i, (size_t)n + 1);
+            i += (size_t)n + 1;
+        }
+        else if (n > 128)
+        {
+            size_t run = 257u - n;
+
+            if (run > length - i)
+            {
+                return false;
+            }
+            memset(data + i, snapshot_get_u8(r), run);
+            i += run;
+        }
+    }
+    return !r->failed;
+}
+
+void snapshot_save_memory(snapshot_writer_t* w, const altair_memory_t* mem)
+{
+    for (int first = 0; first < 256; first += MEMORY_CHUNK_PAGES)
+    {
+        snapshot_section_begin(w, "MEM ");
+        snapshot_put_u8(w, (uint8_t)first);
+        snapshot_put_u8(w, MEMORY_CHUNK_PAGES);
+        for (int page = first; page < first + MEMORY_CHUNK_PAGES; page++)
+        {
+            snapshot_put_u8(w, mem->page_attr[page] == MEMORY_ROM ? MEMORY_ROM : MEMORY_RAM);
+        }
+        pack_bits(w, mem->bytes + first * 256, SNAPSHOT_MEMORY_CHUNK);
+        snapshot_section_end(w);
+    }
+}
+
+bool snapshot_load_memory(snapshot_reader_t* section, altair_memory_t* mem)
+{
+    uint8_t first = snapshot_get_u8(section);
+    uint8_t pages = snapshot_get_u8(section);
+    uint8_t attr[256];
+
+    if (pages == 0 || first + pages > 256)
+    {
+        return false;
+    }
+    snapshot_get_bytes(section, attr, pages);
+    if (!unpack_bits(section, mem->bytes + first * 256, (size_t)pages * 256))
+    {
+        return false;
+    }
+    memory_pages_written(mem, (uint16_t)(first * 256), (uint32_t)pages * 256);
+    for (int i = 0; i < pages; i++)
+    {
+        memory_set_pages(mem, (uint16_t)((first + i) * 256), 256, attr[i] == MEMORY_ROM ? MEMORY_ROM : MEMORY_RAM,
+                         NULL, NULL);
+    }
+    return true;
+}
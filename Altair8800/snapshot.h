@@ -0,0 +1,113 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "intel8080.h"
+#include "memory.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Whole-machine snapshots. A snapshot is an 8-byte magic and a 16-bit format
+// version, then sections, each a 4-character tag, a 32-bit payload length and
+// the payload, ending with an "END " section. Integers are little-endian.
+// Every device saves and loads its own sections; loaders skip tags they do
+// not know, so a section can be added without a new version.
+//
+// No section is larger than SNAPSHOT_SECTION_MAX, so a snapshot can be
+// written and read a section at a time through a buffer of that size. Memory
+// goes in SNAPSHOT_MEMORY_CHUNK-byte sections, run-length compressed.
+//
+// Disk images are not in the snapshot. A machine must be resumed with the
+// images it was saved with, which the disk controllers check.
+
+#define SNAPSHOT_MAGIC "ALTRSNAP"
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_MEMORY_CHUNK 4096
+#define SNAPSHOT_SECTION_MAX (SNAPSHOT_MEMORY_CHUNK + SNAPSHOT_MEMORY_CHUNK / 128 + 512)
+
+// A snapshot of memory that is mostly empty, as after a CP/M boot, fits easily
+#define SNAPSHOT_MAX_SIZE (16 + 64 * 1024 + 64 * 1024 / 128 + 16 * 16 + 4096)
+
+// Takes each finished section when writing a section at a time
+typedef bool (*snapshot_sink_fn)(void* context, const uint8_t* data, size_t length);
+
+// Fills data with up to length bytes and returns how many it read
+typedef size_t (*snapshot_source_fn)(void* context, uint8_t* data, size_t length);
+
+typedef struct
+{
+    uint8_t* buffer;
+    size_t capacity;
+    size_t length;
+    size_t section;         // offset of the open section's header
+    snapshot_sink_fn sink;  // NULL to keep the whole snapshot in buffer
+    void* sink_context;
+    bool failed;            // out of room, or the sink failed
+} snapshot_writer_t;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+    bool failed;            // read past the end, or a bad section
+    snapshot_source_fn source;  // NULL when data holds the whole snapshot
+    void* source_context;
+    uint8_t* buffer;        // where sections read through source go
+    size_t capacity;
+} snapshot_reader_t;
+
+// Starts a snapshot in buffer. With a sink, buffer needs room for one
+// section; without one, for the whole snapshot.
+void snapshot_write_begin(snapshot_writer_t* w, uint8_t* buffer, size_t capacity, snapshot_sink_fn sink,
+                          void* sink_context);
+void snapshot_section_begin(snapshot_writer_t* w, const char tag[4]);
+void snapshot_section_end(snapshot_writer_t* w);
+
+// Ends the snapshot. Returns false if anything could not be written.
+bool snapshot_write_end(snapshot_writer_t* w);
+
+void snapshot_put_u8(snapshot_writer_t* w, uint8_t value);
+void snapshot_put_u16(snapshot_writer_t* w, uint16_t value);
+void snapshot_put_u32(snapshot_writer_t* w, uint32_t value);
+void snapshot_put_u64(snapshot_writer_t* w, uint64_t value);
+void snapshot_put_bytes(snapshot_writer_t* w, const void* data, size_t length);
+
+// Opens a snapshot held in memory, or with a source, read through buffer a
+// section at a time. Returns false if the magic or version is wrong.
+bool snapshot_read_begin(snapshot_reader_t* r, const uint8_t* data, size_t length, snapshot_source_fn source,
+                         void* source_context, uint8_t* buffer, size_t capacity);
+
+// Moves to the next section, setting tag and a reader over its payload.
+// Returns false at the end section or on a bad or truncated snapshot, in
+// which case r->failed is set.
+bool snapshot_next_section(snapshot_reader_t* r, char tag[4], snapshot_reader_t* section);
+
+// Section payload readers; past the end they return zero and set failed
+uint8_t snapshot_get_u8(snapshot_reader_t* r);
+uint16_t snapshot_get_u16(snapshot_reader_t* r);
+uint32_t snapshot_get_u32(snapshot_reader_t* r);
+uint64_t snapshot_get_u64(snapshot_reader_t* r);
+void snapshot_get_bytes(snapshot_reader_t* r, void* data, size_t length);
+
+static inline bool snapshot_tag_is(const char tag[4], const char* name)
+{
+    return tag[0] == name[0] && tag[1] == name[1] && tag[2] == name[2] && tag[3] == name[3];
+}
+
+// FNV-1a, for fingerprinting disk images
+#define SNAPSHOT_HASH_INIT 1469598103934665603ull
+uint64_t snapshot_hash(uint64_t hash, const void* data, size_t length);
+
+// The CPU's registers, interrupt state and counters, as section "CPU "
+void snapshot_save_cpu(snapshot_writer_t* w, const intel8080_t* cpu);
+bool snapshot_load_cpu(snapshot_reader_t* section, intel8080_t* cpu);
+
+// Memory and its RAM/ROM pages, as sections "MEM ". Watched and memory-mapped
+// pages load as RAM; their owner sets them again after loading.
+void snapshot_save_memory(snapshot_writer_t* w, const altair_memory_t* mem);
+bool snapshot_load_memory(snapshot_reader_t* section, altair_memory_t* mem);
+
+#endif
@@ -0,0 +1,152 @@
+#include "symbols.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// A 16-bit hex address as 1234, 0x1234 or 1234H
+static bool parse_address(const char* token, size_t length, uint16_t* address)
+{
+    uint32_t value = 0;
+
+    if (length > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+    {
+        token += 2;
+        length -= 2;
+    }
+    else if (length > 1 && (token[length - 1] == 'h' || token[length - 1] == 'H'))
+    {
+        length--;
+    }
+    if (length == 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        int digit = hex_digit(token[i]);
+
+        if (digit < 0 || (value = value << 4 | (uint32_t)digit) > 0xffff)
+        {
+            return false;
+        }
+    }
+    *address = (uint16_t)value;
+    return true;
+}
+
+size_t symbols_parse(const char* text, size_t length, altair_symbol_t* symbols, size_t count, size_t max)
+{
+    size_t pos = 0;
+    bool line_start = true;
+    bool have_address = false;
+    uint16_t address = 0;
+
+    while (pos < length && text[pos] != 0x1a && count < max)
+    {
+        char c = text[pos];
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            line_start = line_start || c == '\n';
+            pos++;
+            continue;
+        }
+        if (line_start && (c == ';' || c == '#'))
+        {
+            while (pos < length && text[pos] != '\n')
+            {
+                pos++;
+            }
+            continue;
+        }
+        line_start = false;
+
+        size_t start = pos;
+
+        while (pos < length && text[pos] > ' ' && text[pos] != 0x1a)
+        {
+            pos++;
+        }
+        if (!have_address)
+        {
+            have_address = parse_address(text + start, pos - start, &address);
+            continue;
+        }
+
+        // A name, kept in order of address
+        size_t name_length = pos - start < SYMBOL_NAME - 1 ? pos - start : SYMBOL_NAME - 1;
+        size_t i = count;
+
+        while (i > 0 && symbols[i - 1].address > address)
+        {
+            symbols[i] = symbols[i - 1];
+            i--;
+        }
+        symbols[i].address = address;
+        memcpy(symbols[i].name, text + start, name_length);
+        symbols[i].name[name_length] = '\0';
+        count++;
+        have_address = false;
+    }
+    return count;
+}
+
+const altair_symbol_t* symbols_find(const altair_symbol_t* symbols, size_t count, uint16_t address)
+{
+    size_t low = 0;
+    size_t high = count;
+
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+
+        if (symbols[mid].address <= address)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (low == 0 || address - symbols[low - 1].address >= SYMBOL_SPAN)
+    {
+        return NULL;
+    }
+    return &symbols[low - 1];
+}
+
+void symbols_format(const altair_symbol_t* symbols, size_t count, uint16_t address, char* text, size_t size)
+{
+    const altair_symbol_t* symbol = symbols_find(symbols, count, address);
+
+    if (symbol == NULL)
+    {
+        snprintf(text, size, "0x%04X", address);
+    }
+    else if (symbol->address == address)
+    {
+        snprintf(text, size, "%s", symbol->name);
+    }
+    else
+    {
+        snprintf(text, size, "%s+0x%X", symbol->name, address - symbol->address);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef _SYMBOLS_H_
+#define _SYMBOLS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Guest symbol tables for the profilers, read from CLINK .SYM files or maps.
+
+#define SYMBOL_NAME 16
+
+// An address is not put down to a symbol further below it than this
+#define SYMBOL_SPAN 0x1000
+
+typedef struct
+{
+    uint16_t address;
+    char name[SYMBOL_NAME];
+} altair_symbol_t;
+
+// Reads "address name" pairs from a CLINK .SYM file or a map file in the
+// same form: hex addresses, with or without 0x or a trailing H, separated
+// from the names by spaces, tabs or line ends. Lines starting with ';' or
+// '#' are comments and a Ctrl-Z ends the file. Adds up to max - count
+// symbols to symbols[count..] and returns the new count, sorted.
+size_t symbols_parse(const char* text, size_t length, altair_symbol_t* symbols, size_t count, size_t max);
+
+// The symbol at or below address, within SYMBOL_SPAN of it, or NULL
+const altair_symbol_t* symbols_find(const altair_symbol_t* symbols, size_t count, uint16_t address);
+
+// Writes "NAME+0x12", or the bare hex address when no symbol covers it
+void symbols_format(const altair_symbol_t* symbols, size_t count, uint16_t address, char* text, size_t size);
+
+#endif
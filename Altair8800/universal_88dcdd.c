@@ -5,12 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define HOST_SECTOR_SIZE 137
 #define HOST_SECTORS_PER_TRACK 32
 #define HOST_MAX_TRACKS 77
 #define HOST_TRACK_SIZE (HOST_SECTORS_PER_TRACK * HOST_SECTOR_SIZE)
 #define HOST_DISK_SIZE (HOST_MAX_TRACKS * HOST_TRACK_SIZE)
-#define HOST_MAX_DRIVES 3
 #define HOST_SECTOR_SHIFT_BITS 1
 
 #define HOST_STATUS_ENWD 1
@@ -27,42 +25,20 @@
 #define HOST_CONTROL_HEAD_UNLOAD 8
 #define HOST_CONTROL_WE 128
 
-typedef struct {
-    FILE *file;
-    uint8_t track;
-    uint8_t sector;
-    uint8_t status;
-    uint8_t write_status;
-    long disk_pointer;
-    uint16_t sector_pointer;
-    uint8_t sector_data[HOST_SECTOR_SIZE + 2];
-    bool sector_dirty;
-    bool have_sector_data;
-    bool loaded;
-} host_disk_t;
-
-typedef struct {
-    host_disk_t disk[HOST_MAX_DRIVES];
-    host_disk_t *current;
-    uint8_t current_disk;
-} host_disk_controller_t;
-
-static host_disk_controller_t g_disk;
-
 static const uint8_t status_default = HOST_STATUS_ENWD | HOST_STATUS_MOVE_HEAD | HOST_STATUS_HEAD |
                                       HOST_STATUS_IE | HOST_STATUS_TRACK_0 | HOST_STATUS_NRDA;
 
-static void set_status(uint8_t bit)
+static void set_status(host_disk_t *disk, uint8_t bit)
 {
-    g_disk.current->status &= (uint8_t)~bit;
+    disk->status &= (uint8_t)~bit;
 }
 
-static void clear_status(uint8_t bit)
+static void clear_status(host_disk_t *disk, uint8_t bit)
 {
-    g_disk.current->status |= bit;
+    disk->status |= bit;
 }
 
-static bool open_disk(uint8_t drive, const char *path)
+static bool open_disk(host_disk_controller_t *controller, uint8_t drive, const char *path)
 {
     host_disk_t *disk;
 
@@ -70,7 +46,7 @@ static bool open_disk(uint8_t drive, const char *path)
         return false;
     }
 
-    disk = &g_disk.disk[drive];
+    disk = &controller->disk[drive];
     disk->file = fopen(path, "r+b");
     if (!disk->file) {
         return false;
@@ -100,53 +76,79 @@ static bool open_disk(uint8_t drive, const char *path)
     return true;
 }
 
-static void flush_sector(host_disk_t *disk)
+// Writes a whole sector to the image, keeping what it held for the checkpoints
+static bool write_image_sector(host_disk_controller_t *controller, host_disk_t *disk, long offset,
+                               const uint8_t *data)
+{
+    bool ok;
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    if (controller->checkpoints) {
+        uint8_t old_data[HOST_SECTOR_SIZE];
+
+        fseek(disk->file, offset, SEEK_SET);
+        if (fread(old_data, 1, HOST_SECTOR_SIZE, disk->file) == HOST_SECTOR_SIZE) {
+            checkpoint_disk_write(controller->checkpoints, (uint8_t)(disk - controller->disk), (uint32_t)offset,
+                                  old_data, HOST_SECTOR_SIZE);
+        }
+    }
+#else
+    (void)controller;
+#endif
+
+    fseek(disk->file, offset, SEEK_SET);
+    ok = fwrite(data, 1, HOST_SECTOR_SIZE, disk->file) == HOST_SECTOR_SIZE;
+    fflush(disk->file);
+    return ok;
+}
+
+static void flush_sector(host_disk_controller_t *controller, host_disk_t *disk)
 {
     if (!disk->loaded || !disk->sector_dirty) {
         return;
     }
 
-    fseek(disk->file, disk->disk_pointer, SEEK_SET);
-    fwrite(disk->sector_data, 1, HOST_SECTOR_SIZE, disk->file);
-    fflush(disk->file);
+    write_image_sector(controller, disk, disk->disk_pointer, disk->sector_data);
     disk->sector_dirty = false;
 }
 
-static void seek_to_track(void)
+static void seek_to_track(host_disk_controller_t *controller, host_disk_t *disk)
 {
-    host_disk_t *disk = g_disk.current;
-
     if (!disk->loaded) {
         return;
     }
 
-    flush_sector(disk);
+    flush_sector(controller, disk);
     disk->disk_pointer = (long)disk->track * HOST_TRACK_SIZE;
     disk->sector = 0;
     disk->sector_pointer = 0;
     disk->have_sector_data = false;
 }
 
-static void host_disk_select(uint8_t drive)
+static void host_disk_select(void *context, uint8_t drive)
 {
+    host_disk_controller_t *controller = context;
     uint8_t select = drive & 0x0f;
 
     if (select >= HOST_MAX_DRIVES) {
         select = 0;
     }
 
-    g_disk.current_disk = select;
-    g_disk.current = &g_disk.disk[select];
+    controller->current_disk = select;
+    controller->current = &controller->disk[select];
 }
 
-static uint8_t host_disk_status(void)
+static uint8_t host_disk_status(void *context)
 {
-    return g_disk.current->status;
+    host_disk_controller_t *controller = context;
+
+    return controller->current->status;
 }
 
-static void host_disk_function(uint8_t control)
+static void host_disk_function(void *context, uint8_t control)
 {
-    host_disk_t *disk = g_disk.current;
+    host_disk_controller_t *controller = context;
+    host_disk_t *disk = controller->current;
 
     if (!disk->loaded) {
         return;
@@ -157,9 +159,9 @@ static void host_disk_function(uint8_t control)
             disk->track++;
         }
         if (disk->track != 0) {
-            clear_status(HOST_STATUS_TRACK_0);
+            clear_status(disk, HOST_STATUS_TRACK_0);
         }
-        seek_to_track();
+        seek_to_track(controller, disk);
     }
 
     if (control & HOST_CONTROL_STEP_OUT) {
@@ -167,29 +169,30 @@ static void host_disk_function(uint8_t control)
             disk->track--;
         }
         if (disk->track == 0) {
-            set_status(HOST_STATUS_TRACK_0);
+            set_status(disk, HOST_STATUS_TRACK_0);
         }
-        seek_to_track();
+        seek_to_track(controller, disk);
     }
 
     if (control & HOST_CONTROL_HEAD_LOAD) {
-        set_status(HOST_STATUS_HEAD);
-        set_status(HOST_STATUS_NRDA);
+        set_status(disk, HOST_STATUS_HEAD);
+        set_status(disk, HOST_STATUS_NRDA);
     }
 
     if (control & HOST_CONTROL_HEAD_UNLOAD) {
-        clear_status(HOST_STATUS_HEAD);
+        clear_status(disk, HOST_STATUS_HEAD);
     }
 
     if (control & HOST_CONTROL_WE) {
-        set_status(HOST_STATUS_ENWD);
+        set_status(disk, HOST_STATUS_ENWD);
         disk->write_status = 0;
     }
 }
 
-static uint8_t host_disk_sector(void)
+static uint8_t host_disk_sector(void *context)
 {
-    host_disk_t *disk = g_disk.current;
+    host_disk_controller_t *controller = context;
+    host_disk_t *disk = controller->current;
     uint8_t ret_val;
 
     if (!disk->loaded) {
@@ -200,7 +203,7 @@ static uint8_t host_disk_sector(void)
         disk->sector = 0;
     }
 
-    flush_sector(disk);
+    flush_sector(controller, disk);
     disk->disk_pointer = ((long)disk->track * HOST_TRACK_SIZE) + ((long)disk->sector * HOST_SECTOR_SIZE);
     disk->sector_pointer = 0;
     disk->have_sector_data = false;
@@ -212,9 +215,10 @@ static uint8_t host_disk_sector(void)
     return ret_val;
 }
 
-static void host_disk_write(uint8_t data)
+static void host_disk_write(void *context, uint8_t data)
 {
-    host_disk_t *disk = g_disk.current;
+    host_disk_controller_t *controller = context;
+    host_disk_t *disk = controller->current;
 
     if (!disk->loaded) {
         return;
@@ -229,17 +233,17 @@ static void host_disk_write(uint8_t data)
     disk->have_sector_data = true;
 
     if (disk->write_status == HOST_SECTOR_SIZE) {
-        flush_sector(disk);
+        flush_sector(controller, disk);
         disk->write_status = 0;
-        clear_status(HOST_STATUS_ENWD);
+        clear_status(disk, HOST_STATUS_ENWD);
     } else {
         disk->write_status++;
     }
 }
 
-static uint8_t host_disk_read(void)
+static uint8_t host_disk_read(void *context)
 {
-    host_disk_t *disk = g_disk.current;
+    host_disk_t *disk = ((host_disk_controller_t *)context)->current;
 
     if (!disk->loaded) {
         return 0x00;
@@ -260,49 +264,238 @@ static uint8_t host_disk_read(void)
     return disk->sector_data[disk->sector_pointer++];
 }
 
-bool host_disk_init(const char *drive_a, const char *drive_b, const char *drive_c)
+bool host_disk_init(host_disk_controller_t *controller, const char *drive_a, const char *drive_b, const char *drive_c)
 {
-    memset(&g_disk, 0, sizeof(g_disk));
-    g_disk.current = &g_disk.disk[0];
+    memset(controller, 0, sizeof(*controller));
+    controller->current = &controller->disk[0];
 
-    if (!open_disk(0, drive_a)) {
+    if (!open_disk(controller, 0, drive_a)) {
         return false;
     }
-    if (!open_disk(1, drive_b)) {
-        host_disk_close();
+    if (!open_disk(controller, 1, drive_b)) {
+        host_disk_close(controller);
         return false;
     }
-    if (!open_disk(2, drive_c)) {
-        host_disk_close();
+    if (!open_disk(controller, 2, drive_c)) {
+        host_disk_close(controller);
         return false;
     }
 
     return true;
 }
 
-void host_disk_close(void)
+void host_disk_close(host_disk_controller_t *controller)
+{
+    int i;
+
+    for (i = 0; i < HOST_MAX_DRIVES; i++) {
+        host_disk_t *disk = &controller->disk[i];
+
+        if (disk->file) {
+            flush_sector(controller, disk);
+            fclose(disk->file);
+            disk->file = NULL;
+        }
+        disk->loaded = false;
+    }
+}
+
+disk_controller_t host_disk_controller(host_disk_controller_t *controller)
+{
+    disk_controller_t ports;
+
+    ports.context = controller;
+    ports.disk_select = host_disk_select;
+    ports.disk_status = host_disk_status;
+    ports.disk_function = host_disk_function;
+    ports.sector = host_disk_sector;
+    ports.write = host_disk_write;
+    ports.read = host_disk_read;
+    return ports;
+}
+
+// The drive for a whole-sector access, with its byte-at-a-time sector written back
+static host_disk_t *sector_disk(host_disk_controller_t *controller, uint8_t drive, uint8_t track, uint8_t sector)
+{
+    host_disk_t *disk;
+
+    if (drive >= HOST_MAX_DRIVES || track >= HOST_MAX_TRACKS || sector >= HOST_SECTORS_PER_TRACK) {
+        return NULL;
+    }
+    disk = &controller->disk[drive];
+    if (!disk->loaded) {
+        return NULL;
+    }
+    flush_sector(controller, disk);
+    return disk;
+}
+
+static long sector_offset(uint8_t track, uint8_t sector)
+{
+    return ((long)track * HOST_TRACK_SIZE) + ((long)sector * HOST_SECTOR_SIZE);
+}
+
+bool host_disk_read_sector(host_disk_controller_t *controller, uint8_t drive, uint8_t track, uint8_t sector,
+                           uint8_t *data)
+{
+    host_disk_t *disk = sector_disk(controller, drive, track, sector);
+
+    if (!disk) {
+        return false;
+    }
+    fseek(disk->file, sector_offset(track, sector), SEEK_SET);
+    return fread(data, 1, HOST_SECTOR_SIZE, disk->file) == HOST_SECTOR_SIZE;
+}
+
+bool host_disk_write_sector(host_disk_controller_t *controller, uint8_t drive, uint8_t track, uint8_t sector,
+                            const uint8_t *data)
+{
+    host_disk_t *disk = sector_disk(controller, drive, track, sector);
+    long offset = sector_offset(track, sector);
+
+    if (!disk) {
+        return false;
+    }
+    if (disk->disk_pointer == offset) {
+        // The 88-DCDD reads it afresh
+        disk->have_sector_data = false;
+    }
+    return write_image_sector(controller, disk, offset, data);
+}
+
+static uint64_t image_fingerprint(host_disk_t *disk)
+{
+    uint8_t chunk[4096];
+    uint64_t hash = SNAPSHOT_HASH_INIT;
+    size_t n;
+
+    if (!disk->loaded) {
+        return 0;
+    }
+
+    fseek(disk->file, 0, SEEK_SET);
+    while ((n = fread(chunk, 1, sizeof(chunk), disk->file)) > 0) {
+        hash = snapshot_hash(hash, chunk, n);
+    }
+    clearerr(disk->file);
+    return hash;
+}
+
+static void put_drive(snapshot_writer_t *w, const host_disk_t *disk)
+{
+    snapshot_put_u8(w, disk->track);
+    snapshot_put_u8(w, disk->sector);
+    snapshot_put_u8(w, disk->status);
+    snapshot_put_u8(w, disk->write_status);
+    snapshot_put_u32(w, (uint32_t)disk->disk_pointer);
+    snapshot_put_u16(w, disk->sector_pointer);
+    snapshot_put_u8(w, disk->have_sector_data);
+    snapshot_put_bytes(w, disk->sector_data, sizeof(disk->sector_data));
+}
+
+static bool get_drive(snapshot_reader_t *section, host_disk_t *disk)
+{
+    disk->track = snapshot_get_u8(section);
+    disk->sector = snapshot_get_u8(section);
+    disk->status = snapshot_get_u8(section);
+    disk->write_status = snapshot_get_u8(section);
+    disk->disk_pointer = (long)snapshot_get_u32(section);
+    disk->sector_pointer = snapshot_get_u16(section);
+    disk->have_sector_data = snapshot_get_u8(section) != 0;
+    disk->sector_dirty = false;
+    snapshot_get_bytes(section, disk->sector_data, sizeof(disk->sector_data));
+
+    return disk->track < HOST_MAX_TRACKS && disk->sector <= HOST_SECTORS_PER_TRACK && disk->disk_pointer >= 0 &&
+           disk->disk_pointer <= HOST_DISK_SIZE - HOST_SECTOR_SIZE &&
+           disk->sector_pointer <= sizeof(disk->sector_data);
+}
+
+void host_disk_save(host_disk_controller_t *controller, snapshot_writer_t *w)
 {
     int i;
 
+    snapshot_section_begin(w, "DSK ");
+    snapshot_put_u8(w, HOST_MAX_DRIVES);
+    snapshot_put_u8(w, controller->current_disk);
+    for (i = 0; i < HOST_MAX_DRIVES; i++) {
+        host_disk_t *disk = &controller->disk[i];
+
+        flush_sector(controller, disk);
+        snapshot_put_u8(w, disk->loaded);
+        snapshot_put_u64(w, image_fingerprint(disk));
+        put_drive(w, disk);
+    }
+    snapshot_section_end(w);
+}
+
+bool host_disk_load(host_disk_controller_t *controller, snapshot_reader_t *section)
+{
+    uint8_t drives = snapshot_get_u8(section);
+    uint8_t current = snapshot_get_u8(section);
+    int i;
+
+    if (drives != HOST_MAX_DRIVES || current >= HOST_MAX_DRIVES) {
+        return false;
+    }
+
     for (i = 0; i < HOST_MAX_DRIVES; i++) {
-        if (g_disk.disk[i].file) {
-            flush_sector(&g_disk.disk[i]);
-            fclose(g_disk.disk[i].file);
-            g_disk.disk[i].file = NULL;
+        host_disk_t *disk = &controller->disk[i];
+        uint8_t loaded = snapshot_get_u8(section);
+        uint64_t fingerprint = snapshot_get_u64(section);
+
+        if (loaded != disk->loaded || fingerprint != image_fingerprint(disk) || !get_drive(section, disk)) {
+            return false;
         }
-        g_disk.disk[i].loaded = false;
     }
+
+    controller->current_disk = current;
+    controller->current = &controller->disk[current];
+    return !section->failed;
 }
 
-disk_controller_t host_disk_controller(void)
+void host_disk_save_state(host_disk_controller_t *controller, snapshot_writer_t *w)
 {
-    disk_controller_t controller;
-
-    controller.disk_select = host_disk_select;
-    controller.disk_status = host_disk_status;
-    controller.disk_function = host_disk_function;
-    controller.sector = host_disk_sector;
-    controller.write = host_disk_write;
-    controller.read = host_disk_read;
-    return controller;
+    int i;
+
+    snapshot_section_begin(w, "DSKS");
+    snapshot_put_u8(w, controller->current_disk);
+    for (i = 0; i < HOST_MAX_DRIVES; i++) {
+        put_drive(w, &controller->disk[i]);
+        snapshot_put_u8(w, controller->disk[i].sector_dirty);
+    }
+    snapshot_section_end(w);
+}
+
+bool host_disk_load_state(host_disk_controller_t *controller, snapshot_reader_t *section)
+{
+    uint8_t current = snapshot_get_u8(section);
+    int i;
+
+    if (current >= HOST_MAX_DRIVES) {
+        return false;
+    }
+    for (i = 0; i < HOST_MAX_DRIVES; i++) {
+        if (!get_drive(section, &controller->disk[i])) {
+            return false;
+        }
+        controller->disk[i].sector_dirty = snapshot_get_u8(section) != 0;
+    }
+
+    controller->current_disk = current;
+    controller->current = &controller->disk[current];
+    return !section->failed;
+}
+
+void host_disk_write_image(host_disk_controller_t *controller, uint8_t drive, uint32_t offset, const uint8_t *data,
+                           uint16_t length)
+{
+    host_disk_t *disk;
+
+    if (drive >= HOST_MAX_DRIVES || !controller->disk[drive].loaded) {
+        return;
+    }
+    disk = &controller->disk[drive];
+    fseek(disk->file, (long)offset, SEEK_SET);
+    fwrite(data, 1, length, disk->file);
+    fflush(disk->file);
 }
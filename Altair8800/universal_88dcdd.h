@@ -1,11 +1,67 @@
 #ifndef UNIVERSAL_88DCDD_H
 #define UNIVERSAL_88DCDD_H
 
+#include "checkpoint.h"
 #include "intel8080.h"
+#include "snapshot.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
-bool host_disk_init(const char *drive_a, const char *drive_b, const char *drive_c);
-void host_disk_close(void);
-disk_controller_t host_disk_controller(void);
+#define HOST_SECTOR_SIZE 137
+#define HOST_MAX_DRIVES 3
+
+typedef struct {
+    FILE *file;
+    uint8_t track;
+    uint8_t sector;
+    uint8_t status;
+    uint8_t write_status;
+    long disk_pointer;
+    uint16_t sector_pointer;
+    uint8_t sector_data[HOST_SECTOR_SIZE + 2];
+    bool sector_dirty;
+    bool have_sector_data;
+    bool loaded;
+} host_disk_t;
+
+// One 88-DCDD controller with its drives backed by image files
+typedef struct {
+    host_disk_t disk[HOST_MAX_DRIVES];
+    host_disk_t *current;
+    uint8_t current_disk;
+    checkpoint_ring_t *checkpoints; // when set, gets what each sector held before it is written
+} host_disk_controller_t;
+
+bool host_disk_init(host_disk_controller_t *controller, const char *drive_a, const char *drive_b, const char *drive_c);
+void host_disk_close(host_disk_controller_t *controller);
+
+// Port handlers for i8080_reset() that run this controller
+disk_controller_t host_disk_controller(host_disk_controller_t *controller);
+
+// Whole sectors of HOST_SECTOR_SIZE bytes, sector 0-31 in the order they
+// are on the track, straight from and to the image, for the sector DMA
+// controller (PortDrivers/disk_dma_io.h). A sector the 88-DCDD is in the
+// middle of writing is written back first. Return false for a drive without
+// an image or a track or sector off the disk.
+bool host_disk_read_sector(host_disk_controller_t *controller, uint8_t drive, uint8_t track, uint8_t sector,
+                           uint8_t *data);
+bool host_disk_write_sector(host_disk_controller_t *controller, uint8_t drive, uint8_t track, uint8_t sector,
+                            const uint8_t *data);
+
+// Section "DSK ": the head, sector and buffer state of each drive and a
+// fingerprint of its image. Saving writes back a pending sector first.
+// Loading fails if an open image is not the one the snapshot was saved with.
+void host_disk_save(host_disk_controller_t *controller, snapshot_writer_t *w);
+bool host_disk_load(host_disk_controller_t *controller, snapshot_reader_t *section);
+
+// Section "DSKS": the same state with a sector not yet written back, for
+// checkpoints. Neither writes to nor checks the images.
+void host_disk_save_state(host_disk_controller_t *controller, snapshot_writer_t *w);
+bool host_disk_load_state(host_disk_controller_t *controller, snapshot_reader_t *section);
+
+// Writes bytes straight to a drive's image, for rewinding a checkpoint
+void host_disk_write_image(host_disk_controller_t *controller, uint8_t drive, uint32_t offset, const uint8_t *data,
+                           uint16_t length);
 
 #endif
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Make a copy of the 63K CP/M 2.2 disk whose BIOS reads and writes through the sector DMA controller."""
+
+from __future__ import annotations
+
+import argparse
+from pathlib import Path
+
+SECTOR_SIZE = 137
+SECTORS_PER_TRACK = 32
+TRACK_SIZE = SECTOR_SIZE * SECTORS_PER_TRACK
+RECORD_OFFSET = 3  # the system tracks have a 3-byte sector header
+RECORD_SIZE = 128
+
+# The BIOS is loaded at F500 from track 1, sector 15 on, one record per sector.
+BIOS_ADDRESS = 0xF500
+BIOS_TRACK = 1
+BIOS_SECTOR = 15
+
+# The BIOS's READ and WRITE, at F678 and F687 in its jump table, select the
+# drive and move each record through the 88-DCDD a byte at a time. The patch
+# replaces them, up to the exit they share at F6A8, with:
+#
+#   F678  06 01     READ:   MVI  B,01H      ; one record in
+#   F67A  C3 89 F6          JMP  DMAIO
+#   F67D  00 ...            (unused)
+#   F687  06 81     WRITE:  MVI  B,81H      ; one record out
+#   F689  21 E6 F6  DMAIO:  LXI  H,DSKNO    ; drive, track, sector and DMA address
+#   F68C  7D                MOV  A,L
+#   F68D  D3 0D             OUT  0DH        ; command block address
+#   F68F  7C                MOV  A,H
+#   F690  D3 0E             OUT  0EH
+#   F692  78                MOV  A,B
+#   F693  D3 0C             OUT  0CH        ; move the record
+#   F695  DB 0C             IN   0CH        ; 80H if it went, 81H if not
+#   F697  EE 80             XRI  80H        ; and so 0 or 1 for the BDOS
+#   F699  C9                RET
+#   F69A  00 ...            (unused)
+#
+# DSKNO, at F6E6, and the track, sector and DMA address after it are where
+# SELDSK, SETTRK, SETSEC and SETDMA leave them, in the order the controller
+# takes its command block. See PortDrivers/disk_dma_io.h for the ports.
+PATCH_ADDRESS = 0xF678
+ORIGINAL = bytes.fromhex(
+    "cdd4f63e01cdc4f6f3cdf4f6c3a8f6"  # READ
+    "cdd4f6afcdc4f6f3cdb7f7c2a8f63a59fae640caa8f63e01cdc4f6215bf9cdf4f6"  # WRITE
+)
+PATCH = bytes.fromhex(
+    "0601c389f6" + "00" * 10  # READ
+    + "0681" + "21e6f67dd30d7cd30e78d30cdb0cee80c9" + "00" * 14  # WRITE, DMAIO
+)
+
+
+def record_location(address: int) -> tuple[int, int, int]:
+    """Track, sector and offset in the record of a BIOS address."""
+    index, offset = divmod(address - BIOS_ADDRESS, RECORD_SIZE)
+    track, sector = divmod(BIOS_TRACK * SECTORS_PER_TRACK + BIOS_SECTOR + index, SECTORS_PER_TRACK)
+    return track, sector, offset
+
+
+def sector_start(track: int, sector: int) -> int:
+    return track * TRACK_SIZE + sector * SECTOR_SIZE
+
+
+def read_bios(image: bytearray, address: int, length: int) -> bytes:
+    data = bytearray()
+    for i in range(length):
+        track, sector, offset = record_location(address + i)
+        data.append(image[sector_start(track, sector) + RECORD_OFFSET + offset])
+    return bytes(data)
+
+
+def write_bios(image: bytearray, address: int, data: bytes) -> None:
+    sectors = set()
+    for i, byte in enumerate(data):
+        track, sector, offset = record_location(address + i)
+        image[sector_start(track, sector) + RECORD_OFFSET + offset] = byte
+        sectors.add((track, sector))
+    # The boot loader checks the sum of each record, after its stop byte
+    for track, sector in sectors:
+        start = sector_start(track, sector)
+        record = image[start + RECORD_OFFSET : start + RECORD_OFFSET + RECORD_SIZE]
+        image[start + RECORD_OFFSET + RECORD_SIZE + 1] = sum(record) & 0xFF
+
+
+def main() -> None:
+    here = Path(__file__).resolve().parent
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("input", nargs="?", type=Path, default=here / "cpm63k.dsk", help="63K CP/M disk image")
+    parser.add_argument(
+        "output", nargs="?", type=Path, default=here / "cpm63k-dma.dsk", help="Destination disk image"
+    )
+    args = parser.parse_args()
+
+    image = bytearray(args.input.read_bytes())
+    if len(PATCH) != len(ORIGINAL):
+        raise SystemExit("patch and original BIOS code differ in length")
+    current = read_bios(image, PATCH_ADDRESS, len(ORIGINAL))
+    if current == PATCH:
+        raise SystemExit(f"{args.input} already has the DMA BIOS")
+    if current != ORIGINAL:
+        raise SystemExit(f"{args.input} does not have the BIOS this patch is for")
+
+    write_bios(image, PATCH_ADDRESS, PATCH)
+    args.output.write_bytes(image)
+    print(f"Wrote {args.output}")
+
+
+if __name__ == "__main__":
+    main()
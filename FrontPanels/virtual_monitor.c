@@ -2,10 +2,21 @@
    Licensed under the MIT License. */
 
 #include "virtual_monitor.h"
+#include "cpu_clock.h"
 #include "i8080_disasm.h"
 #include "memory.h"
+#ifdef SD_CARD_SUPPORT
+#include "pico_snapshot.h"
+#endif
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+#include "pico_checkpoint.h"
+#endif
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+#include "Altair8800/counters.h"
+#endif
 #include "remote_fs.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char* too_many_switches = "\r\nError: Number of input switches must be less that or equal to 16.\n\r";
@@ -75,6 +86,163 @@ static void process_virtual_switches(const char* command)
     }
 }
 
+// CLOCK shows the target clock, CLOCK <MHz> sets it, CLOCK MAX (or 0) runs flat out
+static void process_clock_command(const char* args)
+{
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if (strcmp(args, "MAX") == 0)
+    {
+        cpu_clock_set_khz(CPU_CLOCK_UNLIMITED);
+    }
+    else if (*args != '\0')
+    {
+        char* end;
+        unsigned long mhz = strtoul(args, &end, 10);
+
+        if (end == args || *end != '\0' || mhz > 1000)
+        {
+            const char* usage = "\r\nUsage: CLOCK [MHz|MAX], e.g. CLOCK 2";
+            publish_message(usage, strlen(usage));
+            return;
+        }
+        cpu_clock_set_khz((uint32_t)mhz * 1000u);
+    }
+
+    uint32_t khz = cpu_clock_get_khz();
+    if (khz == CPU_CLOCK_UNLIMITED)
+    {
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: unlimited", "Clock");
+    }
+    else
+    {
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: %lu.%03lu MHz", "Clock", (unsigned long)(khz / 1000),
+                 (unsigned long)(khz % 1000));
+    }
+    publish_message(panel_info, strlen(panel_info));
+}
+
+// SAVE writes the whole machine to the SD card, RESUME reads it back
+static void process_snapshot_command(bool save)
+{
+#ifdef SD_CARD_SUPPORT
+    bool ok = save ? pico_snapshot_save() : pico_snapshot_resume();
+
+    if (!ok && !save)
+    {
+        altair_reset();
+    }
+    snprintf(panel_info, sizeof(panel_info), "\r\n%14s: %s %s", "Snapshot", save ? "save" : "resume",
+             ok ? "done" : (save ? "failed" : "failed, machine reset"));
+    if (ok && !save)
+    {
+        bus_switches = cpu.address_bus;
+    }
+#else
+    (void)save;
+    snprintf(panel_info, sizeof(panel_info), "\r\n%14s: needs an SD card build", "Snapshot");
+#endif
+    publish_message(panel_info, strlen(panel_info));
+}
+
+#if (defined(ALTAIR_PROFILER) && ALTAIR_PROFILER) || (defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS)
+static void publish_report_line(void* context, const char* line)
+{
+    (void)context;
+    publish_message("\r\n", 2);
+    publish_message(line, strlen(line));
+}
+#endif
+
+// PROFILE START samples the PC while the CPU runs, PROFILE STOP ends it and
+// PROFILE (or PROFILE REPORT) shows the hot spots
+static void process_profile_command(const char* args)
+{
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if (*args != '\0' && strcmp(args, "START") != 0 && strcmp(args, "STOP") != 0 && strcmp(args, "REPORT") != 0)
+    {
+        const char* usage = "\r\nUsage: PROFILE [START|STOP|REPORT]";
+        publish_message(usage, strlen(usage));
+        return;
+    }
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+    if (strcmp(args, "START") == 0)
+    {
+        profiler_start(&profiler);
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: started, RUN to take samples", "Profile");
+        publish_message(panel_info, strlen(panel_info));
+        return;
+    }
+    if (strcmp(args, "STOP") == 0)
+    {
+        profiler_stop(&profiler);
+    }
+    profiler_report(&profiler, 10, publish_report_line, NULL);
+#else
+    snprintf(panel_info, sizeof(panel_info), "\r\n%14s: needs an ALTAIR_PROFILER build", "Profile");
+    publish_message(panel_info, strlen(panel_info));
+#endif
+}
+
+// COUNTERS shows the opcode, port, disk and console counts since reset
+static void process_counters_command(void)
+{
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+    counters_report(&cpu, 10, 0.0, publish_report_line, NULL);
+#else
+    snprintf(panel_info, sizeof(panel_info), "\r\n%14s: needs an ALTAIR_COUNTERS build", "Counters");
+    publish_message(panel_info, strlen(panel_info));
+#endif
+}
+
+// REWIND [N] goes back to the Nth latest checkpoint, the latest by default
+static void process_rewind_command(const char* args)
+{
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    char* end;
+    unsigned long n = *args == '\0' ? 1 : strtoul(args, &end, 10);
+
+    if (*args != '\0' && (end == args || *end != '\0' || n == 0))
+    {
+        const char* usage = "\r\nUsage: REWIND [N], e.g. REWIND 3";
+        publish_message(usage, strlen(usage));
+        return;
+    }
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    uint32_t depth = pico_checkpoint_depth();
+
+    if (n > depth)
+    {
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: only %lu checkpoints", "Rewind", (unsigned long)depth);
+    }
+    else if (pico_checkpoint_rewind((uint32_t)n))
+    {
+        i8080_examine(&cpu, cpu.registers.pc);
+        bus_switches = cpu.address_bus;
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: back %lu, PC 0x%04x", "Rewind", n, cpu.registers.pc);
+    }
+    else
+    {
+        altair_reset();
+        snprintf(panel_info, sizeof(panel_info), "\r\n%14s: failed, machine reset", "Rewind");
+    }
+#else
+    snprintf(panel_info, sizeof(panel_info), "\r\n%14s: needs an ALTAIR_CHECKPOINTS build", "Rewind");
+#endif
+    publish_message(panel_info, strlen(panel_info));
+}
+
 void process_virtual_input(const char* command, size_t len)
 {
     if (len == 0)
@@ -133,6 +301,31 @@ void process_virtual_input(const char* command, size_t len)
         cmd_switches = RUN_CMD;
         process_control_panel_commands();
     }
+    else if (strncmp(command, "REWIND", 6) == 0 && (command[6] == '\0' || command[6] == ' '))
+    {
+        process_rewind_command(command + 6);
+        publish_message("\r\nCPU MONITOR> ", 15);
+    }
+    else if (strncmp(command, "PROFILE", 7) == 0 && (command[7] == '\0' || command[7] == ' '))
+    {
+        process_profile_command(command + 7);
+        publish_message("\r\nCPU MONITOR> ", 15);
+    }
+    else if (strcmp(command, "COUNTERS") == 0)
+    {
+        process_counters_command();
+        publish_message("\r\nCPU MONITOR> ", 15);
+    }
+    else if (strcmp(command, "SAVE") == 0 || strcmp(command, "RESUME") == 0)
+    {
+        process_snapshot_command(command[0] == 'S');
+        publish_message("\r\nCPU MONITOR> ", 15);
+    }
+    else if (strncmp(command, "CLOCK", 5) == 0 && (command[5] == '\0' || command[5] == ' '))
+    {
+        process_clock_command(command + 5);
+        publish_message("\r\nCPU MONITOR> ", 15);
+    }
     else
     {
         process_virtual_switches(command);
@@ -301,8 +494,8 @@ void altair_panel_command_handler(void)
 #ifdef REMOTE_FS_SUPPORT
             rfs_cache_clear();
 #endif
-            memset(memory, 0x00, 64 * 1024); // clear altair memory
-            load8kRom(0x0000);               // load Altair BASIC at 0x0000
+            memory_init(&altair_memory);        // clear altair memory; BASIC sizes memory by writing to it, so no ROM
+            load8kRom(&altair_memory, 0x0000);  // load Altair BASIC at 0x0000
             publish_message("\r\n*** Altair BASIC Loaded ***\r\n", 32);
             i8080_examine(&cpu, 0x0000); // 0x0000 loads Altair BASIC
             cpu_state_set_mode(CPU_RUNNING);
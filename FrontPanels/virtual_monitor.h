@@ -28,7 +28,6 @@ typedef enum
 } ALTAIR_COMMAND;
 
 extern intel8080_t cpu;
-extern uint8_t memory[64 * 1024];
 extern ALTAIR_COMMAND cmd_switches;
 
 void disassemble(intel8080_t* cpu);
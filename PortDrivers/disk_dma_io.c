@@ -0,0 +1,158 @@
+#include "PortDrivers/disk_dma_io.h"
+
+#include <stddef.h>
+
+#define SECTORS_PER_TRACK 32
+#define SYSTEM_TRACKS 6     // tracks with the short sector header
+#define RECORD_SIZE 128
+
+void disk_dma_init(disk_dma_io_t* dma, disk_dma_sector_fn read_sector, disk_dma_sector_fn write_sector,
+                   void* context)
+{
+    dma->read_sector = read_sector;
+    dma->write_sector = write_sector;
+    dma->context = context;
+    disk_dma_reset(dma);
+}
+
+void disk_dma_reset(disk_dma_io_t* dma)
+{
+    dma->block = 0;
+    dma->status = DISK_DMA_OK;
+}
+
+uint8_t disk_dma_input(disk_dma_io_t* dma, uint8_t port)
+{
+    return port == DISK_DMA_COMMAND_PORT ? dma->status : 0x00;
+}
+
+// Where the record starts in its sector
+static size_t record_offset(uint8_t track)
+{
+    return track < SYSTEM_TRACKS ? 3 : 7;
+}
+
+// Where a sector is on the track. Past the system tracks the sector number
+// is the one in the sector header, and those are interleaved 17 apart.
+static uint8_t sector_position(uint8_t track, uint8_t sector)
+{
+    return track < SYSTEM_TRACKS ? sector : (uint8_t)((sector * 17) % SECTORS_PER_TRACK);
+}
+
+// The header and trailer a write leaves, as the BIOS writes them. Bytes the
+// BIOS leaves as they were stay as they were, though they still count in the
+// checksum of the longer header.
+static void seal_sector(uint8_t* sector_data, uint8_t track, uint8_t sector)
+{
+    const uint8_t* record = sector_data + record_offset(track);
+    uint8_t sum = 0;
+
+    for (int i = 0; i < RECORD_SIZE; i++)
+    {
+        sum = (uint8_t)(sum + record[i]);
+    }
+    sector_data[0] = (uint8_t)(0x80 | track);
+    if (track < SYSTEM_TRACKS)
+    {
+        sector_data[1] = 0x00;
+        sector_data[2] = 0x01;
+        sector_data[131] = 0xff;
+        sector_data[132] = sum;
+    }
+    else
+    {
+        sector_data[1] = sector;
+        sector_data[4] = (uint8_t)(sum + sector_data[2] + sector_data[3] + sector_data[5] + sector_data[6]);
+        sector_data[135] = 0xff;
+        sector_data[136] = 0x00;
+    }
+}
+
+static bool move_record(disk_dma_io_t* dma, altair_memory_t* memory, bool write, uint8_t drive, uint8_t track,
+                        uint8_t sector, uint16_t address)
+{
+    uint8_t sector_data[DISK_DMA_SECTOR_SIZE];
+    uint8_t* record = sector_data + record_offset(track);
+    uint8_t position = sector_position(track, sector);
+
+    if (!dma->read_sector(dma->context, drive, track, position, sector_data))
+    {
+        return false;
+    }
+    if (!write)
+    {
+        for (int i = 0; i < RECORD_SIZE; i++)
+        {
+            write8(memory, address++, record[i]);
+        }
+        return true;
+    }
+    for (int i = 0; i < RECORD_SIZE; i++)
+    {
+        record[i] = read8(memory, address++);
+    }
+    seal_sector(sector_data, track, sector);
+    return dma->write_sector(dma->context, drive, track, position, sector_data);
+}
+
+uint8_t disk_dma_transfer(disk_dma_io_t* dma, altair_memory_t* memory, uint16_t block, uint8_t command)
+{
+    bool write = (command & DISK_DMA_WRITE) != 0;
+    uint8_t drive = read8(memory, block);
+    uint8_t track = read8(memory, (uint16_t)(block + 1));
+    uint8_t sector = read8(memory, (uint16_t)(block + 2));
+    uint16_t address = read16(memory, (uint16_t)(block + 3));
+
+    if (sector < 1 || sector > SECTORS_PER_TRACK)
+    {
+        return DISK_DMA_ERROR;
+    }
+    sector--;
+    for (int n = command & DISK_DMA_RECORDS; n > 0; n--)
+    {
+        if (!move_record(dma, memory, write, drive, track, sector, address))
+        {
+            return DISK_DMA_ERROR;
+        }
+        address = (uint16_t)(address + RECORD_SIZE);
+        if (++sector == SECTORS_PER_TRACK)
+        {
+            sector = 0;
+            track++;
+        }
+    }
+    return DISK_DMA_OK;
+}
+
+void disk_dma_output(disk_dma_io_t* dma, altair_memory_t* memory, uint8_t port, uint8_t data)
+{
+    switch (port)
+    {
+        case DISK_DMA_COMMAND_PORT:
+            dma->status = disk_dma_transfer(dma, memory, dma->block, data);
+            break;
+        case DISK_DMA_BLOCK_LOW_PORT:
+            dma->block = (uint16_t)((dma->block & 0xff00) | data);
+            break;
+        case DISK_DMA_BLOCK_HIGH_PORT:
+            dma->block = (uint16_t)((dma->block & 0x00ff) | (data << 8));
+            break;
+        default:
+            break;
+    }
+}
+
+void disk_dma_save(const disk_dma_io_t* dma, snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "DDMA");
+    snapshot_put_u16(w, dma->block);
+    snapshot_put_u8(w, dma->status);
+    snapshot_section_end(w);
+}
+
+bool disk_dma_load(disk_dma_io_t* dma, snapshot_reader_t* section)
+{
+    dma->block = snapshot_get_u16(section);
+    dma->status = snapshot_get_u8(section);
+    return !section->failed;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Altair8800/memory.h"
+#include "Altair8800/snapshot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sector DMA disk controller, next to the 88-DCDD's own ports. It moves
+// whole CP/M records between the 88-DCDD disk images and 8080 memory, so
+// that a BIOS reads or writes a record with one OUT rather than polling for
+// the sector and moving its 137 bytes through port 0A one at a time.
+//
+// OUT 0D and OUT 0E set the low and high byte of the address of a command
+// block in 8080 memory, which stays set:
+//   +0  drive, 0 for A:
+//   +1  track, 0-76
+//   +2  sector, 1-32 as the sector translation table gives it (past track 5
+//       the number in the sector header, as the sectors are interleaved)
+//   +3  DMA address, low byte first
+// which is the layout of the variables of the Altair CP/M 2.2 BIOS itself.
+// OUT 0C then runs a command: the number of records in bits 0-5, taken from
+// that sector on into the next ones, and on into the next track after sector
+// 32 (so 32 records from sector 1 are the whole track), and bit 7 set to
+// write them rather than read them. The records are those of the 88-DCDD
+// sectors, behind the 3-byte header of tracks 0-5 or the 7-byte one of the
+// others; a write fills in the header's track, sector and checksum as the
+// BIOS would. IN 0C gives the status of the last command, 80 if every record
+// was moved and 81 if one was on a drive without an image or off the disk,
+// which is where it stopped. Bit 7 is always set so that on a machine
+// without the controller, whose ports read 0, commands fail rather than seem
+// to work.
+//
+// Disks/cpm_dma_bios.py makes a copy of Disks/cpm63k.dsk whose BIOS reads
+// and writes through these ports.
+
+#define DISK_DMA_COMMAND_PORT 0x0C
+#define DISK_DMA_BLOCK_LOW_PORT 0x0D
+#define DISK_DMA_BLOCK_HIGH_PORT 0x0E
+
+#define DISK_DMA_RECORDS 0x3f   // command bits giving the number of records
+#define DISK_DMA_WRITE 0x80
+
+#define DISK_DMA_OK 0x80
+#define DISK_DMA_ERROR 0x81
+
+#define DISK_DMA_SECTOR_SIZE 137    // an 88-DCDD sector, header and all
+
+// Reads or writes the 137 bytes of a sector, sector 0-31 in the order they
+// are on the track. Returns false for a drive without an image or a track or
+// sector off the disk.
+typedef bool (*disk_dma_sector_fn)(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data);
+
+typedef struct
+{
+    disk_dma_sector_fn read_sector;
+    disk_dma_sector_fn write_sector;
+    void* context;
+    uint16_t block;             // address of the command block
+    uint8_t status;             // of the last command
+} disk_dma_io_t;
+
+// Sets the sector access of the disk images, which stays across resets
+void disk_dma_init(disk_dma_io_t* dma, disk_dma_sector_fn read_sector, disk_dma_sector_fn write_sector,
+                   void* context);
+void disk_dma_reset(disk_dma_io_t* dma);
+
+// Ports 0C-0E. Records are written to memory through write8(), so they are
+// seen by the block cache, the JIT and checkpoints like CPU writes.
+uint8_t disk_dma_input(disk_dma_io_t* dma, uint8_t port);
+void disk_dma_output(disk_dma_io_t* dma, altair_memory_t* memory, uint8_t port, uint8_t data);
+
+// Runs a command on the command block at block, as OUT 0C does, but leaving
+// the block address and status of the ports alone. Returns the status.
+uint8_t disk_dma_transfer(disk_dma_io_t* dma, altair_memory_t* memory, uint16_t block, uint8_t command);
+
+// Section "DDMA": the command block address and the status
+void disk_dma_save(const disk_dma_io_t* dma, snapshot_writer_t* w);
+bool disk_dma_load(disk_dma_io_t* dma, snapshot_reader_t* section);
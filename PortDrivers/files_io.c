@@ -239,6 +239,13 @@ static uint8_t files_input_status(void)
     return port_state.status;
 }
 
+bool files_ready(void)
+{
+    uint8_t status = files_input_status();
+
+    return status == FT_STATUS_DATAREADY || status == FT_STATUS_EOF || status == FT_STATUS_ERROR;
+}
+
 static uint8_t files_input_data(void)
 {
     if (port_state.chunk_position < port_state.chunk_len)
@@ -618,6 +625,11 @@ uint8_t files_input(uint8_t port)
     return 0xFF;
 }
 
+bool files_ready(void)
+{
+    return false;
+}
+
 void ft_client_poll(void) {}
 
 #endif
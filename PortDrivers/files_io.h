@@ -1,6 +1,7 @@
 #ifndef FILES_IO_H
 #define FILES_IO_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -35,6 +36,9 @@ size_t files_output(int port, uint8_t data, char* buffer, size_t buffer_length);
 // Handle input from file transfer ports (called from Core 0)
 uint8_t files_input(uint8_t port);
 
+// True while port 60 reports data ready, end of file or an error (called from Core 0)
+bool files_ready(void);
+
 // Poll for file transfer operations (called from Core 1)
 void ft_client_poll(void);
 
@@ -0,0 +1,888 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "PortDrivers/host_drive.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#define RECORD_SIZE 128
+#define EXTENT_RECORDS 128
+#define MODULE_EXTENTS 32
+#define BLOCK_RECORDS 8         // 1K blocks, for the allocation map
+#define MAX_FILES 256           // host files H: shows at most
+#define DIRECTORY_ENTRY 32
+#define EMPTY_ENTRY 0xe5
+#define END_OF_FILE 0x1a
+
+// BDOS functions
+#define BDOS_RESET_DISKS 13
+#define BDOS_SELECT_DISK 14
+#define BDOS_OPEN 15
+#define BDOS_CLOSE 16
+#define BDOS_SEARCH_FIRST 17
+#define BDOS_SEARCH_NEXT 18
+#define BDOS_DELETE 19
+#define BDOS_READ 20
+#define BDOS_WRITE 21
+#define BDOS_MAKE 22
+#define BDOS_RENAME 23
+#define BDOS_CURRENT_DISK 25
+#define BDOS_SET_DMA 26
+#define BDOS_SET_ATTRIBUTES 30
+#define BDOS_READ_RANDOM 33
+#define BDOS_WRITE_RANDOM 34
+#define BDOS_FILE_SIZE 35
+#define BDOS_SET_RANDOM 36
+#define BDOS_WRITE_ZERO_FILL 40
+
+// FCB fields
+#define FCB_DRIVE 0
+#define FCB_NAME 1              // 8 name and 3 type characters, space padded
+#define FCB_EXTENT 12
+#define FCB_S1 13
+#define FCB_MODULE 14
+#define FCB_RECORDS 15
+#define FCB_MAP 16
+#define FCB_NEW_NAME 17         // where rename takes the new name
+#define FCB_RECORD 32
+#define FCB_RANDOM 33
+
+#define NAME_LENGTH 11
+#define ANY_DRIVE '?'
+
+// Result codes in A
+#define RESULT_OK 0x00
+#define RESULT_END 0x01         // end of file, or reading unwritten data
+#define RESULT_DISK_FULL 0x02
+#define RESULT_NO_EXTENT 0x04
+#define RESULT_PAST_DISK 0x06
+#define RESULT_NOT_FOUND 0xff
+
+typedef struct
+{
+    uint8_t name[NAME_LENGTH];  // as in an FCB, or all 0 before the file is named
+    char host[HOST_DRIVE_NAME_SIZE];
+    uint32_t records;
+} entry_t;
+
+// True if the directory exists and its files can be listed
+static bool directory_readable(const char* root)
+{
+    struct stat info;
+
+    if (stat(root, &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        return false;
+    }
+#ifndef _WIN32
+    DIR* dir = opendir(root);
+
+    if (!dir)
+    {
+        return false;
+    }
+    closedir(dir);
+#endif
+    return true;
+}
+
+bool host_drive_init(host_drive_t* drive, const char* root)
+{
+    memset(drive, 0, sizeof(*drive));
+    host_drive_reset(drive);
+    if (root && (strlen(root) >= sizeof(drive->root) || !directory_readable(root)))
+    {
+        return false;
+    }
+    if (root)
+    {
+        snprintf(drive->root, sizeof(drive->root), "%s", root);
+        drive->mounted = true;
+    }
+    return true;
+}
+
+void host_drive_close(host_drive_t* drive)
+{
+    for (int i = 0; i < HOST_DRIVE_OPEN_FILES; i++)
+    {
+        if (drive->files[i].file)
+        {
+            fclose(drive->files[i].file);
+        }
+        memset(&drive->files[i], 0, sizeof(drive->files[i]));
+    }
+}
+
+void host_drive_reset(host_drive_t* drive)
+{
+    host_drive_close(drive);
+    drive->current = false;
+    drive->dma = 0x0080;
+    drive->searching = false;
+    drive->found = 0;
+}
+
+static bool cpm_char(char c)
+{
+    return c > ' ' && c <= '~' && !strchr("<>.,;:=?*[]%|()/\\\"", c);
+}
+
+// The FCB form of a host file name, if it fits 8.3 in characters CP/M allows
+static bool fcb_name(const char* host, uint8_t name[NAME_LENGTH])
+{
+    int length = 0;
+    int limit = 8;
+
+    memset(name, ' ', NAME_LENGTH);
+    for (const char* c = host; *c; c++)
+    {
+        if (*c == '.' && limit == 8 && length > 0)
+        {
+            length = 8;
+            limit = NAME_LENGTH;
+            continue;
+        }
+        if (length == limit || !cpm_char(*c))
+        {
+            return false;
+        }
+        name[length++] = (uint8_t)toupper((unsigned char)*c);
+    }
+    return length > 0;
+}
+
+// BASE~N.TYP for a host name that does not fit 8.3: the name up to its last
+// dot, cut short to leave room for ~N, and three characters after the dot.
+// Characters CP/M does not allow are left out, and so is _, which the CCP
+// takes as the end of a name.
+static void short_name(const char* host, unsigned n, uint8_t name[NAME_LENGTH])
+{
+    const char* dot = strrchr(host, '.');
+    char tail[8];
+    int tail_length = snprintf(tail, sizeof(tail), "~%u", n);
+    int length = 0;
+
+    memset(name, ' ', NAME_LENGTH);
+    for (const char* c = host; *c && c != dot && length < 8 - tail_length; c++)
+    {
+        if (cpm_char(*c) && *c != '_')
+        {
+            name[length++] = (uint8_t)toupper((unsigned char)*c);
+        }
+    }
+    memcpy(name + length, tail, (size_t)tail_length);
+    length = 8;
+    for (const char* c = dot ? dot + 1 : ""; *c && length < NAME_LENGTH; c++)
+    {
+        if (cpm_char(*c) && *c != '_')
+        {
+            name[length++] = (uint8_t)toupper((unsigned char)*c);
+        }
+    }
+}
+
+// "NAME.TYP", or "NAME" for a file without a type, in upper case
+static void host_name(const uint8_t name[NAME_LENGTH], char host[HOST_DRIVE_NAME_SIZE])
+{
+    int length = 0;
+
+    for (int i = 0; i < NAME_LENGTH; i++)
+    {
+        uint8_t c = name[i] & 0x7f;
+
+        if (i == 8 && (name[8] & 0x7f) != ' ')
+        {
+            host[length++] = '.';
+        }
+        if (c != ' ')
+        {
+            host[length++] = (char)toupper(c);
+        }
+    }
+    host[length] = '\0';
+}
+
+static bool name_matches(const uint8_t pattern[NAME_LENGTH], const uint8_t name[NAME_LENGTH])
+{
+    for (int i = 0; i < NAME_LENGTH; i++)
+    {
+        uint8_t p = pattern[i] & 0x7f;
+
+        if (p != '?' && toupper(p) != name[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool has_wildcard(const uint8_t name[NAME_LENGTH])
+{
+    return memchr(name, '?', NAME_LENGTH) != NULL;
+}
+
+static void host_path(const host_drive_t* drive, const char* host, char* path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%s", drive->root, host);
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    return memcmp(((const entry_t*)a)->name, ((const entry_t*)b)->name, NAME_LENGTH);
+}
+
+static int compare_hosts(const void* a, const void* b)
+{
+    return strcmp(((const entry_t*)a)->host, ((const entry_t*)b)->host);
+}
+
+// Adds the host file to the entries if it is a file on H:
+static void add_entry(const host_drive_t* drive, const char* host, entry_t* entries, int* count)
+{
+    entry_t* entry = &entries[*count];
+    char path[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+    struct stat info;
+
+    if (*count == MAX_FILES || host[0] == '.' || strlen(host) >= HOST_DRIVE_NAME_SIZE)
+    {
+        return;
+    }
+    host_path(drive, host, path, sizeof(path));
+    if (stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        return;
+    }
+    memset(entry->name, 0, NAME_LENGTH);
+    strcpy(entry->host, host);
+    entry->records = (uint32_t)((info.st_size + RECORD_SIZE - 1) / RECORD_SIZE);
+    (*count)++;
+}
+
+static bool name_taken(const entry_t* entries, int count, const uint8_t name[NAME_LENGTH])
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (memcmp(entries[i].name, name, NAME_LENGTH) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Gives every file its CP/M name: first the host names that fit 8.3, then
+// short names for the rest, each in host name order so that the same files
+// always get the same names
+static void name_entries(entry_t* entries, int count)
+{
+    uint8_t name[NAME_LENGTH];
+
+    qsort(entries, (size_t)count, sizeof(entry_t), compare_hosts);
+    for (int i = 0; i < count; i++)
+    {
+        if (fcb_name(entries[i].host, name) && !name_taken(entries, count, name))
+        {
+            memcpy(entries[i].name, name, NAME_LENGTH);
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        unsigned n = 1;
+
+        if (entries[i].name[0] != 0)
+        {
+            continue;
+        }
+        short_name(entries[i].host, n, name);
+        while (name_taken(entries, count, name))
+        {
+            short_name(entries[i].host, ++n, name);
+        }
+        memcpy(entries[i].name, name, NAME_LENGTH);
+    }
+}
+
+// The files on H: that match the pattern, in name order
+static int find_files(const host_drive_t* drive, const uint8_t pattern[NAME_LENGTH], entry_t* entries)
+{
+    int count = 0;
+    int matched = 0;
+#ifdef _WIN32
+    char search[sizeof(drive->root) + 3];
+    WIN32_FIND_DATAA found;
+    HANDLE handle;
+
+    snprintf(search, sizeof(search), "%s/*", drive->root);
+    handle = FindFirstFileA(search, &found);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    do
+    {
+        add_entry(drive, found.cFileName, entries, &count);
+    } while (FindNextFileA(handle, &found));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(drive->root);
+    struct dirent* found;
+
+    if (!dir)
+    {
+        return 0;
+    }
+    while ((found = readdir(dir)) != NULL)
+    {
+        add_entry(drive, found->d_name, entries, &count);
+    }
+    closedir(dir);
+#endif
+    name_entries(entries, count);
+    for (int i = 0; i < count; i++)
+    {
+        if (name_matches(pattern, entries[i].name))
+        {
+            entries[matched++] = entries[i];
+        }
+    }
+    qsort(entries, (size_t)matched, sizeof(entry_t), compare_entries);
+    return matched;
+}
+
+// The first file that matches the FCB's name
+static bool find_file(const host_drive_t* drive, const uint8_t name[NAME_LENGTH], entry_t* file)
+{
+    entry_t* entries = malloc(MAX_FILES * sizeof(entry_t));
+    bool found = entries && find_files(drive, name, entries) > 0;
+
+    if (found)
+    {
+        *file = entries[0];
+    }
+    free(entries);
+    return found;
+}
+
+static void forget_file(host_drive_t* drive, const char* host)
+{
+    for (int i = 0; i < HOST_DRIVE_OPEN_FILES; i++)
+    {
+        host_drive_file_t* open = &drive->files[i];
+
+        if (open->file && strcmp(open->name, host) == 0)
+        {
+            fclose(open->file);
+            memset(open, 0, sizeof(*open));
+        }
+    }
+}
+
+// The host file, kept open for the next call. It is opened for update when
+// it can be, and otherwise read only.
+static host_drive_file_t* open_file(host_drive_t* drive, const char* host)
+{
+    char path[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+    host_drive_file_t* open;
+    FILE* file;
+    bool writable = true;
+
+    for (int i = 0; i < HOST_DRIVE_OPEN_FILES; i++)
+    {
+        if (drive->files[i].file && strcmp(drive->files[i].name, host) == 0)
+        {
+            return &drive->files[i];
+        }
+    }
+    host_path(drive, host, path, sizeof(path));
+    file = fopen(path, "r+b");
+    if (!file)
+    {
+        file = fopen(path, "rb");
+        writable = false;
+    }
+    if (!file)
+    {
+        return NULL;
+    }
+    open = &drive->files[drive->next_file];
+    drive->next_file = (uint8_t)((drive->next_file + 1) % HOST_DRIVE_OPEN_FILES);
+    if (open->file)
+    {
+        fclose(open->file);
+    }
+    snprintf(open->name, sizeof(open->name), "%s", host);
+    open->file = file;
+    open->writable = writable;
+    return open;
+}
+
+static uint32_t file_records(FILE* file)
+{
+    long size;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0)
+    {
+        return 0;
+    }
+    return (uint32_t)((size + RECORD_SIZE - 1) / RECORD_SIZE);
+}
+
+// The record the FCB's extent, module and current record point at
+static uint32_t sequential_record(const uint8_t* fcb)
+{
+    return ((uint32_t)(fcb[FCB_MODULE] & 0x3f) * MODULE_EXTENTS + (fcb[FCB_EXTENT] & 0x1f)) * EXTENT_RECORDS +
+           (fcb[FCB_RECORD] & 0x7f);
+}
+
+// Points the FCB at a record, with the record count and allocation map of
+// its extent in a file of that many records
+static void set_position(uint8_t* fcb, uint32_t record, uint32_t records)
+{
+    uint32_t extent = record / EXTENT_RECORDS;
+    uint32_t first = extent * EXTENT_RECORDS;
+    uint32_t held = records > first ? records - first : 0;
+
+    if (held > EXTENT_RECORDS)
+    {
+        held = EXTENT_RECORDS;
+    }
+    fcb[FCB_EXTENT] = (uint8_t)(extent % MODULE_EXTENTS);
+    fcb[FCB_MODULE] = (uint8_t)(extent / MODULE_EXTENTS);
+    fcb[FCB_RECORD] = (uint8_t)(record % EXTENT_RECORDS);
+    fcb[FCB_RECORDS] = (uint8_t)held;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        fcb[FCB_MAP + i] = i * BLOCK_RECORDS < held ? (uint8_t)(extent * 16 + i + 1) : 0;
+    }
+}
+
+static uint32_t random_record(const uint8_t* fcb)
+{
+    return fcb[FCB_RANDOM] | (uint32_t)fcb[FCB_RANDOM + 1] << 8 | (uint32_t)fcb[FCB_RANDOM + 2] << 16;
+}
+
+// Reads the FCB from, or writes it back to, 8080 memory
+static void load_fcb(const altair_memory_t* memory, uint16_t address, uint8_t* fcb, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        fcb[i] = read8(memory, (uint16_t)(address + i));
+    }
+}
+
+static void store_fcb(altair_memory_t* memory, uint16_t address, const uint8_t* fcb, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        write8(memory, (uint16_t)(address + i), fcb[i]);
+    }
+}
+
+static uint8_t read_record(host_drive_t* drive, altair_memory_t* memory, const char* host, uint32_t record,
+                           uint32_t* records)
+{
+    host_drive_file_t* open = open_file(drive, host);
+    uint8_t data[RECORD_SIZE];
+    size_t length;
+
+    *records = open ? file_records(open->file) : 0;
+    if (record >= *records)
+    {
+        return *records > 0 && record / EXTENT_RECORDS <= (*records - 1) / EXTENT_RECORDS ? RESULT_END
+                                                                                            : RESULT_NO_EXTENT;
+    }
+    if (fseek(open->file, (long)record * RECORD_SIZE, SEEK_SET) != 0 ||
+        (length = fread(data, 1, RECORD_SIZE, open->file)) == 0)
+    {
+        return RESULT_END;
+    }
+    memset(data + length, END_OF_FILE, RECORD_SIZE - length);
+    for (int i = 0; i < RECORD_SIZE; i++)
+    {
+        write8(memory, (uint16_t)(drive->dma + i), data[i]);
+    }
+    return RESULT_OK;
+}
+
+static uint8_t write_record(host_drive_t* drive, const altair_memory_t* memory, const char* host, uint32_t record,
+                            uint32_t* records)
+{
+    host_drive_file_t* open = open_file(drive, host);
+    uint8_t data[RECORD_SIZE];
+
+    *records = 0;
+    if (!open || !open->writable)
+    {
+        return RESULT_DISK_FULL;
+    }
+    for (int i = 0; i < RECORD_SIZE; i++)
+    {
+        data[i] = read8(memory, (uint16_t)(drive->dma + i));
+    }
+    if (fseek(open->file, (long)record * RECORD_SIZE, SEEK_SET) != 0 ||
+        fwrite(data, 1, RECORD_SIZE, open->file) != RECORD_SIZE)
+    {
+        return RESULT_DISK_FULL;
+    }
+    *records = file_records(open->file);
+    return RESULT_OK;
+}
+
+// Puts the directory entry of an extent of a file at the start of the DMA buffer
+static void put_entry(host_drive_t* drive, altair_memory_t* memory, const entry_t* file, uint32_t extent)
+{
+    uint8_t entry[RECORD_SIZE];
+
+    memset(entry, EMPTY_ENTRY, sizeof(entry));
+    entry[0] = 0;
+    memcpy(entry + FCB_NAME, file->name, NAME_LENGTH);
+    entry[FCB_S1] = 0;
+    set_position(entry, extent * EXTENT_RECORDS, file->records);
+    for (int i = 0; i < RECORD_SIZE; i++)
+    {
+        write8(memory, (uint16_t)(drive->dma + i), entry[i]);
+    }
+}
+
+static uint32_t file_extents(const entry_t* file)
+{
+    return file->records == 0 ? 1 : (file->records + EXTENT_RECORDS - 1) / EXTENT_RECORDS;
+}
+
+// Returns the next directory entry of the search, as search next does
+static uint8_t search_next(host_drive_t* drive, altair_memory_t* memory)
+{
+    entry_t* entries = malloc(MAX_FILES * sizeof(entry_t));
+    uint8_t result = RESULT_NOT_FOUND;
+    uint16_t skip = drive->found;
+    int count;
+
+    if (!entries)
+    {
+        return RESULT_NOT_FOUND;
+    }
+    count = find_files(drive, drive->pattern, entries);
+    for (int i = 0; i < count && result == RESULT_NOT_FOUND; i++)
+    {
+        for (uint32_t extent = 0; extent < file_extents(&entries[i]); extent++)
+        {
+            if (drive->pattern[NAME_LENGTH] != '?' && extent != (drive->pattern[NAME_LENGTH] & 0x1f))
+            {
+                continue;
+            }
+            if (skip > 0)
+            {
+                skip--;
+                continue;
+            }
+            put_entry(drive, memory, &entries[i], extent);
+            drive->found++;
+            result = RESULT_OK;
+            break;
+        }
+    }
+    free(entries);
+    return result;
+}
+
+static uint8_t search_first(host_drive_t* drive, altair_memory_t* memory, const uint8_t* fcb)
+{
+    memcpy(drive->pattern, fcb + FCB_NAME, NAME_LENGTH);
+    drive->pattern[NAME_LENGTH] = fcb[FCB_DRIVE] == ANY_DRIVE ? '?' : fcb[FCB_EXTENT];
+    if (fcb[FCB_DRIVE] == ANY_DRIVE)
+    {
+        memset(drive->pattern, '?', NAME_LENGTH);
+    }
+    drive->found = 0;
+    drive->searching = true;
+    return search_next(drive, memory);
+}
+
+static uint8_t open_fcb(host_drive_t* drive, uint8_t* fcb)
+{
+    entry_t file;
+    uint32_t extent = (uint32_t)(fcb[FCB_MODULE] & 0x3f) * MODULE_EXTENTS + (fcb[FCB_EXTENT] & 0x1f);
+
+    if (!find_file(drive, fcb + FCB_NAME, &file) || !open_file(drive, file.host) ||
+        (extent > 0 && extent * EXTENT_RECORDS >= file.records))
+    {
+        return RESULT_NOT_FOUND;
+    }
+    memcpy(fcb + FCB_NAME, file.name, NAME_LENGTH);
+    fcb[FCB_S1] = 0;
+    set_position(fcb, extent * EXTENT_RECORDS + fcb[FCB_RECORD] % EXTENT_RECORDS, file.records);
+    return RESULT_OK;
+}
+
+static uint8_t make_fcb(host_drive_t* drive, uint8_t* fcb)
+{
+    char path[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+    entry_t file;
+    FILE* created;
+    uint32_t extent = (uint32_t)(fcb[FCB_MODULE] & 0x3f) * MODULE_EXTENTS + (fcb[FCB_EXTENT] & 0x1f);
+
+    if (has_wildcard(fcb + FCB_NAME))
+    {
+        return RESULT_NOT_FOUND;
+    }
+    // Only the first extent starts a new file; a later one adds to it
+    if (!find_file(drive, fcb + FCB_NAME, &file))
+    {
+        host_name(fcb + FCB_NAME, file.host);
+    }
+    else if (extent > 0)
+    {
+        return open_fcb(drive, fcb);
+    }
+    forget_file(drive, file.host);
+    host_path(drive, file.host, path, sizeof(path));
+    created = fopen(path, "wb");
+    if (!created)
+    {
+        return RESULT_NOT_FOUND;
+    }
+    fclose(created);
+    fcb[FCB_S1] = 0;
+    set_position(fcb, extent * EXTENT_RECORDS, 0);
+    return RESULT_OK;
+}
+
+static uint8_t delete_files(host_drive_t* drive, const uint8_t* fcb)
+{
+    entry_t* entries = malloc(MAX_FILES * sizeof(entry_t));
+    uint8_t result = RESULT_NOT_FOUND;
+    int count;
+
+    if (!entries)
+    {
+        return RESULT_NOT_FOUND;
+    }
+    count = find_files(drive, fcb + FCB_NAME, entries);
+    for (int i = 0; i < count; i++)
+    {
+        char path[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+
+        forget_file(drive, entries[i].host);
+        host_path(drive, entries[i].host, path, sizeof(path));
+        if (remove(path) == 0)
+        {
+            result = RESULT_OK;
+        }
+    }
+    free(entries);
+    return result;
+}
+
+static uint8_t rename_file(host_drive_t* drive, const uint8_t* fcb)
+{
+    char from[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+    char to[sizeof(drive->root) + HOST_DRIVE_NAME_SIZE + 1];
+    char host[HOST_DRIVE_NAME_SIZE];
+    entry_t file;
+    entry_t existing;
+
+    if (has_wildcard(fcb + FCB_NEW_NAME) || !find_file(drive, fcb + FCB_NAME, &file) ||
+        find_file(drive, fcb + FCB_NEW_NAME, &existing))
+    {
+        return RESULT_NOT_FOUND;
+    }
+    forget_file(drive, file.host);
+    host_name(fcb + FCB_NEW_NAME, host);
+    host_path(drive, file.host, from, sizeof(from));
+    host_path(drive, host, to, sizeof(to));
+    return rename(from, to) == 0 ? RESULT_OK : RESULT_NOT_FOUND;
+}
+
+// The file calls, on an FCB already read from memory
+static uint8_t file_call(host_drive_t* drive, altair_memory_t* memory, uint8_t function, uint8_t* fcb)
+{
+    char host[HOST_DRIVE_NAME_SIZE];
+    entry_t file;
+    uint32_t records = 0;
+    uint32_t record;
+    uint8_t result;
+
+    switch (function)
+    {
+        case BDOS_OPEN:
+            return open_fcb(drive, fcb);
+        case BDOS_MAKE:
+            return make_fcb(drive, fcb);
+        case BDOS_SEARCH_FIRST:
+            return search_first(drive, memory, fcb);
+        case BDOS_DELETE:
+            return delete_files(drive, fcb);
+        case BDOS_RENAME:
+            return rename_file(drive, fcb);
+        default:
+            break;
+    }
+
+    // The rest work on one file, named in full
+    if (!find_file(drive, fcb + FCB_NAME, &file))
+    {
+        return function == BDOS_READ ? RESULT_END : function == BDOS_WRITE ? RESULT_DISK_FULL : RESULT_NOT_FOUND;
+    }
+    strcpy(host, file.host);
+    switch (function)
+    {
+        case BDOS_CLOSE:
+            forget_file(drive, host);
+            return RESULT_OK;
+        case BDOS_SET_ATTRIBUTES:
+            return RESULT_OK;
+        case BDOS_READ:
+            record = sequential_record(fcb);
+            result = read_record(drive, memory, host, record, &records);
+            set_position(fcb, result == RESULT_OK ? record + 1 : record, records);
+            return result == RESULT_OK ? RESULT_OK : RESULT_END;
+        case BDOS_WRITE:
+            record = sequential_record(fcb);
+            result = write_record(drive, memory, host, record, &records);
+            set_position(fcb, result == RESULT_OK ? record + 1 : record, records);
+            return result;
+        case BDOS_READ_RANDOM:
+        case BDOS_WRITE_RANDOM:
+        case BDOS_WRITE_ZERO_FILL:
+            record = random_record(fcb);
+            if (record >= 0x10000)
+            {
+                return RESULT_PAST_DISK;
+            }
+            result = function == BDOS_READ_RANDOM ? read_record(drive, memory, host, record, &records)
+                                                  : write_record(drive, memory, host, record, &records);
+            // The next sequential call is for the same record
+            set_position(fcb, record, records ? records : file.records);
+            return result;
+        case BDOS_FILE_SIZE:
+            record = file.records;
+            fcb[FCB_RANDOM] = (uint8_t)record;
+            fcb[FCB_RANDOM + 1] = (uint8_t)(record >> 8);
+            fcb[FCB_RANDOM + 2] = (uint8_t)(record >> 16);
+            return RESULT_OK;
+        case BDOS_SET_RANDOM:
+            record = sequential_record(fcb);
+            fcb[FCB_RANDOM] = (uint8_t)record;
+            fcb[FCB_RANDOM + 1] = (uint8_t)(record >> 8);
+            fcb[FCB_RANDOM + 2] = (uint8_t)(record >> 16);
+            return RESULT_OK;
+        default:
+            return RESULT_NOT_FOUND;
+    }
+}
+
+// True for the FCB of a file call if it is for H:
+static bool for_host_drive(const host_drive_t* drive, uint8_t function, uint8_t drive_code)
+{
+    if (drive_code == 0 || (drive_code == ANY_DRIVE && function == BDOS_SEARCH_FIRST))
+    {
+        return drive->current;
+    }
+    return drive_code == HOST_DRIVE_NUMBER + 1;
+}
+
+static bool served(registers_t* registers, uint8_t result)
+{
+    registers->a = registers->l = result;
+    registers->b = registers->h = 0;
+    return true;
+}
+
+bool host_drive_bdos(host_drive_t* drive, registers_t* registers, altair_memory_t* memory)
+{
+    uint8_t function = registers->c;
+    uint16_t address = registers->de;
+    uint8_t fcb[FCB_RANDOM + 3];
+    int length;
+
+    if (!drive->mounted)
+    {
+        return false;
+    }
+    switch (function)
+    {
+        case BDOS_RESET_DISKS:
+            drive->current = false;
+            drive->dma = 0x0080;
+            return false;
+        case BDOS_SELECT_DISK:
+            drive->current = (registers->e & 0x0f) == HOST_DRIVE_NUMBER;
+            return drive->current && served(registers, RESULT_OK);
+        case BDOS_CURRENT_DISK:
+            return drive->current && served(registers, HOST_DRIVE_NUMBER);
+        case BDOS_SET_DMA:
+            drive->dma = address;
+            return false;
+        case BDOS_SEARCH_NEXT:
+            return drive->searching && served(registers, search_next(drive, memory));
+        case BDOS_OPEN:
+        case BDOS_CLOSE:
+        case BDOS_SEARCH_FIRST:
+        case BDOS_DELETE:
+        case BDOS_READ:
+        case BDOS_WRITE:
+        case BDOS_MAKE:
+        case BDOS_RENAME:
+        case BDOS_SET_ATTRIBUTES:
+        case BDOS_READ_RANDOM:
+        case BDOS_WRITE_RANDOM:
+        case BDOS_FILE_SIZE:
+        case BDOS_SET_RANDOM:
+        case BDOS_WRITE_ZERO_FILL:
+            break;
+        default:
+            return false;
+    }
+
+    // Sequential calls leave the random record alone, and rename takes a
+    // second name where the others have the allocation map
+    length = function >= BDOS_READ_RANDOM ? FCB_RANDOM + 3 : FCB_RECORD + 1;
+    load_fcb(memory, address, fcb, length);
+    if (function == BDOS_SEARCH_FIRST)
+    {
+        drive->searching = for_host_drive(drive, function, fcb[FCB_DRIVE]);
+    }
+    if (!for_host_drive(drive, function, fcb[FCB_DRIVE]))
+    {
+        return false;
+    }
+    served(registers, file_call(drive, memory, function, fcb));
+    if (function != BDOS_SEARCH_FIRST && function != BDOS_DELETE && function != BDOS_RENAME)
+    {
+        store_fcb(memory, address, fcb, length);
+    }
+    return true;
+}
+
+void host_drive_save(const host_drive_t* drive, snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "HDRV");
+    snapshot_put_u8(w, drive->current);
+    snapshot_put_u16(w, drive->dma);
+    snapshot_put_u8(w, drive->searching);
+    snapshot_put_bytes(w, drive->pattern, sizeof(drive->pattern));
+    snapshot_put_u16(w, drive->found);
+    snapshot_section_end(w);
+}
+
+bool host_drive_load(host_drive_t* drive, snapshot_reader_t* section)
+{
+    host_drive_close(drive);
+    drive->current = snapshot_get_u8(section) != 0;
+    drive->dma = snapshot_get_u16(section);
+    drive->searching = snapshot_get_u8(section) != 0;
+    snapshot_get_bytes(section, drive->pattern, sizeof(drive->pattern));
+    drive->found = snapshot_get_u16(section);
+    return !section->failed;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Altair8800/intel8080.h"
+#include "Altair8800/memory.h"
+#include "Altair8800/snapshot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// CP/M drive H: served from a host directory rather than a disk image. The
+// host traps the BDOS entry at 0005 and passes each call to host_drive_bdos(),
+// which serves the file calls for H: with host file I/O and leaves the rest
+// to the BDOS:
+//   14, 25      select disk and current disk, so that H: can be logged in
+//   15, 16      open and close
+//   17, 18      search first and next; the entry found is put at the start of
+//               the DMA buffer, and the other three are left empty
+//   19, 23      delete and rename
+//   20, 21      read and write sequential
+//   22          make, which empties a file that is already there
+//   30          set file attributes, which does nothing
+//   33, 34, 40  read and write random
+//   35, 36      compute file size and set random record
+// Calls 13 (reset disk system) and 26 (set DMA address) are watched on their
+// way to the BDOS for the DMA address.
+//
+// The regular files in the directory are the files on H:; subdirectories and
+// names starting with a dot do not show. A host name that fits 8.3, in
+// characters CP/M allows, shows as itself in uppercase. Other names, and the
+// second of two that differ only in case, show as BASE~N.TYP, made from the
+// start of the name and its type as on FAT, with the lowest N no other file
+// has. The short names depend only on the directory's files, so they stay
+// the same until a file is added, removed or renamed. Open, rename and
+// delete act on the host file a short name stands for. New files get
+// uppercase names. Every extent holds 16K, 128 records, as on a disk with
+// an extent mask of 0, and the FCB's allocation map only marks the blocks
+// that hold records. There are no user areas, and no disk parameters or
+// allocation vector for STAT. Files on H: are the host's: a snapshot does not
+// hold them, and rewinding to a checkpoint does not undo writes to them.
+
+#define HOST_DRIVE_NUMBER 7         // H:
+#define HOST_DRIVE_BDOS_ENTRY 0x0005
+#define HOST_DRIVE_CALL_CYCLES 100  // charged for a call served from the host, about a CALL, a RET and a little more
+#define HOST_DRIVE_OPEN_FILES 4     // host files kept open between calls
+#define HOST_DRIVE_NAME_SIZE 256    // a host file name and the terminator
+
+typedef struct
+{
+    char name[HOST_DRIVE_NAME_SIZE];
+    FILE* file;
+    bool writable;
+} host_drive_file_t;
+
+typedef struct
+{
+    char root[512];
+    bool mounted;
+    bool current;               // H: is the current drive
+    uint16_t dma;
+    bool searching;             // the last search first was for H:
+    uint8_t pattern[12];        // its name and extent, '?' matching anything
+    uint16_t found;             // directory entries it has returned
+    host_drive_file_t files[HOST_DRIVE_OPEN_FILES];
+    uint8_t next_file;          // the open file to close for another
+} host_drive_t;
+
+// Serves H: from the directory root, or nothing for a NULL root. Returns
+// false, serving nothing, if root is not a directory that can be listed.
+bool host_drive_init(host_drive_t* drive, const char* root);
+void host_drive_reset(host_drive_t* drive);
+
+// Closes the host files kept open
+void host_drive_close(host_drive_t* drive);
+
+// Serves the BDOS call in C with DE, as it is made at 0005, if it is one for
+// H:, leaving the results in A, L, B and H and memory. Returns false, having
+// changed nothing but what it watches, for a call the BDOS is to serve.
+bool host_drive_bdos(host_drive_t* drive, registers_t* registers, altair_memory_t* memory);
+
+// Section "HDRV": the current drive, the DMA address and the search in
+// progress. The files are not included.
+void host_drive_save(const host_drive_t* drive, snapshot_writer_t* w);
+bool host_drive_load(host_drive_t* drive, snapshot_reader_t* section);
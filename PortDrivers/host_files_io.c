@@ -11,7 +11,6 @@
 #define FT_COMMAND_PORT 60
 #define FT_DATA_PORT 61
 
-#define FT_CHUNK_SIZE 256
 #define FT_STATUS_IDLE 0
 #define FT_STATUS_DATAREADY 1
 #define FT_STATUS_EOF 2
@@ -24,20 +23,6 @@ typedef enum {
     FT_CMD_CLOSE = 4
 } ft_command_t;
 
-typedef struct {
-    char apps_root[512];
-    char filename[256];
-    size_t filename_len;
-    FILE *file;
-    uint8_t chunk[FT_CHUNK_SIZE + 1];
-    size_t chunk_len;
-    size_t chunk_pos;
-    bool eof_after_chunk;
-    uint8_t status;
-} host_files_t;
-
-static host_files_t g_ft;
-
 static void uppercase_component(char *dst, size_t dst_size, const char *src)
 {
     size_t i = 0;
@@ -48,7 +33,7 @@ static void uppercase_component(char *dst, size_t dst_size, const char *src)
     dst[i] = '\0';
 }
 
-static bool resolve_path(char *out, size_t out_size)
+static bool resolve_path(host_files_t *ft, char *out, size_t out_size)
 {
     char tmp[256];
     char *name;
@@ -56,7 +41,7 @@ static bool resolve_path(char *out, size_t out_size)
     char dir[128];
     char file[128];
 
-    name = g_ft.filename;
+    name = ft->filename;
     if (strncmp(name, "file://", 7) == 0) {
         name += 7;
     } else if (strncmp(name, "FILE://", 7) == 0) {
@@ -74,95 +59,95 @@ static bool resolve_path(char *out, size_t out_size)
         *slash = '\0';
         uppercase_component(dir, sizeof(dir), tmp);
         uppercase_component(file, sizeof(file), slash + 1);
-        snprintf(out, out_size, "%s/%s/%s", g_ft.apps_root, dir, file);
+        snprintf(out, out_size, "%s/%s/%s", ft->apps_root, dir, file);
     } else {
         uppercase_component(file, sizeof(file), tmp);
-        snprintf(out, out_size, "%s/%s", g_ft.apps_root, file);
+        snprintf(out, out_size, "%s/%s", ft->apps_root, file);
     }
 
     return true;
 }
 
-static void close_file(void)
+static void close_file(host_files_t *ft)
 {
-    if (g_ft.file) {
-        fclose(g_ft.file);
-        g_ft.file = NULL;
-    }
-    g_ft.chunk_len = 0;
-    g_ft.chunk_pos = 0;
-    g_ft.eof_after_chunk = false;
-    g_ft.status = FT_STATUS_IDLE;
+    if (ft->file) {
+        fclose(ft->file);
+        ft->file = NULL;
+    }
+    ft->chunk_len = 0;
+    ft->chunk_pos = 0;
+    ft->eof_after_chunk = false;
+    ft->status = FT_STATUS_IDLE;
 }
 
-static bool ensure_file_open(void)
+static bool ensure_file_open(host_files_t *ft)
 {
     char path[1024];
 
-    if (g_ft.file) {
+    if (ft->file) {
         return true;
     }
 
-    if (g_ft.filename[0] == '\0') {
-        g_ft.status = FT_STATUS_ERROR;
+    if (ft->filename[0] == '\0') {
+        ft->status = FT_STATUS_ERROR;
         return false;
     }
 
-    resolve_path(path, sizeof(path));
-    g_ft.file = fopen(path, "rb");
-    if (!g_ft.file) {
-        g_ft.status = FT_STATUS_ERROR;
+    resolve_path(ft, path, sizeof(path));
+    ft->file = fopen(path, "rb");
+    if (!ft->file) {
+        ft->status = FT_STATUS_ERROR;
         return false;
     }
 
     return true;
 }
 
-static void request_chunk(void)
+static void request_chunk(host_files_t *ft)
 {
     size_t n;
 
-    if (g_ft.chunk_pos < g_ft.chunk_len) {
+    if (ft->chunk_pos < ft->chunk_len) {
         return;
     }
 
-    if (!ensure_file_open()) {
+    if (!ensure_file_open(ft)) {
         return;
     }
 
-    n = fread(&g_ft.chunk[1], 1, FT_CHUNK_SIZE, g_ft.file);
+    n = fread(&ft->chunk[1], 1, FT_CHUNK_SIZE, ft->file);
     if (n == 0) {
-        g_ft.chunk_len = 0;
-        g_ft.chunk_pos = 0;
-        g_ft.status = FT_STATUS_EOF;
+        ft->chunk_len = 0;
+        ft->chunk_pos = 0;
+        ft->status = FT_STATUS_EOF;
         return;
     }
 
-    g_ft.chunk[0] = (uint8_t)(n == FT_CHUNK_SIZE ? 0 : n);
-    g_ft.chunk_len = n + 1;
-    g_ft.chunk_pos = 0;
-    g_ft.eof_after_chunk = n < FT_CHUNK_SIZE;
-    g_ft.status = FT_STATUS_DATAREADY;
+    ft->chunk[0] = (uint8_t)(n == FT_CHUNK_SIZE ? 0 : n);
+    ft->chunk_len = n + 1;
+    ft->chunk_pos = 0;
+    ft->eof_after_chunk = n < FT_CHUNK_SIZE;
+    ft->status = FT_STATUS_DATAREADY;
 }
 
-static void host_files_output_command(uint8_t data)
+static void host_files_output_command(host_files_t *ft, uint8_t data)
 {
     switch ((ft_command_t)data) {
     case FT_CMD_NOP:
         break;
 
     case FT_CMD_SET_FILENAME:
-        close_file();
-        g_ft.filename_len = 0;
-        g_ft.filename[0] = '\0';
+        close_file(ft);
+        ft->filename_len = 0;
+        ft->filename[0] = '\0';
         break;
 
     case FT_CMD_REQUEST_CHUNK:
-        request_chunk();
+        request_chunk(ft);
         break;
 
     case FT_CMD_CLOSE:
-        close_file();
+        close_file(ft);
         break;
 
     default:
@@ -170,62 +155,62 @@ static void host_files_output_command(uint8_t data)
     }
 }
 
-static void host_files_output_data(uint8_t data)
+static void host_files_output_data(host_files_t *ft, uint8_t data)
 {
     if (data == 0) {
-        g_ft.filename[g_ft.filename_len] = '\0';
-        close_file();
-        g_ft.status = FT_STATUS_IDLE;
-    } else if (g_ft.filename_len + 1 < sizeof(g_ft.filename)) {
-        g_ft.filename[g_ft.filename_len++] = (char)data;
+        ft->filename[ft->filename_len] = '\0';
+        close_file(ft);
+        ft->status = FT_STATUS_IDLE;
+    } else if (ft->filename_len + 1 < sizeof(ft->filename)) {
+        ft->filename[ft->filename_len++] = (char)data;
     } else {
-        g_ft.filename_len = 0;
-        g_ft.filename[0] = '\0';
-        close_file();
-        g_ft.status = FT_STATUS_ERROR;
+        ft->filename_len = 0;
+        ft->filename[0] = '\0';
+        close_file(ft);
+        ft->status = FT_STATUS_ERROR;
     }
 }
 
-static uint8_t host_files_input_status(void)
+static uint8_t host_files_input_status(host_files_t *ft)
 {
-    if (g_ft.chunk_pos < g_ft.chunk_len) {
+    if (ft->chunk_pos < ft->chunk_len) {
         return FT_STATUS_DATAREADY;
     }
 
-    if (g_ft.eof_after_chunk) {
-        close_file();
-        g_ft.status = FT_STATUS_EOF;
+    if (ft->eof_after_chunk) {
+        close_file(ft);
+        ft->status = FT_STATUS_EOF;
         return FT_STATUS_EOF;
     }
 
-    return g_ft.status;
+    return ft->status;
 }
 
-static uint8_t host_files_input_data(void)
+static uint8_t host_files_input_data(host_files_t *ft)
 {
-    if (g_ft.chunk_pos < g_ft.chunk_len) {
-        return g_ft.chunk[g_ft.chunk_pos++];
+    if (ft->chunk_pos < ft->chunk_len) {
+        return ft->chunk[ft->chunk_pos++];
     }
 
     return 0x00;
 }
 
-void host_files_init(const char *apps_root)
+void host_files_init(host_files_t *ft, const char *apps_root)
 {
-    memset(&g_ft, 0, sizeof(g_ft));
-    strncpy(g_ft.apps_root, apps_root, sizeof(g_ft.apps_root) - 1);
-    g_ft.status = FT_STATUS_IDLE;
+    memset(ft, 0, sizeof(*ft));
+    strncpy(ft->apps_root, apps_root, sizeof(ft->apps_root) - 1);
+    ft->status = FT_STATUS_IDLE;
 }
 
-void host_files_out(uint8_t port, uint8_t data)
+void host_files_out(host_files_t *ft, uint8_t port, uint8_t data)
 {
     switch (port) {
     case FT_COMMAND_PORT:
-        host_files_output_command(data);
+        host_files_output_command(ft, data);
         break;
 
     case FT_DATA_PORT:
-        host_files_output_data(data);
+        host_files_output_data(ft, data);
         break;
 
     default:
@@ -233,16 +218,23 @@ void host_files_out(uint8_t port, uint8_t data)
     }
 }
 
-uint8_t host_files_in(uint8_t port)
+uint8_t host_files_in(host_files_t *ft, uint8_t port)
 {
     switch (port) {
     case FT_COMMAND_PORT:
-        return host_files_input_status();
+        return host_files_input_status(ft);
 
     case FT_DATA_PORT:
-        return host_files_input_data();
+        return host_files_input_data(ft);
 
     default:
         return 0x00;
     }
 }
+
+bool host_files_ready(host_files_t *ft)
+{
+    uint8_t status = host_files_input_status(ft);
+
+    return status == FT_STATUS_DATAREADY || status == FT_STATUS_EOF || status == FT_STATUS_ERROR;
+}
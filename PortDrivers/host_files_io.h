@@ -1,10 +1,31 @@
 #ifndef HOST_FILES_IO_H
 #define HOST_FILES_IO_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
-void host_files_init(const char *apps_root);
-void host_files_out(uint8_t port, uint8_t data);
-uint8_t host_files_in(uint8_t port);
+#define FT_CHUNK_SIZE 256
+
+// File transfer ports 60 and 61 served from a host directory
+typedef struct {
+    char apps_root[512];
+    char filename[256];
+    size_t filename_len;
+    FILE *file;
+    uint8_t chunk[FT_CHUNK_SIZE + 1];
+    size_t chunk_len;
+    size_t chunk_pos;
+    bool eof_after_chunk;
+    uint8_t status;
+} host_files_t;
+
+void host_files_init(host_files_t *ft, const char *apps_root);
+void host_files_out(host_files_t *ft, uint8_t port, uint8_t data);
+uint8_t host_files_in(host_files_t *ft, uint8_t port);
+
+// True while port 60 reports data ready, end of file or an error
+bool host_files_ready(host_files_t *ft);
 
 #endif
@@ -0,0 +1,81 @@
+#include "PortDrivers/interrupt_io.h"
+
+#define ROUTE_ENABLED 0x08
+#define ROUTE_VECTOR_MASK 0x07
+#define SOURCE_ALL 0x0F
+
+void interrupt_output(interrupt_io_t* irq, uint8_t data)
+{
+    uint8_t source = data >> 4;
+
+    if (source == SOURCE_ALL)
+    {
+        interrupt_reset(irq);
+    }
+    else if (source < IRQ_SOURCE_COUNT)
+    {
+        irq->routes[source] = data & (ROUTE_ENABLED | ROUTE_VECTOR_MASK);
+    }
+}
+
+uint8_t interrupt_input(const interrupt_io_t* irq)
+{
+    uint8_t enabled = 0;
+
+    for (int i = 0; i < IRQ_SOURCE_COUNT; i++)
+    {
+        if (irq->routes[i] & ROUTE_ENABLED)
+        {
+            enabled |= (uint8_t)(1 << i);
+        }
+    }
+
+    return enabled;
+}
+
+void interrupt_reset(interrupt_io_t* irq)
+{
+    for (int i = 0; i < IRQ_SOURCE_COUNT; i++)
+    {
+        irq->routes[i] = 0;
+    }
+}
+
+bool interrupt_routed(const interrupt_io_t* irq, irq_source_t source)
+{
+    return (irq->routes[source] & ROUTE_ENABLED) != 0;
+}
+
+void interrupt_raise(const interrupt_io_t* irq, intel8080_t* cpu, irq_source_t source)
+{
+    if (interrupt_routed(irq, source))
+    {
+        i8080_interrupt(cpu, irq->routes[source] & ROUTE_VECTOR_MASK);
+    }
+}
+
+void interrupt_save(const interrupt_io_t* irq, snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "IRQ ");
+    snapshot_put_u8(w, IRQ_SOURCE_COUNT);
+    snapshot_put_bytes(w, irq->routes, IRQ_SOURCE_COUNT);
+    snapshot_section_end(w);
+}
+
+bool interrupt_load(interrupt_io_t* irq, snapshot_reader_t* section)
+{
+    uint8_t count = snapshot_get_u8(section);
+
+    interrupt_reset(irq);
+    for (int i = 0; i < count && !section->failed; i++)
+    {
+        uint8_t route = snapshot_get_u8(section);
+
+        // Sources this build does not have stay unrouted
+        if (i < IRQ_SOURCE_COUNT)
+        {
+            irq->routes[i] = route & (ROUTE_ENABLED | ROUTE_VECTOR_MASK);
+        }
+    }
+    return !section->failed;
+}
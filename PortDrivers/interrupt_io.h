@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Altair8800/intel8080.h"
+#include "Altair8800/snapshot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Vectored interrupt port, loosely modelled on the 88-VI/RTC board at port 0xFE.
+//
+// OUT 0xFE routes one source to an RST vector:
+//   bits 7-4  source (irq_source_t); 0xF disables every source
+//   bit 3     1 = enabled, 0 = disabled
+//   bits 2-0  RST vector
+// IN 0xFE returns the enabled sources, bit n for source n.
+//
+// Timers request their interrupt once when they run out. The console and file
+// transfer keep requesting it while their condition holds, so the handler
+// must read the character or answer before it enables interrupts again.
+
+#define INTERRUPT_PORT 0xFE
+
+typedef enum
+{
+    IRQ_SOURCE_TIMER_0 = 0, // ms timer 0 (ports 24/25) ran out
+    IRQ_SOURCE_TIMER_1 = 1, // ms timer 1 (ports 26/27) ran out
+    IRQ_SOURCE_TIMER_2 = 2, // ms timer 2 (ports 28/29) ran out
+    IRQ_SOURCE_SECONDS = 3, // seconds timer (port 30) ran out
+    IRQ_SOURCE_CONSOLE = 4, // 2SIO port 1 has a received character
+    IRQ_SOURCE_FILES = 5,   // file transfer status (port 60) has data, end of file or an error
+    IRQ_SOURCE_COUNT
+} irq_source_t;
+
+typedef struct
+{
+    uint8_t routes[IRQ_SOURCE_COUNT]; // per source: enabled bit plus the RST vector
+} interrupt_io_t;
+
+void interrupt_output(interrupt_io_t* irq, uint8_t data);
+uint8_t interrupt_input(const interrupt_io_t* irq);
+void interrupt_reset(interrupt_io_t* irq);
+
+bool interrupt_routed(const interrupt_io_t* irq, irq_source_t source);
+
+// Request the source's interrupt if the guest has routed it
+void interrupt_raise(const interrupt_io_t* irq, intel8080_t* cpu, irq_source_t source);
+
+// Section "IRQ ": the routes
+void interrupt_save(const interrupt_io_t* irq, snapshot_writer_t* w);
+bool interrupt_load(interrupt_io_t* irq, snapshot_reader_t* section);
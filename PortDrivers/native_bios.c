@@ -0,0 +1,391 @@
+#include "PortDrivers/native_bios.h"
+
+#include "Altair8800/intel8080_ops.h"
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+
+#define JMP 0xc3
+#define WARM_BOOT_VECTOR 0x0000
+#define STOCK_WARM_BOOT 0xf503  // where the stock BIOS's vector leads, its WBOOT entry
+
+// Jump table entries
+#define ENTRY_WBOOT 1
+#define ENTRY_CONST 2
+#define ENTRY_CONIN 3
+#define ENTRY_CONOUT 4
+#define ENTRY_SELDSK 9
+#define ENTRY_READ 13
+#define ENTRY_WRITE 14
+
+// BIOS variables, where the stock BIOS keeps them
+#define DISK_BLOCK 0xf6e6       // drive, track, sector and DMA address, as disk_dma_transfer() takes them
+#define DISK_DIRECTION 0xf6eb   // 1 for a read, 0 for a write
+#define DISK_PARAMETERS 0xf9e9  // the disk parameter headers, 16 bytes each
+#define DISK_ERRORS 0xfa58
+#define DISK_OPTIONS 0xfa59     // bit 4 enables interrupts after disk I/O
+#define LAST_CHARACTER 0xfa8d   // the last one CONOUT was given
+
+#define DISK_OPTION_INTERRUPTS 0x10
+#define DRIVES 4
+#define CR 0x0d
+
+#define SIO_STATUS_PORT 0x10
+#define SIO_DATA_PORT 0x11
+#define SIO_RX_READY 0x01
+#define SIO_TX_READY 0x02
+#define DISK_FUNCTION_PORT 0x09
+#define DISK_HEAD_UNLOAD 0x08
+
+typedef struct
+{
+    uint16_t address;           // in the stock BIOS
+    uint8_t length;
+    const uint8_t* code;
+    const uint8_t* relocations; // where in code the addresses in the BIOS are, ending with 0
+} code_t;
+
+typedef struct
+{
+    uint8_t entry;
+    uint16_t address;           // where the stock BIOS's entry leads
+    const code_t* code;
+    uint8_t pieces;
+    i8080_trap_fn fn;
+} routine_t;
+
+enum
+{
+    ROUTINE_CONST,
+    ROUTINE_CONIN,
+    ROUTINE_CONOUT,
+    ROUTINE_SELDSK,
+    ROUTINE_READ,
+    ROUTINE_WRITE,
+    ROUTINES
+};
+
+// The stock routines, and the subroutines they share that are replaced with them
+static const uint8_t const_code[] = {0xdb, 0x10, 0xe6, 0x01, 0x3e, 0x00, 0xc8, 0x2f, 0xc9};
+static const uint8_t conin_code[] = {0xcd, 0x24, 0xf9, 0xc3, 0x69, 0xfa};
+static const uint8_t unload_code[] = {0x3e, 0x08, 0xd3, 0x09, 0xc9};
+static const uint8_t wait_code[] = {0xdb, 0x10, 0xe6, 0x01, 0xca, 0x69, 0xfa, 0xdb, 0x11, 0xe6, 0x7f, 0xc9};
+static const uint8_t conout_code[] = {0xdb, 0x10, 0xe6, 0x02, 0xca, 0x75, 0xfa, 0x79, 0xe5, 0x21, 0x8d, 0xfa,
+                                      0xbe, 0x77, 0xe1, 0xc2, 0x8a, 0xfa, 0xfe, 0x0d, 0xc8, 0xd3, 0x11, 0xc9};
+static const uint8_t seldsk_code[] = {0x21, 0x00, 0x00, 0x79, 0xfe, 0x04, 0xd0, 0x79, 0x32, 0xe6, 0xf6, 0x07,
+                                      0x07, 0x07, 0x07, 0x21, 0xe9, 0xf9, 0x5f, 0x16, 0x00, 0x19, 0xc9};
+// READ and WRITE, to the exit they share
+static const uint8_t disk_code[] = {
+    0xcd, 0xd4, 0xf6, 0x3e, 0x01, 0xcd, 0xc4, 0xf6, 0xf3, 0xcd, 0xf4, 0xf6, 0xc3, 0xa8, 0xf6, 0xcd, 0xd4, 0xf6,
+    0xaf, 0xcd, 0xc4, 0xf6, 0xf3, 0xcd, 0xb7, 0xf7, 0xc2, 0xa8, 0xf6, 0x3a, 0x59, 0xfa, 0xe6, 0x40, 0xca, 0xa8,
+    0xf6, 0x3e, 0x01, 0xcd, 0xc4, 0xf6, 0x21, 0x5b, 0xf9, 0xcd, 0xf4, 0xf6, 0xf5, 0x3a, 0x59, 0xfa, 0xe6, 0x10,
+    0xca, 0xb2, 0xf6, 0xfb, 0xf1, 0x3e, 0x00, 0xc8, 0x21, 0x58, 0xfa, 0x34, 0x3e, 0x01, 0xb7, 0xc9};
+
+static const uint8_t no_relocations[] = {0};
+static const uint8_t conin_relocations[] = {1, 4, 0};
+static const uint8_t wait_relocations[] = {5, 0};
+static const uint8_t conout_relocations[] = {5, 10, 16, 0};
+static const uint8_t seldsk_relocations[] = {9, 16, 0};
+static const uint8_t disk_relocations[] = {1,  6,  10, 13, 16, 20, 24, 27, 30,
+                                           35, 40, 43, 46, 50, 55, 63, 0};
+
+#define CODE(address, code, relocations) {(address), (uint8_t)sizeof(code), (code), (relocations)}
+
+static const code_t const_routine[] = {CODE(0xfa60, const_code, no_relocations)};
+static const code_t conin_routine[] = {CODE(0xf6ce, conin_code, conin_relocations),
+                                       CODE(0xf924, unload_code, no_relocations),
+                                       CODE(0xfa69, wait_code, wait_relocations)};
+static const code_t conout_routine[] = {CODE(0xfa75, conout_code, conout_relocations)};
+static const code_t seldsk_routine[] = {CODE(0xf64e, seldsk_code, seldsk_relocations)};
+static const code_t disk_routine[] = {CODE(0xf678, disk_code, disk_relocations)};
+
+static uint32_t bios_const(void* context, intel8080_t* cpu);
+static uint32_t bios_conin(void* context, intel8080_t* cpu);
+static uint32_t bios_conout(void* context, intel8080_t* cpu);
+static uint32_t bios_seldsk(void* context, intel8080_t* cpu);
+static uint32_t bios_read(void* context, intel8080_t* cpu);
+static uint32_t bios_write(void* context, intel8080_t* cpu);
+
+#define ROUTINE(entry, address, code, fn) {(entry), (address), (code), (uint8_t)(sizeof(code) / sizeof(code[0])), (fn)}
+
+static const routine_t routines[ROUTINES] = {
+    ROUTINE(ENTRY_CONST, 0xfa60, const_routine, bios_const),
+    ROUTINE(ENTRY_CONIN, 0xf6ce, conin_routine, bios_conin),
+    ROUTINE(ENTRY_CONOUT, 0xfa75, conout_routine, bios_conout),
+    ROUTINE(ENTRY_SELDSK, 0xf64e, seldsk_routine, bios_seldsk),
+    ROUTINE(ENTRY_READ, 0xf678, disk_routine, bios_read),
+    ROUTINE(ENTRY_WRITE, 0xf687, disk_routine, bios_write),
+};
+
+static uint16_t read_word(const uint8_t* bytes, uint16_t address)
+{
+    return (uint16_t)(bytes[address] | bytes[(uint16_t)(address + 1)] << 8);
+}
+
+// An address in the stock BIOS, in the one the traps are set for
+static uint16_t relocate(const native_bios_t* bios, uint16_t address)
+{
+    return (uint16_t)(address + bios->offset);
+}
+
+// True if the code is in memory offset bytes up from its place in the stock
+// BIOS, with the addresses in the BIOS it holds moved as far
+static bool code_matches(const uint8_t* bytes, const code_t* code, uint16_t offset)
+{
+    const uint8_t* relocation = code->relocations;
+    uint16_t address = (uint16_t)(code->address + offset);
+
+    for (uint8_t i = 0; i < code->length; i++, address++)
+    {
+        if (*relocation != 0 && i == *relocation)
+        {
+            if (read_word(bytes, address) != (uint16_t)(read_word(code->code, i) + offset))
+            {
+                return false;
+            }
+            i++;
+            address++;
+            relocation++;
+        }
+        else if (bytes[address] != code->code[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the jump table whose WBOOT entry is at vector, offset bytes from
+// the stock one, leads to the stock routine, and the routine is there
+static bool routine_matches(const uint8_t* bytes, uint16_t vector, uint16_t offset, const routine_t* routine)
+{
+    uint16_t jump = (uint16_t)(vector + (routine->entry - ENTRY_WBOOT) * 3);
+
+    if (bytes[jump] != JMP || read_word(bytes, (uint16_t)(jump + 1)) != (uint16_t)(routine->address + offset))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < routine->pieces; i++)
+    {
+        if (!code_matches(bytes, &routine->code[i], offset))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the warm boot vector still points at the BIOS the traps were set
+// for, and that still has the routine
+static bool is_stock(const native_bios_t* bios, const intel8080_t* cpu, int routine)
+{
+    const uint8_t* bytes = cpu->memory->bytes;
+
+    return bytes[WARM_BOOT_VECTOR] == JMP && read_word(bytes, WARM_BOOT_VECTOR + 1) == bios->vector &&
+           routine_matches(bytes, bios->vector, bios->offset, &routines[routine]);
+}
+
+static uint32_t bios_const(void* context, intel8080_t* cpu)
+{
+    uint8_t ready;
+
+    if (!is_stock(context, cpu, ROUTINE_CONST))
+    {
+        return 0;
+    }
+    ready = i8080_port_in(cpu, SIO_STATUS_PORT) & SIO_RX_READY;
+    i8080_alu_logic(&cpu->registers.flags, ready, FLAGS_CARRY | FLAGS_H);
+    cpu->registers.a = ready ? 0xff : 0x00;
+    i8080_trap_return(cpu);
+    return ready ? 43 : 35;
+}
+
+static uint32_t bios_conin(void* context, intel8080_t* cpu)
+{
+    if (!is_stock(context, cpu, ROUTINE_CONIN) || !(i8080_port_in(cpu, SIO_STATUS_PORT) & SIO_RX_READY))
+    {
+        return 0;
+    }
+    i8080_port_out(cpu, DISK_FUNCTION_PORT, DISK_HEAD_UNLOAD);
+    cpu->registers.a = i8080_alu_logic(&cpu->registers.flags, i8080_port_in(cpu, SIO_DATA_PORT) & 0x7f,
+                                       FLAGS_CARRY | FLAGS_H);
+    i8080_trap_return(cpu);
+    return 108;
+}
+
+static uint32_t bios_conout(void* context, intel8080_t* cpu)
+{
+    const native_bios_t* bios = context;
+    altair_memory_t* memory = cpu->memory;
+    uint16_t last_character = relocate(bios, LAST_CHARACTER);
+    uint8_t c = cpu->registers.c;
+    uint8_t last;
+
+    if (!is_stock(bios, cpu, ROUTINE_CONOUT) || !(i8080_port_in(cpu, SIO_STATUS_PORT) & SIO_TX_READY))
+    {
+        return 0;
+    }
+    last = read8(memory, last_character);
+    write8(memory, last_character, c);
+    cpu->registers.a = c;
+    i8080_trap_return(cpu);
+    if (c != last)
+    {
+        (void)i8080_alu_sub(&cpu->registers.flags, c, last);
+        i8080_port_out(cpu, SIO_DATA_PORT, c);
+        return 107;
+    }
+    (void)i8080_alu_sub(&cpu->registers.flags, c, CR);
+    if (c == CR)
+    {
+        return 105;
+    }
+    i8080_port_out(cpu, SIO_DATA_PORT, c);
+    return 119;
+}
+
+static uint32_t bios_seldsk(void* context, intel8080_t* cpu)
+{
+    const native_bios_t* bios = context;
+    uint8_t drive = cpu->registers.c;
+    uint8_t flags;
+
+    if (!is_stock(bios, cpu, ROUTINE_SELDSK))
+    {
+        return 0;
+    }
+    (void)i8080_alu_sub(&cpu->registers.flags, drive, DRIVES);
+    i8080_trap_return(cpu);
+    if (drive >= DRIVES)
+    {
+        cpu->registers.a = drive;
+        cpu->registers.hl = 0x0000;
+        return 33;
+    }
+    // The rotates and the add leave carry clear, the other flags as CPI left them
+    flags = cpu->registers.flags & ~FLAGS_CARRY;
+    write8(cpu->memory, relocate(bios, DISK_BLOCK), drive);
+    cpu->registers.a = (uint8_t)(drive << 4);
+    cpu->registers.de = cpu->registers.a;
+    cpu->registers.hl = (uint16_t)(relocate(bios, DISK_PARAMETERS) + cpu->registers.de);
+    cpu->registers.flags = flags;
+    return 103;
+}
+
+static uint32_t bios_disk(intel8080_t* cpu, const native_bios_t* bios, int routine, bool write)
+{
+    altair_memory_t* memory = cpu->memory;
+    uint16_t errors = relocate(bios, DISK_ERRORS);
+    uint8_t status;
+
+    if (!is_stock(bios, cpu, routine))
+    {
+        return 0;
+    }
+    write8(memory, relocate(bios, DISK_DIRECTION), write ? 0 : 1);
+    status = disk_dma_transfer(bios->disk, memory, relocate(bios, DISK_BLOCK),
+                               (uint8_t)(1 | (write ? DISK_DMA_WRITE : 0)));
+    if (read8(memory, relocate(bios, DISK_OPTIONS)) & DISK_OPTION_INTERRUPTS)
+    {
+        cpu->registers.flags |= FLAGS_IF;
+    }
+    else
+    {
+        cpu->registers.flags &= ~FLAGS_IF;
+    }
+    if (status == DISK_DMA_OK)
+    {
+        cpu->registers.a = 0;
+    }
+    else
+    {
+        write8(memory, errors, (uint8_t)(read8(memory, errors) + 1));
+        cpu->registers.a = 1;
+    }
+    i8080_alu_logic(&cpu->registers.flags, cpu->registers.a, FLAGS_CARRY | FLAGS_H);
+    i8080_trap_return(cpu);
+    return NATIVE_BIOS_DISK_CYCLES;
+}
+
+static uint32_t bios_read(void* context, intel8080_t* cpu)
+{
+    return bios_disk(cpu, context, ROUTINE_READ, false);
+}
+
+static uint32_t bios_write(void* context, intel8080_t* cpu)
+{
+    return bios_disk(cpu, context, ROUTINE_WRITE, true);
+}
+
+// Clears the first count traps
+static void clear_traps(native_bios_t* bios, intel8080_t* cpu, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        i8080_trap_clear(cpu, relocate(bios, routines[i].address));
+    }
+}
+
+bool native_bios_poll(native_bios_t* bios, intel8080_t* cpu)
+{
+    const uint8_t* bytes = cpu->memory->bytes;
+    uint16_t vector = read_word(bytes, WARM_BOOT_VECTOR + 1);
+    uint16_t offset = (uint16_t)(vector - STOCK_WARM_BOOT);
+    bool booted = bytes[WARM_BOOT_VECTOR] == JMP;
+
+    if (bios->attached && booted && vector == bios->vector)
+    {
+        return true;
+    }
+    if (bios->attached)
+    {
+        clear_traps(bios, cpu, ROUTINES);
+        bios->attached = false;
+    }
+    if (!booted)
+    {
+        return true;
+    }
+    for (int i = 0; i < ROUTINES; i++)
+    {
+        if (!routine_matches(bytes, vector, offset, &routines[i]))
+        {
+            return true;
+        }
+    }
+    bios->vector = vector;
+    bios->offset = offset;
+    for (int i = 0; i < ROUTINES; i++)
+    {
+        if (i8080_trap_set(cpu, relocate(bios, routines[i].address), routines[i].fn, bios) != 0)
+        {
+            clear_traps(bios, cpu, i);
+            return false;
+        }
+    }
+    bios->attached = true;
+    return true;
+}
+
+#else
+
+bool native_bios_poll(native_bios_t* bios, intel8080_t* cpu)
+{
+    (void)bios;
+    (void)cpu;
+    return false;
+}
+
+#endif
+
+void native_bios_init(native_bios_t* bios, disk_dma_io_t* disk)
+{
+    bios->disk = disk;
+    native_bios_reset(bios);
+}
+
+void native_bios_reset(native_bios_t* bios)
+{
+    bios->attached = false;
+    bios->vector = 0;
+    bios->offset = 0;
+}
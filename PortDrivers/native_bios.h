@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Altair8800/intel8080.h"
+#include "PortDrivers/disk_dma_io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host code in place of the busiest routines of the BIOS of Disks/cpm63k.dsk,
+// the 63K Altair CP/M 2.2 with its jump table at F500, run through the CPU's
+// entry point traps (I8080_PC_TRAPS) when a call or jump lands on them:
+//   CONST     reads the 2SIO status through port 10
+//   CONIN     unloads the disk head and reads port 11, once a character is
+//             waiting; until then the BIOS polls for it itself
+//   CONOUT    writes port 11, dropping a CR that follows a CR as the BIOS does
+//   SELDSK
+//   READ      move the record at the track, sector and DMA address the BIOS
+//   WRITE     keeps straight between the disk image and memory, as the sector
+//             DMA controller does (see disk_dma_io.h), instead of seeking and
+//             polling the 88-DCDD
+// The traps go where the jump table the warm boot vector at 0000 points at
+// leads, once those entries lead to the stock routines, moved as a whole if
+// the BIOS was built for another memory size. A routine is only replaced
+// while that still holds, so a different BIOS, or this one before it has
+// been started, runs as it is.
+//
+// Each leaves the registers, flags and memory the routine would and is
+// charged the T-states it would take, except READ and WRITE: those return
+// the result in A and the flags and the interrupt enable as the BIOS leaves
+// them, but not the other registers it uses (which the BDOS does not rely
+// on), skip the write check of the read-after-write option, and take
+// NATIVE_BIOS_DISK_CYCLES rather than the 88-DCDD's seek and rotation.
+
+#define NATIVE_BIOS_DISK_CYCLES 100 // a READ or WRITE, about what the DMA controller's BIOS takes
+
+typedef struct
+{
+    disk_dma_io_t* disk;    // moves the records of READ and WRITE
+    bool attached;          // the traps are set
+    uint16_t vector;        // while attached, the warm boot vector they were set for
+    uint16_t offset;        // and how far that BIOS lies from the stock one
+} native_bios_t;
+
+void native_bios_init(native_bios_t* bios, disk_dma_io_t* disk);
+
+// Call after resetting the CPU, which drops the traps
+void native_bios_reset(native_bios_t* bios);
+
+// Sets the traps for the BIOS the warm boot vector points at, or moves them
+// after it changes. Call between runs of the CPU. Returns false, having set
+// none, if the CPU has no room for them, or without I8080_PC_TRAPS.
+bool native_bios_poll(native_bios_t* bios, intel8080_t* cpu);
@@ -0,0 +1,103 @@
+#include "PortDrivers/request_io.h"
+
+#include <string.h>
+
+void request_reset(request_io_t* request)
+{
+    memset(request, 0, sizeof(*request));
+}
+
+request_io_t* request_begin(request_io_t* request)
+{
+    request->len = 0;
+    request->count = 0;
+    return request;
+}
+
+static size_t reply_left(const request_io_t* request)
+{
+    return request->count < request->len ? request->len - request->count : 0;
+}
+
+uint8_t request_input(request_io_t* request, uint8_t port)
+{
+    switch (port)
+    {
+        case REQUEST_DATA_PORT:
+            return reply_left(request) ? (uint8_t)request->buffer[request->count++] : 0x00;
+        case REQUEST_DMA_PORT:
+            return request->dma_copied;
+        default:
+            return 0x00;
+    }
+}
+
+// Copies up to max bytes of the reply to the DMA destination, wrapping at 64 KB
+static void dma_copy(request_io_t* request, altair_memory_t* memory, size_t max)
+{
+    size_t n = reply_left(request);
+    uint16_t address = request->dma_address;
+
+    if (n > max)
+    {
+        n = max;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        write8(memory, address++, (uint8_t)request->buffer[request->count++]);
+    }
+    if (n < max)
+    {
+        write8(memory, address, 0x00);
+    }
+    request->dma_copied = (uint8_t)n;
+}
+
+void request_output(request_io_t* request, altair_memory_t* memory, uint8_t port, uint8_t data)
+{
+    switch (port)
+    {
+        case REQUEST_DMA_LOW_PORT:
+            request->dma_address = (uint16_t)((request->dma_address & 0xff00) | data);
+            break;
+        case REQUEST_DMA_HIGH_PORT:
+            request->dma_address = (uint16_t)((request->dma_address & 0x00ff) | (data << 8));
+            break;
+        case REQUEST_DMA_PORT:
+            dma_copy(request, memory, data == 0 ? 256 : data);
+            break;
+        default:
+            break;
+    }
+}
+
+void request_save(const request_io_t* request, snapshot_writer_t* w)
+{
+    snapshot_section_begin(w, "REQ ");
+    snapshot_put_u8(w, (uint8_t)request->len);
+    snapshot_put_u8(w, (uint8_t)request->count);
+    snapshot_put_bytes(w, request->buffer, request->len);
+    snapshot_put_u16(w, request->dma_address);
+    snapshot_put_u8(w, request->dma_copied);
+    snapshot_section_end(w);
+}
+
+bool request_load(request_io_t* request, snapshot_reader_t* section)
+{
+    request_reset(request);
+    request->len = snapshot_get_u8(section);
+    request->count = snapshot_get_u8(section);
+    if (request->len > sizeof(request->buffer))
+    {
+        request->len = 0;
+        return false;
+    }
+    snapshot_get_bytes(section, request->buffer, request->len);
+    // Snapshots from before the DMA ports end here
+    if (section->pos < section->length)
+    {
+        request->dma_address = snapshot_get_u16(section);
+        request->dma_copied = snapshot_get_u8(section);
+    }
+    return !section->failed;
+}
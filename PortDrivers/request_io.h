@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Altair8800/memory.h"
+#include "Altair8800/snapshot.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Replies of the request ports. An OUT to a request port (the clock on
+// 41-43, utilities on 45, 46 and 70, stats on 50-52) leaves its answer here,
+// which the guest then takes either
+//   - a byte at a time with IN 200, reading 0 past the end, or
+//   - in one go with the host DMA ports: OUT 201 and OUT 202 set the low and
+//     high byte of a destination in 8080 memory, which stays set, and OUT
+//     203 copies the rest of the reply there, at most n bytes (0 for 256),
+//     followed by a 0 when fewer than n were copied. IN 203 then gives the
+//     number of reply bytes copied.
+// Both take from the same place, so they can be mixed.
+
+#define REQUEST_DATA_PORT 200
+#define REQUEST_DMA_LOW_PORT 201
+#define REQUEST_DMA_HIGH_PORT 202
+#define REQUEST_DMA_PORT 203
+
+#define REQUEST_BUFFER_SIZE 128
+
+typedef struct
+{
+    size_t len;
+    size_t count;               // bytes of the reply already taken
+    char buffer[REQUEST_BUFFER_SIZE];
+    uint16_t dma_address;
+    uint8_t dma_copied;         // by the last OUT 203
+} request_io_t;
+
+void request_reset(request_io_t* request);
+
+// Drops the reply for a new one, to be written to buffer with its length in len
+request_io_t* request_begin(request_io_t* request);
+
+// Ports 200-203. DMA copies are written to memory through write8(), so they
+// are seen by the block cache, the JIT and checkpoints like CPU writes.
+uint8_t request_input(request_io_t* request, uint8_t port);
+void request_output(request_io_t* request, altair_memory_t* memory, uint8_t port, uint8_t data);
+
+// Section "REQ ": the reply still to be read and the DMA destination
+void request_save(const request_io_t* request, snapshot_writer_t* w);
+bool request_load(request_io_t* request, snapshot_reader_t* section);
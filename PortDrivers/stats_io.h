@@ -4,6 +4,8 @@
  *
  * Port 50: lwIP memory pool statistics
  * Port 51: Remote FS cache statistics
+ *
+ * Port 52, the emulator's own counters, is served by Altair8800/counters.h.
  */
 
 #pragma once
@@ -11,43 +11,36 @@
 #define TIMER_0 0
 #define TIMER_1 1
 #define TIMER_2 2
-#define NUM_MS_TIMERS 3
+#define NUM_MS_TIMERS TIME_MS_TIMERS
 
-static uint64_t ms_timer_targets[NUM_MS_TIMERS] = {0, 0, 0};
-static uint16_t ms_timer_delays[NUM_MS_TIMERS] = {0, 0, 0};
-static uint64_t seconds_timer_target = 0;
-
-#if !defined(PICO_ON_DEVICE) || !PICO_ON_DEVICE
-static uint64_t emulator_start_ms = 0;
-#endif
-
-static inline uint64_t get_elapsed_ms(void)
+static inline uint64_t get_elapsed_ms(const time_io_t* t)
 {
 #if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+    (void)t;
     return to_ms_since_boot(get_absolute_time());
 #else
     uint64_t now_ms = to_ms_since_boot(get_absolute_time());
 
-    if (now_ms < emulator_start_ms)
+    if (now_ms < t->start_ms)
     {
         return 0;
     }
 
-    return now_ms - emulator_start_ms;
+    return now_ms - t->start_ms;
 #endif
 }
 
 #if !defined(PICO_ON_DEVICE) || !PICO_ON_DEVICE
-void time_reset(void)
+void time_reset(time_io_t* t)
 {
     for (int i = 0; i < NUM_MS_TIMERS; i++)
     {
-        ms_timer_targets[i] = 0;
-        ms_timer_delays[i] = 0;
+        t->ms_timer_targets[i] = 0;
+        t->ms_timer_delays[i] = 0;
     }
 
-    seconds_timer_target = 0;
-    emulator_start_ms = to_ms_since_boot(get_absolute_time());
+    t->seconds_timer_target = 0;
+    t->start_ms = to_ms_since_boot(get_absolute_time());
 }
 #endif
 
@@ -69,18 +62,18 @@ static int get_timer_index(int port)
     }
 }
 
-static size_t format_boot_relative_time(char* buffer, size_t buffer_length)
+static size_t format_boot_relative_time(const time_io_t* t, char* buffer, size_t buffer_length)
 {
     if (buffer == NULL || buffer_length == 0)
     {
         return 0;
     }
 
-    uint64_t seconds_since_boot = get_elapsed_ms() / 1000ULL;
+    uint64_t seconds_since_boot = get_elapsed_ms(t) / 1000ULL;
     return (size_t)snprintf(buffer, buffer_length, "+%llus", (unsigned long long)seconds_since_boot);
 }
 
-static size_t format_wall_clock(char* buffer, size_t buffer_length, bool utc)
+static size_t format_wall_clock(const time_io_t* t, char* buffer, size_t buffer_length, bool utc)
 {
     if (buffer == NULL || buffer_length == 0)
     {
@@ -90,21 +83,21 @@ static size_t format_wall_clock(char* buffer, size_t buffer_length, bool utc)
     time_t now = time(NULL);
     if (now == 0)
     {
-        return format_boot_relative_time(buffer, buffer_length);
+        return format_boot_relative_time(t, buffer, buffer_length);
     }
 
     struct tm* result = utc ? gmtime(&now) : localtime(&now);
 
     if (result == NULL)
     {
-        return format_boot_relative_time(buffer, buffer_length);
+        return format_boot_relative_time(t, buffer, buffer_length);
     }
 
     size_t len = strftime(buffer, buffer_length, utc ? "%Y-%m-%dT%H:%M:%SZ" : "%Y-%m-%dT%H:%M:%S", result);
     return len;
 }
 
-size_t time_output(int port, uint8_t data, char* buffer, size_t buffer_length)
+size_t time_output(time_io_t* t, int port, uint8_t data, char* buffer, size_t buffer_length)
 {
     size_t len = 0;
     int timer_idx = get_timer_index(port);
@@ -116,7 +109,7 @@ size_t time_output(int port, uint8_t data, char* buffer, size_t buffer_length)
         case 28:
             if (timer_idx >= 0 && timer_idx < NUM_MS_TIMERS)
             {
-                ms_timer_delays[timer_idx] = (ms_timer_delays[timer_idx] & 0x00FFu) | ((uint16_t)data << 8);
+                t->ms_timer_delays[timer_idx] = (t->ms_timer_delays[timer_idx] & 0x00FFu) | ((uint16_t)data << 8);
             }
             break;
         case 25:
@@ -124,21 +117,21 @@ size_t time_output(int port, uint8_t data, char* buffer, size_t buffer_length)
         case 29:
             if (timer_idx >= 0 && timer_idx < NUM_MS_TIMERS)
             {
-                ms_timer_delays[timer_idx] = (ms_timer_delays[timer_idx] & 0xFF00u) | data;
-                ms_timer_targets[timer_idx] = get_elapsed_ms() + ms_timer_delays[timer_idx];
+                t->ms_timer_delays[timer_idx] = (t->ms_timer_delays[timer_idx] & 0xFF00u) | data;
+                t->ms_timer_targets[timer_idx] = get_elapsed_ms(t) + t->ms_timer_delays[timer_idx];
             }
             break;
         case 30:
-            seconds_timer_target = get_elapsed_ms() / 1000ULL + data;
+            t->seconds_timer_target = get_elapsed_ms(t) / 1000ULL + data;
             break;
         case 41:
-            len = (size_t)snprintf(buffer, buffer_length, "%llu", (unsigned long long)(get_elapsed_ms() / 1000ULL));
+            len = (size_t)snprintf(buffer, buffer_length, "%llu", (unsigned long long)(get_elapsed_ms(t) / 1000ULL));
             break;
         case 42:
-            len = format_wall_clock(buffer, buffer_length, true);
+            len = format_wall_clock(t, buffer, buffer_length, true);
             break;
         case 43:
-            len = format_wall_clock(buffer, buffer_length, false);
+            len = format_wall_clock(t, buffer, buffer_length, false);
             break;
         default:
             break;
@@ -147,7 +140,7 @@ size_t time_output(int port, uint8_t data, char* buffer, size_t buffer_length)
     return len;
 }
 
-uint8_t time_input(uint8_t port)
+uint8_t time_input(time_io_t* t, uint8_t port)
 {
     uint8_t retVal = 0;
     int timer_idx = get_timer_index(port);
@@ -162,11 +155,11 @@ uint8_t time_input(uint8_t port)
         case 29:
             if (timer_idx >= 0 && timer_idx < NUM_MS_TIMERS)
             {
-                uint64_t target_time = ms_timer_targets[timer_idx];
-                if (target_time > 0 && get_elapsed_ms() >= target_time)
+                uint64_t target_time = t->ms_timer_targets[timer_idx];
+                if (target_time > 0 && get_elapsed_ms(t) >= target_time)
                 {
-                    ms_timer_targets[timer_idx] = 0;
-                    ms_timer_delays[timer_idx] = 0;
+                    t->ms_timer_targets[timer_idx] = 0;
+                    t->ms_timer_delays[timer_idx] = 0;
                     retVal = 0;
                 }
                 else if (target_time > 0)
@@ -181,12 +174,12 @@ uint8_t time_input(uint8_t port)
             break;
         case 30:
         {
-            uint64_t target_time = seconds_timer_target;
-            uint64_t now_seconds = get_elapsed_ms() / 1000ULL;
+            uint64_t target_time = t->seconds_timer_target;
+            uint64_t now_seconds = get_elapsed_ms(t) / 1000ULL;
 
             if (target_time > 0 && now_seconds >= target_time)
             {
-                seconds_timer_target = 0;
+                t->seconds_timer_target = 0;
                 retVal = 0;
             }
             else if (target_time > 0)
@@ -206,3 +199,103 @@ uint8_t time_input(uint8_t port)
 
     return retVal;
 }
+
+bool time_take_expired(time_io_t* t, int timer)
+{
+    uint64_t now_ms = get_elapsed_ms(t);
+
+    if (timer == TIME_SECONDS_TIMER)
+    {
+        if (t->seconds_timer_target > 0 && now_ms / 1000ULL >= t->seconds_timer_target)
+        {
+            t->seconds_timer_target = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (timer >= 0 && timer < NUM_MS_TIMERS && t->ms_timer_targets[timer] > 0 && now_ms >= t->ms_timer_targets[timer])
+    {
+        t->ms_timer_targets[timer] = 0;
+        t->ms_timer_delays[timer] = 0;
+        return true;
+    }
+    return false;
+}
+
+uint32_t time_ms_until_next(const time_io_t* t)
+{
+    uint64_t now_ms = get_elapsed_ms(t);
+    uint64_t next_ms = UINT64_MAX;
+
+    for (int i = 0; i < NUM_MS_TIMERS; i++)
+    {
+        if (t->ms_timer_targets[i] > now_ms && t->ms_timer_targets[i] < next_ms)
+        {
+            next_ms = t->ms_timer_targets[i];
+        }
+    }
+    if (t->seconds_timer_target > now_ms / 1000ULL && t->seconds_timer_target * 1000ULL < next_ms)
+    {
+        next_ms = t->seconds_timer_target * 1000ULL;
+    }
+
+    return next_ms == UINT64_MAX ? UINT32_MAX : (uint32_t)(next_ms - now_ms);
+}
+
+// Targets are kept as time left, since the clock they count on starts again
+// with the host. A timer that ran out before the save runs out straight away.
+void time_save(const time_io_t* t, snapshot_writer_t* w)
+{
+    uint64_t now_ms = get_elapsed_ms(t);
+    uint64_t now_seconds = now_ms / 1000ULL;
+
+    snapshot_section_begin(w, "TIME");
+    snapshot_put_u64(w, now_ms);
+    for (int i = 0; i < NUM_MS_TIMERS; i++)
+    {
+        uint64_t target = t->ms_timer_targets[i];
+
+        snapshot_put_u16(w, t->ms_timer_delays[i]);
+        snapshot_put_u8(w, target > 0);
+        snapshot_put_u64(w, target > now_ms ? target - now_ms : 0);
+    }
+    snapshot_put_u8(w, t->seconds_timer_target > 0);
+    snapshot_put_u64(w, t->seconds_timer_target > now_seconds ? t->seconds_timer_target - now_seconds : 0);
+    snapshot_section_end(w);
+}
+
+bool time_load(time_io_t* t, snapshot_reader_t* section)
+{
+    uint64_t saved_ms = snapshot_get_u64(section);
+    uint64_t now_ms;
+
+#if !defined(PICO_ON_DEVICE) || !PICO_ON_DEVICE
+    // Carry on the guest's uptime where the host clock allows
+    uint64_t host_ms = to_ms_since_boot(get_absolute_time());
+
+    t->start_ms = host_ms >= saved_ms ? host_ms - saved_ms : 0;
+#else
+    (void)saved_ms;
+#endif
+    now_ms = get_elapsed_ms(t);
+
+    for (int i = 0; i < NUM_MS_TIMERS; i++)
+    {
+        uint8_t active;
+        uint64_t left;
+
+        t->ms_timer_delays[i] = snapshot_get_u16(section);
+        active = snapshot_get_u8(section);
+        left = snapshot_get_u64(section);
+        t->ms_timer_targets[i] = active ? (now_ms + left > 0 ? now_ms + left : 1) : 0;
+    }
+    {
+        uint8_t active = snapshot_get_u8(section);
+        uint64_t left = snapshot_get_u64(section);
+        uint64_t now_seconds = now_ms / 1000ULL;
+
+        t->seconds_timer_target = active ? (now_seconds + left > 0 ? now_seconds + left : 1) : 0;
+    }
+    return !section->failed;
+}
@@ -1,10 +1,40 @@
 #pragma once
 
+#include "Altair8800/snapshot.h"
+
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-size_t time_output(int port, uint8_t data, char* buffer, size_t buffer_length);
-uint8_t time_input(uint8_t port);
+#define TIME_MS_TIMERS 3
+#define TIME_SECONDS_TIMER 3 // timer index of port 30 for time_take_expired()
+
+// Timer ports 24-30 and the clock ports 41-43 of one machine
+typedef struct
+{
+    uint64_t ms_timer_targets[TIME_MS_TIMERS];
+    uint16_t ms_timer_delays[TIME_MS_TIMERS];
+    uint64_t seconds_timer_target;
 #if !defined(PICO_ON_DEVICE) || !PICO_ON_DEVICE
-void time_reset(void);
+    uint64_t start_ms; // host time of time_reset(), where the guest's uptime starts
 #endif
+} time_io_t;
+
+size_t time_output(time_io_t* t, int port, uint8_t data, char* buffer, size_t buffer_length);
+uint8_t time_input(time_io_t* t, uint8_t port);
+
+// True once when ms timer 0-2 or TIME_SECONDS_TIMER has run out; the timer is
+// then inactive, as after the guest has read it as expired
+bool time_take_expired(time_io_t* t, int timer);
+
+// Milliseconds until the next running timer runs out, or UINT32_MAX if none
+// is still running
+uint32_t time_ms_until_next(const time_io_t* t);
+
+#if !defined(PICO_ON_DEVICE) || !PICO_ON_DEVICE
+void time_reset(time_io_t* t);
+#endif
+
+// Section "TIME": the running timers, as time left, and the guest's uptime
+void time_save(const time_io_t* t, snapshot_writer_t* w);
+bool time_load(time_io_t* t, snapshot_reader_t* section);
@@ -4,4 +4,12 @@
 
 #define ANSI_INPUT_ESC_GRACE_MS 30u
 
-uint8_t ansi_input_process(uint8_t ch, uint32_t now_ms);
+// Escape sequence decoder state for one terminal; zero it before first use
+typedef struct
+{
+    uint8_t key_state;
+    uint8_t pending_key;
+    uint32_t esc_start;
+} ansi_input_t;
+
+uint8_t ansi_input_process(ansi_input_t* in, uint8_t ch, uint32_t now_ms);
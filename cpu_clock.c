@@ -0,0 +1,72 @@
+#include "cpu_clock.h"
+
+#include <stdbool.h>
+
+// Written by the monitor on core 1, read by the CPU loop on core 0
+static volatile uint32_t clock_khz = ALTAIR_CPU_CLOCK_MHZ * 1000u;
+static volatile bool anchored = false;
+
+static uint64_t anchor_us;
+static uint64_t anchor_cycles;
+
+void cpu_clock_set_khz(uint32_t khz)
+{
+    clock_khz = khz;
+    anchored = false;
+}
+
+uint32_t cpu_clock_get_khz(void)
+{
+    return clock_khz;
+}
+
+uint32_t cpu_clock_slice_cycles(uint32_t unpaced_cycles)
+{
+    uint32_t khz = clock_khz;
+
+    if (khz == CPU_CLOCK_UNLIMITED)
+    {
+        return unpaced_cycles;
+    }
+
+    return (uint32_t)(((uint64_t)khz * CPU_CLOCK_SLICE_US) / 1000u);
+}
+
+uint32_t cpu_clock_wait_us(uint64_t now_us, uint64_t cycles)
+{
+    uint32_t khz = clock_khz;
+    uint64_t due_us;
+
+    if (khz == CPU_CLOCK_UNLIMITED)
+    {
+        return 0;
+    }
+
+    // A reset rewinds the T-state counter; start again from here
+    if (!anchored || cycles < anchor_cycles)
+    {
+        anchor_us = now_us;
+        anchor_cycles = cycles;
+        anchored = true;
+        return 0;
+    }
+
+    // kHz is T-states per millisecond, so T-states * 1000 / kHz is microseconds
+    due_us = anchor_us + ((cycles - anchor_cycles) * 1000u) / khz;
+
+    if (due_us > now_us)
+    {
+        if (due_us - now_us <= CPU_CLOCK_MAX_LAG_US)
+        {
+            return (uint32_t)(due_us - now_us);
+        }
+    }
+    else if (now_us - due_us <= CPU_CLOCK_MAX_LAG_US)
+    {
+        return 0;
+    }
+
+    anchor_us = now_us;
+    anchor_cycles = cycles;
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// Paces the emulated 8080 to a target clock. The CPU runs in slices of one
+// millisecond's worth of T-states, and after each slice the host sleeps until
+// the wall clock catches up with the T-state counter. Deadlines are measured
+// from a fixed anchor, so oversleeping one slice is made up in the next ones
+// instead of accumulating as drift.
+
+#define CPU_CLOCK_UNLIMITED 0
+#define CPU_CLOCK_SLICE_US 1000u
+
+// Further behind than this (a host stall, an idle sleep, the CPU stopped in
+// the monitor) and the pacer starts again from now rather than run flat out
+// to catch up.
+#define CPU_CLOCK_MAX_LAG_US 20000u
+
+#ifndef ALTAIR_CPU_CLOCK_MHZ
+#define ALTAIR_CPU_CLOCK_MHZ CPU_CLOCK_UNLIMITED
+#endif
+
+// Target clock in kHz, CPU_CLOCK_UNLIMITED to run flat out
+void cpu_clock_set_khz(uint32_t khz);
+uint32_t cpu_clock_get_khz(void);
+
+// T-states to run before the next call to cpu_clock_wait_us, or
+// unpaced_cycles when the clock is unlimited.
+uint32_t cpu_clock_slice_cycles(uint32_t unpaced_cycles);
+
+// Microseconds to sleep before running the next slice, given the host time
+// and the CPU's T-state counter. Returns 0 when the CPU is due to run.
+uint32_t cpu_clock_wait_us(uint64_t now_us, uint64_t cycles);
@@ -3,6 +3,7 @@
 #include "FrontPanels/display_st7789.h"
 #include "i8080_disasm.h"
 #include "virtual_monitor.h"
+#include "hardware/sync.h"
 #include <ctype.h>
 #include <stdio.h>
 
@@ -11,8 +12,12 @@
 static char command_buffer[COMMAND_BUFFER_SIZE] = {0};
 static size_t command_buffer_length = 0;
 
-// Global CPU instance
+// Global CPU instance and its memory
 intel8080_t cpu;
+altair_memory_t altair_memory;
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+profiler_t profiler;
+#endif
 
 volatile CPU_OPERATING_MODE g_cpu_mode = CPU_STOPPED;
 uint16_t bus_switches = 0x00;
@@ -21,6 +26,7 @@ ALTAIR_COMMAND cmd_switches = NOP;
 void cpu_state_set_mode(CPU_OPERATING_MODE mode)
 {
     g_cpu_mode = mode;
+    __sev(); // wake core 0 if it sleeps in the idle wait
 
     // Update Display 2.8 LED based on CPU state
     display_st7789_set_cpu_led(mode == CPU_RUNNING);
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #include "Altair8800/intel8080.h"
+#include "Altair8800/memory.h"
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+#include "Altair8800/profiler.h"
+#endif
 
 typedef enum
 {
@@ -11,8 +15,12 @@ typedef enum
     CPU_LOW_POWER = 3
 } CPU_OPERATING_MODE;
 
-// Global CPU instance
+// Global CPU instance and its memory
 extern intel8080_t cpu;
+extern altair_memory_t altair_memory;
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+extern profiler_t profiler;
+#endif
 
 // Bus switches state
 extern uint16_t bus_switches;
@@ -1,81 +1,192 @@
 #include "io_ports.h"
 
+#include "Altair8800/counters.h"
+#include "cpu_state.h"
+#include "PortDrivers/disk_dma_io.h"
 #include "PortDrivers/files_io.h"
+#include "PortDrivers/interrupt_io.h"
+#include "PortDrivers/request_io.h"
 #include "PortDrivers/stats_io.h"
 #include "PortDrivers/time_io.h"
 #include "PortDrivers/utility_io.h"
-#include <stdio.h>
-#include <string.h>
 
-#define REQUEST_BUFFER_SIZE 128
+// The Pico runs a single machine, so its port drivers' state lives here
+static request_io_t request_unit;
+static time_io_t time_io;
+static interrupt_io_t interrupts;
+static disk_dma_io_t disk_dma;
+static i8080_ports_t ports;
 
-typedef struct
+void io_ports_reset(void)
 {
-    size_t len;
-    size_t count;
-    char buffer[REQUEST_BUFFER_SIZE];
-} request_unit_t;
+    request_reset(&request_unit);
+    interrupt_reset(&interrupts);
+    disk_dma_reset(&disk_dma);
+}
 
-static request_unit_t request_unit;
+static uint8_t time_in(void* context, uint8_t port)
+{
+    (void)context;
+    return time_input(&time_io, port);
+}
 
-void io_port_out(uint8_t port, uint8_t data)
+static void time_out(void* context, uint8_t port, uint8_t data)
 {
-    memset(&request_unit, 0, sizeof(request_unit));
+    request_io_t* request = request_begin(&request_unit);
+
+    (void)context;
+    request->len = time_output(&time_io, port, data, request->buffer, sizeof(request->buffer));
+}
+
+static void stats_out(void* context, uint8_t port, uint8_t data)
+{
+    request_io_t* request = request_begin(&request_unit);
+
+    (void)context;
+    request->len = stats_output(port, data, request->buffer, sizeof(request->buffer));
+}
+
+static void counters_out(void* context, uint8_t port, uint8_t data)
+{
+    request_io_t* request = request_begin(&request_unit);
+
+    (void)context;
+    (void)port;
+    request->len = counters_output(&cpu, data, request->buffer, sizeof(request->buffer));
+}
+
+static void utility_out(void* context, uint8_t port, uint8_t data)
+{
+    request_io_t* request = request_begin(&request_unit);
+
+    (void)context;
+    request->len = utility_output(port, data, request->buffer, sizeof(request->buffer));
+}
+
+static uint8_t files_in(void* context, uint8_t port)
+{
+    (void)context;
+    return files_input(port);
+}
+
+static void files_out(void* context, uint8_t port, uint8_t data)
+{
+    request_io_t* request = request_begin(&request_unit);
+
+    (void)context;
+    files_output(port, data, request->buffer, sizeof(request->buffer));
+}
+
+static uint8_t request_in(void* context, uint8_t port)
+{
+    (void)context;
+    return request_input(&request_unit, port);
+}
+
+static void request_out(void* context, uint8_t port, uint8_t data)
+{
+    (void)context;
+    request_output(&request_unit, &altair_memory, port, data);
+}
+
+static uint8_t irq_in(void* context, uint8_t port)
+{
+    (void)context;
+    (void)port;
+    return interrupt_input(&interrupts);
+}
 
-    switch (port)
+static void irq_out(void* context, uint8_t port, uint8_t data)
+{
+    (void)context;
+    (void)port;
+    request_begin(&request_unit);
+    interrupt_output(&interrupts, data);
+}
+
+static uint8_t disk_dma_in(void* context, uint8_t port)
+{
+    (void)context;
+    return disk_dma_input(&disk_dma, port);
+}
+
+static void disk_dma_out(void* context, uint8_t port, uint8_t data)
+{
+    (void)context;
+    disk_dma_output(&disk_dma, &altair_memory, port, data);
+}
+
+i8080_ports_t* io_ports_init(disk_dma_sector_fn read_sector, disk_dma_sector_fn write_sector)
+{
+    disk_dma_init(&disk_dma, read_sector, write_sector, NULL);
+    i8080_ports_init(&ports);
+    i8080_ports_register(&ports, DISK_DMA_COMMAND_PORT, DISK_DMA_BLOCK_HIGH_PORT, disk_dma_in, disk_dma_out, NULL);
+    i8080_ports_register(&ports, 24, 30, time_in, time_out, NULL);
+    i8080_ports_register(&ports, 41, 43, NULL, time_out, NULL);
+    i8080_ports_register(&ports, 45, 46, NULL, utility_out, NULL);
+    i8080_ports_register(&ports, 50, 51, NULL, stats_out, NULL);
+    i8080_ports_register(&ports, COUNTERS_PORT, COUNTERS_PORT, NULL, counters_out, NULL);
+    i8080_ports_register(&ports, 60, 61, files_in, files_out, NULL);
+    i8080_ports_register(&ports, 70, 70, NULL, utility_out, NULL);
+    i8080_ports_register(&ports, REQUEST_DATA_PORT, REQUEST_DMA_PORT, request_in, request_out, NULL);
+    i8080_ports_register(&ports, INTERRUPT_PORT, INTERRUPT_PORT, irq_in, irq_out, NULL);
+    return &ports;
+}
+
+i8080_ports_t* io_ports_table(void)
+{
+    return &ports;
+}
+
+void io_ports_poll(intel8080_t* cpu)
+{
+    for (int timer = 0; timer <= TIME_SECONDS_TIMER; timer++)
     {
-        case 24:
-        case 25:
-        case 26:
-        case 27:
-        case 28:
-        case 29:
-        case 30:
-        case 41:
-        case 42:
-        case 43:
-            request_unit.len = time_output(port, data, request_unit.buffer, sizeof(request_unit.buffer));
-            break;
-        case 50:
-        case 51:
-            request_unit.len = stats_output(port, data, request_unit.buffer, sizeof(request_unit.buffer));
-            break;
-        case 45:
-        case 46:
-        case 70:
-            request_unit.len = utility_output(port, data, request_unit.buffer, sizeof(request_unit.buffer));
-            break;
-        case 60:
-        case 61:
-            files_output(port, data, request_unit.buffer, sizeof(request_unit.buffer));
-            break;
-        default:
-            break;
+        if (interrupt_routed(&interrupts, (irq_source_t)(IRQ_SOURCE_TIMER_0 + timer)) && time_take_expired(&time_io, timer))
+        {
+            interrupt_raise(&interrupts, cpu, (irq_source_t)(IRQ_SOURCE_TIMER_0 + timer));
+        }
     }
+    if (interrupt_routed(&interrupts, IRQ_SOURCE_CONSOLE) && i8080_sio_rx_ready(cpu))
+    {
+        interrupt_raise(&interrupts, cpu, IRQ_SOURCE_CONSOLE);
+    }
+    if (interrupt_routed(&interrupts, IRQ_SOURCE_FILES) && files_ready())
+    {
+        interrupt_raise(&interrupts, cpu, IRQ_SOURCE_FILES);
+    }
+}
+
+uint32_t io_ports_ms_until_next_timer(void)
+{
+    return time_ms_until_next(&time_io);
+}
+
+void io_ports_save(snapshot_writer_t* w)
+{
+    time_save(&time_io, w);
+    interrupt_save(&interrupts, w);
+    request_save(&request_unit, w);
+    disk_dma_save(&disk_dma, w);
 }
 
-uint8_t io_port_in(uint8_t port)
+bool io_ports_load(const char tag[4], snapshot_reader_t* section)
 {
-    switch (port)
+    if (snapshot_tag_is(tag, "TIME"))
+    {
+        return time_load(&time_io, section);
+    }
+    if (snapshot_tag_is(tag, "IRQ "))
+    {
+        return interrupt_load(&interrupts, section);
+    }
+    if (snapshot_tag_is(tag, "REQ "))
+    {
+        return request_load(&request_unit, section);
+    }
+    if (snapshot_tag_is(tag, "DDMA"))
     {
-        case 24:
-        case 25:
-        case 26:
-        case 27:
-        case 28:
-        case 29:
-        case 30:
-            return time_input(port);
-        case 60:
-        case 61:
-            return files_input(port);
-        case 200:
-            if (request_unit.count < request_unit.len && request_unit.count < sizeof(request_unit.buffer))
-            {
-                return (uint8_t)request_unit.buffer[request_unit.count++];
-            }
-            return 0x00;
-        default:
-            return 0x00;
+        return disk_dma_load(&disk_dma, section);
     }
+    return true;
 }
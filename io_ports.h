@@ -1,6 +1,33 @@
 #pragma once
 
+#include "Altair8800/intel8080.h"
+#include "Altair8800/snapshot.h"
+#include "PortDrivers/disk_dma_io.h"
+
 #include <stdint.h>
 
-uint8_t io_port_in(uint8_t port);
-void io_port_out(uint8_t port, uint8_t data);
+// Registers the port drivers in the machine's I/O port table and returns it
+// for i8080_reset(). The sector DMA controller on ports 0C-0E moves records
+// through the disk backend's whole-sector access. Call once, before the
+// first reset.
+i8080_ports_t* io_ports_init(disk_dma_sector_fn read_sector, disk_dma_sector_fn write_sector);
+
+// The table io_ports_init() set up
+i8080_ports_t* io_ports_table(void);
+
+// Clears the interrupt routes, the pending request reply and the sector DMA
+// controller. Call with the CPU reset.
+void io_ports_reset(void);
+
+// Request the interrupts of the devices routed through port 0xFE whose
+// condition holds. Call between runs of the CPU.
+void io_ports_poll(intel8080_t* cpu);
+
+// Milliseconds until the next running guest timer runs out, or UINT32_MAX
+uint32_t io_ports_ms_until_next_timer(void);
+
+// Snapshot sections "TIME", "IRQ ", "REQ " and "DDMA" for the port drivers' state
+void io_ports_save(snapshot_writer_t* w);
+
+// Loads one of the sections io_ports_save() writes; other tags are ignored
+bool io_ports_load(const char tag[4], snapshot_reader_t* section);
@@ -0,0 +1,469 @@
+#include "altair_machine.h"
+
+#include "Altair8800/counters.h"
+#include "PortDrivers/utility_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BOOT_LOADER_ADDRESS 0xff00
+
+static uint8_t time_in(void* context, uint8_t port)
+{
+    altair_machine_t* machine = context;
+
+    return time_input(&machine->time, port);
+}
+
+static void time_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+    request_io_t* request = request_begin(&machine->request);
+
+    request->len = time_output(&machine->time, port, data, request->buffer, sizeof(request->buffer));
+}
+
+static void utility_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+    request_io_t* request = request_begin(&machine->request);
+
+    request->len = utility_output(port, data, request->buffer, sizeof(request->buffer));
+}
+
+static void counters_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+    request_io_t* request = request_begin(&machine->request);
+
+    (void)port;
+    request->len = counters_output(&machine->cpu, data, request->buffer, sizeof(request->buffer));
+}
+
+static uint8_t files_in(void* context, uint8_t port)
+{
+    altair_machine_t* machine = context;
+
+    return host_files_in(&machine->files, port);
+}
+
+static void files_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+
+    request_begin(&machine->request);
+    host_files_out(&machine->files, port, data);
+}
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+static uint32_t bdos_trap(void* context, intel8080_t* cpu)
+{
+    altair_machine_t* machine = context;
+
+    if (!host_drive_bdos(&machine->drive_h, &cpu->registers, &machine->memory))
+    {
+        return 0;
+    }
+    i8080_trap_return(cpu);
+    return HOST_DRIVE_CALL_CYCLES;
+}
+#endif
+
+static uint8_t request_in(void* context, uint8_t port)
+{
+    altair_machine_t* machine = context;
+
+    return request_input(&machine->request, port);
+}
+
+static void request_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+
+    request_output(&machine->request, &machine->memory, port, data);
+}
+
+static uint8_t irq_in(void* context, uint8_t port)
+{
+    altair_machine_t* machine = context;
+
+    (void)port;
+    return interrupt_input(&machine->interrupts);
+}
+
+static void irq_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+
+    (void)port;
+    request_begin(&machine->request);
+    interrupt_output(&machine->interrupts, data);
+}
+
+static bool read_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    altair_machine_t* machine = context;
+
+    return host_disk_read_sector(&machine->disk, drive, track, sector, data);
+}
+
+static bool write_sector(void* context, uint8_t drive, uint8_t track, uint8_t sector, uint8_t* data)
+{
+    altair_machine_t* machine = context;
+
+    return host_disk_write_sector(&machine->disk, drive, track, sector, data);
+}
+
+static uint8_t disk_dma_in(void* context, uint8_t port)
+{
+    altair_machine_t* machine = context;
+
+    return disk_dma_input(&machine->disk_dma, port);
+}
+
+static void disk_dma_out(void* context, uint8_t port, uint8_t data)
+{
+    altair_machine_t* machine = context;
+
+    disk_dma_output(&machine->disk_dma, &machine->memory, port, data);
+}
+
+static void register_ports(altair_machine_t* machine)
+{
+    i8080_ports_t* ports = &machine->ports;
+
+    i8080_ports_init(ports);
+    i8080_ports_register(ports, DISK_DMA_COMMAND_PORT, DISK_DMA_BLOCK_HIGH_PORT, disk_dma_in, disk_dma_out, machine);
+    i8080_ports_register(ports, 24, 30, time_in, time_out, machine);
+    i8080_ports_register(ports, 41, 43, NULL, time_out, machine);
+    i8080_ports_register(ports, 45, 46, NULL, utility_out, machine);
+    i8080_ports_register(ports, 70, 70, NULL, utility_out, machine);
+    i8080_ports_register(ports, COUNTERS_PORT, COUNTERS_PORT, NULL, counters_out, machine);
+    i8080_ports_register(ports, 60, 61, files_in, files_out, machine);
+    i8080_ports_register(ports, REQUEST_DATA_PORT, REQUEST_DMA_PORT, request_in, request_out, machine);
+    i8080_ports_register(ports, INTERRUPT_PORT, INTERRUPT_PORT, irq_in, irq_out, machine);
+}
+
+bool altair_machine_open(altair_machine_t* machine, const char* drive_a, const char* drive_b, const char* drive_c,
+                         const char* apps_root)
+{
+    machine->checkpoints = NULL;
+    machine->call_hooks = NULL;
+    machine->native_bios = false;
+    if (!host_disk_init(&machine->disk, drive_a, drive_b, drive_c))
+    {
+        return false;
+    }
+    disk_dma_init(&machine->disk_dma, read_sector, write_sector, machine);
+    native_bios_init(&machine->bios, &machine->disk_dma);
+    host_files_init(&machine->files, apps_root);
+    machine->code_cache = i8080_code_cache_create();
+    host_drive_init(&machine->drive_h, NULL);
+    register_ports(machine);
+    return true;
+}
+
+void altair_machine_close(altair_machine_t* machine)
+{
+    host_disk_close(&machine->disk);
+    host_drive_close(&machine->drive_h);
+    i8080_code_cache_destroy(machine->code_cache);
+    machine->code_cache = NULL;
+}
+
+bool altair_machine_mount(altair_machine_t* machine, const char* root)
+{
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+    host_drive_close(&machine->drive_h);
+    return host_drive_init(&machine->drive_h, root);
+#else
+    (void)machine;
+    (void)root;
+    return false;
+#endif
+}
+
+void altair_machine_reset(altair_machine_t* machine, port_in terminal_in, port_out terminal_out,
+                          read_sense_switches sense)
+{
+    disk_controller_t controller = host_disk_controller(&machine->disk);
+
+    memory_init(&machine->memory);
+    loadDiskLoader(&machine->memory, BOOT_LOADER_ADDRESS);
+    time_reset(&machine->time);
+    interrupt_reset(&machine->interrupts);
+    request_reset(&machine->request);
+    disk_dma_reset(&machine->disk_dma);
+    host_drive_reset(&machine->drive_h);
+    memset(&machine->ansi, 0, sizeof(machine->ansi));
+    i8080_reset(&machine->cpu, &machine->memory, machine, terminal_in, terminal_out, sense, &controller,
+                &machine->ports);
+    machine->cpu.code_cache = machine->code_cache;
+    machine->cpu.call_hooks = machine->call_hooks;
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+    if (machine->drive_h.mounted)
+    {
+        i8080_trap_set(&machine->cpu, HOST_DRIVE_BDOS_ENTRY, bdos_trap, machine);
+    }
+#endif
+    native_bios_reset(&machine->bios);
+    i8080_examine(&machine->cpu, BOOT_LOADER_ADDRESS);
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    if (machine->checkpoints)
+    {
+        checkpoint_clear(machine->checkpoints);
+    }
+#endif
+}
+
+bool altair_machine_poll(altair_machine_t* machine)
+{
+    const interrupt_io_t* irq = &machine->interrupts;
+    intel8080_t* cpu = &machine->cpu;
+
+    for (int timer = 0; timer <= TIME_SECONDS_TIMER; timer++)
+    {
+        if (interrupt_routed(irq, (irq_source_t)(IRQ_SOURCE_TIMER_0 + timer)) &&
+            time_take_expired(&machine->time, timer))
+        {
+            interrupt_raise(irq, cpu, (irq_source_t)(IRQ_SOURCE_TIMER_0 + timer));
+        }
+    }
+    if (interrupt_routed(irq, IRQ_SOURCE_CONSOLE) && i8080_sio_rx_ready(cpu))
+    {
+        interrupt_raise(irq, cpu, IRQ_SOURCE_CONSOLE);
+    }
+    if (interrupt_routed(irq, IRQ_SOURCE_FILES) && host_files_ready(&machine->files))
+    {
+        interrupt_raise(irq, cpu, IRQ_SOURCE_FILES);
+    }
+    if (machine->native_bios && !native_bios_poll(&machine->bios, cpu))
+    {
+        machine->native_bios = false;
+        return false;
+    }
+    return true;
+}
+
+static void save_ports(altair_machine_t* machine, snapshot_writer_t* w)
+{
+    time_save(&machine->time, w);
+    interrupt_save(&machine->interrupts, w);
+    request_save(&machine->request, w);
+    disk_dma_save(&machine->disk_dma, w);
+    host_drive_save(&machine->drive_h, w);
+}
+
+void altair_machine_save(altair_machine_t* machine, snapshot_writer_t* w)
+{
+    snapshot_save_cpu(w, &machine->cpu);
+    snapshot_save_memory(w, &machine->memory);
+    host_disk_save(&machine->disk, w);
+    save_ports(machine, w);
+}
+
+// Drops any file transfer in progress
+static void drop_transfer(altair_machine_t* machine)
+{
+    char apps_root[sizeof(machine->files.apps_root)];
+
+    memcpy(apps_root, machine->files.apps_root, sizeof(apps_root));
+    if (machine->files.file)
+    {
+        fclose(machine->files.file);
+    }
+    host_files_init(&machine->files, apps_root);
+}
+
+// Sections of the port drivers; other tags are ignored
+static bool load_port_section(altair_machine_t* machine, const char tag[4], snapshot_reader_t* section)
+{
+    if (snapshot_tag_is(tag, "TIME"))
+    {
+        return time_load(&machine->time, section);
+    }
+    if (snapshot_tag_is(tag, "IRQ "))
+    {
+        return interrupt_load(&machine->interrupts, section);
+    }
+    if (snapshot_tag_is(tag, "REQ "))
+    {
+        return request_load(&machine->request, section);
+    }
+    if (snapshot_tag_is(tag, "DDMA"))
+    {
+        return disk_dma_load(&machine->disk_dma, section);
+    }
+    if (snapshot_tag_is(tag, "HDRV"))
+    {
+        return host_drive_load(&machine->drive_h, section);
+    }
+    return true;
+}
+
+bool altair_machine_load(altair_machine_t* machine, snapshot_reader_t* r)
+{
+    snapshot_reader_t section;
+    char tag[4];
+    bool have_cpu = false;
+    bool have_disk = false;
+    int memory_chunks = 0;
+
+    drop_transfer(machine);
+    memset(&machine->ansi, 0, sizeof(machine->ansi));
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    if (machine->checkpoints)
+    {
+        checkpoint_clear(machine->checkpoints);
+    }
+#endif
+
+    while (snapshot_next_section(r, tag, &section))
+    {
+        bool ok;
+
+        if (snapshot_tag_is(tag, "CPU "))
+        {
+            ok = have_cpu = snapshot_load_cpu(&section, &machine->cpu);
+        }
+        else if (snapshot_tag_is(tag, "MEM "))
+        {
+            ok = snapshot_load_memory(&section, &machine->memory);
+            memory_chunks++;
+        }
+        else if (snapshot_tag_is(tag, "DSK "))
+        {
+            ok = have_disk = host_disk_load(&machine->disk, &section);
+        }
+        else
+        {
+            ok = load_port_section(machine, tag, &section);
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return !r->failed && have_cpu && have_disk && memory_chunks == 64 * 1024 / SNAPSHOT_MEMORY_CHUNK;
+}
+
+static bool file_sink(void* context, const uint8_t* data, size_t length)
+{
+    return fwrite(data, 1, length, (FILE*)context) == length;
+}
+
+static size_t file_source(void* context, uint8_t* data, size_t length)
+{
+    return fread(data, 1, length, (FILE*)context);
+}
+
+bool altair_machine_save_file(altair_machine_t* machine, const char* path)
+{
+    uint8_t buffer[SNAPSHOT_SECTION_MAX];
+    snapshot_writer_t w;
+    FILE* file = fopen(path, "wb");
+    bool ok;
+
+    if (!file)
+    {
+        return false;
+    }
+    snapshot_write_begin(&w, buffer, sizeof(buffer), file_sink, file);
+    altair_machine_save(machine, &w);
+    ok = snapshot_write_end(&w);
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        remove(path);
+    }
+    return ok;
+}
+
+bool altair_machine_load_file(altair_machine_t* machine, const char* path)
+{
+    uint8_t buffer[SNAPSHOT_SECTION_MAX];
+    snapshot_reader_t r;
+    FILE* file = fopen(path, "rb");
+    bool ok;
+
+    if (!file)
+    {
+        return false;
+    }
+    ok = snapshot_read_begin(&r, NULL, 0, file_source, file, buffer, sizeof(buffer)) &&
+         altair_machine_load(machine, &r);
+    fclose(file);
+    return ok;
+}
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+static void checkpoint_save(void* context, snapshot_writer_t* w)
+{
+    altair_machine_t* machine = context;
+
+    snapshot_save_cpu(w, &machine->cpu);
+    host_disk_save_state(&machine->disk, w);
+    save_ports(machine, w);
+}
+
+static bool checkpoint_restore(void* context, snapshot_reader_t* r)
+{
+    altair_machine_t* machine = context;
+    snapshot_reader_t section;
+    char tag[4];
+
+    while (snapshot_next_section(r, tag, &section))
+    {
+        bool ok;
+
+        if (snapshot_tag_is(tag, "CPU "))
+        {
+            ok = snapshot_load_cpu(&section, &machine->cpu);
+        }
+        else if (snapshot_tag_is(tag, "DSKS"))
+        {
+            ok = host_disk_load_state(&machine->disk, &section);
+        }
+        else
+        {
+            ok = load_port_section(machine, tag, &section);
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return !r->failed;
+}
+
+static void checkpoint_disk(void* context, uint8_t drive, uint32_t offset, const uint8_t* data, uint16_t length)
+{
+    altair_machine_t* machine = context;
+
+    host_disk_write_image(&machine->disk, drive, offset, data, length);
+}
+
+void altair_machine_enable_checkpoints(altair_machine_t* machine, checkpoint_ring_t* cp, uint8_t* ring,
+                                       size_t capacity)
+{
+    checkpoint_init(cp, &machine->memory, ring, capacity, checkpoint_save, checkpoint_restore, checkpoint_disk,
+                    machine);
+    machine->checkpoints = cp;
+    machine->disk.checkpoints = cp;
+}
+
+void altair_machine_checkpoint(altair_machine_t* machine)
+{
+    checkpoint_take(machine->checkpoints, machine->cpu.cycles);
+}
+
+bool altair_machine_rewind(altair_machine_t* machine, uint32_t n)
+{
+    if (!checkpoint_rewind(machine->checkpoints, n))
+    {
+        return false;
+    }
+    drop_transfer(machine);
+    return true;
+}
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Altair8800/checkpoint.h"
+#include "Altair8800/intel8080.h"
+#include "Altair8800/memory.h"
+#include "Altair8800/snapshot.h"
+#include "Altair8800/universal_88dcdd.h"
+#include "PortDrivers/disk_dma_io.h"
+#include "PortDrivers/host_drive.h"
+#include "PortDrivers/host_files_io.h"
+#include "PortDrivers/interrupt_io.h"
+#include "PortDrivers/native_bios.h"
+#include "PortDrivers/request_io.h"
+#include "PortDrivers/time_io.h"
+#include "ansi_input.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One host-side Altair: the CPU, its memory and code cache, the disk
+// controllers and the port drivers. Machines share no state, so a host can run
+// several at once, each on its own thread.
+typedef struct
+{
+    intel8080_t cpu;
+    altair_memory_t memory;
+    i8080_code_cache_t* code_cache;  // NULL without the block cache or JIT
+    host_disk_controller_t disk;
+    disk_dma_io_t disk_dma;     // the sector DMA controller on the same images
+    host_files_t files;
+    host_drive_t drive_h;       // a host directory as CP/M drive H:, if mounted
+    time_io_t time;
+    interrupt_io_t interrupts;
+    request_io_t request;
+    i8080_ports_t ports;  // the drivers above, registered by altair_machine_open()
+    ansi_input_t ansi;  // for hosts that decode terminal escape sequences
+    checkpoint_ring_t* checkpoints;  // NULL unless checkpoints are enabled
+    i8080_call_hooks_t* call_hooks;  // given to the CPU on every reset, see Altair8800/callgraph.h
+    bool native_bios;   // host code for BIOS routines, see PortDrivers/native_bios.h
+    native_bios_t bios;     // its traps, set by altair_machine_poll()
+    void* host;         // the host's own state, for its terminal callbacks
+} altair_machine_t;
+
+// Opens the disk images and the file transfer directory, registers the port
+// drivers and creates the code cache. Returns false, with nothing left open,
+// if a disk image cannot be used. Close frees the code cache too, so read its
+// counters before.
+bool altair_machine_open(altair_machine_t* machine, const char* drive_a, const char* drive_b, const char* drive_c,
+                         const char* apps_root);
+void altair_machine_close(altair_machine_t* machine);
+
+// Serves CP/M drive H: from the host directory root (see
+// PortDrivers/host_drive.h) from the next reset on. Returns false if root is
+// not a directory that can be listed, or if the CPU is built without
+// I8080_PC_TRAPS, which it needs to catch BDOS calls.
+bool altair_machine_mount(altair_machine_t* machine, const char* root);
+
+// Clears memory, loads the disk boot loader at 0xFF00 and resets the CPU and
+// port drivers to start it. The terminal and sense switch callbacks are
+// passed the machine as their context.
+void altair_machine_reset(altair_machine_t* machine, port_in terminal_in, port_out terminal_out,
+                          read_sense_switches sense);
+
+// Request the interrupts of the devices routed through port 0xFE whose
+// condition holds, and with native_bios set, set the BIOS traps once the
+// stock BIOS has booted. Call between runs of the CPU. Returns false, once,
+// if the CPU has no room for the traps or lacks I8080_PC_TRAPS; native_bios
+// is then cleared.
+bool altair_machine_poll(altair_machine_t* machine);
+
+// Whole-machine snapshots (see Altair8800/snapshot.h). The file transfer and
+// terminal input state are not kept: a transfer in progress is dropped. Nor
+// are the files on H:.
+void altair_machine_save(altair_machine_t* machine, snapshot_writer_t* w);
+
+// Load into a machine that has been opened with the disk images the snapshot
+// was saved with and reset. Returns false if the snapshot is damaged or for
+// other images, leaving the machine to be reset again.
+bool altair_machine_load(altair_machine_t* machine, snapshot_reader_t* r);
+
+bool altair_machine_save_file(altair_machine_t* machine, const char* path);
+bool altair_machine_load_file(altair_machine_t* machine, const char* path);
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+// Keeps rewindable checkpoints (see Altair8800/checkpoint.h) in cp, with the
+// undo records in ring. Call after altair_machine_open(); a reset or a
+// snapshot load forgets them.
+void altair_machine_enable_checkpoints(altair_machine_t* machine, checkpoint_ring_t* cp, uint8_t* ring,
+                                       size_t capacity);
+
+// Takes a checkpoint. Call between runs of the CPU.
+void altair_machine_checkpoint(altair_machine_t* machine);
+
+// Goes back to the nth latest checkpoint. A file transfer in progress is dropped.
+bool altair_machine_rewind(altair_machine_t* machine, uint32_t n);
+#endif
@@ -109,6 +109,28 @@ uint32_t host_monotonic_ms(void)
     return (uint32_t)(((now.QuadPart - start.QuadPart) * 1000ULL) / frequency.QuadPart);
 }
 
+uint64_t host_monotonic_us(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000ULL +
+           (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000ULL / (uint64_t)frequency.QuadPart;
+}
+
+void host_sleep_us(uint32_t us)
+{
+    // Sleep only has millisecond resolution; the caller's pacing makes up the
+    // difference over the following slices
+    Sleep((us + 999) / 1000);
+}
+
 bool host_terminal_configure(void)
 {
     HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
@@ -193,9 +215,27 @@ bool host_terminal_write_byte(uint8_t ch)
     return _write(_fileno(stdout), &ch, 1) == 1;
 }
 
+bool host_terminal_wait_input(uint32_t timeout_ms)
+{
+    if (pending_input_pos < pending_input_len)
+    {
+        return true;
+    }
+    if (!input_console)
+    {
+        Sleep(timeout_ms);
+        return false;
+    }
+
+    // The console handle is also signalled by focus and mouse events, so
+    // callers treat a true return as "worth polling" rather than a key
+    return WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), timeout_ms) == WAIT_OBJECT_0;
+}
+
 #else
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
@@ -233,6 +273,27 @@ uint32_t host_monotonic_ms(void)
     return (uint32_t)((now.tv_sec * 1000u) + (now.tv_nsec / 1000000u));
 }
 
+uint64_t host_monotonic_us(void)
+{
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        return 0;
+    }
+
+    return ((uint64_t)now.tv_sec * 1000000u) + ((uint64_t)now.tv_nsec / 1000u);
+}
+
+void host_sleep_us(uint32_t us)
+{
+    struct timespec delay;
+
+    delay.tv_sec = us / 1000000u;
+    delay.tv_nsec = (long)(us % 1000000u) * 1000L;
+    nanosleep(&delay, NULL);
+}
+
 bool host_terminal_configure(void)
 {
     struct termios raw;
@@ -308,4 +369,14 @@ bool host_terminal_write_byte(uint8_t ch)
     return write(STDOUT_FILENO, &ch, 1) >= 0 || errno == EAGAIN;
 }
 
+bool host_terminal_wait_input(uint32_t timeout_ms)
+{
+    struct pollfd pfd;
+
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, (int)timeout_ms) > 0;
+}
+
 #endif
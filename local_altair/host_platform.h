@@ -5,7 +5,13 @@
 
 void host_prefer_efficiency_core(void);
 uint32_t host_monotonic_ms(void);
+uint64_t host_monotonic_us(void);
+void host_sleep_us(uint32_t us);
 bool host_terminal_configure(void);
 void host_terminal_restore(void);
 int host_terminal_read_byte(void);
 bool host_terminal_write_byte(uint8_t ch);
+
+// Block until terminal input may be ready or timeout_ms passes. Returns true
+// if input may be ready.
+bool host_terminal_wait_input(uint32_t timeout_ms);
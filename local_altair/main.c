@@ -1,11 +1,15 @@
-#include "Altair8800/intel8080.h"
-#include "Altair8800/memory.h"
-#include "PortDrivers/host_files_io.h"
-#include "ansi_input.h"
+#include "altair_machine.h"
+#include "cpu_clock.h"
 #include "host_platform.h"
-#include "io_ports.h"
-#include "PortDrivers/time_io.h"
-#include "universal_88dcdd.h"
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+#include "profiler.h"
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+#include "callgraph.h"
+#endif
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+#include "counters.h"
+#endif
 
 #include <signal.h>
 #include <stdbool.h>
@@ -15,18 +19,68 @@
 #include <string.h>
 
 #define ASCII_MASK_7BIT 0x7f
+#define CPU_SLICE_CYCLES 8000 // T-states run between checks of keep_running when the clock is unlimited
+#define IDLE_WAIT_MS 100 // longest sleep while the guest is halted or idle, so signals are seen
+#define TYPEAHEAD_SIZE 256 // keys held while halted; later ones are dropped
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+#define CHECKPOINT_INTERVAL_MS 1000 // how often a rewindable checkpoint is taken
+#define CHECKPOINT_RING_BYTES (4 * 1024 * 1024)
+#endif
+
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+#define PROFILE_TOP 20 // lines in each table of the --profile report
+#endif
+
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+#define COUNTERS_TOP 16 // lines in each table of the counters printed on exit
+#endif
+
+// --symbols names addresses for the sampling profiler and the call graph alike
+#if (defined(ALTAIR_PROFILER) && ALTAIR_PROFILER) || (defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE)
+#define PROFILE_SYMBOLS 1
+#define PROFILE_MAX_SYMBOLS 8192
+#endif
 
 #ifndef LOCAL_RUNNER_REPO_ROOT
 #define LOCAL_RUNNER_REPO_ROOT ".."
 #endif
 
-static intel8080_t cpu;
+static altair_machine_t machine;
 static volatile sig_atomic_t keep_running = 1;
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+static checkpoint_ring_t checkpoints;
+static uint8_t checkpoint_ring[CHECKPOINT_RING_BYTES];
+static bool rewind_requested = false;
+#endif
+#if defined(PROFILE_SYMBOLS)
+static altair_symbol_t profile_symbols[PROFILE_MAX_SYMBOLS];
+static size_t profile_symbol_count = 0;
+#endif
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+static profiler_t profiler;
+static const char *profile_path = NULL;
+static const char *profile_stacks_path = NULL;
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+static callgraph_t callgraph;
+static const char *callgrind_path = NULL;
+#endif
+
+// Keys typed while the CPU is halted, in arrival order
+static uint8_t typeahead[TYPEAHEAD_SIZE];
+static unsigned typeahead_head;
+static unsigned typeahead_count;
 
 static const char *drive_a_path = LOCAL_RUNNER_REPO_ROOT "/Disks/cpm63k.dsk";
 static const char *drive_b_path = LOCAL_RUNNER_REPO_ROOT "/Disks/bdsc-v1.60.dsk";
 static const char *drive_c_path = LOCAL_RUNNER_REPO_ROOT "/Disks/blank.dsk";
 static const char *apps_root_path = LOCAL_RUNNER_REPO_ROOT "/Apps";
+static const char *drive_h_path = NULL;
+static bool native_bios = false;
+static const char *snapshot_path = NULL;
+static const char *resume_path = NULL;
+static bool jit_lockstep;
 
 static void handle_signal(int signum)
 {
@@ -34,15 +88,25 @@ static void handle_signal(int signum)
     keep_running = 0;
 }
 
-static uint8_t terminal_read(void)
+static uint8_t terminal_read(void *context)
 {
+    altair_machine_t *m = context;
     int raw_ch;
     uint8_t ch;
 
-    raw_ch = host_terminal_read_byte();
+    if (typeahead_count)
+    {
+        raw_ch = typeahead[typeahead_head];
+        typeahead_head = (typeahead_head + 1) % TYPEAHEAD_SIZE;
+        typeahead_count--;
+    }
+    else
+    {
+        raw_ch = host_terminal_read_byte();
+    }
     if (raw_ch < 0)
     {
-        return ansi_input_process(0x00, host_monotonic_ms());
+        return ansi_input_process(&m->ansi, 0x00, host_monotonic_ms());
     }
 
     ch = (uint8_t)raw_ch;
@@ -52,7 +116,14 @@ static uint8_t terminal_read(void)
         keep_running = 0;
         return 0x00;
     }
-    ch = ansi_input_process(ch, host_monotonic_ms());
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    if (ch == 0x1c)
+    {
+        rewind_requested = true;
+        return 0x00;
+    }
+#endif
+    ch = ansi_input_process(&m->ansi, ch, host_monotonic_ms());
     if (ch == '\n')
     {
         return '\r';
@@ -60,25 +131,170 @@ static uint8_t terminal_read(void)
     return ch;
 }
 
-static void terminal_write(uint8_t c)
+// Reads waiting keys into the typeahead queue for when the CPU runs again.
+// Ctrl-] still exits at once.
+static void terminal_hold_input(void)
+{
+    int raw_ch;
+
+    while ((raw_ch = host_terminal_read_byte()) >= 0)
+    {
+        if ((raw_ch & ASCII_MASK_7BIT) == 0x1d)
+        {
+            keep_running = 0;
+            return;
+        }
+        if (typeahead_count < TYPEAHEAD_SIZE)
+        {
+            typeahead[(typeahead_head + typeahead_count) % TYPEAHEAD_SIZE] = (uint8_t)raw_ch;
+            typeahead_count++;
+        }
+    }
+}
+
+static void terminal_write(void *context, uint8_t c)
 {
     unsigned char ch = (unsigned char)(c & ASCII_MASK_7BIT);
 
+    (void)context;
     if (!host_terminal_write_byte(ch))
     {
         keep_running = 0;
     }
 }
 
-static uint8_t sense_switches(void)
+static uint8_t sense_switches(void *context)
 {
+    (void)context;
     return 0xff;
 }
 
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+static void write_notice(const char *notice)
+{
+    while (*notice)
+    {
+        host_terminal_write_byte((unsigned char)*notice++);
+    }
+}
+
+// Ctrl-\ goes back to the latest checkpoint; pressed again within a
+// checkpoint interval, one further each time
+static void rewind_machine(uint32_t now_ms, uint32_t *last_rewind_ms)
+{
+    uint32_t n = now_ms - *last_rewind_ms < CHECKPOINT_INTERVAL_MS ? 2 : 1;
+
+    if (altair_machine_rewind(&machine, n))
+    {
+        write_notice("\r\n*** REWOUND ***\r\n");
+    }
+    else if (n > checkpoint_depth(&checkpoints))
+    {
+        write_notice("\r\n*** NO EARLIER CHECKPOINT ***\r\n");
+    }
+    else
+    {
+        altair_machine_reset(&machine, terminal_read, terminal_write, sense_switches);
+        write_notice("\r\n*** REWIND FAILED - RESET ***\r\n");
+    }
+    *last_rewind_ms = now_ms;
+}
+#endif
+
+#if defined(PROFILE_SYMBOLS)
+static bool load_symbols(const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    char *text;
+    long length;
+    bool ok;
+
+    if (!in)
+    {
+        return false;
+    }
+    ok = fseek(in, 0, SEEK_END) == 0 && (length = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0;
+    text = ok ? malloc((size_t)length + 1) : NULL;
+    ok = text && fread(text, 1, (size_t)length, in) == (size_t)length;
+    fclose(in);
+    if (ok)
+    {
+        profile_symbol_count =
+            symbols_parse(text, (size_t)length, profile_symbols, profile_symbol_count, PROFILE_MAX_SYMBOLS);
+    }
+    free(text);
+    return ok;
+}
+#endif
+
+#if defined(PROFILE_SYMBOLS) || (defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS)
+static void print_line(void *context, const char *line)
+{
+    fprintf(context, "%s\n", line);
+}
+#endif
+
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+static void write_profile(const char *path, bool collapsed)
+{
+    FILE *out = fopen(path, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "altair-local: could not write profile to %s\n", path);
+        return;
+    }
+    if (collapsed)
+    {
+        profiler_write_collapsed(&profiler, print_line, out);
+    }
+    else
+    {
+        profiler_report(&profiler, PROFILE_TOP, print_line, out);
+    }
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "altair-local: could not write profile to %s\n", path);
+    }
+}
+#endif
+
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+static void write_callgrind(const char *path)
+{
+    FILE *out = fopen(path, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "altair-local: could not write call graph to %s\n", path);
+        return;
+    }
+    callgraph_write_callgrind(&callgraph, "altair-local", print_line, out);
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "altair-local: could not write call graph to %s\n", path);
+    }
+}
+#endif
+
 static void print_usage(const char *program)
 {
     fprintf(stderr,
-            "Usage: %s [--drive-a PATH] [--drive-b PATH] [--drive-c PATH] [--apps-root PATH]\n"
+            "Usage: %s [--drive-a PATH] [--drive-b PATH] [--drive-c PATH] [--drive-h DIR] [--apps-root PATH]\n"
+            "          [--clock MHZ|max] [--snapshot FILE] [--resume FILE] [--native-bios] [--jit-lockstep]\n"
+            "          [--profile FILE] [--profile-stacks FILE] [--callgrind FILE] [--symbols FILE]...\n"
+            "\n"
+            "--drive-h serves CP/M drive H: from the files in DIR, which the guest reads and writes.\n"
+            "--native-bios runs the console and disk routines of the cpm63k.dsk BIOS as host code\n"
+            "(I8080_PC_TRAPS builds).\n"
+            "--clock runs the 8080 at MHZ (2 for an original Altair, 4 for a fast one) instead of flat out.\n"
+            "--snapshot saves the whole machine to FILE on exit; --resume starts from such a file instead of\n"
+            "booting, and needs the disk images it was saved with.\n"
+            "--profile samples the guest's PC for the whole run and writes the hot spots to FILE on exit;\n"
+            "--profile-stacks writes its call stacks as collapsed stacks for flamegraph.pl. --symbols names\n"
+            "addresses from a CLINK .SYM file or a map of \"address name\" lines, and may be repeated.\n"
+            "--callgrind writes the calls and their inclusive T-states to FILE on exit, for\n"
+            "callgrind_annotate or KCachegrind (I8080_CALL_PROFILE builds).\n"
             "\n"
             "Defaults reference the repository Disks and Apps folders:\n"
             "  A: %s\n"
@@ -88,6 +304,28 @@ static void print_usage(const char *program)
             program, drive_a_path, drive_b_path, drive_c_path, apps_root_path);
 }
 
+// MHz, or "max" (or 0) for no limit
+static bool parse_clock(const char *text)
+{
+    char *end;
+    double mhz;
+
+    if (strcmp(text, "max") == 0)
+    {
+        cpu_clock_set_khz(CPU_CLOCK_UNLIMITED);
+        return true;
+    }
+
+    mhz = strtod(text, &end);
+    if (end == text || *end != '\0' || mhz < 0.0 || mhz > 1000.0)
+    {
+        return false;
+    }
+
+    cpu_clock_set_khz((uint32_t)(mhz * 1000.0 + 0.5));
+    return true;
+}
+
 static bool parse_args(int argc, char **argv)
 {
     int i;
@@ -106,10 +344,64 @@ static bool parse_args(int argc, char **argv)
         {
             drive_c_path = argv[++i];
         }
+        else if (strcmp(argv[i], "--drive-h") == 0 && i + 1 < argc)
+        {
+            drive_h_path = argv[++i];
+        }
         else if (strcmp(argv[i], "--apps-root") == 0 && i + 1 < argc)
         {
             apps_root_path = argv[++i];
         }
+        else if (strcmp(argv[i], "--clock") == 0 && i + 1 < argc)
+        {
+            if (!parse_clock(argv[++i]))
+            {
+                fprintf(stderr, "altair-local: invalid clock '%s'\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+        {
+            snapshot_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+        {
+            resume_path = argv[++i];
+        }
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc)
+        {
+            profile_stacks_path = argv[++i];
+        }
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+        else if (strcmp(argv[i], "--callgrind") == 0 && i + 1 < argc)
+        {
+            callgrind_path = argv[++i];
+        }
+#endif
+#if defined(PROFILE_SYMBOLS)
+        else if (strcmp(argv[i], "--symbols") == 0 && i + 1 < argc)
+        {
+            if (!load_symbols(argv[++i]))
+            {
+                fprintf(stderr, "altair-local: cannot read symbols from %s\n", argv[i]);
+                return false;
+            }
+        }
+#endif
+        else if (strcmp(argv[i], "--native-bios") == 0)
+        {
+            native_bios = true;
+        }
+        else if (strcmp(argv[i], "--jit-lockstep") == 0)
+        {
+            jit_lockstep = true;
+        }
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
         {
             print_usage(argv[0]);
@@ -127,7 +419,7 @@ static bool parse_args(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-    disk_controller_t controller;
+    intel8080_t *cpu = &machine.cpu;
 
     if (!parse_args(argc, argv))
     {
@@ -144,29 +436,185 @@ int main(int argc, char **argv)
     atexit(host_terminal_restore);
     host_prefer_efficiency_core();
 
-    if (!host_disk_init(drive_a_path, drive_b_path, drive_c_path))
+    if (!altair_machine_open(&machine, drive_a_path, drive_b_path, drive_c_path, apps_root_path))
     {
         host_terminal_restore();
         fprintf(stderr, "altair-local: failed to open disk images\n");
         fprintf(stderr, "  A: %s\n  B: %s\n  C: %s\n", drive_a_path, drive_b_path, drive_c_path);
         return 1;
     }
+    if (jit_lockstep && i8080_jit_set_lockstep(machine.code_cache, 1) != 0)
+    {
+        altair_machine_close(&machine);
+        host_terminal_restore();
+        fprintf(stderr, "altair-local: --jit-lockstep needs a build with I8080_JIT on an x86-64 host\n");
+        return 1;
+    }
+    if (drive_h_path && !altair_machine_mount(&machine, drive_h_path))
+    {
+        altair_machine_close(&machine);
+        host_terminal_restore();
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+        fprintf(stderr, "altair-local: --drive-h %s is not a directory that can be read\n", drive_h_path);
+#else
+        fprintf(stderr, "altair-local: --drive-h needs a build with I8080_PC_TRAPS\n");
+#endif
+        return 1;
+    }
+#if !(defined(I8080_PC_TRAPS) && I8080_PC_TRAPS)
+    if (native_bios)
+    {
+        altair_machine_close(&machine);
+        host_terminal_restore();
+        fprintf(stderr, "altair-local: --native-bios needs a build with I8080_PC_TRAPS\n");
+        return 1;
+    }
+#endif
 
-    host_files_init(apps_root_path);
-    controller = host_disk_controller();
+    machine.native_bios = native_bios;
+    altair_machine_reset(&machine, terminal_read, terminal_write, sense_switches);
+    if (resume_path && !altair_machine_load_file(&machine, resume_path))
+    {
+        altair_machine_close(&machine);
+        host_terminal_restore();
+        fprintf(stderr, "altair-local: cannot resume from %s: not a snapshot, or saved with other disk images\n",
+                resume_path);
+        return 1;
+    }
 
-    memset(memory, 0x00, 64 * 1024);
-    loadDiskLoader(0xff00);
-    time_reset();
-    i8080_reset(&cpu, terminal_read, terminal_write, sense_switches, &controller, io_port_in, io_port_out);
-    i8080_examine(&cpu, 0xff00);
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    uint32_t last_checkpoint_ms = host_monotonic_ms();
+    uint32_t last_rewind_ms = last_checkpoint_ms - CHECKPOINT_INTERVAL_MS;
+
+    altair_machine_enable_checkpoints(&machine, &checkpoints, checkpoint_ring, sizeof(checkpoint_ring));
+    altair_machine_checkpoint(&machine);
+#endif
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+    profiler_init(&profiler);
+    profiler_set_symbols(&profiler, profile_symbols, profile_symbol_count);
+    if (profile_path || profile_stacks_path)
+    {
+        profiler_start(&profiler);
+    }
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+    callgraph_init(&callgraph, &machine.memory);
+    callgraph_set_symbols(&callgraph, profile_symbols, profile_symbol_count);
+    if (callgrind_path)
+    {
+        machine.call_hooks = cpu->call_hooks = &callgraph.hooks;
+        callgraph_start(&callgraph, cpu->cycles);
+    }
+#endif
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+    uint32_t start_ms = host_monotonic_ms();
+#endif
 
     while (keep_running)
     {
-        i8080_cycle(&cpu);
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+        uint32_t now_ms = host_monotonic_ms();
+
+        if (rewind_requested)
+        {
+            rewind_requested = false;
+            rewind_machine(now_ms, &last_rewind_ms);
+            last_checkpoint_ms = now_ms;
+        }
+        else if (now_ms - last_checkpoint_ms >= CHECKPOINT_INTERVAL_MS)
+        {
+            altair_machine_checkpoint(&machine);
+            last_checkpoint_ms = now_ms;
+        }
+#endif
+        uint32_t wait_us = cpu_clock_wait_us(host_monotonic_us(), cpu->cycles);
+
+        if (wait_us != 0)
+        {
+            host_sleep_us(wait_us);
+        }
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+        profiler_run(&profiler, cpu, cpu_clock_slice_cycles(CPU_SLICE_CYCLES), 0);
+#else
+        i8080_run(cpu, cpu_clock_slice_cycles(CPU_SLICE_CYCLES), 0);
+#endif
+        if (!altair_machine_poll(&machine))
+        {
+            fprintf(stderr, "altair-local: no room for the --native-bios traps, running the BIOS as it is\r\n");
+        }
+        if (cpu->idle || (cpu->halted && !(cpu->interrupt_requests && (cpu->registers.flags & FLAGS_IF))))
+        {
+            uint32_t timer_ms = time_ms_until_next(&machine.time);
+
+            // Sleep until a key arrives or the next timer runs out. Without a
+            // console interrupt to take it, a key for a halted CPU is kept for
+            // later.
+            if (host_terminal_wait_input(timer_ms < IDLE_WAIT_MS ? timer_ms : IDLE_WAIT_MS) && cpu->halted &&
+                !interrupt_routed(&machine.interrupts, IRQ_SOURCE_CONSOLE))
+            {
+                terminal_hold_input();
+            }
+        }
     }
 
-    host_disk_close();
+    if (snapshot_path && !altair_machine_save_file(&machine, snapshot_path))
+    {
+        host_terminal_restore();
+        fprintf(stderr, "altair-local: could not save snapshot to %s\n", snapshot_path);
+    }
     host_terminal_restore();
+
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+    profiler_stop(&profiler);
+    if (profile_path)
+    {
+        write_profile(profile_path, false);
+    }
+    if (profile_stacks_path)
+    {
+        write_profile(profile_stacks_path, true);
+    }
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+    if (callgrind_path)
+    {
+        callgraph_stop(&callgraph, cpu->cycles);
+        write_callgrind(callgrind_path);
+    }
+#endif
+#if defined(ALTAIR_COUNTERS) && ALTAIR_COUNTERS
+    counters_report(cpu, COUNTERS_TOP, (host_monotonic_ms() - start_ms) / 1000.0, print_line, stderr);
+#endif
+#if defined(I8080_BLOCK_CACHE) && I8080_BLOCK_CACHE
+    {
+        i8080_block_stats_t stats;
+
+        i8080_block_cache_stats(machine.code_cache, &stats);
+        fprintf(stderr, "altair-local: block cache: %llu hits, %llu misses, %llu invalidations\n",
+                (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                (unsigned long long)stats.invalidations);
+    }
+#endif
+#if defined(I8080_JIT) && I8080_JIT
+    {
+        i8080_jit_stats_t stats;
+
+        i8080_jit_stats(machine.code_cache, &stats);
+        fprintf(stderr, "altair-local: jit: %llu translations, %llu native entries, %llu links, "
+                "%llu interpreted, %llu invalidations, %llu flushes, %llu/%llu lockstep mismatches\n",
+                (unsigned long long)stats.translations, (unsigned long long)stats.native_entries,
+                (unsigned long long)stats.links, (unsigned long long)stats.interpreted,
+                (unsigned long long)stats.invalidations, (unsigned long long)stats.flushes,
+                (unsigned long long)stats.lockstep_mismatches, (unsigned long long)stats.lockstep_checks);
+    }
+#endif
+    altair_machine_close(&machine);
+#if defined(I8080_PAIR_PROFILE) && I8080_PAIR_PROFILE
+    if (i8080_pair_profile_write("intel8080_fusion.h") == 0) {
+        fprintf(stderr, "altair-local: wrote instruction pair profile to intel8080_fusion.h\n");
+    } else {
+        fprintf(stderr, "altair-local: could not write intel8080_fusion.h\n");
+    }
+#endif
     return 0;
 }
@@ -23,10 +23,17 @@
 #include "build_version.h"
 #include "core1_io_mgr.h"
 #include "config.h"
+#include "cpu_clock.h"
 #include "cpu_state.h"
 #include "hardware/timer.h"
 #include "hardware/watchdog.h"
 #include "io_ports.h"
+#if defined(SD_CARD_SUPPORT)
+#include "pico_snapshot.h"
+#endif
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+#include "pico_checkpoint.h"
+#endif
 #include "pico/error.h"
 #include "pico/stdlib.h"
 #include "pico/platform.h"
@@ -37,6 +44,8 @@
 #include <string.h>
 
 #define ASCII_MASK_7BIT 0x7F
+#define CPU_SLICE_CYCLES 8000 // T-states run between checks of the CPU mode when the clock is unlimited
+#define CPU_IDLE_WAIT_MS 4 // longest sleep between mode checks while the CPU is halted or idle
 
 #if !defined(SD_CARD_SUPPORT) && !defined(REMOTE_FS_SUPPORT)
 // Include the CPM disk image (only for embedded XIP disk controller)
@@ -52,9 +61,9 @@ static char g_ip_buffer[32] = {0};
 extern intel8080_t cpu;
 
 // Forward declarations of static functions
-static uint8_t terminal_read(void);
-static void terminal_write(uint8_t c);
-static inline uint8_t sense(void);
+static uint8_t terminal_read(void* context);
+static void terminal_write(void* context, uint8_t c);
+static inline uint8_t sense(void* context);
 #if defined(BLUETOOTH_KEYBOARD_SUPPORT)
 static int serial_wait_for_char_ms(uint32_t timeout_ms);
 static void maybe_run_bluetooth_keyboard_shell(void);
@@ -77,6 +86,9 @@ static void __not_in_flash_func(spin_in_ram)(void)
 // Static disk controller reference for reset
 static disk_controller_t* g_disk_controller = NULL;
 
+// Escape sequence state of the terminal input, shared by the CPU and the monitor
+static ansi_input_t ansi_input;
+
 void client_connected_cb(void)
 {
     cpu_state_set_mode(CPU_RUNNING);
@@ -91,11 +103,16 @@ void altair_reset(void)
 {
     if (g_disk_controller)
     {
-        memset(memory, 0x00, 64 * 1024); // Clear Altair memory
-        loadDiskLoader(0xFF00);          // Load disk boot loader at 0xFF00
-        i8080_reset(&cpu, terminal_read, terminal_write, sense, g_disk_controller, io_port_in, io_port_out);
+        memory_init(&altair_memory);             // Clear Altair memory
+        loadDiskLoader(&altair_memory, 0xFF00);  // Load disk boot loader at 0xFF00
+        i8080_reset(&cpu, &altair_memory, NULL, terminal_read, terminal_write, sense, g_disk_controller,
+                    io_ports_table());
+        io_ports_reset();
         i8080_examine(&cpu, 0xFF00); // Reset to boot loader address
         bus_switches = cpu.address_bus;
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+        pico_checkpoint_clear();
+#endif
     }
 }
 
@@ -120,15 +137,16 @@ static uint8_t terminal_postprocess(uint8_t ch)
 }
 
 // Terminal read function - non-blocking
-static uint8_t terminal_read(void)
+static uint8_t terminal_read(void* context)
 {
+    (void)context;
 
 #if defined(CYW43_WL_GPIO_LED_PIN)
     // Input priority is WebSocket client, then BLE keyboard, then USB serial.
     uint8_t ws_ch = 0;
     if (websocket_console_has_client() && websocket_console_try_dequeue_input(&ws_ch))
     {
-        uint8_t ch = ansi_input_process((uint8_t)(ws_ch & ASCII_MASK_7BIT), monotonic_ms());
+        uint8_t ch = ansi_input_process(&ansi_input, (uint8_t)(ws_ch & ASCII_MASK_7BIT), monotonic_ms());
         return terminal_postprocess(ch);
     }
 
@@ -136,7 +154,7 @@ static uint8_t terminal_read(void)
     uint8_t bt_ch = 0;
     if (bt_keyboard_try_dequeue_input(&bt_ch))
     {
-        uint8_t ch = ansi_input_process((uint8_t)(bt_ch & ASCII_MASK_7BIT), monotonic_ms());
+        uint8_t ch = ansi_input_process(&ansi_input, (uint8_t)(bt_ch & ASCII_MASK_7BIT), monotonic_ms());
         return terminal_postprocess(ch);
     }
 #endif
@@ -147,28 +165,29 @@ static uint8_t terminal_read(void)
         int c = getchar_timeout_us(0);
         if (c != PICO_ERROR_TIMEOUT)
         {
-            uint8_t ch = ansi_input_process((uint8_t)(c & ASCII_MASK_7BIT), monotonic_ms());
+            uint8_t ch = ansi_input_process(&ansi_input, (uint8_t)(c & ASCII_MASK_7BIT), monotonic_ms());
             return terminal_postprocess(ch);
         }
     }
 
-    return terminal_postprocess(ansi_input_process(0x00, monotonic_ms()));
+    return terminal_postprocess(ansi_input_process(&ansi_input, 0x00, monotonic_ms()));
 #else
     int c = getchar_timeout_us(0); // Non-blocking read
     if (c == PICO_ERROR_TIMEOUT)
     {
-        return terminal_postprocess(ansi_input_process(0x00, monotonic_ms()));
+        return terminal_postprocess(ansi_input_process(&ansi_input, 0x00, monotonic_ms()));
     }
 
     uint8_t ch = (uint8_t)(c & ASCII_MASK_7BIT);
-    ch = ansi_input_process(ch, monotonic_ms());
+    ch = ansi_input_process(&ansi_input, ch, monotonic_ms());
     return terminal_postprocess(ch);
 #endif
 }
 
 // Terminal write function
-static void terminal_write(uint8_t c)
+static void terminal_write(void* context, uint8_t c)
 {
+    (void)context;
     c &= ASCII_MASK_7BIT; // Take first 7 bits only
 #if defined(CYW43_WL_GPIO_LED_PIN)
     websocket_console_enqueue_output(c);
@@ -183,8 +202,9 @@ static void terminal_write(uint8_t c)
 }
 
 // Sense switches
-static inline uint8_t sense(void)
+static inline uint8_t sense(void* context)
 {
+    (void)context;
     return (uint8_t)(bus_switches >> 8);
 }
 
@@ -615,30 +635,34 @@ int main(void)
 
     // Load disk boot loader ROM at 0xFF00 (ROM_LOADER_ADDRESS)
     printf("Loading disk boot loader ROM at 0xFF00...\n");
-    loadDiskLoader(0xFF00);
+    memory_init(&altair_memory);
+    loadDiskLoader(&altair_memory, 0xFF00);
 
     // Set up disk controller structure for CPU
 #if defined(SD_CARD_SUPPORT)
-    static disk_controller_t disk_controller = {.disk_select = (port_out)sd_disk_select,
-                                                .disk_status = (port_in)sd_disk_status,
-                                                .disk_function = (port_out)sd_disk_function,
-                                                .sector = (port_in)sd_disk_sector,
-                                                .write = (port_out)sd_disk_write,
-                                                .read = (port_in)sd_disk_read};
+    static disk_controller_t disk_controller = {.context = NULL,
+                                                .disk_select = sd_disk_select,
+                                                .disk_status = sd_disk_status,
+                                                .disk_function = sd_disk_function,
+                                                .sector = sd_disk_sector,
+                                                .write = sd_disk_write,
+                                                .read = sd_disk_read};
 #elif defined(REMOTE_FS_SUPPORT)
-    static disk_controller_t disk_controller = {.disk_select = (port_out)rfs_disk_select,
-                                                .disk_status = (port_in)rfs_disk_status,
-                                                .disk_function = (port_out)rfs_disk_function,
-                                                .sector = (port_in)rfs_disk_sector,
-                                                .write = (port_out)rfs_disk_write,
-                                                .read = (port_in)rfs_disk_read};
+    static disk_controller_t disk_controller = {.context = NULL,
+                                                .disk_select = rfs_disk_select,
+                                                .disk_status = rfs_disk_status,
+                                                .disk_function = rfs_disk_function,
+                                                .sector = rfs_disk_sector,
+                                                .write = rfs_disk_write,
+                                                .read = rfs_disk_read};
 #else
-    static disk_controller_t disk_controller = {.disk_select = (port_out)pico_disk_select,
-                                                .disk_status = (port_in)pico_disk_status,
-                                                .disk_function = (port_out)pico_disk_function,
-                                                .sector = (port_in)pico_disk_sector,
-                                                .write = (port_out)pico_disk_write,
-                                                .read = (port_in)pico_disk_read};
+    static disk_controller_t disk_controller = {.context = NULL,
+                                                .disk_select = pico_disk_select,
+                                                .disk_status = pico_disk_status,
+                                                .disk_function = pico_disk_function,
+                                                .sector = pico_disk_sector,
+                                                .write = pico_disk_write,
+                                                .read = pico_disk_read};
 #endif
 
     // Store reference for reset function
@@ -646,11 +670,36 @@ int main(void)
 
     // Reset and initialize the CPU
     printf("Initializing Intel 8080 CPU...\n");
-    i8080_reset(&cpu, terminal_read, terminal_write, sense, &disk_controller, io_port_in, io_port_out);
+#if defined(SD_CARD_SUPPORT)
+    i8080_ports_t* ports = io_ports_init(sd_disk_read_sector, sd_disk_write_sector);
+#elif defined(REMOTE_FS_SUPPORT)
+    i8080_ports_t* ports = io_ports_init(rfs_disk_read_sector, rfs_disk_write_sector);
+#else
+    i8080_ports_t* ports = io_ports_init(pico_disk_read_sector, pico_disk_write_sector);
+#endif
+    i8080_reset(&cpu, &altair_memory, NULL, terminal_read, terminal_write, sense, &disk_controller, ports);
 
     // Set CPU to start at ROM_LOADER_ADDRESS (0xFF00) to boot from disk
     printf("Setting CPU to ROM_LOADER_ADDRESS (0xFF00) to boot from disk\n");
     i8080_examine(&cpu, 0xFF00);
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    pico_checkpoint_init();
+#endif
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+    profiler_init(&profiler);
+#endif
+
+#if defined(SD_CARD_SUPPORT)
+    // Skip the CP/M boot if the monitor SAVE command left a snapshot taken with these disks
+    if (pico_snapshot_resume())
+    {
+        printf("Resumed from %s\n", PICO_SNAPSHOT_PATH);
+    }
+    else
+    {
+        altair_reset();
+    }
+#endif
 
     // Report basic memory usage at startup (static allocation only)
     extern char __StackLimit, __bss_end__;
@@ -718,13 +767,37 @@ int main(void)
         switch (mode)
         {
             case CPU_RUNNING:
-                for (int i = 0; i < 1000; ++i)
+            {
+                uint32_t wait_us = cpu_clock_wait_us(time_us_64(), cpu.cycles);
+
+                if (wait_us != 0)
                 {
-                    i8080_cycle(&cpu);
+                    // Ahead of the target clock: sleep off the rest of the slice
+                    sleep_us(wait_us);
+                }
+#if defined(ALTAIR_PROFILER) && ALTAIR_PROFILER
+                profiler_run(&profiler, &cpu, cpu_clock_slice_cycles(CPU_SLICE_CYCLES), 0);
+#else
+                i8080_run(&cpu, cpu_clock_slice_cycles(CPU_SLICE_CYCLES), 0);
+#endif
+                io_ports_poll(&cpu);
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+                pico_checkpoint_poll(monotonic_ms());
+#endif
+                if (cpu.idle || (cpu.halted && !(cpu.interrupt_requests && (cpu.registers.flags & FLAGS_IF))))
+                {
+                    uint32_t timer_ms = io_ports_ms_until_next_timer();
+
+                    // Sleep until core 1 signals (queue_try_add() on the input
+                    // queues and cpu_state_set_mode() send an event), a timer
+                    // runs out or the next mode check is due
+                    best_effort_wfe_or_timeout(
+                        make_timeout_time_ms(timer_ms < CPU_IDLE_WAIT_MS ? timer_ms : CPU_IDLE_WAIT_MS));
                 }
                 break;
+            }
             case CPU_LOW_POWER:
-                i8080_cycle(&cpu);
+                i8080_run(&cpu, 1, 0);
                 sleep_us(1);
                 break;
             case CPU_STOPPED:
@@ -733,7 +806,7 @@ int main(void)
                 uint8_t ch = 0;
                 if (websocket_console_try_dequeue_monitor_input(&ch))
                 {
-                    uint8_t filtered = ansi_input_process((uint8_t)(ch & ASCII_MASK_7BIT), monotonic_ms());
+                    uint8_t filtered = ansi_input_process(&ansi_input, (uint8_t)(ch & ASCII_MASK_7BIT), monotonic_ms());
                     filtered = terminal_postprocess(filtered);
                     handled = true;
                     if (filtered != 0x00)
@@ -745,7 +818,7 @@ int main(void)
 #if defined(BLUETOOTH_KEYBOARD_SUPPORT)
                 if (!handled && bt_keyboard_try_dequeue_input(&ch))
                 {
-                    uint8_t filtered = ansi_input_process((uint8_t)(ch & ASCII_MASK_7BIT), monotonic_ms());
+                    uint8_t filtered = ansi_input_process(&ansi_input, (uint8_t)(ch & ASCII_MASK_7BIT), monotonic_ms());
                     filtered = terminal_postprocess(filtered);
                     handled = true;
                     if (filtered != 0x00)
@@ -761,7 +834,7 @@ int main(void)
                     int c = getchar_timeout_us(0);
                     if (c != PICO_ERROR_TIMEOUT)
                     {
-                        uint8_t sc = ansi_input_process((uint8_t)(c & ASCII_MASK_7BIT), monotonic_ms());
+                        uint8_t sc = ansi_input_process(&ansi_input, (uint8_t)(c & ASCII_MASK_7BIT), monotonic_ms());
                         sc = terminal_postprocess(sc);
                         if (sc != 0x00)
                         {
@@ -772,7 +845,7 @@ int main(void)
 
                 if (!handled)
                 {
-                    uint8_t filtered = ansi_input_process(0x00, monotonic_ms());
+                    uint8_t filtered = ansi_input_process(&ansi_input, 0x00, monotonic_ms());
                     filtered = terminal_postprocess(filtered);
                     if (filtered != 0x00)
                     {
@@ -1,10 +1,9 @@
 #define _GNU_SOURCE
 
-#include "host_files_io.h"
-#include "universal_88dcdd.h"
-
-#include "../Altair8800/intel8080.h"
-#include "../Altair8800/memory.h"
+#include "altair_machine.h"
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+#include "callgraph.h"
+#endif
 
 #include <ctype.h>
 #include <stdbool.h>
@@ -25,9 +24,10 @@
 
 #define INPUT_CAP 16384
 #define OUTPUT_CAP 1048576
-#define BOOT_CYCLES 20000000
-#define DEFAULT_CALL_CYCLES 12000000
-#define BUILD_STEP_CYCLES 800000000
+#define BOOT_CYCLES 160000000ULL
+#define DEFAULT_CALL_CYCLES 96000000
+#define BUILD_STEP_CYCLES 6400000000ULL
+#define PROMPT_CHECK_CYCLES 0x20000
 #define BUILD_MAX_STEPS 80
 #define BUILD_TIMEOUT_SECONDS 5
 #define SUBMIT_MAX_STEPS 300
@@ -48,7 +48,7 @@ static const char *tools_list_result =
     "},"
     "\"cycles\":{"
     "\"type\":\"integer\","
-    "\"description\":\"Maximum Intel 8080 cycles to run before returning. Increase this for long compiles, links, or submit-file steps. Default is enough for short commands.\""
+    "\"description\":\"Maximum Intel 8080 T-states (clock cycles) to run before returning. Increase this for long compiles, links, or submit-file steps. Default is enough for short commands.\""
     "}"
     "},"
     "\"required\":[\"input\"]"
@@ -133,7 +133,12 @@ static const char *tools_list_result =
     "]"
     "}";
 
-static intel8080_t g_cpu;
+static altair_machine_t g_machine;
+static i8080_block_stats_t g_block_stats;  // code cache counters of every machine closed so far
+static i8080_jit_stats_t g_jit_stats;
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+static callgraph_t g_callgraph; // every build's calls, written to callgrind.out.altair on exit
+#endif
 static const char *g_drive_a;
 static const char *g_drive_b;
 static const char *g_drive_c;
@@ -141,17 +146,25 @@ static const char *g_pristine_a;
 static const char *g_pristine_b;
 static const char *g_pristine_c;
 static const char *g_apps_root;
+static const char *g_drive_h;  // NULL unless a host directory is served as H:
+static bool g_native_bios;     // --native-bios, see PortDrivers/native_bios.h
 static bool g_booted = false;
+// The machine as it was at the A> prompt after the last cold boot, and how
+// long that is. A reset resumes from it instead of booting again while the
+// disk images are the ones it was taken with.
+static uint8_t g_boot_snapshot[SNAPSHOT_MAX_SIZE];
+static size_t g_boot_snapshot_len = 0;
 static uint8_t g_input[INPUT_CAP];
 static size_t g_input_read = 0;
 static size_t g_input_write = 0;
 static char g_output[OUTPUT_CAP];
 static size_t g_output_len = 0;
 
-static uint8_t terminal_read(void)
+static uint8_t terminal_read(void *context)
 {
     uint8_t ch;
 
+    (void)context;
     if (g_input_read == g_input_write) {
         return 0x00;
     }
@@ -161,8 +174,9 @@ static uint8_t terminal_read(void)
     return ch & 0x7f;
 }
 
-static void terminal_write(uint8_t c)
+static void terminal_write(void *context, uint8_t c)
 {
+    (void)context;
     c &= 0x7f;
     if (g_output_len + 1 < sizeof(g_output)) {
         g_output[g_output_len++] = (char)c;
@@ -170,26 +184,12 @@ static void terminal_write(uint8_t c)
     }
 }
 
-static uint8_t sense_switches(void)
+static uint8_t sense_switches(void *context)
 {
+    (void)context;
     return 0xff;
 }
 
-static uint8_t io_port_in(uint8_t port)
-{
-    if (port == 60 || port == 61) {
-        return host_files_in(port);
-    }
-    return 0x00;
-}
-
-static void io_port_out(uint8_t port, uint8_t data)
-{
-    if (port == 60 || port == 61) {
-        host_files_out(port, data);
-    }
-}
-
 static void enqueue_text(const char *text)
 {
     while (*text) {
@@ -232,60 +232,120 @@ static bool output_has_prompt(char boot_only)
     return false;
 }
 
+static void poll_machine(void)
+{
+    if (!altair_machine_poll(&g_machine)) {
+        fprintf(stderr, "[MCP] no room for the native BIOS traps, running the BIOS as it is\n");
+    }
+}
+
 static bool input_empty(void)
 {
     return g_input_read == g_input_write;
 }
 
-static void run_cycles(size_t cycles)
+static void run_cycles(uint64_t cycles)
 {
-    size_t i;
+    uint64_t elapsed = 0;
 
-    for (i = 0; i < cycles; i++) {
-        i8080_cycle(&g_cpu);
+    while (elapsed < cycles) {
+        uint64_t remaining = cycles - elapsed;
+        elapsed += i8080_run(&g_machine.cpu, remaining > PROMPT_CHECK_CYCLES ? PROMPT_CHECK_CYCLES : (uint32_t)remaining, 0);
+        poll_machine();
     }
 }
 
-static bool run_until_prompt(size_t max_cycles, char boot_only)
+static bool run_until_prompt(uint64_t max_cycles, char boot_only)
 {
-    size_t i;
+    uint64_t elapsed = 0;
 
-    for (i = 0; i < max_cycles; i++) {
-        i8080_cycle(&g_cpu);
-        if ((i & 0x3fff) == 0 && input_empty() && output_has_prompt(boot_only)) {
+    while (elapsed < max_cycles) {
+        uint64_t remaining = max_cycles - elapsed;
+        elapsed += i8080_run(&g_machine.cpu, remaining > PROMPT_CHECK_CYCLES ? PROMPT_CHECK_CYCLES : (uint32_t)remaining, 0);
+        poll_machine();
+        if (input_empty() && output_has_prompt(boot_only)) {
             return true;
         }
+        if (g_machine.cpu.halted) {
+            break; // nothing here can wake it
+        }
     }
     return input_empty() && output_has_prompt(boot_only);
 }
 
-static bool emulator_boot(const char *drive_a, const char *drive_b, const char *drive_c)
+// Closes the machine, adding its code cache counters to the totals
+static void emulator_close(void)
 {
-    disk_controller_t controller;
+    i8080_block_stats_t block;
+    i8080_jit_stats_t jit;
+
+    i8080_block_cache_stats(g_machine.code_cache, &block);
+    g_block_stats.hits += block.hits;
+    g_block_stats.misses += block.misses;
+    g_block_stats.invalidations += block.invalidations;
+
+    i8080_jit_stats(g_machine.code_cache, &jit);
+    g_jit_stats.translations += jit.translations;
+    g_jit_stats.native_entries += jit.native_entries;
+    g_jit_stats.links += jit.links;
+    g_jit_stats.interpreted += jit.interpreted;
+    g_jit_stats.invalidations += jit.invalidations;
+    g_jit_stats.flushes += jit.flushes;
+    g_jit_stats.lockstep_checks += jit.lockstep_checks;
+    g_jit_stats.lockstep_mismatches += jit.lockstep_mismatches;
+
+    altair_machine_close(&g_machine);
+}
 
-    host_disk_close();
+static bool emulator_boot(const char *drive_a, const char *drive_b, const char *drive_c)
+{
+    emulator_close();
     g_input_read = 0;
     g_input_write = 0;
     g_output_len = 0;
     g_output[0] = '\0';
 
-    if (!host_disk_init(drive_a, drive_b, drive_c)) {
+    if (!altair_machine_open(&g_machine, drive_a, drive_b, drive_c, g_apps_root)) {
         fprintf(stderr, "failed to open MCP disk images\n");
         return false;
     }
-    host_files_init(g_apps_root);
+    if (g_drive_h && !altair_machine_mount(&g_machine, g_drive_h)) {
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+        fprintf(stderr, "[MCP] H: %s is not a directory that can be read, not mounted\n", g_drive_h);
+#else
+        fprintf(stderr, "[MCP] H: needs a build with I8080_PC_TRAPS, not mounted\n");
+#endif
+    }
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+    g_machine.call_hooks = &g_callgraph.hooks;
+#endif
+    g_machine.native_bios = g_native_bios;
+    altair_machine_reset(&g_machine, terminal_read, terminal_write, sense_switches);
 
-    controller = host_disk_controller();
-    memset(memory, 0, 64 * 1024);
-    loadDiskLoader(0xff00);
-    i8080_reset(&g_cpu, terminal_read, terminal_write, sense_switches, &controller, io_port_in, io_port_out);
-    i8080_examine(&g_cpu, 0xff00);
+    if (g_boot_snapshot_len > 0) {
+        snapshot_reader_t r;
+
+        if (snapshot_read_begin(&r, g_boot_snapshot, g_boot_snapshot_len, NULL, NULL, NULL, 0) &&
+            altair_machine_load(&g_machine, &r)) {
+            g_booted = true;
+            return true;
+        }
+        altair_machine_reset(&g_machine, terminal_read, terminal_write, sense_switches);
+    }
 
     if (!run_until_prompt(BOOT_CYCLES, 1)) {
         fprintf(stderr, "CP/M boot prompt was not seen\n");
         return false;
     }
 
+    {
+        snapshot_writer_t w;
+
+        snapshot_write_begin(&w, g_boot_snapshot, sizeof(g_boot_snapshot), NULL, NULL);
+        altair_machine_save(&g_machine, &w);
+        g_boot_snapshot_len = snapshot_write_end(&w) ? w.length : 0;
+    }
+
     g_output_len = 0;
     g_output[0] = '\0';
     g_booted = true;
@@ -331,7 +391,7 @@ static bool copy_file(const char *src_path, const char *dst_path)
 
 static bool reset_emulator(void)
 {
-    host_disk_close();
+    emulator_close();
     g_booted = false;
 
     if (!copy_file(g_pristine_a, g_drive_a)) {
@@ -671,7 +731,7 @@ static bool append_text(char **buf, size_t *len, size_t *cap, const char *text)
     return true;
 }
 
-static bool run_cpm_step(const char *input, size_t cycles)
+static bool run_cpm_step(const char *input, uint64_t cycles)
 {
     if (!ensure_booted()) {
         return false;
@@ -686,7 +746,7 @@ static bool run_cpm_step(const char *input, size_t cycles)
         }
     }
     run_until_prompt(cycles, 0);
-    run_cycles(5000);
+    run_cycles(40000);
     return true;
 }
 
@@ -1269,7 +1329,7 @@ static void handle_tools_call(const char *id, const char *json)
         input = strdup("");
     }
 
-    run_cpm_step(input, (size_t)cycles);
+    run_cpm_step(input, (uint64_t)cycles);
 
     if (strstr(g_output, "SUBMIT?")) {
         append_output_hint(
@@ -1381,26 +1441,91 @@ static void handle_message(const char *json)
     free(id);
 }
 
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+static void print_callgrind_line(void *context, const char *line)
+{
+    fprintf(context, "%s\n", line);
+}
+#endif
+
 int main(int argc, char **argv)
 {
     char *message;
 
-    g_drive_a = (argc > 1) ? argv[1] : "disks/cpm63k.dsk";
-    g_drive_b = (argc > 2) ? argv[2] : "disks/bdsc-v1.60.dsk";
-    g_drive_c = (argc > 3) ? argv[3] : "disks/blank.dsk";
-    g_pristine_a = (argc > 4) ? argv[4] : "../Disks/cpm63k.dsk";
-    g_pristine_b = (argc > 5) ? argv[5] : "../Disks/bdsc-v1.60.dsk";
-    g_pristine_c = (argc > 6) ? argv[6] : "../Disks/blank.dsk";
-    g_apps_root = (argc > 7) ? argv[7] : "../Apps";
+    const char *args[9] = {NULL};
+    int count = 1;
+    int i;
+
+    // --native-bios may come anywhere; the other arguments go by position
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--native-bios") == 0) {
+            g_native_bios = true;
+        } else if (count < 9) {
+            args[count++] = argv[i];
+        }
+    }
+    g_drive_a = args[1] ? args[1] : "disks/cpm63k.dsk";
+    g_drive_b = args[2] ? args[2] : "disks/bdsc-v1.60.dsk";
+    g_drive_c = args[3] ? args[3] : "disks/blank.dsk";
+    g_pristine_a = args[4] ? args[4] : "../Disks/cpm63k.dsk";
+    g_pristine_b = args[5] ? args[5] : "../Disks/bdsc-v1.60.dsk";
+    g_pristine_c = args[6] ? args[6] : "../Disks/blank.dsk";
+    g_apps_root = args[7] ? args[7] : "../Apps";
+    g_drive_h = args[8];
 
     setvbuf(stdout, NULL, _IONBF, 0);
     fprintf(stderr, "[MCP] altair-cpm-build started\n");
+#if !(defined(I8080_PC_TRAPS) && I8080_PC_TRAPS)
+    if (g_native_bios) {
+        fprintf(stderr, "[MCP] --native-bios needs a build with I8080_PC_TRAPS, running the BIOS as it is\n");
+        g_native_bios = false;
+    }
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+    callgraph_init(&g_callgraph, &g_machine.memory);
+    callgraph_start(&g_callgraph, 0);
+#endif
 
     while (read_message(&message)) {
         handle_message(message);
         free(message);
     }
+    emulator_close();
+
+#if defined(I8080_BLOCK_CACHE) && I8080_BLOCK_CACHE
+    fprintf(stderr, "[MCP] block cache: %llu hits, %llu misses, %llu invalidations\n",
+            (unsigned long long)g_block_stats.hits, (unsigned long long)g_block_stats.misses,
+            (unsigned long long)g_block_stats.invalidations);
+#endif
+#if defined(I8080_JIT) && I8080_JIT
+    fprintf(stderr, "[MCP] jit: %llu translations, %llu native entries, %llu links, "
+            "%llu interpreted, %llu invalidations, %llu flushes\n",
+            (unsigned long long)g_jit_stats.translations, (unsigned long long)g_jit_stats.native_entries,
+            (unsigned long long)g_jit_stats.links, (unsigned long long)g_jit_stats.interpreted,
+            (unsigned long long)g_jit_stats.invalidations, (unsigned long long)g_jit_stats.flushes);
+#endif
+#if defined(I8080_PAIR_PROFILE) && I8080_PAIR_PROFILE
+    if (i8080_pair_profile_write("intel8080_fusion.h") == 0) {
+        fprintf(stderr, "[MCP] wrote instruction pair profile to intel8080_fusion.h\n");
+    } else {
+        fprintf(stderr, "[MCP] could not write intel8080_fusion.h\n");
+    }
+#endif
+#if defined(I8080_CALL_PROFILE) && I8080_CALL_PROFILE
+    {
+        FILE *out = fopen("callgrind.out.altair", "w");
+
+        callgraph_stop(&g_callgraph, g_machine.cpu.cycles);
+        if (out) {
+            callgraph_write_callgrind(&g_callgraph, "altair-cpm-mcp", print_callgrind_line, out);
+        }
+        if (out && fclose(out) == 0) {
+            fprintf(stderr, "[MCP] wrote call graph to callgrind.out.altair\n");
+        } else {
+            fprintf(stderr, "[MCP] could not write callgrind.out.altair\n");
+        }
+    }
+#endif
 
-    host_disk_close();
     return 0;
 }
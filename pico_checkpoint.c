@@ -0,0 +1,102 @@
+#include "pico_checkpoint.h"
+
+#include "Altair8800/checkpoint.h"
+#include "cpu_state.h"
+#include "io_ports.h"
+#if defined(SD_CARD_SUPPORT)
+#include "Altair8800/pico_88dcdd_sd_card.h"
+#endif
+
+static checkpoint_ring_t checkpoints;
+static uint8_t checkpoint_ring[PICO_CHECKPOINT_RING_BYTES];
+static uint32_t last_checkpoint_ms;
+
+static void save(void* context, snapshot_writer_t* w)
+{
+    (void)context;
+    snapshot_save_cpu(w, &cpu);
+#if defined(SD_CARD_SUPPORT)
+    sd_disk_save_state(w);
+#endif
+    io_ports_save(w);
+}
+
+static bool restore(void* context, snapshot_reader_t* r)
+{
+    snapshot_reader_t section;
+    char tag[4];
+
+    (void)context;
+    while (snapshot_next_section(r, tag, &section))
+    {
+        bool ok;
+
+        if (snapshot_tag_is(tag, "CPU "))
+        {
+            ok = snapshot_load_cpu(&section, &cpu);
+        }
+#if defined(SD_CARD_SUPPORT)
+        else if (snapshot_tag_is(tag, "DSKS"))
+        {
+            ok = sd_disk_restore_state(&section);
+        }
+#endif
+        else
+        {
+            ok = io_ports_load(tag, &section);
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return !r->failed;
+}
+
+// Only the SD card controller reports the sectors it writes; with the
+// others a rewind leaves the disks as they are
+static void disk_write(void* context, uint8_t drive, uint32_t offset, const uint8_t* data, uint16_t length)
+{
+    (void)context;
+#if defined(SD_CARD_SUPPORT)
+    sd_disk_write_image(drive, offset, data, length);
+#else
+    (void)drive;
+    (void)offset;
+    (void)data;
+    (void)length;
+#endif
+}
+
+void pico_checkpoint_init(void)
+{
+    checkpoint_init(&checkpoints, &altair_memory, checkpoint_ring, sizeof(checkpoint_ring), save, restore,
+                    disk_write, NULL);
+#if defined(SD_CARD_SUPPORT)
+    sd_disk_controller.checkpoints = &checkpoints;
+#endif
+}
+
+void pico_checkpoint_clear(void)
+{
+    checkpoint_clear(&checkpoints);
+}
+
+void pico_checkpoint_poll(uint32_t now_ms)
+{
+    if (now_ms - last_checkpoint_ms >= PICO_CHECKPOINT_INTERVAL_MS)
+    {
+        checkpoint_take(&checkpoints, cpu.cycles);
+        last_checkpoint_ms = now_ms;
+    }
+}
+
+uint32_t pico_checkpoint_depth(void)
+{
+    return checkpoint_depth(&checkpoints);
+}
+
+bool pico_checkpoint_rewind(uint32_t n)
+{
+    return checkpoint_rewind(&checkpoints, n);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rewindable checkpoints of the Pico's machine (see Altair8800/checkpoint.h),
+// built with ALTAIR_CHECKPOINTS. They need a 64 KB copy of memory and a
+// PICO_CHECKPOINT_RING_BYTES ring on top of the Altair's own memory.
+#define PICO_CHECKPOINT_INTERVAL_MS 1000
+#define PICO_CHECKPOINT_RING_BYTES (32 * 1024)
+
+void pico_checkpoint_init(void);
+
+// Forgets every checkpoint. Call when the machine is reset or resumed.
+void pico_checkpoint_clear(void);
+
+// Takes a checkpoint if one is due. Call between runs of the CPU.
+void pico_checkpoint_poll(uint32_t now_ms);
+
+// Checkpoints that can be rewound to
+uint32_t pico_checkpoint_depth(void);
+
+// Goes back to the nth latest checkpoint, 1 being the latest
+bool pico_checkpoint_rewind(uint32_t n);
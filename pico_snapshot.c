@@ -0,0 +1,120 @@
+#include "pico_snapshot.h"
+
+#include "Altair8800/pico_88dcdd_sd_card.h"
+#include "Altair8800/snapshot.h"
+#include "cpu_state.h"
+#include "io_ports.h"
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+#include "pico_checkpoint.h"
+#endif
+#include "ff.h"
+#ifdef WAVESHARE_3_5_DISPLAY
+#include "drivers/waveshare/ws_fatfs.h"
+#define SNAP_OPEN ws_f_open
+#define SNAP_READ ws_f_read
+#define SNAP_WRITE ws_f_write
+#define SNAP_CLOSE ws_f_close
+#else
+#define SNAP_OPEN f_open
+#define SNAP_READ f_read
+#define SNAP_WRITE f_write
+#define SNAP_CLOSE f_close
+#endif
+
+#include <string.h>
+
+// One section at a time, so a snapshot needs no 64 KB buffer
+static uint8_t section_buffer[SNAPSHOT_SECTION_MAX];
+static FIL snapshot_file;
+
+static bool file_sink(void* context, const uint8_t* data, size_t length)
+{
+    UINT written;
+
+    return SNAP_WRITE((FIL*)context, data, (UINT)length, &written) == FR_OK && written == length;
+}
+
+static size_t file_source(void* context, uint8_t* data, size_t length)
+{
+    UINT got;
+
+    if (SNAP_READ((FIL*)context, data, (UINT)length, &got) != FR_OK)
+    {
+        return 0;
+    }
+    return got;
+}
+
+bool pico_snapshot_save(void)
+{
+    snapshot_writer_t w;
+    bool ok;
+
+    if (SNAP_OPEN(&snapshot_file, PICO_SNAPSHOT_PATH, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        return false;
+    }
+    snapshot_write_begin(&w, section_buffer, sizeof(section_buffer), file_sink, &snapshot_file);
+    snapshot_save_cpu(&w, &cpu);
+    snapshot_save_memory(&w, &altair_memory);
+    sd_disk_save(&w);
+    io_ports_save(&w);
+    ok = snapshot_write_end(&w);
+    ok = SNAP_CLOSE(&snapshot_file) == FR_OK && ok;
+    return ok;
+}
+
+static bool load_sections(snapshot_reader_t* r)
+{
+    char tag[4];
+    snapshot_reader_t section;
+    bool have_cpu = false;
+    bool have_disk = false;
+    int memory_chunks = 0;
+
+    while (snapshot_next_section(r, tag, &section))
+    {
+        bool ok;
+
+        if (snapshot_tag_is(tag, "CPU "))
+        {
+            ok = have_cpu = snapshot_load_cpu(&section, &cpu);
+        }
+        else if (snapshot_tag_is(tag, "MEM "))
+        {
+            ok = snapshot_load_memory(&section, &altair_memory);
+            memory_chunks++;
+        }
+        else if (snapshot_tag_is(tag, "DSK "))
+        {
+            ok = have_disk = sd_disk_restore(&section);
+        }
+        else
+        {
+            ok = io_ports_load(tag, &section);
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return !r->failed && have_cpu && have_disk && memory_chunks == 64 * 1024 / SNAPSHOT_MEMORY_CHUNK;
+}
+
+bool pico_snapshot_resume(void)
+{
+    snapshot_reader_t r;
+    bool ok;
+
+#if defined(ALTAIR_CHECKPOINTS) && ALTAIR_CHECKPOINTS
+    pico_checkpoint_clear();
+#endif
+    if (SNAP_OPEN(&snapshot_file, PICO_SNAPSHOT_PATH, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+    ok = snapshot_read_begin(&r, NULL, 0, file_source, &snapshot_file, section_buffer, sizeof(section_buffer)) &&
+         load_sections(&r);
+    SNAP_CLOSE(&snapshot_file);
+    return ok;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Whole-machine snapshots on the SD card, in the format of
+// Altair8800/snapshot.h. Only SD card builds have somewhere to keep one.
+#define PICO_SNAPSHOT_PATH "snapshot.bin"
+
+// Saves the CPU, memory, disk controller and port drivers. Call with the
+// CPU stopped.
+bool pico_snapshot_save(void);
+
+// Restores a snapshot saved with the disk images now loaded. On failure the
+// machine is left part restored and should be reset.
+bool pico_snapshot_resume(void);
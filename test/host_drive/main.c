@@ -0,0 +1,226 @@
+/*
+ * Drive H: test
+ *
+ * Fills a scratch directory with host files whose names do not fit 8.3,
+ * two of them alike in their first six characters, and makes the BDOS
+ * calls a CP/M program would through host_drive_bdos(). Checks the names a
+ * directory search returns, and that open, rename and delete act on the
+ * host file each short name stands for.
+ *
+ * Usage: ./host_drive_test <scratch_directory>
+ */
+
+#include "PortDrivers/host_drive.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+#define FCB_ADDRESS 0x005c
+#define DMA_ADDRESS 0x0080
+
+#define BDOS_SELECT_DISK 14
+#define BDOS_OPEN 15
+#define BDOS_CLOSE 16
+#define BDOS_SEARCH_FIRST 17
+#define BDOS_SEARCH_NEXT 18
+#define BDOS_DELETE 19
+#define BDOS_READ 20
+#define BDOS_RENAME 23
+#define BDOS_SET_DMA 26
+
+static altair_memory_t mem;
+static host_drive_t drive;
+static const char* root;
+static int failures;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void host_path(const char* name, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%s", root, name);
+}
+
+static void write_host_file(const char* name, const char* text)
+{
+    char path[512];
+    FILE* file;
+
+    host_path(name, path, sizeof(path));
+    file = fopen(path, "wb");
+    if (file)
+    {
+        fputs(text, file);
+        fclose(file);
+    }
+}
+
+static bool host_file_exists(const char* name)
+{
+    char path[512];
+    struct stat info;
+
+    host_path(name, path, sizeof(path));
+    return stat(path, &info) == 0;
+}
+
+/* Makes the call at 0005 with C and DE; returns A, or 0xfe if the BDOS was left to serve it */
+static uint8_t bdos(uint8_t function, uint16_t de)
+{
+    registers_t registers;
+
+    memset(&registers, 0, sizeof(registers));
+    registers.c = function;
+    registers.de = de;
+    return host_drive_bdos(&drive, &registers, &mem) ? registers.a : 0xfe;
+}
+
+/* An FCB for the current drive at 005C, with the 11-character name and, for rename, a new one */
+static void set_fcb(const char* name, const char* new_name)
+{
+    for (int i = 0; i < 36; i++)
+    {
+        write8(&mem, (uint16_t)(FCB_ADDRESS + i), 0);
+    }
+    for (int i = 0; i < 11; i++)
+    {
+        write8(&mem, (uint16_t)(FCB_ADDRESS + 1 + i), (uint8_t)name[i]);
+        if (new_name)
+        {
+            write8(&mem, (uint16_t)(FCB_ADDRESS + 17 + i), (uint8_t)new_name[i]);
+        }
+    }
+}
+
+/* The names a search of H: for every file returns, in order, as "NAME    TYP|..." */
+static void list_names(char* list, size_t size)
+{
+    size_t length = 0;
+    uint8_t result;
+
+    list[0] = '\0';
+    set_fcb("???????????", NULL);
+    for (result = bdos(BDOS_SEARCH_FIRST, FCB_ADDRESS); result == 0; result = bdos(BDOS_SEARCH_NEXT, 0))
+    {
+        for (int i = 0; i < 11 && length + 2 < size; i++)
+        {
+            list[length++] = (char)read8(&mem, (uint16_t)(DMA_ADDRESS + 1 + i));
+        }
+        list[length++] = '|';
+        list[length] = '\0';
+    }
+}
+
+static void check_names(const char* expected, const char* what)
+{
+    char list[256];
+
+    list_names(list, sizeof(list));
+    check(strcmp(list, expected) == 0, what);
+    if (strcmp(list, expected) != 0)
+    {
+        fprintf(stderr, "  expected %s\n  got      %s\n", expected, list);
+    }
+}
+
+/* Opens the file and reads its first record; true if it starts with the text */
+static bool first_record_is(const char* name, const char* text)
+{
+    bool same = true;
+
+    set_fcb(name, NULL);
+    if (bdos(BDOS_OPEN, FCB_ADDRESS) != 0 || bdos(BDOS_READ, FCB_ADDRESS) != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < strlen(text); i++)
+    {
+        same = same && read8(&mem, (uint16_t)(DMA_ADDRESS + i)) == (uint8_t)text[i];
+    }
+    bdos(BDOS_CLOSE, FCB_ADDRESS);
+    return same;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* files[] = {"long_name.c", "long_nail.c", "readme.txt", "a.long.name.html", ".hidden",
+                                  "NAIL.C"};
+    char path[512];
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <scratch_directory>\n", argv[0]);
+        return 1;
+    }
+    root = argv[1];
+    make_directory(root);
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        host_path(files[i], path, sizeof(path));
+        remove(path);
+    }
+    host_path("sub", path, sizeof(path));
+    make_directory(path);
+    write_host_file("long_name.c", "name");
+    write_host_file("long_nail.c", "nail");
+    write_host_file("readme.txt", "readme");
+    write_host_file("a.long.name.html", "html");
+    write_host_file(".hidden", "hidden");
+
+    memory_init(&mem);
+    if (host_drive_init(&drive, "/nonexistent/drive/h"))
+    {
+        fprintf(stderr, "FAIL: a directory that does not exist was mounted\n");
+        return 1;
+    }
+    if (!host_drive_init(&drive, root))
+    {
+        fprintf(stderr, "FAIL: cannot mount %s\n", root);
+        return 1;
+    }
+    bdos(BDOS_SET_DMA, DMA_ADDRESS);
+    check(bdos(BDOS_SELECT_DISK, HOST_DRIVE_NUMBER) == 0, "select H:");
+
+    /* The two long .c names both start LONGNA, and take ~1 and ~2 in host name order */
+    check_names("ALONGN~1HTM|LONGNA~1C  |LONGNA~2C  |README  TXT|", "directory of H:");
+    check(first_record_is("LONGNA~2C  ", "name"), "LONGNA~2.C reads long_name.c");
+    check(first_record_is("LONGNA~1C  ", "nail"), "LONGNA~1.C reads long_nail.c");
+    check(first_record_is("README  TXT", "readme"), "README.TXT reads readme.txt");
+
+    set_fcb("LONGNA~1C  ", "NAIL    C  ");
+    check(bdos(BDOS_RENAME, FCB_ADDRESS) == 0, "rename LONGNA~1.C");
+    check(!host_file_exists("long_nail.c") && host_file_exists("NAIL.C"), "rename moves long_nail.c to NAIL.C");
+    check(first_record_is("NAIL    C  ", "nail"), "NAIL.C reads what long_nail.c held");
+
+    set_fcb("ALONGN~1HTM", NULL);
+    check(bdos(BDOS_DELETE, FCB_ADDRESS) == 0, "delete ALONGN~1.HTM");
+    check(!host_file_exists("a.long.name.html") && host_file_exists("long_name.c"),
+          "delete removes a.long.name.html only");
+
+    /* With its namesake gone, long_name.c is the only LONGNA and takes ~1 */
+    check_names("LONGNA~1C  |NAIL    C  |README  TXT|", "directory of H: after rename and delete");
+    check(first_record_is("LONGNA~1C  ", "name"), "LONGNA~1.C reads long_name.c after the rename");
+
+    host_drive_close(&drive);
+    if (failures)
+    {
+        return 1;
+    }
+    printf("host_drive: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,818 @@
+/*
+ * 8080 flags differential test
+ *
+ * Runs a fixed set of ALU sweeps and pseudo-random programs through the
+ * interpreter core and writes the resulting machine state to a trace file.
+ * The CMake project builds this once per core configuration (eager or lazy
+ * flags; jump-table core with or without fused pairs, threaded or
+ * block-cache core; with or without loop idioms; JIT; with memory traps;
+ * with PC traps on those cores) and ctest compares every trace against the
+ * eager jump-table one. With
+ * --lockstep the JIT
+ * checks every block it runs against the interpreter and the run fails on
+ * any mismatch.
+ *
+ * Usage: ./i8080_flags_<variant> <trace_file> [--lockstep]
+ */
+
+#include "intel8080.h"
+#include "intel8080_fusion.h"
+#include "memory.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_COUNT 32
+#define STEPS_PER_PROGRAM 2000
+#define SLICES_PER_PROGRAM 64
+
+static intel8080_t cpu;
+static altair_memory_t mem;
+static i8080_code_cache_t* code_cache; /* NULL unless the block cache or JIT is built in */
+static i8080_ports_t ports;
+static uint32_t rng_state;
+
+static uint32_t rng_next(void)
+{
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+static uint8_t term_in(void* context)
+{
+    (void)context;
+    return 0x00;
+}
+
+static void term_out(void* context, uint8_t b)
+{
+    (void)context;
+    (void)b;
+}
+
+static uint8_t sense_switches(void* context)
+{
+    (void)context;
+    return 0x5a;
+}
+
+static void disk_out(void* context, uint8_t b)
+{
+    (void)context;
+    (void)b;
+}
+
+static uint8_t disk_in(void* context)
+{
+    (void)context;
+    return 0xe5;
+}
+
+static uint8_t io_in(void* context, uint8_t port)
+{
+    (void)context;
+    return (uint8_t)(port * 7 + 1);
+}
+
+/* Some writes request an interrupt from inside the slice */
+static void io_out(void* context, uint8_t port, uint8_t data)
+{
+    (void)context;
+    (void)port;
+    if (data < 0x20)
+    {
+        i8080_interrupt(&cpu, data);
+    }
+}
+
+static void reset_cpu(void)
+{
+    disk_controller_t controller = {NULL, disk_out, disk_in, disk_out, disk_in, disk_out, disk_in};
+
+    i8080_ports_register(&ports, 0x00, 0xff, io_in, io_out, NULL);
+    i8080_reset(&cpu, &mem, NULL, term_in, term_out, sense_switches, &controller, &ports);
+    cpu.code_cache = code_cache;
+}
+
+/* Wake a CPU stopped by HLT the way the front panel does, so programs go on past it */
+static void wake(void)
+{
+    if (cpu.halted)
+    {
+        i8080_examine(&cpu, cpu.registers.pc);
+    }
+}
+
+/*
+ * Builds that track page writes and those that do not compare different
+ * memory samples to decide idleness, so random programs that write memory
+ * may differ; the idle flag is only traced by the status loop tests.
+ */
+static int trace_idle;
+
+static void write_state(FILE* out)
+{
+    fprintf(out, "%04x %02x%02x %04x %04x %04x %04x %llu %llu %d %d\n", cpu.registers.pc, cpu.registers.a,
+            cpu.registers.flags, cpu.registers.bc, cpu.registers.de, cpu.registers.hl, cpu.registers.sp,
+            (unsigned long long)cpu.cycles, (unsigned long long)cpu.instructions, cpu.halted,
+            trace_idle && cpu.idle);
+    wake();
+}
+
+static uint64_t fnv_add(uint64_t hash, uint8_t val)
+{
+    return (hash ^ val) * 1099511628211ull;
+}
+
+/* Every accumulator op against every A, operand and incoming C/H combination */
+static void sweep_alu(FILE* out)
+{
+    static const uint8_t flags_in[] = {0x02, 0x03, 0x12, 0x13, 0xd7};
+    int op, a, val, f;
+
+    for (op = 0; op < 8; op++)
+    {
+        for (a = 0; a < 256; a++)
+        {
+            uint64_t hash = 1469598103934665603ull;
+
+            for (val = 0; val < 256; val++)
+            {
+                for (f = 0; f < (int)sizeof(flags_in); f++)
+                {
+                    reset_cpu();
+                    mem.bytes[0] = (uint8_t)(0x80 | op << 3); /* op B */
+                    mem.bytes[1] = (uint8_t)(0xc6 | op << 3); /* op immediate */
+                    mem.bytes[2] = (uint8_t)val;
+                    cpu.registers.a = (uint8_t)a;
+                    cpu.registers.b = (uint8_t)val;
+                    cpu.registers.flags = flags_in[f];
+
+                    i8080_run(&cpu, 1, 0);
+                    hash = fnv_add(hash, cpu.registers.a);
+                    hash = fnv_add(hash, cpu.registers.flags);
+                    i8080_run(&cpu, 1, 0);
+                    hash = fnv_add(hash, cpu.registers.a);
+                    hash = fnv_add(hash, cpu.registers.flags);
+                }
+            }
+            fprintf(out, "alu %d %02x %016llx\n", op, a, (unsigned long long)hash);
+        }
+    }
+}
+
+/* INR, DCR and DAA on every value with every incoming C/H combination */
+static void sweep_unary(FILE* out)
+{
+    static const uint8_t ops[] = {0x3c, 0x3d, 0x27, 0x34, 0x35};
+    int op, val, f;
+
+    for (op = 0; op < (int)sizeof(ops); op++)
+    {
+        uint64_t hash = 1469598103934665603ull;
+
+        for (val = 0; val < 256; val++)
+        {
+            for (f = 0; f < 4; f++)
+            {
+                reset_cpu();
+                mem.bytes[0] = ops[op];
+                mem.bytes[0x100] = (uint8_t)val;
+                cpu.registers.hl = 0x100;
+                cpu.registers.a = (uint8_t)val;
+                cpu.registers.flags = (uint8_t)(0x02 | (f & 1) | (f & 2) << 3);
+
+                i8080_run(&cpu, 1, 0);
+                hash = fnv_add(hash, cpu.registers.a);
+                hash = fnv_add(hash, cpu.registers.flags);
+                hash = fnv_add(hash, mem.bytes[0x100]);
+            }
+        }
+        fprintf(out, "unary %02x %016llx\n", ops[op], (unsigned long long)hash);
+    }
+}
+
+static void load_program(int program)
+{
+    int i;
+
+    rng_state = (uint32_t)program * 2654435761u + 7;
+    for (i = 0; i < 64 * 1024; i++)
+    {
+        mem.bytes[i] = (uint8_t)rng_next();
+    }
+
+    reset_cpu();
+    cpu.registers.pc = (uint16_t)rng_next();
+    cpu.registers.sp = (uint16_t)rng_next();
+    cpu.registers.bc = (uint16_t)rng_next();
+    cpu.registers.de = (uint16_t)rng_next();
+    cpu.registers.hl = (uint16_t)rng_next();
+    cpu.registers.af = (uint16_t)rng_next();
+}
+
+/*
+ * Random programs, stepped one instruction at a time, then in variable slices
+ * so flags stay pending across instructions, then through i8080_cycle as the
+ * monitor does. Every HLT is woken from before the next run; the slices that
+ * do not stop at it idle out the rest of their budget. Interrupts are
+ * requested between slices and by OUT, and taken whenever the program has
+ * enabled them. Flags only escape a slice through conditions, PUSH PSW and
+ * the registers handed back at the end of it.
+ */
+static void run_programs(FILE* out)
+{
+    int program, i;
+    uint64_t hash;
+
+    for (program = 0; program < PROGRAM_COUNT; program++)
+    {
+        fprintf(out, "program %d\n", program);
+
+        load_program(program);
+        for (i = 0; i < STEPS_PER_PROGRAM; i++)
+        {
+            i8080_run(&cpu, 1, 0);
+            write_state(out);
+        }
+
+        load_program(program);
+        for (i = 0; i < SLICES_PER_PROGRAM; i++)
+        {
+            if (rng_next() % 4 == 0)
+            {
+                i8080_interrupt(&cpu, (uint8_t)(rng_next() % 8));
+            }
+            i8080_run(&cpu, 1 + rng_next() % 400, (i & 1) ? I8080_STOP_IO | I8080_STOP_HALT : 0);
+            write_state(out);
+        }
+
+        load_program(program);
+        for (i = 0; i < STEPS_PER_PROGRAM; i++)
+        {
+            i8080_cycle(&cpu);
+            wake();
+        }
+        write_state(out);
+
+        hash = 1469598103934665603ull;
+        for (i = 0; i < 64 * 1024; i++)
+        {
+            hash = fnv_add(hash, mem.bytes[i]);
+        }
+        fprintf(out, "memory %016llx\n", (unsigned long long)hash);
+    }
+}
+
+static int op_length(uint8_t op)
+{
+    if ((op & 0xcf) == 0x01 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 || op == 0x22 || op == 0x2a ||
+        op == 0x32 || op == 0x3a || op == 0xc3 || op == 0xcd)
+    {
+        return 3;
+    }
+    if ((op & 0xc7) == 0x06 || (op & 0xc7) == 0xc6 || op == 0xd3 || op == 0xdb)
+    {
+        return 2;
+    }
+    return 1;
+}
+
+/*
+ * A run of one fused pair with random operands, in slices of every length so
+ * that slices end between the two instructions. HL and SP point into the run
+ * so stores can overwrite the second opcode before it executes.
+ */
+static void run_pair(FILE* out, uint8_t first, uint8_t second)
+{
+    uint16_t addr = 0x1000;
+    int slice;
+
+    fprintf(out, "pair %02x %02x\n", first, second);
+
+    load_program(first << 8 | second);
+    while (addr < 0x1400)
+    {
+        mem.bytes[addr] = first;
+        addr += op_length(first);
+        mem.bytes[addr] = second;
+        addr += op_length(second);
+    }
+    cpu.registers.pc = 0x1000;
+    cpu.registers.hl = (uint16_t)(0x1000 + rng_next() % 0x400);
+    cpu.registers.sp = (uint16_t)(0x1000 + rng_next() % 0x400);
+
+    for (slice = 1; slice < 64; slice++)
+    {
+        i8080_run(&cpu, (uint32_t)slice, 0);
+        write_state(out);
+    }
+}
+
+#define RUN_FUSED_PAIR(first, second) run_pair(out, first, second);
+
+static void run_pairs(FILE* out)
+{
+    I8080_FUSED_PAIRS(RUN_FUSED_PAIR)
+}
+
+#define LOOP_COUNT 300
+#define SLICES_PER_LOOP 48
+
+/* INX or DCX of a pair, mostly upwards */
+static uint8_t loop_step(int pair)
+{
+    return (uint8_t)(pair << 4 | ((rng_next() % 4) ? 0x03 : 0x0b));
+}
+
+/*
+ * A random copy, fill, sum, scan or compare loop of the shapes the loop idiom
+ * code recognises at 0x1000, with the pointers, counts and tail order drawn
+ * at random and a jump back to its start after it. Pointers may overlap each
+ * other or the loop's own code and wrap around 64K; the reference core just
+ * interprets whatever that does.
+ */
+static void run_loop(FILE* out, int index)
+{
+    static const uint8_t loads[] = {0x0a, 0x1a, 0x7e};
+    static const uint8_t stores[] = {0x02, 0x12, 0x77};
+    static const uint8_t scan_tests[] = {0xb7, 0xa7, 0xfe};
+    static const uint8_t scan_jumps[] = {0xc2, 0xca, 0xf2, 0xfa};
+    uint8_t tail[8][3], head[6];
+    int tail_len[8], tails = 0, head_len = 0, form, i, slice;
+    int src = -1, dst = -1, counter_pair;
+    uint16_t addr = 0x1000;
+    uint64_t hash;
+
+    load_program(0x10000 + index);
+    form = (int)(rng_next() % 5);
+    fprintf(out, "loop %d form %d\n", index, form);
+
+    switch (form)
+    {
+    case 0: /* copy */
+        src = (int)(rng_next() % 3);
+        dst = (src + 1 + (int)(rng_next() % 2)) % 3;
+        head[head_len++] = loads[src];
+        head[head_len++] = stores[dst];
+        if (rng_next() % 2)
+        {
+            int acc = (int)(rng_next() % 6);
+
+            head[head_len++] = (uint8_t)(0x80 | acc);
+            head[head_len++] = (uint8_t)(0x47 | acc << 3);
+        }
+        break;
+    case 1: /* fill */
+        dst = (int)(rng_next() % 3);
+        if (rng_next() % 2)
+        {
+            head[head_len++] = stores[dst];
+        }
+        else if (rng_next() % 2)
+        {
+            dst = 2;
+            head[head_len++] = 0x36;
+            head[head_len++] = (uint8_t)rng_next();
+        }
+        else
+        {
+            dst = 2;
+            head[head_len++] = (uint8_t)(0x70 | rng_next() % 6);
+        }
+        break;
+    case 2: /* sum */
+        src = 2;
+        head[head_len++] = 0x86;
+        break;
+    case 3: /* scan */
+        src = (int)(rng_next() % 3);
+        head[head_len++] = loads[src];
+        tail[tails][0] = scan_tests[rng_next() % 3];
+        tail[tails][1] = (uint8_t)rng_next();
+        tail_len[tails] = tail[tails][0] == 0xfe ? 2 : 1;
+        tails++;
+        break;
+    default: /* compare */
+        src = (int)(rng_next() % 2);
+        dst = 2;
+        head[head_len++] = loads[src];
+        head[head_len++] = 0xbe;
+        head[head_len++] = 0xc2;
+        head[head_len++] = 0x00; /* patched to the jump after the loop */
+        head[head_len++] = 0x00;
+        break;
+    }
+
+    if (src >= 0)
+    {
+        tail[tails][0] = loop_step(src);
+        tail_len[tails++] = 1;
+    }
+    if (dst >= 0 && dst != src)
+    {
+        tail[tails][0] = loop_step(dst);
+        tail_len[tails++] = 1;
+    }
+    if (form != 3)
+    {
+        /* Mostly a counter clear of the pointers, sometimes any */
+        counter_pair = (int)(rng_next() % 3);
+        while (rng_next() % 8 && (counter_pair == src || counter_pair == dst))
+        {
+            counter_pair = (int)(rng_next() % 3);
+        }
+        if (rng_next() % 2)
+        {
+            tail[tails][0] = (uint8_t)(0x05 | (counter_pair * 2 + rng_next() % 2) << 3); /* DCR r */
+            tail_len[tails++] = 1;
+        }
+        else
+        {
+            int swap = (int)(rng_next() % 2);
+
+            tail[tails][0] = (uint8_t)(counter_pair << 4 | 0x0b);
+            tail[tails][1] = (uint8_t)(0x78 | (counter_pair * 2 + swap));
+            tail[tails][2] = (uint8_t)(0xb0 | (counter_pair * 2 + !swap));
+            tail_len[tails++] = 3;
+        }
+    }
+
+    for (i = tails - 1; i > 0; i--)
+    {
+        int j = (int)(rng_next() % (uint32_t)(i + 1));
+        uint8_t t[3];
+        int t_len = tail_len[i];
+
+        memcpy(t, tail[i], sizeof(t));
+        memcpy(tail[i], tail[j], sizeof(t));
+        tail_len[i] = tail_len[j];
+        memcpy(tail[j], t, sizeof(t));
+        tail_len[j] = t_len;
+    }
+
+    for (i = 0; i < head_len; i++)
+    {
+        mem.bytes[addr++] = head[i];
+    }
+    for (i = 0; i < tails; i++)
+    {
+        memcpy(&mem.bytes[addr], tail[i], (size_t)tail_len[i]);
+        addr += tail_len[i];
+    }
+    mem.bytes[addr] = form == 3 ? scan_jumps[rng_next() % 4] : 0xc2;
+    mem.bytes[addr + 1] = 0x00;
+    mem.bytes[addr + 2] = 0x10;
+    mem.bytes[addr + 3] = 0xc3; /* JMP 0x1000 */
+    mem.bytes[addr + 4] = 0x00;
+    mem.bytes[addr + 5] = 0x10;
+    if (form == 4)
+    {
+        mem.bytes[0x1000 + 3] = (uint8_t)(addr + 3);
+        mem.bytes[0x1000 + 4] = (uint8_t)((addr + 3) >> 8);
+        /* Mostly equal bytes to compare */
+        memcpy(&mem.bytes[cpu.registers.hl & 0x7fff], &mem.bytes[(src ? cpu.registers.de : cpu.registers.bc) & 0x7fff], 0x800);
+    }
+
+    cpu.registers.pc = 0x1000;
+    if (rng_next() % 4 == 0)
+    {
+        /* Close to the loop itself */
+        cpu.registers.hl = (uint16_t)(0x1000 - 0x40 + rng_next() % 0x80);
+        cpu.registers.de = (uint16_t)(0x1000 - 0x40 + rng_next() % 0x80);
+    }
+    else if (form == 4)
+    {
+        cpu.registers.hl &= 0x7fff;
+        cpu.registers.bc &= 0x7fff;
+        cpu.registers.de &= 0x7fff;
+    }
+    if (form == 0 && rng_next() % 3 == 0)
+    {
+        /* Source and destination a few bytes apart, either way round */
+        uint16_t* pairs[3] = {&cpu.registers.bc, &cpu.registers.de, &cpu.registers.hl};
+
+        *pairs[src] = (uint16_t)(0x4000 + rng_next() % 0x100);
+        *pairs[dst] = (uint16_t)(*pairs[src] + rng_next() % 9 - 4);
+    }
+    if (form == 3 && rng_next() % 2)
+    {
+        /* A string to scan over */
+        for (i = 0; i < 200; i++)
+        {
+            mem.bytes[(uint16_t)((src == 0 ? cpu.registers.bc : src == 1 ? cpu.registers.de : cpu.registers.hl) + i)] =
+                (uint8_t)(0x20 + rng_next() % 0x5f);
+        }
+    }
+
+    for (slice = 0; slice < SLICES_PER_LOOP; slice++)
+    {
+        i8080_run(&cpu, 1 + rng_next() % 3000, 0);
+        write_state(out);
+    }
+
+    hash = 1469598103934665603ull;
+    for (i = 0; i < 64 * 1024; i++)
+    {
+        hash = fnv_add(hash, mem.bytes[i]);
+    }
+    fprintf(out, "memory %016llx\n", (unsigned long long)hash);
+}
+
+#if MEMORY_TRAPS
+static uint32_t watched_writes;
+
+static void count_write(void* context, uint16_t address, uint8_t val)
+{
+    (void)context;
+    (void)address;
+    (void)val;
+    watched_writes++;
+}
+
+/* Behaves like RAM, so the trace matches the builds without traps */
+static void store_write(void* context, uint16_t address, uint8_t val)
+{
+    altair_memory_t* m = context;
+
+    m->bytes[address] = val;
+    memory_pages_written(m, address, 1);
+}
+#endif
+
+/*
+ * Random programs with 0x4000-0x7fff as ROM. Returns the number of ROM bytes
+ * that changed. With memory traps, 0x8000-0x9fff is also watched and
+ * 0xa000-0xbfff memory-mapped, with handlers that leave the trace unchanged.
+ */
+static int run_rom(FILE* out)
+{
+    static uint8_t rom[0x4000];
+    int program, i, changed = 0;
+    uint64_t hash;
+
+    for (program = 0; program < 8; program++)
+    {
+        fprintf(out, "rom %d\n", program);
+
+        load_program(program);
+        memcpy(rom, &mem.bytes[0x4000], sizeof(rom));
+        memory_set_pages(&mem, 0x4000, sizeof(rom), MEMORY_ROM, NULL, NULL);
+#if MEMORY_TRAPS
+        memory_set_pages(&mem, 0x8000, 0x2000, MEMORY_WATCH, count_write, NULL);
+        memory_set_pages(&mem, 0xa000, 0x2000, MEMORY_MMIO, store_write, &mem);
+#endif
+        for (i = 0; i < SLICES_PER_PROGRAM; i++)
+        {
+            i8080_run(&cpu, 1 + rng_next() % 400, 0);
+            write_state(out);
+        }
+        memory_reset_pages(&mem);
+
+        changed += memcmp(rom, &mem.bytes[0x4000], sizeof(rom)) != 0;
+        hash = 1469598103934665603ull;
+        for (i = 0; i < 64 * 1024; i++)
+        {
+            hash = fnv_add(hash, mem.bytes[i]);
+        }
+        fprintf(out, "memory %016llx\n", (unsigned long long)hash);
+    }
+    return changed;
+}
+
+static void run_loops(FILE* out)
+{
+    int i;
+
+    for (i = 0; i < LOOP_COUNT; i++)
+    {
+        run_loop(out, i);
+    }
+}
+
+/*
+ * A BIOS-style console input loop, IN 10h / ANI 1 / JZ, with nothing to read.
+ * Returns the number of slices the core did not report as idle.
+ */
+static int run_idle(FILE* out)
+{
+    static const uint8_t status_loop[] = {0xdb, 0x10, 0xe6, 0x01, 0xca, 0x00, 0x10};
+    int slice, busy = 0;
+
+    fprintf(out, "idle\n");
+    trace_idle = 1;
+    load_program(0x20000);
+    memcpy(&mem.bytes[0x1000], status_loop, sizeof(status_loop));
+    cpu.registers.pc = 0x1000;
+
+    for (slice = 0; slice < 16; slice++)
+    {
+        i8080_run(&cpu, 1000 + rng_next() % 8000, 0);
+        busy += !cpu.idle;
+        write_state(out);
+    }
+    return busy;
+}
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+static uint32_t served_traps;
+static uint32_t declined_traps;
+
+/* Stands in for a routine that is just RET */
+static uint32_t serve_trap(void* context, intel8080_t* c)
+{
+    (void)context;
+    served_traps++;
+    i8080_trap_return(c);
+    return 10;
+}
+
+/* Leaves the routine to the guest */
+static uint32_t decline_trap(void* context, intel8080_t* c)
+{
+    (void)context;
+    (void)c;
+    declined_traps++;
+    return 0;
+}
+#endif
+
+/*
+ * A loop of calls into routines that the trap builds set traps on: one whose
+ * handler declines, so the guest's INX H / RET runs, and two RETs whose
+ * handler serves them, reached by CALL, by RST 1 and by a JMP at the end of a
+ * routine that runs often enough to be translated. The eager reference runs
+ * the guest code throughout. Slices stop only at the HLT that ends the loop,
+ * so the state there does not depend on where handlers fall in the slices.
+ * Returns the number of handler calls that were not as expected.
+ */
+static int run_traps(FILE* out)
+{
+    static const uint8_t loop[] = {0x31, 0x00, 0x80,       /* LXI SP,8000h */
+                                   0x06, 0xc8,             /* MVI B,200 */
+                                   0x13,                   /* INX D */
+                                   0xcd, 0x00, 0x20,       /* CALL 2000h */
+                                   0xcd, 0x10, 0x20,       /* CALL 2010h */
+                                   0xcf,                   /* RST 1 */
+                                   0xcd, 0x20, 0x20,       /* CALL 2020h */
+                                   0xc2, 0x05, 0x10,       /* JNZ 1005h */
+                                   0x76};                  /* HLT */
+    static const uint8_t declined[] = {0x23, 0xc9};        /* INX H / RET */
+    static const uint8_t tail[] = {0x05, 0xc3, 0x10, 0x20}; /* DCR B / JMP 2010h */
+    int slice, i, wrong = 0;
+    uint64_t hash;
+
+    fprintf(out, "traps\n");
+    load_program(0x20003);
+    memcpy(&mem.bytes[0x1000], loop, sizeof(loop));
+    memcpy(&mem.bytes[0x2000], declined, sizeof(declined));
+    memcpy(&mem.bytes[0x2020], tail, sizeof(tail));
+    mem.bytes[0x2010] = 0xc9;
+    mem.bytes[0x0008] = 0xc9;
+    cpu.registers.pc = 0x1000;
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+    served_traps = declined_traps = 0;
+    i8080_trap_set(&cpu, 0x2000, decline_trap, NULL);
+    i8080_trap_set(&cpu, 0x2010, serve_trap, NULL);
+    i8080_trap_set(&cpu, 0x0008, serve_trap, NULL);
+#endif
+
+    for (slice = 0; slice < 10000 && !cpu.halted; slice++)
+    {
+        i8080_run(&cpu, 1 + rng_next() % 400, I8080_STOP_HALT);
+    }
+    write_state(out);
+
+    hash = 1469598103934665603ull;
+    for (i = 0; i < 64 * 1024; i++)
+    {
+        hash = fnv_add(hash, mem.bytes[i]);
+    }
+    fprintf(out, "memory %016llx\n", (unsigned long long)hash);
+
+#if defined(I8080_PC_TRAPS) && I8080_PC_TRAPS
+    wrong += served_traps != 3 * 200;
+    wrong += declined_traps != 200;
+#endif
+    return wrong;
+}
+
+/*
+ * Status polls that also count down a timeout, in DE (LXI D,0 / IN 10h /
+ * ANI 1 / JNZ / DCX D / MOV A,D / ORA E / JNZ) or in memory (LXI H / IN 10h /
+ * ANI 1 / JNZ / DCR M / JNZ). Returns the number of slices the core reported
+ * as idle.
+ */
+static int run_timeouts(FILE* out)
+{
+    static const uint8_t register_loop[] = {0x11, 0x00, 0x00, 0xdb, 0x10, 0xe6, 0x01, 0xc2, 0x00, 0x20,
+                                            0x1b, 0x7a, 0xb3, 0xc2, 0x03, 0x10};
+    static const uint8_t memory_loop[] = {0x21, 0x00, 0x30, 0xdb, 0x10, 0xe6, 0x01, 0xc2, 0x00, 0x20,
+                                          0x35, 0xc2, 0x03, 0x10};
+    int slice, idle = 0;
+
+    fprintf(out, "timeouts\n");
+    load_program(0x20001);
+    memcpy(&mem.bytes[0x1000], register_loop, sizeof(register_loop));
+    cpu.registers.pc = 0x1000;
+    for (slice = 0; slice < 16; slice++)
+    {
+        i8080_run(&cpu, 1000 + rng_next() % 8000, 0);
+        idle += cpu.idle;
+        write_state(out);
+    }
+
+    load_program(0x20002);
+    memcpy(&mem.bytes[0x1000], memory_loop, sizeof(memory_loop));
+    mem.bytes[0x3000] = 0x00;
+    cpu.registers.pc = 0x1000;
+    for (slice = 0; slice < 16; slice++)
+    {
+        /* Short enough that the 256 counts do not run out */
+        i8080_run(&cpu, 100 + rng_next() % 400, 0);
+        idle += cpu.idle;
+        write_state(out);
+    }
+    return idle;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out;
+    i8080_jit_stats_t jit_stats;
+
+    code_cache = i8080_code_cache_create();
+    if (argc == 3 && strcmp(argv[2], "--lockstep") == 0)
+    {
+        if (i8080_jit_set_lockstep(code_cache, 1) != 0)
+        {
+            fprintf(stderr, "--lockstep needs the JIT variant\n");
+            return 1;
+        }
+    }
+    else if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <trace_file> [--lockstep]\n", argv[0]);
+        return 1;
+    }
+
+    out = fopen(argv[1], "w");
+    if (!out)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    memory_init(&mem);
+    sweep_alu(out);
+    sweep_unary(out);
+    run_programs(out);
+    run_pairs(out);
+    run_loops(out);
+    if (run_rom(out))
+    {
+        fprintf(stderr, "A write through the CPU changed a ROM page\n");
+        fclose(out);
+        return 1;
+    }
+#if MEMORY_TRAPS
+    if (watched_writes == 0)
+    {
+        fprintf(stderr, "No write to a watched page reached its handler\n");
+        fclose(out);
+        return 1;
+    }
+#endif
+    if (run_idle(out))
+    {
+        fprintf(stderr, "A console status loop was not reported idle\n");
+        fclose(out);
+        return 1;
+    }
+    if (run_traps(out))
+    {
+        fprintf(stderr, "Trap handlers were not called as often as the loop reaches their addresses\n");
+        fclose(out);
+        return 1;
+    }
+    if (run_timeouts(out))
+    {
+        fprintf(stderr, "A status loop that counts down a timeout was reported idle\n");
+        fclose(out);
+        return 1;
+    }
+
+    fclose(out);
+
+    i8080_jit_stats(code_cache, &jit_stats);
+    i8080_code_cache_destroy(code_cache);
+    if (jit_stats.lockstep_mismatches)
+    {
+        fprintf(stderr, "%llu of %llu JIT blocks differ from the interpreter\n",
+                (unsigned long long)jit_stats.lockstep_mismatches, (unsigned long long)jit_stats.lockstep_checks);
+        return 1;
+    }
+    return 0;
+}